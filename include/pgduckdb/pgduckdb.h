@@ -3,7 +3,27 @@
 // pgduckdb.c
 extern bool duckdb_execution;
 extern int duckdb_max_threads_per_query;
+extern bool duckdb_track_scan_timing;
+extern int duckdb_index_lookup_max_keys;
+extern bool duckdb_direct_heap_reads;
+extern char *duckdb_max_memory;
+extern int duckdb_threads;
+extern bool duckdb_result_cache;
+extern int duckdb_result_cache_size;
+extern int duckdb_result_cache_ttl;
+extern bool duckdb_shared_service;
 extern "C" void _PG_init(void);
 
 // pgduckdb_hooks.c
 void DuckdbInitHooks(void);
+
+// pgduckdb_jobs.cpp
+void DuckdbInitJobs(void);
+
+// pgduckdb_result_cache.cpp
+void DuckdbInitResultCache(void);
+/* Accounts a write to the relation for the result cache, needed for writes that don't go through the executor */
+void DuckdbResultCacheTrackWrite(Oid relid);
+
+// pgduckdb_service.cpp
+void DuckdbInitService(void);
@@ -10,7 +10,8 @@ extern "C" {
 
 namespace pgduckdb {
 
-duckdb::unique_ptr<duckdb::DuckDB> DuckdbOpenDatabase();
+/* Returns the DuckDB database of the backend, opening it on first use */
+duckdb::DuckDB &DuckdbGetDatabase();
 duckdb::unique_ptr<duckdb::Connection> DuckdbCreateConnection(List *rtables, PlannerInfo *planner_info,
                                                               List *needed_columns, const char *query);
 
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "duckdb.hpp"
+
+extern "C" {
+#include "postgres.h"
+#include "miscadmin.h"
+#include "utils/elog.h"
+#include "utils/memutils.h"
+}
+
+namespace pgduckdb {
+
+/* Turns the ERROR caught by PostgresFunctionGuard into a DuckDB exception */
+[[noreturn]] inline void
+ThrowPostgresError(MemoryContext context) {
+	MemoryContextSwitchTo(context);
+	ErrorData *edata = CopyErrorData();
+	FlushErrorState();
+	std::string message = edata->message ? edata->message : "unknown error";
+	FreeErrorData(edata);
+	throw duckdb::Exception(duckdb::ExceptionType::EXECUTOR, message);
+}
+
+/*
+ * Runs Postgres code on a thread of DuckDB. An ERROR raised by it can't longjmp to the error handler of the backend,
+ * which is on the stack of another thread, so it is caught here and rethrown as a DuckDB exception that fails the
+ * query. The backend then reports it and aborts the transaction, which releases what the failed call left behind,
+ * e.g. buffer pins and LWLocks.
+ *
+ * The error handling state of the backend is shared by all threads, so this must be called while holding
+ * DuckdbProcessLock. `func` must not create objects with destructors, the longjmp would skip them.
+ *
+ * check_stack_depth() measures the stack from the base of the backend's stack, which is meaningless on another
+ * thread. The base is moved to the stack of the calling thread while `func` runs.
+ */
+template <typename Func>
+void
+PostgresFunctionGuard(const Func &func) {
+	MemoryContext context = CurrentMemoryContext;
+	sigjmp_buf *exception_stack = PG_exception_stack;
+	ErrorContextCallback *context_stack = error_context_stack;
+	pg_stack_base_t stack_base = set_stack_base();
+	bool failed = false;
+	PG_TRY();
+	{
+		try {
+			func();
+		} catch (...) {
+			PG_exception_stack = exception_stack;
+			error_context_stack = context_stack;
+			restore_stack_base(stack_base);
+			throw;
+		}
+	}
+	PG_CATCH();
+	{
+		failed = true;
+	}
+	PG_END_TRY();
+	restore_stack_base(stack_base);
+	if (failed) {
+		ThrowPostgresError(context);
+	}
+}
+
+/*
+ * PostgresFunctionGuard for destructors, which must not throw. The error is dropped, whatever the call left behind is
+ * released when the transaction ends.
+ */
+template <typename Func>
+void
+PostgresCleanupGuard(const Func &func) noexcept {
+	try {
+		PostgresFunctionGuard(func);
+	} catch (...) {
+	}
+}
+
+/*
+ * Runs Postgres code on the backend's thread and calls `cleanup` before an ERROR raised by it is rethrown, to release
+ * C++ objects of the caller whose destructors the longjmp would skip. C++ exceptions are passed on as they are.
+ */
+template <typename Func, typename Cleanup>
+void
+CleanupOnPostgresError(const Func &func, const Cleanup &cleanup) {
+	sigjmp_buf *exception_stack = PG_exception_stack;
+	ErrorContextCallback *context_stack = error_context_stack;
+	PG_TRY();
+	{
+		try {
+			func();
+		} catch (...) {
+			PG_exception_stack = exception_stack;
+			error_context_stack = context_stack;
+			throw;
+		}
+	}
+	PG_CATCH();
+	{
+		cleanup();
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+}
+
+} // namespace pgduckdb
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "duckdb.hpp"
+#include "duckdb/common/types/column/column_data_collection.hpp"
+
+extern "C" {
+#include "postgres.h"
+#include "nodes/parsenodes.h"
+#include "utils/timestamp.h"
+}
+
+namespace pgduckdb {
+
+/* Local file read by a cached query, the result is stale once its modification time or size changes */
+struct ResultCacheFile {
+	std::string m_path;
+	int64 m_mtime_ns;
+	int64 m_size;
+
+	bool
+	operator==(const ResultCacheFile &other) const {
+		return m_path == other.m_path && m_mtime_ns == other.m_mtime_ns && m_size == other.m_size;
+	}
+};
+
+/* Write counter slot of a relation read by a cached query, see pgduckdb_result_cache.cpp */
+struct ResultCacheSlot {
+	uint32 m_slot;
+	uint64 m_started;
+	uint64 m_finished;
+};
+
+/*
+ * Result of a query kept by the result cache, see duckdb.result_cache. While the query is planned and executed it
+ * is a candidate: its rows are collected as DuckDB returns them and it is added to the cache once all of them were
+ * fetched.
+ */
+struct ResultCacheEntry {
+	/* Role, search_path and query text */
+	std::string m_key;
+	duckdb::vector<Oid> m_relids;
+	duckdb::vector<ResultCacheSlot> m_slots;
+	duckdb::vector<ResultCacheFile> m_files;
+	/* Set if the query reads remote files, whose changes can't be detected, 0 otherwise */
+	TimestampTz m_expires_at;
+	/* Whether the write counters showed that the result can be cached, see CreateResultCacheEntry */
+	bool m_storable;
+	duckdb::vector<std::string> m_names;
+	duckdb::vector<duckdb::LogicalType> m_types;
+	duckdb::unique_ptr<duckdb::ColumnDataCollection> m_rows;
+};
+
+/* Returns the rows of a cached result to the DuckDB scan node */
+class ResultCacheReader {
+public:
+	explicit ResultCacheReader(duckdb::shared_ptr<ResultCacheEntry> entry);
+	duckdb::unique_ptr<duckdb::DataChunk> Fetch();
+	const ResultCacheEntry &
+	GetEntry() const {
+		return *m_entry;
+	}
+
+private:
+	duckdb::shared_ptr<ResultCacheEntry> m_entry;
+	duckdb::ColumnDataScanState m_scan_state;
+};
+
+/* Describes the cacheable query about to be planned, nullptr if its result can't be cached */
+duckdb::unique_ptr<ResultCacheEntry> CreateResultCacheEntry(Query *query, const char *query_string);
+/* Returns the cached result of the query described by the candidate, nullptr if there is no valid one */
+duckdb::shared_ptr<ResultCacheEntry> LookupResultCache(const ResultCacheEntry &candidate);
+/* Adds a chunk returned by DuckDB to the candidate, returns false once it doesn't fit into duckdb.result_cache_size */
+bool CollectResultCacheRows(ResultCacheEntry &candidate, duckdb::DataChunk &chunk);
+/* Adds the candidate to the cache after all its rows were collected */
+void InsertResultCache(duckdb::unique_ptr<ResultCacheEntry> candidate);
+
+} // namespace pgduckdb
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "duckdb.hpp"
+
+extern "C" {
+#include "postgres.h"
+#include "access/htup.h"
+#include "nodes/parsenodes.h"
+#include "storage/dsm.h"
+#include "storage/shm_mq.h"
+#include "utils/snapshot.h"
+}
+
+namespace pgduckdb {
+
+enum SharedServiceRequestKind {
+	/* Prepare the query and return the columns of its result */
+	SHARED_SERVICE_DESCRIBE,
+	/* Execute the query and return the columns and rows of its result */
+	SHARED_SERVICE_EXECUTE
+};
+
+struct SharedServiceRequestHeader;
+
+/* Query executed by the shared DuckDB service instead of a connection of the backend, see duckdb.shared_service */
+struct SharedServiceQuery {
+	SharedServiceQuery(List *rtables, List *needed_columns, const char *query);
+
+	std::string m_query;
+	/* Range table and needed columns of the query, as nodeToString() writes them */
+	std::string m_rtables;
+	std::string m_needed_columns;
+};
+
+/*
+ * Request of the backend to the service worker of its database. The worker reads the relations with the snapshot of
+ * the backend and as its current user. Destroying the request cancels it if the worker didn't finish it yet.
+ *
+ * Errors of the worker, e.g. of DuckDB, are returned to the caller instead of raised.
+ */
+class SharedServiceRequest {
+public:
+	SharedServiceRequest() = default;
+	~SharedServiceRequest();
+
+	/* Queues the request for the worker of the database, launching the worker if there is none */
+	void Send(SharedServiceRequestKind kind, const SharedServiceQuery &query, Snapshot snapshot);
+	/* Waits for the columns of the result */
+	char *ReceiveColumns(duckdb::vector<Oid> &types, duckdb::vector<std::string> &names, bool &cancelled);
+	/* Waits for the next row of the result, returns nullptr at its end. The row is valid until the next call. */
+	MinimalTuple ReceiveTuple(bool &cancelled, char *&error);
+
+private:
+	shm_mq_result Receive(Size &nbytes, void *&data, bool &cancelled);
+	char *WorkerError();
+
+	dsm_segment *m_segment = nullptr;
+	SharedServiceRequestHeader *m_header = nullptr;
+	shm_mq_handle *m_queue = nullptr;
+	int m_worker_slot = -1;
+	uint64 m_worker_generation = 0;
+};
+
+/* Returns true if the query is executed by the shared DuckDB service */
+bool UseSharedService(Query *query);
+
+} // namespace pgduckdb
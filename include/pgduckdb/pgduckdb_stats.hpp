@@ -0,0 +1,121 @@
+#pragma once
+
+extern "C" {
+#include "postgres.h"
+#include "executor/instrument.h"
+#include "portability/instr_time.h"
+}
+
+#include "pgduckdb/pgduckdb.h"
+#include "pgduckdb/pgduckdb_process_lock.hpp"
+
+namespace pgduckdb {
+
+/*
+ * Counters exposed through the `duckdb.stat_scans` view. Times are stored in microseconds. Collecting the
+ * visibility, deform, filter and detoast times requires `duckdb.track_scan_timing`.
+ */
+enum ScanStatCounter : uint8_t {
+	SCAN_STAT_DUCKDB_QUERIES = 0,
+	SCAN_STAT_FALLBACKS,
+	SCAN_STAT_BLOCKS_SCANNED,
+	SCAN_STAT_BLOCKS_SKIPPED,
+	SCAN_STAT_TUPLES_VISIBLE,
+	SCAN_STAT_TUPLES_INVISIBLE,
+	SCAN_STAT_TUPLES_FILTERED,
+	SCAN_STAT_SHARED_BLKS_HIT,
+	SCAN_STAT_SHARED_BLKS_READ,
+	SCAN_STAT_DIRECT_BLKS_READ,
+	SCAN_STAT_RESULT_CACHE_HITS,
+	SCAN_STAT_RESULT_CACHE_MISSES,
+	SCAN_STAT_VISIBILITY_TIME,
+	SCAN_STAT_DEFORM_TIME,
+	SCAN_STAT_FILTER_TIME,
+	SCAN_STAT_DETOAST_TIME,
+	SCAN_STAT_LOCK_WAIT_TIME,
+	SCAN_STAT_CPU_TIME,
+	SCAN_STAT_COUNT
+};
+
+/* Reasons for executing a query with Postgres even though `duckdb.execution` is enabled */
+enum FallbackReason : uint8_t {
+	FALLBACK_CATALOG_TABLE = 0,
+	FALLBACK_UNSUPPORTED_STATEMENT,
+	FALLBACK_DUCKDB_ERROR,
+	FALLBACK_INDEX_MINMAX,
+	FALLBACK_UNSUPPORTED_TYPE,
+	FALLBACK_REASON_COUNT
+};
+
+/*
+ * Counters collected by a single scan thread. They are kept thread local while scanning and added to the shared
+ * memory counters of the backend with FlushScanStats.
+ */
+struct ScanStats {
+public:
+	uint64_t m_counters[SCAN_STAT_COUNT] = {};
+
+public:
+	void
+	Count(ScanStatCounter counter, uint64_t value = 1) {
+		m_counters[counter] += value;
+	}
+
+	inline void
+	StartTimer(instr_time &start) const {
+		if (duckdb_track_scan_timing) {
+			INSTR_TIME_SET_CURRENT(start);
+		} else {
+			INSTR_TIME_SET_ZERO(start);
+		}
+	}
+
+	inline void
+	StopTimer(ScanStatCounter counter, const instr_time &start) {
+		if (duckdb_track_scan_timing) {
+			instr_time duration;
+			INSTR_TIME_SET_CURRENT(duration);
+			INSTR_TIME_SUBTRACT(duration, start);
+			m_counters[counter] += INSTR_TIME_GET_MICROSEC(duration);
+		}
+	}
+};
+
+/*
+ * Acquires DuckdbProcessLock and accounts the time spent waiting for it. The clock is only read when the lock is
+ * contended, so this is cheap enough to do unconditionally. The lock is released when the returned guard goes out of
+ * scope, also when an error is thrown while holding it.
+ */
+[[nodiscard]] inline std::unique_lock<std::mutex>
+LockProcessLock(ScanStats &stats) {
+	std::unique_lock<std::mutex> lock(DuckdbProcessLock::GetLock(), std::try_to_lock);
+	if (lock.owns_lock()) {
+		return lock;
+	}
+	instr_time start, duration;
+	INSTR_TIME_SET_CURRENT(start);
+	lock.lock();
+	INSTR_TIME_SET_CURRENT(duration);
+	INSTR_TIME_SUBTRACT(duration, start);
+	stats.Count(SCAN_STAT_LOCK_WAIT_TIME, INSTR_TIME_GET_MICROSEC(duration));
+	return lock;
+}
+
+/*
+ * Accounts the shared buffer hits and reads done since `start` was taken from pgBufferUsage. pgBufferUsage is shared
+ * by all threads of the backend, so this must be called while holding DuckdbProcessLock.
+ */
+inline void
+CountBufferUsage(ScanStats &stats, const BufferUsage &start) {
+	stats.Count(SCAN_STAT_SHARED_BLKS_HIT, pgBufferUsage.shared_blks_hit - start.shared_blks_hit);
+	stats.Count(SCAN_STAT_SHARED_BLKS_READ, pgBufferUsage.shared_blks_read - start.shared_blks_read);
+}
+
+void FlushScanStats(ScanStats &stats);
+void CountDuckdbQuery();
+void CountFallback(FallbackReason reason);
+void CountResultCacheLookup(bool hit);
+void AttachScanStats();
+void DuckdbInitStats();
+
+} // namespace pgduckdb
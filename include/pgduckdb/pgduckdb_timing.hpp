@@ -0,0 +1,45 @@
+#pragma once
+
+extern "C" {
+#include "postgres.h"
+#include "portability/instr_time.h"
+}
+
+namespace pgduckdb {
+
+/*
+ * Phases of the per-query DuckDB setup work that is done while planning a query. Time spent in each phase is
+ * accumulated per backend and can be inspected with `duckdb.query_setup_timing()`.
+ */
+enum class SetupPhase : uint8_t {
+	PLAN_QUERY = 0,
+	OPEN_DATABASE,
+	CREATE_CONNECTION,
+	REGISTER_CATALOG,
+	LOAD_SECRETS,
+	LOAD_EXTENSIONS,
+	PREPARE,
+	TOTAL,
+	PHASE_COUNT
+};
+
+void AccumulateSetupTime(SetupPhase phase, const instr_time &start);
+
+/* Accumulates the time between construction and destruction into the given phase */
+class SetupTimer {
+public:
+	explicit SetupTimer(SetupPhase phase) : m_phase(phase) {
+		INSTR_TIME_SET_CURRENT(m_start);
+	}
+	~SetupTimer() {
+		AccumulateSetupTime(m_phase, m_start);
+	}
+	SetupTimer(const SetupTimer &other) = delete;
+	SetupTimer &operator=(const SetupTimer &other) = delete;
+
+private:
+	SetupPhase m_phase;
+	instr_time m_start;
+};
+
+} // namespace pgduckdb
@@ -10,6 +10,7 @@ extern "C" {
 }
 
 #include "pgduckdb/scan/postgres_scan.hpp"
+#include "pgduckdb/scan/tuple_deform.hpp"
 
 namespace pgduckdb {
 
@@ -18,10 +19,21 @@ constexpr int32_t PGDUCKDB_DUCK_DATE_OFFSET = 10957;
 constexpr int64_t PGDUCKDB_DUCK_TIMESTAMP_OFFSET = INT64CONST(10957) * USECS_PER_DAY;
 
 duckdb::LogicalType ConvertPostgresToDuckColumnType(Form_pg_attribute &attribute);
+/* Returns whether DuckDB can read columns of the Postgres type */
+bool IsSupportedPostgresType(Oid type);
 Oid GetPostgresDuckDBType(duckdb::LogicalType type);
 void ConvertPostgresToDuckValue(Datum value, duckdb::Vector &result, idx_t offset);
+PostgresToDuckConverter GetPostgresToDuckConverter(const duckdb::LogicalType &type);
 void ConvertDuckToPostgresValue(TupleTableSlot *slot, duckdb::Value &value, idx_t col);
 void InsertTupleIntoChunk(duckdb::DataChunk &output, duckdb::shared_ptr<PostgresScanGlobalState> scan_global_state,
                           duckdb::shared_ptr<PostgresScanLocalState> scan_local_state, HeapTupleData *tuple);
+void InsertFixedWidthTuplesIntoChunk(duckdb::DataChunk &output,
+                                     duckdb::shared_ptr<PostgresScanGlobalState> scan_global_state,
+                                     duckdb::shared_ptr<PostgresScanLocalState> scan_local_state,
+                                     const HeapTupleHeader *tuples, idx_t count);
+void InsertFilteredTuplesIntoChunk(duckdb::DataChunk &output,
+                                   duckdb::shared_ptr<PostgresScanGlobalState> scan_global_state,
+                                   duckdb::shared_ptr<PostgresScanLocalState> scan_local_state, HeapTupleData *tuples,
+                                   idx_t count);
 
 } // namespace pgduckdb
@@ -8,19 +8,75 @@ extern "C" {
 }
 
 #include "pgduckdb/scan/postgres_scan.hpp"
+#include "pgduckdb/scan/xid_status_cache.hpp"
 
 namespace pgduckdb {
 
+/* Most blocks a reader is assigned at once. Smaller ranges are handed out near the end of the relation. */
+#define HEAP_READER_MAX_BLOCK_RANGE 16
+
+// HeapReaderSharedState
+
+/*
+ * Visibility state of the scans of one relation under one snapshot. A query that reads a relation several times, e.g.
+ * a self-join, shares it between its scans, see PostgresSharedVisibilityOptimizerExtension: the commit status of a
+ * transaction is looked up once, the pages of a temporary relation are copied once, and the visibility of the tuples
+ * of a page that is not all-visible is resolved by the first scan that reads it. Each scan still reads and decodes the
+ * pages of the relation itself.
+ */
+class HeapReaderSharedState {
+public:
+	HeapReaderSharedState(Snapshot snapshot, duckdb::idx_t scan_count);
+	/* Returns the index of a scan starting to read the relation, passed to PageTuplesVisibility and FinishScan */
+	duckdb::idx_t RegisterScan();
+	/* Drops the visibility kept for a scan that won't read any more pages, e.g. because of a LIMIT */
+	void FinishScan(duckdb::idx_t scan);
+	/* Copies the pages of a temporary relation, unless another scan already did. Returns the number of copied pages. */
+	BlockNumber CopyLocalPages(Relation relation, BlockNumber nblocks);
+	bool
+	HasLocalPages() const {
+		return !m_local_pages.empty();
+	}
+	Page GetLocalPage(BlockNumber block, bool *visible);
+	/* Same as XidStatusCache::PageTuplesVisibility, reusing the result of other scans of the page */
+	void PageTuplesVisibility(duckdb::idx_t scan, Relation relation, BlockNumber block, Buffer buffer, Page page,
+	                          bool *visible, ScanStats &stats);
+
+private:
+	Snapshot m_snapshot;
+	/* Number of scans sharing the state, the visibility of pages is only kept if there are several */
+	duckdb::idx_t m_scan_count;
+	duckdb::idx_t m_registered_scans;
+	XidStatusCache m_xid_status_cache;
+	/* Copy of the pages of a temporary relation and the visibility of their tuples, see CopyLocalPages */
+	bool m_local_pages_copied;
+	duckdb::vector<char> m_local_pages;
+	duckdb::vector<char> m_local_visibility;
+	struct PageVisibility {
+		duckdb::vector<bool> visible;
+		/* Scans that still have to read the page, indexed by the index returned by RegisterScan */
+		duckdb::vector<bool> pending_scans;
+		duckdb::idx_t remaining_scans;
+	};
+	std::mutex m_page_visibility_lock;
+	duckdb::unordered_map<BlockNumber, PageVisibility> m_page_visibility;
+};
+
 // HeapReaderGlobalState
 
 class HeapReaderGlobalState {
 public:
-	HeapReaderGlobalState(Relation relation)
-	    : m_nblocks(RelationGetNumberOfBlocks(relation)), m_last_assigned_block_number(InvalidBlockNumber) {
-	}
-	BlockNumber AssignNextBlockNumber(std::mutex &lock);
+	HeapReaderGlobalState(Relation relation, Snapshot snapshot,
+	                      duckdb::shared_ptr<HeapReaderSharedState> shared_state = nullptr);
+	~HeapReaderGlobalState();
+	BlockNumber AssignNextBlockRange(std::mutex &lock, BlockNumber &range_end);
 	BlockNumber m_nblocks;
 	BlockNumber m_last_assigned_block_number;
+	duckdb::shared_ptr<HeapReaderSharedState> m_shared_state;
+	duckdb::idx_t m_scan_index;
+	/* Whether all-visible pages may be read from the segment files at m_relation_path, see duckdb.direct_heap_reads */
+	bool m_direct_reads;
+	std::string m_relation_path;
 };
 
 // HeapReader
@@ -43,7 +99,14 @@ public:
 	}
 
 private:
-	Page PreparePageRead();
+	BlockNumber NextBlockNumber();
+	void StartBlockRange();
+	void ReadDirectPages();
+	Page GetDirectPage(BlockNumber block);
+	Page ReadBufferedPage(BlockNumber block);
+	Page PreparePageRead(Page page);
+	void ReportTuplesReturned();
+	void FlushTupleBatch(duckdb::DataChunk &output);
 
 private:
 	duckdb::shared_ptr<PostgresScanGlobalState> m_global_state;
@@ -53,11 +116,38 @@ private:
 	bool m_inited;
 	bool m_read_next_page;
 	bool m_page_tuples_all_visible;
+	/* Visibility of the tuples of the current page, indexed by offset number, unless it is all-visible */
+	bool m_page_tuples_visible[MaxHeapTuplesPerPage];
 	BlockNumber m_block_number;
+	/* Range of blocks assigned to this reader, m_block_number is part of it */
+	BlockNumber m_range_start;
+	BlockNumber m_range_end;
+	/* Set when m_block_number is the first block of a range that has not been prefetched yet */
+	bool m_prefetch_range;
+	BufferAccessStrategy m_strategy;
+	/* Buffer holding the current page, InvalidBuffer if it was read directly from the segment file */
 	Buffer m_buffer;
+	Page m_page;
+	/* Standby scans: whether the visibility map marks the current page all-visible */
+	bool m_page_all_visible_in_vm;
+	/* Direct reads: pages of the current range read from the segment files and which of them are usable */
+	duckdb::vector<char> m_direct_pages;
+	bool m_direct_page_valid[HEAP_READER_MAX_BLOCK_RANGE];
+	BlockNumber m_segment_number;
+	int m_segment_fd;
+	Buffer m_vm_buffer;
 	OffsetNumber m_current_tuple_index;
 	int m_page_tuples_left;
+	/* Tuples returned since they were last reported to the cumulative statistics */
+	int64 m_tuples_returned;
 	HeapTupleData m_tuple;
+	/* Fixed-width path: visible tuples of the current page waiting to be gathered */
+	bool m_gather_fixed_width;
+	duckdb::vector<HeapTupleHeader> m_tuple_batch;
+	/* Complex filter path: visible tuples of the current page waiting to be filtered */
+	bool m_complex_filter;
+	duckdb::vector<HeapTupleData> m_filter_batch;
+	duckdb::idx_t m_tuple_batch_size;
 };
 
 } // namespace pgduckdb
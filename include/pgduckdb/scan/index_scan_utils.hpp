@@ -14,5 +14,6 @@ namespace pgduckdb {
 
 Node *FixIndexQualOperand(Node *node, IndexOptInfo *index, int indexcol);
 Node *FixIndexQualClause(PlannerInfo *root, IndexOptInfo *index, int indexcol, Node *clause, List *indexcolnos);
+List *FixIndexQualClauses(PlannerInfo *root, IndexPath *index_path);
 
 } // namespace pgduckdb
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "duckdb.hpp"
+
+extern "C" {
+#include "postgres.h"
+#include "access/tableam.h"
+#include "nodes/execnodes.h"
+#include "nodes/pathnodes.h"
+#include "nodes/tidbitmap.h"
+}
+
+#include "pgduckdb/pgduckdb.h"
+#include "pgduckdb/scan/postgres_scan.hpp"
+
+namespace pgduckdb {
+
+// Global State
+
+struct PostgresBitmapHeapScanGlobalState : public duckdb::GlobalTableFunctionState {
+	explicit PostgresBitmapHeapScanGlobalState(Relation relation, EState *estate, TIDBitmap *tbm,
+	                                           ExprState *postgres_quals, duckdb::TableFunctionInitInput &input);
+	~PostgresBitmapHeapScanGlobalState();
+	idx_t
+	MaxThreads() const override {
+		return duckdb_max_threads_per_query;
+	}
+
+public:
+	duckdb::shared_ptr<PostgresScanGlobalState> m_global_state;
+	Relation m_relation;
+	/* Executor state the index scan keys were evaluated in */
+	EState *m_estate;
+	/* TIDs of the rows matching the bitmap quals, its pages are handed out to the threads by m_iterator */
+	TIDBitmap *m_tbm;
+	TBMIterator *m_iterator;
+	/* Quals DuckDB can't evaluate, checked on every fetched tuple, nullptr if there are none (see GetPostgresQuals) */
+	ExprState *m_postgres_quals;
+	ExprContext *m_econtext;
+};
+
+// Local State
+
+struct PostgresBitmapHeapScanLocalState : public duckdb::LocalTableFunctionState {
+public:
+	PostgresBitmapHeapScanLocalState(Relation relation, Snapshot snapshot);
+	~PostgresBitmapHeapScanLocalState() override;
+
+public:
+	duckdb::shared_ptr<PostgresScanLocalState> m_local_state;
+	TableScanDesc m_scan;
+	TupleTableSlot *m_slot;
+	/* Copy of the bitmap page this thread is reading, the shared iterator reuses its result */
+	TBMIterateResult *m_tbmres;
+	bool m_page_ready;
+};
+
+// PostgresBitmapHeapScanFunctionData
+
+struct PostgresBitmapHeapScanFunctionData : public duckdb::TableFunctionData {
+public:
+	PostgresBitmapHeapScanFunctionData(uint64_t cardinality, Path *path, PlannerInfo *planner_info, Oid relation_oid,
+	                                   Snapshot snapshot);
+	~PostgresBitmapHeapScanFunctionData() override;
+
+public:
+	uint64_t m_cardinality;
+	Path *m_path;
+	PlannerInfo *m_planner_info;
+	Snapshot m_snapshot;
+	Oid m_relation_oid;
+};
+
+// PostgresBitmapHeapScanFunction
+
+struct PostgresBitmapHeapScanFunction : public duckdb::TableFunction {
+public:
+	PostgresBitmapHeapScanFunction();
+
+public:
+	static duckdb::unique_ptr<duckdb::FunctionData>
+	PostgresBitmapHeapScanBind(duckdb::ClientContext &context, duckdb::TableFunctionBindInput &input,
+	                           duckdb::vector<duckdb::LogicalType> &return_types,
+	                           duckdb::vector<duckdb::string> &names);
+
+	static duckdb::unique_ptr<duckdb::GlobalTableFunctionState>
+	PostgresBitmapHeapScanInitGlobal(duckdb::ClientContext &context, duckdb::TableFunctionInitInput &input);
+
+	static duckdb::unique_ptr<duckdb::LocalTableFunctionState>
+	PostgresBitmapHeapScanInitLocal(duckdb::ExecutionContext &context, duckdb::TableFunctionInitInput &input,
+	                                duckdb::GlobalTableFunctionState *gstate);
+
+	static void PostgresBitmapHeapScanFunc(duckdb::ClientContext &context, duckdb::TableFunctionInput &data,
+	                                       duckdb::DataChunk &output);
+
+	static duckdb::unique_ptr<duckdb::NodeStatistics>
+	PostgresBitmapHeapScanCardinality(duckdb::ClientContext &context, const duckdb::FunctionData *data);
+};
+
+} // namespace pgduckdb
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "duckdb.hpp"
+#include "duckdb/optimizer/optimizer_extension.hpp"
+
+extern "C" {
+#include "postgres.h"
+#include "access/genam.h"
+#include "executor/tuptable.h"
+}
+
+#include "pgduckdb/pgduckdb.h"
+#include "pgduckdb/scan/postgres_scan.hpp"
+
+#include <unordered_map>
+
+namespace pgduckdb {
+
+// Global State
+
+struct PostgresIndexLookupGlobalState : public duckdb::GlobalTableFunctionState {
+	explicit PostgresIndexLookupGlobalState(Relation relation, Relation index, duckdb::TableFunctionInitInput &input);
+	~PostgresIndexLookupGlobalState();
+	idx_t
+	MaxThreads() const override {
+		return duckdb_max_threads_per_query;
+	}
+
+public:
+	duckdb::shared_ptr<PostgresScanGlobalState> m_global_state;
+	Relation m_relation;
+	Relation m_index;
+	/* Equality function of the key type in the opfamily of the index */
+	RegProcedure m_eq_proc;
+};
+
+// Local State
+
+struct PostgresIndexLookupLocalState : public duckdb::LocalTableFunctionState {
+public:
+	PostgresIndexLookupLocalState(Relation relation, Relation index, Snapshot snapshot);
+	~PostgresIndexLookupLocalState() override;
+
+public:
+	duckdb::shared_ptr<PostgresScanLocalState> m_local_state;
+	IndexScanDesc m_index_scan_desc;
+	TupleTableSlot *m_slot;
+	/* Rows of the current input chunk by join key */
+	std::unordered_map<int64_t, duckdb::vector<duckdb::idx_t>> m_key_rows;
+	/* True while the index is probed with the keys of the current input chunk */
+	bool m_probing;
+	/* Input rows matching the heap tuple in m_slot that still have to be returned */
+	const duckdb::vector<duckdb::idx_t> *m_pending_rows;
+	duckdb::idx_t m_pending_idx;
+};
+
+// PostgresIndexLookupFunctionData
+
+struct PostgresIndexLookupFunctionData : public duckdb::TableFunctionData {
+public:
+	PostgresIndexLookupFunctionData(Oid relid, Oid index_oid, Snapshot snapshot, AttrNumber key_attnum, Oid key_type,
+	                                duckdb::idx_t key_input_idx, duckdb::idx_t table_column_count);
+	~PostgresIndexLookupFunctionData() override;
+
+public:
+	Oid m_relid;
+	Oid m_index_oid;
+	Snapshot m_snapshot;
+	AttrNumber m_key_attnum;
+	Oid m_key_type;
+	/* Input column holding the join keys */
+	duckdb::idx_t m_key_input_idx;
+	/* Column ids from this one on refer to input columns */
+	duckdb::idx_t m_table_column_count;
+};
+
+// PostgresIndexLookupFunction
+
+struct PostgresIndexLookupFunction : public duckdb::TableFunction {
+public:
+	PostgresIndexLookupFunction();
+
+public:
+	static duckdb::unique_ptr<duckdb::GlobalTableFunctionState>
+	PostgresIndexLookupInitGlobal(duckdb::ClientContext &context, duckdb::TableFunctionInitInput &input);
+
+	static duckdb::unique_ptr<duckdb::LocalTableFunctionState>
+	PostgresIndexLookupInitLocal(duckdb::ExecutionContext &context, duckdb::TableFunctionInitInput &input,
+	                             duckdb::GlobalTableFunctionState *gstate);
+
+	static duckdb::OperatorResultType PostgresIndexLookupFunc(duckdb::ExecutionContext &context,
+	                                                          duckdb::TableFunctionInput &data,
+	                                                          duckdb::DataChunk &input, duckdb::DataChunk &output);
+};
+
+/* Replaces hash joins of a small input with a postgres_seq_scan by lookups in a B-tree index of the table */
+duckdb::OptimizerExtension PostgresIndexLookupOptimizerExtension();
+
+} // namespace pgduckdb
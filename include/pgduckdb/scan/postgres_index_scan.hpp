@@ -17,7 +17,7 @@ namespace pgduckdb {
 // Global State
 
 struct PostgresIndexScanGlobalState : public duckdb::GlobalTableFunctionState {
-	explicit PostgresIndexScanGlobalState(IndexScanState *index_scan_state, Relation relation,
+	explicit PostgresIndexScanGlobalState(IndexScanState *index_scan_state, Relation relation, List *index_quals,
 	                                      duckdb::TableFunctionInitInput &input);
 	~PostgresIndexScanGlobalState();
 	idx_t
@@ -29,20 +29,33 @@ public:
 	duckdb::shared_ptr<PostgresScanGlobalState> m_global_state;
 	IndexScanState *m_index_scan;
 	Relation m_relation;
+	/* Index quals with the index keys replaced by INDEX_VARs, every scan builds its own scan keys from them */
+	List *m_index_quals;
 };
 
 // Local State
 
 struct PostgresIndexScanLocalState : public duckdb::LocalTableFunctionState {
 public:
-	PostgresIndexScanLocalState(IndexScanDesc index_scan_desc, Relation relation);
+	PostgresIndexScanLocalState(Relation relation, ScanDirection direction);
 	~PostgresIndexScanLocalState() override;
+	void BeginScan(PostgresIndexScanGlobalState &global_state, Snapshot snapshot);
 
 public:
 	duckdb::shared_ptr<PostgresScanLocalState> m_local_state;
 	IndexScanDesc m_index_scan_desc;
 	Relation m_relation;
 	TupleTableSlot *m_slot;
+	ScanDirection m_direction;
+	ScanKey m_scan_keys;
+	int m_num_scan_keys;
+	/* Keys of ScalarArrayOpExpr quals the index AM can't handle natively, the scan is repeated for every element */
+	IndexArrayKeyInfo *m_array_keys;
+	int m_num_array_keys;
+	/* An array key is NULL or empty, so no row can match */
+	bool m_array_keys_empty;
+	/* Rows returned so far, the scan stops once it reaches the limit of the bind data */
+	uint64_t m_rows_returned;
 };
 
 // PostgresIndexScanFunctionData
@@ -50,7 +63,7 @@ public:
 struct PostgresIndexScanFunctionData : public duckdb::TableFunctionData {
 public:
 	PostgresIndexScanFunctionData(uint64_t cardinality, Path *path, PlannerInfo *planner_info, Oid relation_oid,
-	                              Snapshot snapshot);
+	                              Snapshot snapshot, uint64_t limit);
 	~PostgresIndexScanFunctionData() override;
 
 public:
@@ -59,6 +72,8 @@ public:
 	PlannerInfo *m_planner_info;
 	Snapshot m_snapshot;
 	Oid m_relation_oid;
+	/* Maximum number of rows to return in index order, 0 if all matching rows are needed */
+	uint64_t m_limit;
 };
 
 // PostgresIndexScanFunction
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "duckdb.hpp"
+
+extern "C" {
+#include "postgres.h"
+#include "access/genam.h"
+#include "executor/tuptable.h"
+}
+
+#include "pgduckdb/pgduckdb.h"
+#include "pgduckdb/scan/postgres_scan.hpp"
+
+namespace pgduckdb {
+
+// Global State
+
+struct PostgresIndexSkipScanGlobalState : public duckdb::GlobalTableFunctionState {
+	explicit PostgresIndexSkipScanGlobalState(Relation relation, Relation index, Snapshot snapshot,
+	                                          duckdb::TableFunctionInitInput &input);
+	~PostgresIndexSkipScanGlobalState();
+	idx_t
+	MaxThreads() const override {
+		return 1;
+	}
+
+public:
+	duckdb::shared_ptr<PostgresScanGlobalState> m_global_state;
+	Relation m_relation;
+	Relation m_index;
+	/* Table attribute of the leading index column */
+	AttrNumber m_key_attnum;
+	/* Greater than function of the opfamily of the leading index column */
+	RegProcedure m_greater_proc;
+};
+
+// Local State
+
+enum class SkipScanPhase : uint8_t { FIRST_KEY, NEXT_KEY, NULL_KEY, DONE };
+
+struct PostgresIndexSkipScanLocalState : public duckdb::LocalTableFunctionState {
+public:
+	PostgresIndexSkipScanLocalState(Relation relation, Relation index, Snapshot snapshot);
+	~PostgresIndexSkipScanLocalState() override;
+
+public:
+	duckdb::shared_ptr<PostgresScanLocalState> m_local_state;
+	IndexScanDesc m_index_scan_desc;
+	TupleTableSlot *m_slot;
+	SkipScanPhase m_phase;
+	/* Key of the last returned row, the next probe starts after it */
+	Datum m_last_key;
+};
+
+// PostgresIndexSkipScanFunctionData
+
+struct PostgresIndexSkipScanFunctionData : public duckdb::TableFunctionData {
+public:
+	PostgresIndexSkipScanFunctionData(uint64_t cardinality, Oid relid, Oid index_oid, Snapshot snapshot);
+	~PostgresIndexSkipScanFunctionData() override;
+
+public:
+	uint64_t m_cardinality;
+	Oid m_relid;
+	Oid m_index_oid;
+	Snapshot m_snapshot;
+};
+
+// PostgresIndexSkipScanFunction
+
+struct PostgresIndexSkipScanFunction : public duckdb::TableFunction {
+public:
+	PostgresIndexSkipScanFunction();
+
+public:
+	static duckdb::unique_ptr<duckdb::FunctionData>
+	PostgresIndexSkipScanBind(duckdb::ClientContext &context, duckdb::TableFunctionBindInput &input,
+	                          duckdb::vector<duckdb::LogicalType> &return_types, duckdb::vector<duckdb::string> &names);
+
+	static duckdb::unique_ptr<duckdb::GlobalTableFunctionState>
+	PostgresIndexSkipScanInitGlobal(duckdb::ClientContext &context, duckdb::TableFunctionInitInput &input);
+
+	static duckdb::unique_ptr<duckdb::LocalTableFunctionState>
+	PostgresIndexSkipScanInitLocal(duckdb::ExecutionContext &context, duckdb::TableFunctionInitInput &input,
+	                               duckdb::GlobalTableFunctionState *gstate);
+
+	static void PostgresIndexSkipScanFunc(duckdb::ClientContext &context, duckdb::TableFunctionInput &data,
+	                                      duckdb::DataChunk &output);
+
+	static duckdb::unique_ptr<duckdb::NodeStatistics>
+	PostgresIndexSkipScanCardinality(duckdb::ClientContext &context, const duckdb::FunctionData *data);
+};
+
+} // namespace pgduckdb
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "duckdb.hpp"
+#include "duckdb/execution/expression_executor.hpp"
+#include "duckdb/main/client_context_state.hpp"
+#include "duckdb/optimizer/column_binding_replacer.hpp"
 
 extern "C" {
 #include "postgres.h"
@@ -10,6 +13,11 @@ extern "C" {
 #include "nodes/pathnodes.h"
 }
 
+#include "pgduckdb/pgduckdb_stats.hpp"
+#include "pgduckdb/scan/tuple_deform.hpp"
+
+#include <functional>
+
 namespace pgduckdb {
 
 class PostgresScanGlobalState {
@@ -19,6 +27,7 @@ public:
 	~PostgresScanGlobalState() {
 	}
 	void InitGlobalState(duckdb::TableFunctionInitInput &input);
+	void InitInOutGlobalState(duckdb::TableFunctionInitInput &input, duckdb::idx_t table_column_count);
 	Snapshot m_snapshot;
 	TupleDesc m_tuple_desc;
 	std::mutex m_lock; // Lock for one replacement scan
@@ -26,7 +35,28 @@ public:
 	duckdb::map<duckdb::idx_t, duckdb::idx_t> m_columns;
 	duckdb::map<duckdb::idx_t, duckdb::idx_t> m_projections;
 	duckdb::TableFilterSet *m_filters = nullptr;
+	/*
+	 * Filter DuckDB can't express as TableFilters, evaluated on batches of tuples. Its BoundReferenceExpressions index
+	 * m_complex_filter_columns, which holds relation column ids. nullptr if the scan has no such filter.
+	 */
+	duckdb::Expression *m_complex_filter = nullptr;
+	duckdb::vector<duckdb::idx_t> m_complex_filter_columns;
+	duckdb::unique_ptr<TupleDeformProgram> m_deform_program;
 	std::atomic<std::uint32_t> m_total_row_count;
+	/* (output column, input column) pairs of the input columns an in-out function passes through */
+	duckdb::vector<std::pair<duckdb::idx_t, duckdb::idx_t>> m_input_columns;
+};
+
+/* Per thread state for evaluating the complex filter of a scan */
+struct ComplexFilterState {
+	ComplexFilterState(duckdb::ClientContext &context, const duckdb::Expression &filter,
+	                   const duckdb::vector<duckdb::LogicalType> &types);
+	duckdb::ExpressionExecutor m_executor;
+	/* Filter columns of a batch of tuples */
+	duckdb::DataChunk m_chunk;
+	duckdb::SelectionVector m_sel;
+	/* Index in the batch of the tuple in each row of m_chunk */
+	duckdb::vector<duckdb::idx_t> m_rows;
 };
 
 class PostgresScanLocalState {
@@ -34,13 +64,22 @@ public:
 	PostgresScanLocalState() : m_output_vector_size(0), m_exhausted_scan(false) {
 	}
 	~PostgresScanLocalState() {
+		FlushScanStats(m_stats);
 	}
 	int m_output_vector_size;
 	bool m_exhausted_scan;
+	ScanStats m_stats;
+	duckdb::unique_ptr<ComplexFilterState> m_complex_filter;
 };
 
-struct PostgresReplacementScanData : public duckdb::ReplacementScanData {
+/*
+ * Postgres query planned by a DuckDB connection. The replacement scan is registered once for the database of the
+ * backend, so the query it resolves table names of is registered on the ClientContext of each connection.
+ */
+struct PostgresReplacementScanData : public duckdb::ClientContextState {
 public:
+	static constexpr const char *STATE_KEY = "pgduckdb_replacement_scan";
+
 	PostgresReplacementScanData(List *rtables, PlannerInfo *query_planner_info, List *needed_columns,
 	                            const char *query_string)
 	    : m_rtables(rtables), m_query_planner_info(query_planner_info), m_needed_columns(needed_columns),
@@ -55,6 +94,15 @@ public:
 	std::string m_query_string;
 };
 
+List *GetPostgresQuals(RelOptInfo *rel);
+
+using TryRewriteOperator = std::function<duckdb::unique_ptr<duckdb::LogicalOperator>(
+    duckdb::LogicalOperator &op, duckdb::vector<duckdb::ReplacementBinding> &replacements)>;
+
+void RewriteOperators(duckdb::unique_ptr<duckdb::LogicalOperator> &op,
+                      duckdb::unique_ptr<duckdb::LogicalOperator> &plan, duckdb::LogicalOperatorType type,
+                      const TryRewriteOperator &try_rewrite);
+
 duckdb::unique_ptr<duckdb::TableRef> PostgresReplacementScan(duckdb::ClientContext &context,
                                                              duckdb::ReplacementScanInput &input,
                                                              duckdb::optional_ptr<duckdb::ReplacementScanData> data);
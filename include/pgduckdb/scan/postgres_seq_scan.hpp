@@ -1,6 +1,8 @@
 #pragma once
 
 #include "duckdb.hpp"
+#include "duckdb/optimizer/optimizer_extension.hpp"
+#include "duckdb/planner/operator/logical_get.hpp"
 
 extern "C" {
 #include "postgres.h"
@@ -59,6 +61,11 @@ public:
 	uint64_t m_cardinality;
 	Oid m_relid;
 	Snapshot m_snapshot;
+	/* Filters pushed down by PostgresSeqScanPushdownComplexFilter, see PostgresScanGlobalState::m_complex_filter */
+	duckdb::unique_ptr<duckdb::Expression> m_complex_filter;
+	duckdb::vector<duckdb::idx_t> m_complex_filter_columns;
+	/* Set by PostgresSharedVisibilityOptimizerExtension if the query scans the relation more than once */
+	duckdb::shared_ptr<HeapReaderSharedState> m_shared_state;
 };
 
 // PostgresSeqScanFunction
@@ -71,6 +78,9 @@ public:
 	static duckdb::unique_ptr<duckdb::FunctionData>
 	PostgresSeqScanBind(duckdb::ClientContext &context, duckdb::TableFunctionBindInput &input,
 	                    duckdb::vector<duckdb::LogicalType> &return_types, duckdb::vector<duckdb::string> &names);
+	static void PostgresSeqScanPushdownComplexFilter(duckdb::ClientContext &context, duckdb::LogicalGet &get,
+	                                                 duckdb::FunctionData *bind_data,
+	                                                 duckdb::vector<duckdb::unique_ptr<duckdb::Expression>> &filters);
 	static duckdb::unique_ptr<duckdb::GlobalTableFunctionState>
 	PostgresSeqScanInitGlobal(duckdb::ClientContext &context, duckdb::TableFunctionInitInput &input);
 	static duckdb::unique_ptr<duckdb::LocalTableFunctionState>
@@ -92,4 +102,10 @@ public:
 	// &function);
 };
 
+/*
+ * Makes the postgres_seq_scans of a query that read the same relation share their HeapReaderSharedState, i.e. the
+ * visibility of its tuples. The pages are still read by every scan.
+ */
+duckdb::OptimizerExtension PostgresSharedVisibilityOptimizerExtension();
+
 } // namespace pgduckdb
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "duckdb.hpp"
+#include "duckdb/optimizer/optimizer_extension.hpp"
+
+extern "C" {
+#include "postgres.h"
+#include "access/htup.h"
+#include "storage/buf.h"
+}
+
+#include "pgduckdb/pgduckdb.h"
+#include "pgduckdb/scan/postgres_scan.hpp"
+
+namespace pgduckdb {
+
+// Global State
+
+struct PostgresTidFetchGlobalState : public duckdb::GlobalTableFunctionState {
+	explicit PostgresTidFetchGlobalState(Relation relation, duckdb::TableFunctionInitInput &input);
+	~PostgresTidFetchGlobalState();
+	idx_t
+	MaxThreads() const override {
+		return duckdb_max_threads_per_query;
+	}
+
+public:
+	duckdb::shared_ptr<PostgresScanGlobalState> m_global_state;
+	Relation m_relation;
+};
+
+// Local State
+
+struct PostgresTidFetchLocalState : public duckdb::LocalTableFunctionState {
+public:
+	PostgresTidFetchLocalState();
+	~PostgresTidFetchLocalState() override;
+
+public:
+	duckdb::shared_ptr<PostgresScanLocalState> m_local_state;
+	/* (ctid, input row) of the current input chunk, sorted by ctid */
+	duckdb::vector<std::pair<int64_t, duckdb::idx_t>> m_tids;
+	/* Fetched tuple of each input row and the pinned buffers they point into */
+	duckdb::vector<HeapTupleData> m_tuples;
+	duckdb::vector<Buffer> m_buffers;
+};
+
+// PostgresTidFetchFunctionData
+
+struct PostgresTidFetchFunctionData : public duckdb::TableFunctionData {
+public:
+	PostgresTidFetchFunctionData(Oid relid, Snapshot snapshot, duckdb::idx_t ctid_input_idx,
+	                             duckdb::idx_t table_column_count);
+	~PostgresTidFetchFunctionData() override;
+
+public:
+	Oid m_relid;
+	Snapshot m_snapshot;
+	/* Input column holding the ctids of the tuples to fetch, see EncodeCtid */
+	duckdb::idx_t m_ctid_input_idx;
+	/* Column ids from this one on refer to input columns */
+	duckdb::idx_t m_table_column_count;
+};
+
+// PostgresTidFetchFunction
+
+struct PostgresTidFetchFunction : public duckdb::TableFunction {
+public:
+	PostgresTidFetchFunction();
+
+public:
+	static duckdb::unique_ptr<duckdb::GlobalTableFunctionState>
+	PostgresTidFetchInitGlobal(duckdb::ClientContext &context, duckdb::TableFunctionInitInput &input);
+
+	static duckdb::unique_ptr<duckdb::LocalTableFunctionState>
+	PostgresTidFetchInitLocal(duckdb::ExecutionContext &context, duckdb::TableFunctionInitInput &input,
+	                          duckdb::GlobalTableFunctionState *gstate);
+
+	static duckdb::OperatorResultType PostgresTidFetchFunc(duckdb::ExecutionContext &context,
+	                                                       duckdb::TableFunctionInput &data, duckdb::DataChunk &input,
+	                                                       duckdb::DataChunk &output);
+};
+
+/*
+ * Makes ORDER BY ... LIMIT queries on a postgres_seq_scan sort only the ctid and the columns they order by, and fetch
+ * the other columns of the remaining rows with postgres_tid_fetch.
+ */
+duckdb::OptimizerExtension PostgresTidFetchOptimizerExtension();
+
+} // namespace pgduckdb
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "duckdb.hpp"
+
+extern "C" {
+#include "postgres.h"
+#include "access/htup.h"
+#include "access/htup_details.h"
+#include "access/tupdesc.h"
+}
+
+namespace pgduckdb {
+
+/*
+ * The ctid of a heap tuple as exposed to DuckDB: a BIGINT holding the block number in the high bits and the offset
+ * number in the low 16 bits, so that ordering by it orders tuples by their position in the relation.
+ */
+inline int64_t
+EncodeCtid(ItemPointer tid) {
+	return (static_cast<int64_t>(ItemPointerGetBlockNumberNoCheck(tid)) << 16) | ItemPointerGetOffsetNumberNoCheck(tid);
+}
+
+inline void
+DecodeCtid(int64_t ctid, ItemPointer tid) {
+	ItemPointerSet(tid, static_cast<BlockNumber>(ctid >> 16), static_cast<OffsetNumber>(ctid & 0xFFFF));
+}
+
+/* Writes a (detoasted) Postgres value into a DuckDB vector */
+using PostgresToDuckConverter = void (*)(Datum value, duckdb::Vector &result, duckdb::idx_t offset);
+
+/* Copies the fixed-width attribute at attr_offset of a batch of tuples into a DuckDB vector */
+using FixedWidthGatherer = void (*)(const HeapTupleHeader *tuples, duckdb::idx_t count, uint32 attr_offset,
+                                    duckdb::Vector &result, duckdb::idx_t result_offset);
+
+/*
+ * Deforming and conversion steps specialized for one TupleDesc and the columns, filters and projections of one scan.
+ * Built once per scan so that the per tuple work doesn't need to look up attributes, filters or type conversions.
+ * Column id natts refers to the ctid of the tuple, see EncodeCtid.
+ */
+class TupleDeformProgram {
+public:
+	TupleDeformProgram(TupleDesc tuple_desc, const duckdb::map<duckdb::idx_t, duckdb::idx_t> &columns,
+	                   const duckdb::map<duckdb::idx_t, duckdb::idx_t> &projections, duckdb::TableFilterSet *filters,
+	                   const duckdb::vector<duckdb::idx_t> &complex_filter_columns = {});
+
+	struct DeformStep {
+		int16 attlen;
+		bool attbyval;
+		char attalign;
+		/* Offset in the tuple data if no preceding attribute is NULL or has variable width, -1 otherwise */
+		int32 fixed_offset;
+		/* Index in the values/nulls arrays, -1 if the scan doesn't need the attribute */
+		int32 value_idx;
+	};
+
+	struct FilterStep {
+		duckdb::idx_t value_idx;
+		duckdb::TableFilter *filter;
+		Oid type_oid;
+	};
+
+	struct OutputStep {
+		duckdb::idx_t value_idx;
+		bool is_varlena;
+		PostgresToDuckConverter convert;
+	};
+
+	struct GatherStep {
+		uint32 attr_offset;
+		FixedWidthGatherer gather;
+	};
+
+	duckdb::vector<FilterStep> m_filter_steps;
+	duckdb::vector<OutputStep> m_output_steps;
+	/* Conversions of the columns the complex filter of the scan is evaluated on, in the order it references them */
+	duckdb::vector<OutputStep> m_complex_filter_steps;
+	duckdb::vector<duckdb::LogicalType> m_complex_filter_types;
+	duckdb::idx_t m_value_count;
+
+public:
+	bool
+	IsCtidColumn(duckdb::idx_t column_idx) const {
+		return column_idx == static_cast<duckdb::idx_t>(m_tuple_desc->natts);
+	}
+	static duckdb::LogicalType
+	CtidType() {
+		return duckdb::LogicalType::BIGINT;
+	}
+
+	/* Deforms the needed attributes of the tuple into values/nulls, indexed by their position in the scan columns */
+	void Deform(HeapTuple tuple, Datum *values, bool *nulls) const;
+
+	/*
+	 * True if every output column is at a constant offset in every tuple: the attributes up to the last one needed
+	 * are all fixed-width and NOT NULL, their types have a specialized gatherer and no filter has to be applied.
+	 */
+	bool
+	CanGatherFixedWidth() const {
+		return m_fixed_width;
+	}
+	/* Tuples written before columns were added don't contain them and have to go through Deform() */
+	bool
+	CanGatherTuple(HeapTupleHeader tuple) const {
+		return static_cast<duckdb::idx_t>(HeapTupleHeaderGetNatts(tuple)) >= m_deform_steps.size();
+	}
+	/* Writes the output columns of a batch of tuples into the output chunk, starting at row offset */
+	void GatherFixedWidth(const HeapTupleHeader *tuples, duckdb::idx_t count, duckdb::DataChunk &output,
+	                      duckdb::idx_t offset) const;
+
+private:
+	TupleDesc m_tuple_desc;
+	duckdb::vector<DeformStep> m_deform_steps;
+	duckdb::vector<GatherStep> m_gather_steps;
+	bool m_fixed_width;
+	/* Index in the values/nulls arrays of the ctid, -1 if the scan doesn't return it */
+	int32 m_ctid_value_idx;
+};
+
+} // namespace pgduckdb
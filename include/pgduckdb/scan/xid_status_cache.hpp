@@ -0,0 +1,54 @@
+#pragma once
+
+#include "duckdb.hpp"
+
+extern "C" {
+#include "postgres.h"
+#include "access/htup_details.h"
+#include "storage/bufpage.h"
+#include "utils/snapshot.h"
+}
+
+#include "pgduckdb/pgduckdb_stats.hpp"
+
+#include <mutex>
+
+namespace pgduckdb {
+
+/*
+ * Commit status of the transactions that modified the tuples of a scan, shared by all threads of the scan.
+ *
+ * Postgres resolves the visibility of a tuple without hint bits through TransactionIdDidCommit, which reads the clog
+ * and may set hint bits, so it can't run concurrently on DuckDB threads. For MVCC snapshots most of that work can be
+ * done without Postgres: transactions at or after the snapshot's xmax or in its xip array are in progress, those
+ * before it that are not in the snapshot have completed, and the status of a completed transaction never changes.
+ * Only the latter are looked up in the clog, once per scan and batched per page.
+ */
+class XidStatusCache {
+public:
+	explicit XidStatusCache(Snapshot snapshot);
+
+	/*
+	 * Sets visible[offset - FirstOffsetNumber] for every normal item of the page. The buffer must be share locked.
+	 * Tuples whose visibility can't be resolved from the snapshot and the cache, e.g. tuples of the current
+	 * transaction or with a MultiXact xmax, are checked by HeapTupleSatisfiesVisibility while holding
+	 * DuckdbProcessLock.
+	 */
+	void PageTuplesVisibility(Relation relation, BlockNumber block, Buffer buffer, Page page, bool *visible,
+	                          ScanStats &stats);
+
+private:
+	enum TupleVisibility : uint8_t { TUPLE_VISIBLE, TUPLE_INVISIBLE, TUPLE_NEEDS_XID_STATUS, TUPLE_NEEDS_POSTGRES };
+
+	TupleVisibility ResolveVisibility(HeapTupleHeader tuple, TransactionId &unknown_xid) const;
+
+private:
+	Snapshot m_snapshot;
+	/* Resolving visibility on the scan threads needs a plain MVCC snapshot without overflowed subxids */
+	bool m_snapshot_usable;
+	std::mutex m_lock;
+	/* Completed transactions of the scan and whether they committed, guarded by m_lock */
+	duckdb::unordered_map<TransactionId, bool> m_committed;
+};
+
+} // namespace pgduckdb
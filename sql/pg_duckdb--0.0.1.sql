@@ -75,6 +75,76 @@ CREATE TABLE extensions (
 CREATE OR REPLACE FUNCTION install_extension(extension_name TEXT) RETURNS bool
     LANGUAGE C AS 'MODULE_PATHNAME', 'install_extension';
 
+-- Time spent by this backend setting up DuckDB while planning queries, per phase
+CREATE OR REPLACE FUNCTION query_setup_timing(OUT phase TEXT, OUT calls BIGINT,
+                                              OUT total_time FLOAT8, OUT mean_time FLOAT8)
+    RETURNS SETOF record
+    LANGUAGE C AS 'MODULE_PATHNAME', 'query_setup_timing';
+
+CREATE OR REPLACE FUNCTION reset_query_setup_timing() RETURNS void
+    LANGUAGE C AS 'MODULE_PATHNAME', 'reset_query_setup_timing';
+
+-- Cumulative scan statistics. The row with a NULL pid contains the totals of the whole cluster.
+CREATE FUNCTION stat_scans(OUT pid INT, OUT duckdb_queries BIGINT, OUT fallbacks BIGINT,
+                           OUT blocks_scanned BIGINT, OUT blocks_skipped BIGINT,
+                           OUT tuples_visible BIGINT, OUT tuples_invisible BIGINT, OUT tuples_filtered BIGINT,
+                           OUT shared_blks_hit BIGINT, OUT shared_blks_read BIGINT, OUT direct_blks_read BIGINT,
+                           OUT result_cache_hits BIGINT, OUT result_cache_misses BIGINT,
+                           OUT visibility_time FLOAT8, OUT deform_time FLOAT8, OUT filter_time FLOAT8,
+                           OUT detoast_time FLOAT8, OUT lock_wait_time FLOAT8, OUT cpu_time FLOAT8)
+    RETURNS SETOF record
+    LANGUAGE C AS 'MODULE_PATHNAME', 'duckdb_stat_scans';
+
+CREATE VIEW stat_scans AS SELECT * FROM stat_scans();
+
+CREATE FUNCTION stat_fallbacks(OUT pid INT, OUT reason TEXT, OUT fallbacks BIGINT)
+    RETURNS SETOF record
+    LANGUAGE C AS 'MODULE_PATHNAME', 'duckdb_stat_fallbacks';
+
+CREATE VIEW stat_fallbacks AS SELECT * FROM stat_fallbacks();
+
+CREATE FUNCTION stat_scans_reset() RETURNS void
+    LANGUAGE C AS 'MODULE_PATHNAME', 'duckdb_stat_scans_reset';
+
+REVOKE ALL ON FUNCTION stat_scans_reset() FROM PUBLIC;
+
+-- Queries submitted with duckdb.submit(). A background worker executes each of them with DuckDB and writes the result
+-- to a Parquet file in the data directory, which duckdb.fetch() and duckdb.result_to_table() read. The file is kept
+-- until duckdb.job_remove() removes the job. worker_pid is the process executing a running job, terminating it with
+-- pg_terminate_backend() cancels the job.
+CREATE TABLE jobs (
+    id BIGSERIAL PRIMARY KEY,
+    owner OID NOT NULL,
+    query TEXT NOT NULL,
+    status TEXT NOT NULL,
+    error TEXT,
+    row_count BIGINT,
+    submitted_at TIMESTAMPTZ NOT NULL,
+    started_at TIMESTAMPTZ,
+    finished_at TIMESTAMPTZ,
+    worker_pid INT,
+    CONSTRAINT status_constraint CHECK (status IN ('queued', 'running', 'done', 'failed'))
+);
+
+CREATE FUNCTION submit(query TEXT) RETURNS BIGINT
+    LANGUAGE C STRICT AS 'MODULE_PATHNAME', 'duckdb_submit';
+
+REVOKE ALL ON FUNCTION submit(TEXT) FROM PUBLIC;
+
+CREATE FUNCTION status(job_id BIGINT, OUT status TEXT, OUT error TEXT, OUT row_count BIGINT,
+                       OUT submitted_at TIMESTAMPTZ, OUT started_at TIMESTAMPTZ, OUT finished_at TIMESTAMPTZ)
+    RETURNS record
+    LANGUAGE C STRICT AS 'MODULE_PATHNAME', 'duckdb_job_status';
+
+CREATE FUNCTION fetch(job_id BIGINT) RETURNS SETOF record
+    LANGUAGE C STRICT AS 'MODULE_PATHNAME', 'duckdb_job_fetch';
+
+CREATE FUNCTION result_to_table(job_id BIGINT, table_name TEXT) RETURNS BIGINT
+    LANGUAGE C STRICT AS 'MODULE_PATHNAME', 'duckdb_job_result_to_table';
+
+CREATE FUNCTION job_remove(job_id BIGINT) RETURNS void
+    LANGUAGE C STRICT AS 'MODULE_PATHNAME', 'duckdb_job_remove';
+
 DO $$
 BEGIN
     RAISE WARNING 'To actually execute queries using DuckDB you need to run "SET duckdb.execution TO true;"';
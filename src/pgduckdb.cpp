@@ -5,12 +5,22 @@ extern "C" {
 
 #include "pgduckdb/pgduckdb.h"
 #include "pgduckdb/pgduckdb_node.hpp"
+#include "pgduckdb/pgduckdb_stats.hpp"
 #include "pgduckdb/pgduckdb_utils.hpp"
 
 static void DuckdbInitGUC(void);
 
 bool duckdb_execution = false;
 int duckdb_max_threads_per_query = 1;
+bool duckdb_track_scan_timing = false;
+int duckdb_index_lookup_max_keys = 1000;
+bool duckdb_direct_heap_reads = false;
+char *duckdb_max_memory = NULL;
+int duckdb_threads = -1;
+bool duckdb_result_cache = false;
+int duckdb_result_cache_size = 65536;
+int duckdb_result_cache_ttl = 60;
+bool duckdb_shared_service = false;
 
 extern "C" {
 PG_MODULE_MAGIC;
@@ -20,6 +30,10 @@ _PG_init(void) {
 	DuckdbInitGUC();
 	DuckdbInitHooks();
 	DuckdbInitNode();
+	pgduckdb::DuckdbInitStats();
+	DuckdbInitResultCache();
+	DuckdbInitJobs();
+	DuckdbInitService();
 }
 }
 
@@ -51,4 +65,129 @@ DuckdbInitGUC(void) {
                             NULL,
                             NULL);
 
+    DefineCustomBoolVariable("duckdb.track_scan_timing",
+                             gettext_noop("Collects timing statistics of Postgres table scans executed by DuckDB."),
+                             gettext_noop("Reading the clock for every scanned tuple can cause significant overhead."),
+                             &duckdb_track_scan_timing,
+                             false,
+                             PGC_SUSET,
+                             0,
+                             NULL,
+                             NULL,
+                             NULL);
+
+    DefineCustomIntVariable("duckdb.index_lookup_max_keys",
+                            gettext_noop("Maximum estimated number of join keys for which DuckDB looks up matching "
+                                         "rows in a B-tree index instead of scanning the whole table."),
+                            gettext_noop("Set to 0 to always scan the table."),
+                            &duckdb_index_lookup_max_keys,
+                            1000,
+                            0,
+                            INT_MAX,
+                            PGC_USERSET,
+                            0,
+                            NULL,
+                            NULL,
+                            NULL);
+
+    DefineCustomBoolVariable("duckdb.direct_heap_reads",
+                             gettext_noop("Reads all-visible pages that are not in shared buffers directly from the "
+                                          "relation's files when scanning tables with DuckDB."),
+                             gettext_noop("Keeps large scans from evicting pages from shared buffers. Requires data "
+                                          "checksums. Directly read pages are counted in direct_blks_read of "
+                                          "duckdb.stat_scans."),
+                             &duckdb_direct_heap_reads,
+                             false,
+                             PGC_SUSET,
+                             0,
+                             NULL,
+                             NULL,
+                             NULL);
+
+    DefineCustomStringVariable("duckdb.max_memory",
+                               gettext_noop("Memory limit of the DuckDB database of each backend."),
+                               gettext_noop("Accepts DuckDB memory sizes such as '1GB' or '10%'. Every backend that "
+                                            "executes queries with DuckDB keeps its own database, so the memory used "
+                                            "by DuckDB can reach this limit times the number of such backends."),
+                               &duckdb_max_memory,
+                               "1GB",
+                               PGC_SUSET,
+                               0,
+                               NULL,
+                               NULL,
+                               NULL);
+
+    DefineCustomIntVariable("duckdb.threads",
+                            gettext_noop("Size of the thread pool of the DuckDB database of each backend."),
+                            gettext_noop("-1 uses duckdb.max_threads_per_query threads. Every backend that executes "
+                                         "queries with DuckDB keeps its own thread pool."),
+                            &duckdb_threads,
+                            -1,
+                            -1,
+                            1024,
+                            PGC_SUSET,
+                            0,
+                            NULL,
+                            NULL,
+                            NULL);
+
+    DefineCustomBoolVariable("duckdb.result_cache",
+                             gettext_noop("Reuses the results of earlier identical queries executed with DuckDB "
+                                          "by the same backend."),
+                             gettext_noop("Each backend has its own cache, results are not shared between "
+                                          "sessions. Queries with parameters, e.g. executed prepared statements, "
+                                          "and queries with volatile or stable functions are not cached. Requires "
+                                          "pg_duckdb to be loaded via shared_preload_libraries."),
+                             &duckdb_result_cache,
+                             false,
+                             PGC_USERSET,
+                             0,
+                             NULL,
+                             NULL,
+                             NULL);
+
+    DefineCustomIntVariable("duckdb.result_cache_size",
+                            gettext_noop("Memory used by the cached query results of each backend."),
+                            NULL,
+                            &duckdb_result_cache_size,
+                            65536,
+                            0,
+                            INT_MAX,
+                            PGC_USERSET,
+                            GUC_UNIT_KB,
+                            NULL,
+                            NULL,
+                            NULL);
+
+    DefineCustomIntVariable("duckdb.result_cache_ttl",
+                            gettext_noop("Time after which cached results of queries that read remote files expire."),
+                            gettext_noop("Remote files are not checked for changes, e.g. by their ETag, a cached "
+                                         "result is returned until it expires even if they changed. Set to 0 to not "
+                                         "cache such queries."),
+                            &duckdb_result_cache_ttl,
+                            60,
+                            0,
+                            INT_MAX,
+                            PGC_USERSET,
+                            GUC_UNIT_S,
+                            NULL,
+                            NULL,
+                            NULL);
+
+    DefineCustomBoolVariable("duckdb.shared_service",
+                             gettext_noop("Executes DuckDB queries in a background worker shared by the backends "
+                                          "of the database."),
+                             gettext_noop("The worker has one DuckDB database for all backends of the database, "
+                                          "instead of one per backend. Queries of transactions that wrote data, "
+                                          "queries reading temporary tables and queries in serializable "
+                                          "transactions are executed by the backend. Requires pg_duckdb to be "
+                                          "loaded via shared_preload_libraries."),
+                             &duckdb_shared_service,
+                             false,
+                             PGC_USERSET,
+                             0,
+                             NULL,
+                             NULL,
+                             NULL);
+
 }
@@ -17,6 +17,7 @@ extern "C" {
 #include "utils/expandeddatum.h"
 }
 
+#include "pgduckdb/pgduckdb_guard.hpp"
 #include "pgduckdb/pgduckdb_process_lock.hpp"
 #include "pgduckdb/pgduckdb_types.hpp"
 #include "pgduckdb/pgduckdb_detoast.hpp"
@@ -39,8 +40,10 @@ PglzDecompressDatum(const struct varlena *value) {
 
 	raw_size = pglz_decompress((char *)value + VARHDRSZ_COMPRESSED, VARSIZE(value) - VARHDRSZ_COMPRESSED,
 	                           VARDATA(result), VARDATA_COMPRESSED_GET_EXTSIZE(value), true);
-	if (raw_size < 0)
-		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg_internal("compressed pglz data is corrupt")));
+	if (raw_size < 0) {
+		duckdb_free(result);
+		throw duckdb::InvalidInputException("compressed pglz data is corrupt");
+	}
 
 	SET_VARSIZE(result, raw_size + VARHDRSZ);
 
@@ -59,8 +62,10 @@ Lz4DecompresDatum(const struct varlena *value) {
 
 	raw_size = LZ4_decompress_safe((char *)value + VARHDRSZ_COMPRESSED, VARDATA(result),
 	                               VARSIZE(value) - VARHDRSZ_COMPRESSED, VARDATA_COMPRESSED_GET_EXTSIZE(value));
-	if (raw_size < 0)
-		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg_internal("compressed lz4 data is corrupt")));
+	if (raw_size < 0) {
+		duckdb_free(result);
+		throw duckdb::InvalidInputException("compressed lz4 data is corrupt");
+	}
 
 	SET_VARSIZE(result, raw_size + VARHDRSZ);
 
@@ -78,8 +83,7 @@ ToastDecompressDatum(struct varlena *attr) {
 	case TOAST_LZ4_COMPRESSION_ID:
 		return Lz4DecompresDatum(attr);
 	default:
-		elog(ERROR, "invalid compression method id %d", TOAST_COMPRESS_METHOD(attr));
-		return NULL; /* keep compiler quiet */
+		throw duckdb::InvalidInputException("invalid compression method id %d", TOAST_COMPRESS_METHOD(attr));
 	}
 }
 
@@ -91,7 +95,7 @@ ToastFetchDatum(struct varlena *attr) {
 	int32 attrsize;
 
 	if (!VARATT_IS_EXTERNAL_ONDISK(attr))
-		elog(ERROR, "toast_fetch_datum shouldn't be called for non-ondisk datums");
+		throw duckdb::InternalException("toast_fetch_datum shouldn't be called for non-ondisk datums");
 
 	/* Must copy to access aligned fields */
 	VARATT_EXTERNAL_GET_POINTER(toast_pointer, attr);
@@ -109,11 +113,17 @@ ToastFetchDatum(struct varlena *attr) {
 	if (attrsize == 0)
 		return result;
 
-	DuckdbProcessLock::GetLock().lock();
-	toastrel = table_open(toast_pointer.va_toastrelid, AccessShareLock);
-	table_relation_fetch_toast_slice(toastrel, toast_pointer.va_valueid, attrsize, 0, attrsize, result);
-	table_close(toastrel, AccessShareLock);
-	DuckdbProcessLock::GetLock().unlock();
+	try {
+		std::lock_guard<std::mutex> lock(DuckdbProcessLock::GetLock());
+		PostgresFunctionGuard([&] {
+			toastrel = table_open(toast_pointer.va_toastrelid, AccessShareLock);
+			table_relation_fetch_toast_slice(toastrel, toast_pointer.va_valueid, attrsize, 0, attrsize, result);
+			table_close(toastrel, AccessShareLock);
+		});
+	} catch (...) {
+		duckdb_free(result);
+		throw;
+	}
 
 	return result;
 }
@@ -1,13 +1,26 @@
 #include "duckdb.hpp"
 #include "duckdb/parser/parsed_data/create_table_function_info.hpp"
 #include "duckdb/main/extension_util.hpp"
+#include "duckdb/parser/keyword_helper.hpp"
 
+extern "C" {
+#include "postgres.h"
+#include "storage/ipc.h"
+}
+
+#include "pgduckdb/pgduckdb.h"
 #include "pgduckdb/pgduckdb_options.hpp"
 #include "pgduckdb/pgduckdb_duckdb.hpp"
+#include "pgduckdb/pgduckdb_guard.hpp"
 #include "pgduckdb/scan/postgres_scan.hpp"
+#include "pgduckdb/scan/postgres_bitmap_heap_scan.hpp"
+#include "pgduckdb/scan/postgres_index_lookup.hpp"
 #include "pgduckdb/scan/postgres_index_scan.hpp"
+#include "pgduckdb/scan/postgres_index_skip_scan.hpp"
 #include "pgduckdb/scan/postgres_seq_scan.hpp"
+#include "pgduckdb/scan/postgres_tid_fetch.hpp"
 #include "pgduckdb/pgduckdb_utils.hpp"
+#include "pgduckdb/pgduckdb_timing.hpp"
 
 #include <string>
 
@@ -63,27 +76,43 @@ GetExtensionDirectory() {
 	return duckdb_extension_directory;
 }
 
-duckdb::unique_ptr<duckdb::DuckDB>
+/*
+ * DuckDB database of the backend. It is opened by the first query DuckDB plans and kept until the backend exits, so
+ * that queries share its thread pool, buffer manager and the caches of loaded extensions, and don't have to register
+ * the Postgres scan functions again.
+ */
+static duckdb::unique_ptr<duckdb::DuckDB> duckdb_database;
+
+/* Settings, secrets and extensions applied to duckdb_database, see DuckdbApplyConfiguration */
+static std::string duckdb_applied_max_memory;
+static int duckdb_applied_threads = -1;
+static duckdb::vector<std::string> duckdb_applied_secrets;
+static duckdb::unordered_set<std::string> duckdb_loaded_extensions;
+
+static void
+DuckdbCloseDatabase(int code, Datum arg) {
+	duckdb_database.reset();
+}
+
+static void
 DuckdbOpenDatabase() {
+	SetupTimer timer(SetupPhase::OPEN_DATABASE);
 	duckdb::DBConfig config;
 	config.SetOptionByName("extension_directory", GetExtensionDirectory());
-	return duckdb::make_uniq<duckdb::DuckDB>(nullptr, &config);
-}
-
-duckdb::unique_ptr<duckdb::Connection>
-DuckdbCreateConnection(List *rtables, PlannerInfo *planner_info, List *needed_columns, const char *query) {
-	auto db = DuckdbOpenDatabase();
-
-	/* Add tables */
-	db->instance->config.replacement_scans.emplace_back(
-	    pgduckdb::PostgresReplacementScan,
-	    duckdb::make_uniq_base<duckdb::ReplacementScanData, PostgresReplacementScanData>(rtables, planner_info,
-	                                                                                     needed_columns, query));
+	/* All threads of duckdb.threads are scheduler threads, the backend only waits for the queries of DuckDB scans */
+	config.options.external_threads = 0;
+	config.replacement_scans.emplace_back(pgduckdb::PostgresReplacementScan);
+	config.optimizer_extensions.push_back(PostgresIndexLookupOptimizerExtension());
+	config.optimizer_extensions.push_back(PostgresTidFetchOptimizerExtension());
+	config.optimizer_extensions.push_back(PostgresSharedVisibilityOptimizerExtension());
+	auto db = duckdb::make_uniq<duckdb::DuckDB>(nullptr, &config);
 
-	auto connection = duckdb::make_uniq<duckdb::Connection>(*db);
+	instr_time start;
+	INSTR_TIME_SET_CURRENT(start);
 
 	// Add the postgres_scan inserted by the replacement scan
-	auto &context = *connection->context;
+	duckdb::Connection connection(*db);
+	auto &context = *connection.context;
 
 	pgduckdb::PostgresSeqScanFunction seq_scan_fun;
 	duckdb::CreateTableFunctionInfo seq_scan_info(seq_scan_fun);
@@ -91,16 +120,68 @@ DuckdbCreateConnection(List *rtables, PlannerInfo *planner_info, List *needed_co
 	pgduckdb::PostgresIndexScanFunction index_scan_fun;
 	duckdb::CreateTableFunctionInfo index_scan_info(index_scan_fun);
 
+	pgduckdb::PostgresIndexSkipScanFunction index_skip_scan_fun;
+	duckdb::CreateTableFunctionInfo index_skip_scan_info(index_skip_scan_fun);
+
+	pgduckdb::PostgresBitmapHeapScanFunction bitmap_heap_scan_fun;
+	duckdb::CreateTableFunctionInfo bitmap_heap_scan_info(bitmap_heap_scan_fun);
+
 	auto &catalog = duckdb::Catalog::GetSystemCatalog(context);
 	context.transaction.BeginTransaction();
 	auto &instance = *db->instance;
 	duckdb::ExtensionUtil::RegisterType(instance, "UnsupportedPostgresType", duckdb::LogicalTypeId::VARCHAR);
 	catalog.CreateTableFunction(context, &seq_scan_info);
 	catalog.CreateTableFunction(context, &index_scan_info);
+	catalog.CreateTableFunction(context, &index_skip_scan_info);
+	catalog.CreateTableFunction(context, &bitmap_heap_scan_info);
 	context.transaction.Commit();
+	AccumulateSetupTime(SetupPhase::REGISTER_CATALOG, start);
+
+	duckdb_database = std::move(db);
+	on_proc_exit(DuckdbCloseDatabase, 0);
+}
 
+duckdb::DuckDB &
+DuckdbGetDatabase() {
+	if (!duckdb_database) {
+		DuckdbOpenDatabase();
+	}
+	return *duckdb_database;
+}
+
+static void
+DuckdbSetGlobal(duckdb::ClientContext &context, const char *statement) {
+	auto res = context.Query(statement, false);
+	if (res->HasError()) {
+		elog(WARNING, "(DuckDB) %s", res->GetError().c_str());
+	}
+}
+
+/*
+ * Brings the database of the backend in line with the duckdb.max_memory and duckdb.threads settings and the
+ * duckdb.secrets and duckdb.extensions tables, which can change between queries. Extensions can't be unloaded, one
+ * that is disabled stays loaded until the backend exits.
+ */
+static void
+DuckdbApplyConfiguration(duckdb::ClientContext &context) {
+	if (duckdb_applied_max_memory != duckdb_max_memory) {
+		std::string statement =
+		    "SET GLOBAL memory_limit = " + duckdb::KeywordHelper::WriteQuoted(duckdb_max_memory, '\'');
+		DuckdbSetGlobal(context, statement.c_str());
+		duckdb_applied_max_memory = duckdb_max_memory;
+	}
+
+	int threads = duckdb_threads < 0 ? duckdb_max_threads_per_query : duckdb_threads;
+	if (duckdb_applied_threads != threads) {
+		DuckdbSetGlobal(context, ("SET GLOBAL threads = " + std::to_string(threads)).c_str());
+		duckdb_applied_threads = threads;
+	}
+
+	instr_time start;
+	INSTR_TIME_SET_CURRENT(start);
 	auto duckdb_secrets = ReadDuckdbSecrets();
 
+	duckdb::vector<std::string> secrets;
 	int secret_id = 0;
 	for (auto &secret : duckdb_secrets) {
 		StringInfo secret_key = makeStringInfo();
@@ -118,24 +199,57 @@ DuckdbCreateConnection(List *rtables, PlannerInfo *planner_info, List *needed_co
 			appendStringInfo(secret_key, ", ACCOUNT_ID '%s'", secret.endpoint.c_str());
 		}
 		appendStringInfo(secret_key, ");");
-		context.Query(secret_key->data, false);
+		secrets.push_back(secret_key->data);
 		pfree(secret_key->data);
 		secret_id++;
 	}
 
+	if (secrets != duckdb_applied_secrets) {
+		for (size_t i = 0; i < duckdb_applied_secrets.size(); i++) {
+			context.Query("DROP SECRET duckdbSecret_" + std::to_string(i), false);
+		}
+		for (auto &secret : secrets) {
+			context.Query(secret, false);
+		}
+		duckdb_applied_secrets = std::move(secrets);
+	}
+	AccumulateSetupTime(SetupPhase::LOAD_SECRETS, start);
+
+	INSTR_TIME_SET_CURRENT(start);
 	auto duckdb_extensions = ReadDuckdbExtensions();
 
 	for (auto &extension : duckdb_extensions) {
-		StringInfo duckdb_extension = makeStringInfo();
-		if (extension.enabled) {
-			appendStringInfo(duckdb_extension, "LOAD %s;", extension.name.c_str());
-			auto res = context.Query(duckdb_extension->data, false);
-			if (res->HasError()) {
-				elog(ERROR, "Extension `%s` could not be loaded with DuckDB", extension.name.c_str());
-			}
+		if (!extension.enabled || duckdb_loaded_extensions.count(extension.name)) {
+			continue;
 		}
+		StringInfo duckdb_extension = makeStringInfo();
+		appendStringInfo(duckdb_extension, "LOAD %s;", extension.name.c_str());
+		auto res = context.Query(duckdb_extension->data, false);
 		pfree(duckdb_extension->data);
+		if (res->HasError()) {
+			elog(ERROR, "Extension `%s` could not be loaded with DuckDB", extension.name.c_str());
+		}
+		duckdb_loaded_extensions.insert(extension.name);
 	}
+	AccumulateSetupTime(SetupPhase::LOAD_EXTENSIONS, start);
+}
+
+duckdb::unique_ptr<duckdb::Connection>
+DuckdbCreateConnection(List *rtables, PlannerInfo *planner_info, List *needed_columns, const char *query) {
+	auto &db = DuckdbGetDatabase();
+	instr_time start;
+
+	INSTR_TIME_SET_CURRENT(start);
+	auto connection = duckdb::make_uniq<duckdb::Connection>(db);
+	auto &context = *connection->context;
+
+	/* Add tables */
+	context.registered_state[PostgresReplacementScanData::STATE_KEY] =
+	    duckdb::make_shared_ptr<PostgresReplacementScanData>(rtables, planner_info, needed_columns, query);
+	AccumulateSetupTime(SetupPhase::CREATE_CONNECTION, start);
+
+	/* An ERROR, e.g. for an extension that can't be loaded, would leave the connection in the database otherwise */
+	CleanupOnPostgresError([&] { DuckdbApplyConfiguration(context); }, [&] { connection.reset(); });
 
 	return connection;
 }
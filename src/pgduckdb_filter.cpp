@@ -53,7 +53,7 @@ FilterOperationSwitch(Datum &value, duckdb::Value &constant, Oid type_oid) {
 		break;
 	}
 	default:
-		elog(ERROR, "(DuckDB/FilterOperationSwitch) Unsupported duckdb type: %d", type_oid);
+		throw duckdb::NotImplementedException("(DuckDB/FilterOperationSwitch) Unsupported duckdb type: %d", type_oid);
 	}
 }
 
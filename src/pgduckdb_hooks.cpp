@@ -1,10 +1,12 @@
 extern "C" {
 #include "postgres.h"
+#include "catalog/namespace.h"
 #include "catalog/pg_namespace.h"
 #include "commands/extension.h"
 #include "nodes/nodes.h"
 #include "tcop/utility.h"
 #include "tcop/pquery.h"
+#include "utils/lsyscache.h"
 #include "utils/rel.h"
 #include "optimizer/optimizer.h"
 }
@@ -12,12 +14,23 @@ extern "C" {
 #include "pgduckdb/pgduckdb.h"
 #include "pgduckdb/pgduckdb_metadata_cache.hpp"
 #include "pgduckdb/pgduckdb_planner.hpp"
+#include "pgduckdb/pgduckdb_stats.hpp"
 #include "pgduckdb/utility/copy.hpp"
 #include "pgduckdb/vendor/pg_list.hpp"
 
 static planner_hook_type prev_planner_hook = NULL;
 static ProcessUtility_hook_type prev_process_utility_hook = NULL;
 
+/*
+ * Returns true if the namespace belongs to Postgres itself or to pg_duckdb. Queries on pg_duckdb's own objects
+ * (e.g. the statistics views) are always executed by Postgres.
+ */
+static bool
+IsCatalogNamespace(Oid namespace_oid) {
+	return namespace_oid == PG_CATALOG_NAMESPACE || namespace_oid == PG_TOAST_NAMESPACE ||
+	       namespace_oid == get_namespace_oid("duckdb", true);
+}
+
 static bool
 IsCatalogTable(List *tables) {
 	foreach_node(RangeTblEntry, table, tables) {
@@ -27,10 +40,18 @@ IsCatalogTable(List *tables) {
 				return true;
 			}
 		}
+		if (table->rtekind == RTE_FUNCTION) {
+			foreach_node(RangeTblFunction, rtfunc, table->functions) {
+				if (IsA(rtfunc->funcexpr, FuncExpr) &&
+				    get_func_namespace(((FuncExpr *)rtfunc->funcexpr)->funcid) == get_namespace_oid("duckdb", true)) {
+					return true;
+				}
+			}
+		}
 		if (table->relid) {
 			auto rel = RelationIdGetRelation(table->relid);
 			auto namespace_oid = RelationGetNamespace(rel);
-			if (namespace_oid == PG_CATALOG_NAMESPACE || namespace_oid == PG_TOAST_NAMESPACE) {
+			if (IsCatalogNamespace(namespace_oid)) {
 				RelationClose(rel);
 				return true;
 			}
@@ -53,11 +74,17 @@ IsAllowedStatement() {
 
 static PlannedStmt *
 DuckdbPlannerHook(Query *parse, const char *query_string, int cursor_options, ParamListInfo bound_params) {
-	if (duckdb_execution && IsAllowedStatement() && pgduckdb::IsExtensionRegistered() && parse->rtable &&
-	    !IsCatalogTable(parse->rtable) && parse->commandType == CMD_SELECT) {
-		PlannedStmt *duckdb_plan = DuckdbPlanNode(parse, query_string, cursor_options, bound_params);
-		if (duckdb_plan) {
-			return duckdb_plan;
+	if (duckdb_execution && pgduckdb::IsExtensionRegistered() && parse->rtable && parse->commandType == CMD_SELECT) {
+		pgduckdb::AttachScanStats();
+		if (!IsAllowedStatement()) {
+			pgduckdb::CountFallback(pgduckdb::FALLBACK_UNSUPPORTED_STATEMENT);
+		} else if (IsCatalogTable(parse->rtable)) {
+			pgduckdb::CountFallback(pgduckdb::FALLBACK_CATALOG_TABLE);
+		} else {
+			PlannedStmt *duckdb_plan = DuckdbPlanNode(parse, query_string, cursor_options, bound_params);
+			if (duckdb_plan) {
+				return duckdb_plan;
+			}
 		}
 	}
 
@@ -72,6 +99,10 @@ static void
 DuckdbUtilityHook(PlannedStmt *pstmt, const char *query_string, bool read_only_tree, ProcessUtilityContext context,
                   ParamListInfo params, struct QueryEnvironment *query_env, DestReceiver *dest, QueryCompletion *qc) {
 	Node *parsetree = pstmt->utilityStmt;
+	/* COPY FROM writes to the table without going through the executor */
+	if (IsA(parsetree, CopyStmt) && ((CopyStmt *)parsetree)->is_from && ((CopyStmt *)parsetree)->relation) {
+		DuckdbResultCacheTrackWrite(RangeVarGetRelid(((CopyStmt *)parsetree)->relation, NoLock, true));
+	}
 	if (duckdb_execution && pgduckdb::IsExtensionRegistered() && IsA(parsetree, CopyStmt)) {
 		uint64 processed;
 		if (DuckdbCopy(pstmt, query_string, query_env, &processed)) {
@@ -0,0 +1,749 @@
+#include "duckdb.hpp"
+#include "duckdb/parser/keyword_helper.hpp"
+
+extern "C" {
+#include "postgres.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "access/genam.h"
+#include "access/htup_details.h"
+#include "access/stratnum.h"
+#include "access/table.h"
+#include "access/xact.h"
+#include "catalog/indexing.h"
+#include "catalog/namespace.h"
+#include "catalog/pg_type.h"
+#include "commands/sequence.h"
+#include "executor/executor.h"
+#include "executor/spi.h"
+#include "funcapi.h"
+#include "optimizer/optimizer.h"
+#include "optimizer/planner.h"
+#include "parser/parser.h"
+#include "postmaster/bgworker.h"
+#include "storage/fd.h"
+#include "storage/ipc.h"
+#include "storage/lmgr.h"
+#include "storage/procarray.h"
+#include "tcop/tcopprot.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/fmgroids.h"
+#include "utils/lsyscache.h"
+#include "utils/regproc.h"
+#include "utils/rel.h"
+#include "utils/rls.h"
+#include "utils/snapmgr.h"
+#include "utils/timestamp.h"
+}
+
+#include "pgduckdb/pgduckdb.h"
+#include "pgduckdb/pgduckdb_duckdb.hpp"
+#include "pgduckdb/pgduckdb_guard.hpp"
+#include "pgduckdb/pgduckdb_types.hpp"
+#include "pgduckdb/vendor/pg_list.hpp"
+
+#include <unistd.h>
+
+/* constants for duckdb.jobs */
+#define Natts_duckdb_job              10
+#define Anum_duckdb_job_id            1
+#define Anum_duckdb_job_owner         2
+#define Anum_duckdb_job_query         3
+#define Anum_duckdb_job_status        4
+#define Anum_duckdb_job_error         5
+#define Anum_duckdb_job_row_count     6
+#define Anum_duckdb_job_submitted_at  7
+#define Anum_duckdb_job_started_at    8
+#define Anum_duckdb_job_finished_at   9
+#define Anum_duckdb_job_worker_pid    10
+
+namespace pgduckdb {
+
+/* Passed to the worker of a job through bgw_extra */
+struct DuckdbJobWorkerArgs {
+	Oid database;
+	/* Transaction that submitted the job, the job only exists once it committed */
+	TransactionId xid;
+};
+
+static Oid
+GetDuckdbNamespace(void) {
+	return get_namespace_oid("duckdb", false);
+}
+
+static Oid
+JobsTableRelationId(void) {
+	return get_relname_relid("jobs", GetDuckdbNamespace());
+}
+
+static Oid
+JobsIndexRelationId(void) {
+	return get_relname_relid("jobs_pkey", GetDuckdbNamespace());
+}
+
+static Oid
+JobsSequenceRelationId(void) {
+	return get_relname_relid("jobs_id_seq", GetDuckdbNamespace());
+}
+
+static SysScanDesc
+BeginJobScan(Relation jobs_relation, int64 job_id, ScanKeyData *key) {
+	ScanKeyInit(key, Anum_duckdb_job_id, BTEqualStrategyNumber, F_INT8EQ, Int64GetDatum(job_id));
+	return systable_beginscan(jobs_relation, JobsIndexRelationId(), true, GetActiveSnapshot(), 1, key);
+}
+
+/* Reads the row of a job into values/nulls, returns false if there is none */
+static bool
+ReadJob(int64 job_id, Datum *values, bool *nulls) {
+	ScanKeyData key;
+	Relation jobs_relation = table_open(JobsTableRelationId(), AccessShareLock);
+	SysScanDesc scan = BeginJobScan(jobs_relation, job_id, &key);
+	HeapTuple tuple = systable_getnext(scan);
+	bool found = HeapTupleIsValid(tuple);
+
+	if (found) {
+		heap_deform_tuple(heap_copytuple(tuple), RelationGetDescr(jobs_relation), values, nulls);
+	}
+
+	systable_endscan(scan);
+	table_close(jobs_relation, NoLock);
+	return found;
+}
+
+/*
+ * Reads the row of a job submitted by a role the current user is a member of. A running job whose worker exited
+ * without recording the end of the job, e.g. because of a FATAL error or a crash, is returned as failed.
+ */
+static void
+ReadOwnJob(int64 job_id, Datum *values, bool *nulls) {
+	if (!ReadJob(job_id, values, nulls)) {
+		ereport(ERROR,
+		        (errcode(ERRCODE_UNDEFINED_OBJECT), errmsg("DuckDB job " INT64_FORMAT " does not exist", job_id)));
+	}
+	if (!has_privs_of_role(GetUserId(), DatumGetObjectId(values[Anum_duckdb_job_owner - 1]))) {
+		ereport(ERROR, (errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+		                errmsg("permission denied for DuckDB job " INT64_FORMAT, job_id)));
+	}
+
+	if (strcmp(TextDatumGetCString(values[Anum_duckdb_job_status - 1]), "running") == 0 &&
+	    !nulls[Anum_duckdb_job_worker_pid - 1] &&
+	    BackendPidGetProc(DatumGetInt32(values[Anum_duckdb_job_worker_pid - 1])) == NULL) {
+		values[Anum_duckdb_job_status - 1] = CStringGetTextDatum("failed");
+		values[Anum_duckdb_job_error - 1] = CStringGetTextDatum("the worker of the job exited before it finished");
+		nulls[Anum_duckdb_job_error - 1] = false;
+	}
+}
+
+/*
+ * Sets the status of a job. Starting it records the start time and the worker's pid, finishing it (done or failed)
+ * the finish time, the error and the number of result rows, a negative row_count is stored as NULL.
+ */
+static void
+UpdateJob(int64 job_id, const char *status, const char *error, int64 row_count) {
+	ScanKeyData key;
+	Relation jobs_relation = table_open(JobsTableRelationId(), RowExclusiveLock);
+	SysScanDesc scan = BeginJobScan(jobs_relation, job_id, &key);
+	HeapTuple tuple = systable_getnext(scan);
+
+	if (HeapTupleIsValid(tuple)) {
+		Datum values[Natts_duckdb_job] = {0};
+		bool nulls[Natts_duckdb_job] = {0};
+		bool replace[Natts_duckdb_job] = {0};
+		TimestampTz now = GetCurrentTimestamp();
+
+		values[Anum_duckdb_job_status - 1] = CStringGetTextDatum(status);
+		replace[Anum_duckdb_job_status - 1] = true;
+
+		if (strcmp(status, "running") == 0) {
+			values[Anum_duckdb_job_started_at - 1] = TimestampTzGetDatum(now);
+			replace[Anum_duckdb_job_started_at - 1] = true;
+			values[Anum_duckdb_job_worker_pid - 1] = Int32GetDatum(MyProcPid);
+			replace[Anum_duckdb_job_worker_pid - 1] = true;
+		} else {
+			values[Anum_duckdb_job_finished_at - 1] = TimestampTzGetDatum(now);
+			replace[Anum_duckdb_job_finished_at - 1] = true;
+			if (error) {
+				values[Anum_duckdb_job_error - 1] = CStringGetTextDatum(error);
+			} else {
+				nulls[Anum_duckdb_job_error - 1] = true;
+			}
+			replace[Anum_duckdb_job_error - 1] = true;
+			if (row_count >= 0) {
+				values[Anum_duckdb_job_row_count - 1] = Int64GetDatum(row_count);
+			} else {
+				nulls[Anum_duckdb_job_row_count - 1] = true;
+			}
+			replace[Anum_duckdb_job_row_count - 1] = true;
+		}
+
+		HeapTuple new_tuple = heap_modify_tuple(tuple, RelationGetDescr(jobs_relation), values, nulls, replace);
+		CatalogTupleUpdate(jobs_relation, &new_tuple->t_self, new_tuple);
+	}
+
+	systable_endscan(scan);
+	table_close(jobs_relation, NoLock);
+}
+
+static std::string
+JobResultPath(int64 job_id) {
+	return std::string(DataDir) + "/duckdb_jobs/" + std::to_string(job_id) + ".parquet";
+}
+
+/*
+ * Result files of the jobs removed by the current transaction, with the subtransaction that removed them. They are
+ * deleted once the transaction commits, the jobs of an aborted (sub)transaction keep them.
+ */
+static duckdb::vector<std::pair<std::string, SubTransactionId>> removed_job_results;
+
+static void
+JobsXactCallback(XactEvent event, void *arg) {
+	switch (event) {
+	case XACT_EVENT_COMMIT:
+		for (auto &removed : removed_job_results) {
+			if (unlink(removed.first.c_str()) < 0 && errno != ENOENT) {
+				ereport(WARNING, (errcode_for_file_access(),
+				                  errmsg("could not remove file \"%s\": %m", removed.first.c_str())));
+			}
+		}
+		removed_job_results.clear();
+		break;
+	case XACT_EVENT_PRE_PREPARE:
+		/* The transaction commits in another backend, which wouldn't delete the files */
+		if (!removed_job_results.empty()) {
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			                errmsg("cannot PREPARE a transaction that has removed DuckDB jobs")));
+		}
+		break;
+	case XACT_EVENT_ABORT:
+		removed_job_results.clear();
+		break;
+	default:
+		break;
+	}
+}
+
+static void
+JobsSubXactCallback(SubXactEvent event, SubTransactionId subid, SubTransactionId parent_subid, void *arg) {
+	for (auto removed = removed_job_results.begin(); removed != removed_job_results.end();) {
+		if (removed->second != subid) {
+			removed++;
+		} else if (event == SUBXACT_EVENT_ABORT_SUB) {
+			removed = removed_job_results.erase(removed);
+		} else {
+			if (event == SUBXACT_EVENT_COMMIT_SUB) {
+				removed->second = parent_subid;
+			}
+			removed++;
+		}
+	}
+}
+
+/* Returns the result file of a job that finished successfully */
+static char *
+FinishedJobResultPath(int64 job_id) {
+	Datum values[Natts_duckdb_job];
+	bool nulls[Natts_duckdb_job];
+
+	ReadOwnJob(job_id, values, nulls);
+
+	auto status = TextDatumGetCString(values[Anum_duckdb_job_status - 1]);
+	if (strcmp(status, "failed") == 0) {
+		ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+		                errmsg("DuckDB job " INT64_FORMAT " failed: %s", job_id,
+		                       TextDatumGetCString(values[Anum_duckdb_job_error - 1]))));
+	}
+	if (strcmp(status, "done") != 0) {
+		ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+		                errmsg("DuckDB job " INT64_FORMAT " has not finished yet", job_id)));
+	}
+	return pstrdup(JobResultPath(job_id).c_str());
+}
+
+/*
+ * Removes a job that isn't running, its result file is deleted once the transaction commits. The worker of a queued
+ * job finds it gone and exits without executing it.
+ */
+static void
+RemoveJob(int64 job_id) {
+	Datum values[Natts_duckdb_job];
+	bool nulls[Natts_duckdb_job];
+
+	ReadOwnJob(job_id, values, nulls);
+
+	auto status = TextDatumGetCString(values[Anum_duckdb_job_status - 1]);
+	if (strcmp(status, "running") == 0) {
+		ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+		                errmsg("DuckDB job " INT64_FORMAT " is still running", job_id),
+		                errhint("Its worker can be stopped with pg_terminate_backend(%d).",
+		                        DatumGetInt32(values[Anum_duckdb_job_worker_pid - 1]))));
+	}
+
+	ScanKeyData key;
+	Relation jobs_relation = table_open(JobsTableRelationId(), RowExclusiveLock);
+	SysScanDesc scan = BeginJobScan(jobs_relation, job_id, &key);
+	HeapTuple tuple = systable_getnext(scan);
+	if (HeapTupleIsValid(tuple)) {
+		CatalogTupleDelete(jobs_relation, &tuple->t_self);
+	}
+	systable_endscan(scan);
+	table_close(jobs_relation, NoLock);
+
+	removed_job_results.emplace_back(JobResultPath(job_id), GetCurrentSubTransactionId());
+}
+
+/* Reads a result file with DuckDB. The ERROR for a failed query is raised after its result was destroyed. */
+static duckdb::unique_ptr<duckdb::QueryResult>
+QueryJobResult(duckdb::Connection &connection, const char *path, const char *suffix) {
+	char *error = nullptr;
+	{
+		auto res = connection.context->Query(
+		    "SELECT * FROM read_parquet(" + duckdb::KeywordHelper::WriteQuoted(path, '\'') + ")" + suffix, false);
+		if (!res->HasError()) {
+			return res;
+		}
+		error = pstrdup(res->GetError().c_str());
+	}
+	elog(ERROR, "(DuckDB) %s", error);
+}
+
+/* Groups the types a result column can be converted to, 0 if the type only converts to itself */
+static char
+FetchTypeGroup(Oid type) {
+	switch (type) {
+	case INT2OID:
+	case INT4OID:
+	case INT8OID:
+		return 'i';
+	case FLOAT4OID:
+	case FLOAT8OID:
+		return 'f';
+	case BPCHAROID:
+	case TEXTOID:
+	case VARCHAROID:
+	case JSONOID:
+		return 's';
+	default:
+		return 0;
+	}
+}
+
+/* Adds the rows of a job's result to the tuplestore of duckdb.fetch() */
+static void
+StoreJobResult(ReturnSetInfo *rsinfo, duckdb::QueryResult &res, int64 job_id) {
+	TupleDesc tuple_desc = rsinfo->setDesc;
+	if (res.ColumnCount() != static_cast<idx_t>(tuple_desc->natts)) {
+		ereport(ERROR, (errcode(ERRCODE_DATATYPE_MISMATCH),
+		                errmsg("result of DuckDB job " INT64_FORMAT " has %lu columns, %d were requested", job_id,
+		                       res.ColumnCount(), tuple_desc->natts)));
+	}
+
+	for (int col = 0; col < tuple_desc->natts; col++) {
+		Oid requested_type = TupleDescAttr(tuple_desc, col)->atttypid;
+		Oid result_type = GetPostgresDuckDBType(res.types[col]);
+		if (requested_type != result_type &&
+		    (FetchTypeGroup(requested_type) == 0 || FetchTypeGroup(requested_type) != FetchTypeGroup(result_type))) {
+			ereport(ERROR,
+			        (errcode(ERRCODE_DATATYPE_MISMATCH),
+			         errmsg("column %d of the result of DuckDB job " INT64_FORMAT " has type %s, %s was requested",
+			                col + 1, job_id, format_type_be(result_type), format_type_be(requested_type))));
+		}
+	}
+
+	TupleTableSlot *slot = MakeSingleTupleTableSlot(tuple_desc, &TTSOpsVirtual);
+	for (auto chunk = res.Fetch(); chunk && chunk->size() > 0; chunk = res.Fetch()) {
+		for (idx_t row = 0; row < chunk->size(); row++) {
+			ExecClearTuple(slot);
+			for (idx_t col = 0; col < chunk->ColumnCount(); col++) {
+				auto value = chunk->GetValue(col, row);
+				if (value.IsNull()) {
+					slot->tts_isnull[col] = true;
+				} else {
+					slot->tts_isnull[col] = false;
+					ConvertDuckToPostgresValue(slot, value, col);
+				}
+			}
+			ExecStoreVirtualTuple(slot);
+			tuplestore_puttupleslot(rsinfo->setResult, slot);
+		}
+	}
+	ExecDropSingleTupleTableSlot(slot);
+}
+
+/* Appends the column definitions of a job's result, as duckdb.fetch() needs them, to column_definitions */
+static void
+AppendJobResultColumns(StringInfo column_definitions, duckdb::QueryResult &res) {
+	for (idx_t col = 0; col < res.ColumnCount(); col++) {
+		Oid type_oid = GetPostgresDuckDBType(res.types[col]);
+		appendStringInfo(column_definitions, "%s%s %s", col ? ", " : "", quote_identifier(res.names[col].c_str()),
+		                 format_type_be(type_oid));
+	}
+}
+
+/*
+ * Validates the query of duckdb.submit() and returns its text, without the trailing semicolon so that it can be
+ * wrapped in a COPY.
+ */
+static std::string
+SubmittedQueryText(const char *query) {
+	List *raw_parsetree_list = raw_parser(query, RAW_PARSE_DEFAULT);
+
+	RawStmt *raw_stmt = list_length(raw_parsetree_list) == 1 ? linitial_node(RawStmt, raw_parsetree_list) : nullptr;
+
+	if (!raw_stmt || !IsA(raw_stmt->stmt, SelectStmt) || ((SelectStmt *)raw_stmt->stmt)->intoClause) {
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+		                errmsg("duckdb.submit() only accepts a single SELECT query")));
+	}
+
+	std::string text(query + raw_stmt->stmt_location);
+	if (raw_stmt->stmt_len) {
+		text.resize(raw_stmt->stmt_len);
+	}
+	return text;
+}
+
+static int64
+SubmitJob(const char *query) {
+	auto query_text = SubmittedQueryText(query);
+	int64 job_id = nextval_internal(JobsSequenceRelationId(), false);
+
+	Datum values[Natts_duckdb_job] = {0};
+	bool nulls[Natts_duckdb_job] = {0};
+
+	values[Anum_duckdb_job_id - 1] = Int64GetDatum(job_id);
+	values[Anum_duckdb_job_owner - 1] = ObjectIdGetDatum(GetUserId());
+	values[Anum_duckdb_job_query - 1] = CStringGetTextDatum(query_text.c_str());
+	values[Anum_duckdb_job_status - 1] = CStringGetTextDatum("queued");
+	nulls[Anum_duckdb_job_error - 1] = true;
+	nulls[Anum_duckdb_job_row_count - 1] = true;
+	values[Anum_duckdb_job_submitted_at - 1] = TimestampTzGetDatum(GetCurrentTimestamp());
+	nulls[Anum_duckdb_job_started_at - 1] = true;
+	nulls[Anum_duckdb_job_finished_at - 1] = true;
+	nulls[Anum_duckdb_job_worker_pid - 1] = true;
+
+	Relation jobs_relation = table_open(JobsTableRelationId(), RowExclusiveLock);
+	HeapTuple new_tuple = heap_form_tuple(RelationGetDescr(jobs_relation), values, nulls);
+	CatalogTupleInsert(jobs_relation, new_tuple);
+	CommandCounterIncrement();
+	table_close(jobs_relation, NoLock);
+
+	/*
+	 * The worker is registered right away so that running out of worker slots fails the submission, it waits for
+	 * this transaction to end before looking the job up.
+	 */
+	BackgroundWorker worker;
+	DuckdbJobWorkerArgs args = {MyDatabaseId, GetTopTransactionId()};
+
+	memset(&worker, 0, sizeof(worker));
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+	worker.bgw_restart_time = BGW_NEVER_RESTART;
+	snprintf(worker.bgw_library_name, BGW_MAXLEN, "pg_duckdb");
+	snprintf(worker.bgw_function_name, BGW_MAXLEN, "DuckdbJobWorkerMain");
+	snprintf(worker.bgw_name, BGW_MAXLEN, "pg_duckdb job " INT64_FORMAT, job_id);
+	snprintf(worker.bgw_type, BGW_MAXLEN, "pg_duckdb job");
+	worker.bgw_main_arg = Int64GetDatum(job_id);
+	memcpy(worker.bgw_extra, &args, sizeof(args));
+
+	if (!RegisterDynamicBackgroundWorker(&worker, NULL)) {
+		ereport(ERROR, (errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+		                errmsg("could not register background worker for DuckDB job"),
+		                errhint("You may need to increase max_worker_processes.")));
+	}
+
+	return job_id;
+}
+
+/*
+ * Runs func, which converts a job's result while the DuckDB objects reading it are on the stack. A Postgres ERROR
+ * calls release before it is rethrown. A DuckDB exception, e.g. for a value that doesn't fit into the requested type,
+ * is turned into an ERROR after calling release, it must not escape the SQL function.
+ */
+template <typename Func, typename Release>
+static void
+ConvertJobResult(int64 job_id, const Func &func, const Release &release) {
+	char *error = nullptr;
+	try {
+		CleanupOnPostgresError(func, release);
+	} catch (std::exception &ex) {
+		error = pstrdup(ex.what());
+	}
+	if (error) {
+		release();
+		ereport(ERROR, (errcode(ERRCODE_DATATYPE_MISMATCH),
+		                errmsg("could not convert the result of DuckDB job " INT64_FORMAT ": %s", job_id, error)));
+	}
+}
+
+/* Context of the DuckDB query the job worker executes, see JobWorkerSigterm */
+static duckdb::ClientContext *volatile job_query_context = nullptr;
+
+/* Publishes the context of a job's query to the SIGTERM handler while it exists */
+struct JobQueryInterruptGuard {
+	explicit JobQueryInterruptGuard(duckdb::ClientContext &context) {
+		job_query_context = &context;
+	}
+	~JobQueryInterruptGuard() {
+		job_query_context = nullptr;
+	}
+};
+
+/* DuckDB doesn't check for Postgres interrupts, SIGTERM interrupts the query of the job in addition to die() */
+static void
+JobWorkerSigterm(SIGNAL_ARGS) {
+	duckdb::ClientContext *context = job_query_context;
+	if (context) {
+		context->Interrupt();
+	}
+	die(postgres_signal_arg);
+}
+
+/*
+ * Writes the result of the query to the job's Parquet file with DuckDB and returns the number of result rows. Errors
+ * of DuckDB are returned in error instead of raised, so that the DuckDB objects are destroyed before the ERROR.
+ */
+static int64
+CopyJobResult(int64 job_id, const std::string &query, List *rtable, List *vars, char *&error) {
+	try {
+		auto duckdb_connection = DuckdbCreateConnection(rtable, nullptr, vars, query.c_str());
+		auto copy_query = "COPY (" + query + ") TO " +
+		                  duckdb::KeywordHelper::WriteQuoted(JobResultPath(job_id), '\'') + " (FORMAT PARQUET)";
+		JobQueryInterruptGuard interrupt_guard(*duckdb_connection->context);
+		auto res = duckdb_connection->context->Query(copy_query, false);
+		if (res->HasError()) {
+			error = pstrdup(res->GetError().c_str());
+			return -1;
+		}
+		auto chunk = res->Fetch();
+		return chunk->GetValue(0, 0).GetValue<int64_t>();
+	} catch (std::exception &ex) {
+		error = pstrdup(ex.what());
+		return -1;
+	}
+}
+
+/*
+ * Executes the query of a job with the privileges of its owner and writes the result to the job's Parquet file.
+ * Returns the number of result rows.
+ */
+static int64
+RunJobQuery(int64 job_id, const std::string &query) {
+	RawStmt *raw_stmt = linitial_node(RawStmt, pg_parse_query(query.c_str()));
+	Query *parsed = linitial_node(Query, pg_analyze_and_rewrite_fixedparams(raw_stmt, query.c_str(), NULL, 0, NULL));
+
+	/* DuckDB scans the relations directly, check the permissions a Postgres plan of the query would check */
+	PlannedStmt *planned = standard_planner((Query *)copyObjectImpl(parsed), query.c_str(), 0, NULL);
+	ExecCheckPermissions(planned->rtable, planned->permInfos, true);
+	foreach_node(RangeTblEntry, rte, planned->rtable) {
+		if (rte->rtekind == RTE_RELATION && check_enable_rls(rte->relid, InvalidOid, false) == RLS_ENABLED) {
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			                errmsg("(DuckDB) RLS enabled on \"%s\"", get_rel_name(rte->relid))));
+		}
+	}
+
+	/* Extract required vars for table */
+	int flags = PVC_RECURSE_AGGREGATES | PVC_RECURSE_WINDOWFUNCS | PVC_RECURSE_PLACEHOLDERS;
+	List *vars = list_concat(pull_var_clause((Node *)parsed->targetList, flags),
+	                         pull_var_clause((Node *)parsed->jointree->quals, flags));
+
+	if (MakePGDirectory("duckdb_jobs") < 0 && errno != EEXIST) {
+		ereport(ERROR, (errcode_for_file_access(), errmsg("could not create directory \"duckdb_jobs\": %m")));
+	}
+
+	char *error = nullptr;
+	int64 row_count = CopyJobResult(job_id, query, parsed->rtable, vars, error);
+	if (error) {
+		elog(ERROR, "(DuckDB) %s", error);
+	}
+	return row_count;
+}
+
+} // namespace pgduckdb
+
+void
+DuckdbInitJobs(void) {
+	RegisterXactCallback(pgduckdb::JobsXactCallback, NULL);
+	RegisterSubXactCallback(pgduckdb::JobsSubXactCallback, NULL);
+}
+
+extern "C" {
+
+PGDLLEXPORT void DuckdbJobWorkerMain(Datum main_arg);
+
+/*
+ * Background worker executing one job submitted with duckdb.submit(). It connects to the database of the job as
+ * superuser and runs the query as the role that submitted it.
+ */
+void
+DuckdbJobWorkerMain(Datum main_arg) {
+	int64 job_id = DatumGetInt64(main_arg);
+	pgduckdb::DuckdbJobWorkerArgs args;
+	Datum values[Natts_duckdb_job];
+	bool nulls[Natts_duckdb_job];
+	Oid owner = InvalidOid;
+	std::string query;
+
+	memcpy(&args, MyBgworkerEntry->bgw_extra, sizeof(args));
+
+	pqsignal(SIGTERM, pgduckdb::JobWorkerSigterm);
+	BackgroundWorkerUnblockSignals();
+	BackgroundWorkerInitializeConnectionByOid(args.database, InvalidOid, 0);
+
+	StartTransactionCommand();
+	XactLockTableWait(args.xid, NULL, NULL, XLTW_None);
+	PushActiveSnapshot(GetTransactionSnapshot());
+	bool found = pgduckdb::ReadJob(job_id, values, nulls);
+	if (found) {
+		owner = DatumGetObjectId(values[Anum_duckdb_job_owner - 1]);
+		query = TextDatumGetCString(values[Anum_duckdb_job_query - 1]);
+		pgduckdb::UpdateJob(job_id, "running", nullptr, -1);
+	}
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+
+	/* The submitting transaction rolled back */
+	if (!found) {
+		proc_exit(0);
+	}
+
+	pgstat_report_activity(STATE_RUNNING, query.c_str());
+
+	PG_TRY();
+	{
+		StartTransactionCommand();
+		PushActiveSnapshot(GetTransactionSnapshot());
+		SetUserIdAndSecContext(owner, SECURITY_RESTRICTED_OPERATION);
+		int64 row_count = pgduckdb::RunJobQuery(job_id, query);
+		PopActiveSnapshot();
+		CommitTransactionCommand();
+
+		StartTransactionCommand();
+		PushActiveSnapshot(GetTransactionSnapshot());
+		pgduckdb::UpdateJob(job_id, "done", nullptr, row_count);
+		PopActiveSnapshot();
+		CommitTransactionCommand();
+	}
+	PG_CATCH();
+	{
+		/* A pending SIGTERM would exit before the failure is recorded */
+		HOLD_INTERRUPTS();
+		MemoryContextSwitchTo(TopMemoryContext);
+		ErrorData *edata = CopyErrorData();
+		FlushErrorState();
+		AbortCurrentTransaction();
+
+		StartTransactionCommand();
+		PushActiveSnapshot(GetTransactionSnapshot());
+		pgduckdb::UpdateJob(job_id, "failed", ProcDiePending ? "the job was terminated" : edata->message, -1);
+		PopActiveSnapshot();
+		CommitTransactionCommand();
+	}
+	PG_END_TRY();
+
+	pgstat_report_activity(STATE_IDLE, NULL);
+	proc_exit(0);
+}
+
+PG_FUNCTION_INFO_V1(duckdb_submit);
+Datum
+duckdb_submit(PG_FUNCTION_ARGS) {
+	char *query = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	PG_RETURN_INT64(pgduckdb::SubmitJob(query));
+}
+
+PG_FUNCTION_INFO_V1(duckdb_job_remove);
+Datum
+duckdb_job_remove(PG_FUNCTION_ARGS) {
+	pgduckdb::RemoveJob(PG_GETARG_INT64(0));
+	PG_RETURN_VOID();
+}
+
+PG_FUNCTION_INFO_V1(duckdb_job_status);
+Datum
+duckdb_job_status(PG_FUNCTION_ARGS) {
+	int64 job_id = PG_GETARG_INT64(0);
+	Datum values[Natts_duckdb_job];
+	bool nulls[Natts_duckdb_job];
+	TupleDesc tuple_desc;
+
+	if (get_call_result_type(fcinfo, NULL, &tuple_desc) != TYPEFUNC_COMPOSITE) {
+		elog(ERROR, "return type must be a row type");
+	}
+
+	pgduckdb::ReadOwnJob(job_id, values, nulls);
+
+	/* Everything from the status on */
+	int offset = Anum_duckdb_job_status - 1;
+	HeapTuple tuple = heap_form_tuple(BlessTupleDesc(tuple_desc), values + offset, nulls + offset);
+	PG_RETURN_DATUM(HeapTupleGetDatum(tuple));
+}
+
+PG_FUNCTION_INFO_V1(duckdb_job_fetch);
+Datum
+duckdb_job_fetch(PG_FUNCTION_ARGS) {
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *)fcinfo->resultinfo;
+	int64 job_id = PG_GETARG_INT64(0);
+
+	InitMaterializedSRF(fcinfo, 0);
+
+	char *path = pgduckdb::FinishedJobResultPath(job_id);
+	auto connection = duckdb::make_uniq<duckdb::Connection>(pgduckdb::DuckdbGetDatabase());
+	duckdb::unique_ptr<duckdb::QueryResult> res;
+	/* The connection would stay in the database of the backend if an ERROR skipped its destructor */
+	auto release_result = [&] {
+		res.reset();
+		connection.reset();
+	};
+	pgduckdb::ConvertJobResult(
+	    job_id,
+	    [&] {
+		    res = pgduckdb::QueryJobResult(*connection, path, "");
+		    pgduckdb::StoreJobResult(rsinfo, *res, job_id);
+	    },
+	    release_result);
+
+	return (Datum)0;
+}
+
+PG_FUNCTION_INFO_V1(duckdb_job_result_to_table);
+Datum
+duckdb_job_result_to_table(PG_FUNCTION_ARGS) {
+	int64 job_id = PG_GETARG_INT64(0);
+	RangeVar *relation =
+	    makeRangeVarFromNameList(stringToQualifiedNameList(text_to_cstring(PG_GETARG_TEXT_PP(1)), NULL));
+
+	/* Column definitions of the result for duckdb.fetch() */
+	StringInfo column_definitions = makeStringInfo();
+	char *path = pgduckdb::FinishedJobResultPath(job_id);
+	{
+		auto connection = duckdb::make_uniq<duckdb::Connection>(pgduckdb::DuckdbGetDatabase());
+		duckdb::unique_ptr<duckdb::QueryResult> res;
+		auto release_result = [&] {
+			res.reset();
+			connection.reset();
+		};
+		pgduckdb::ConvertJobResult(
+		    job_id,
+		    [&] {
+			    res = pgduckdb::QueryJobResult(*connection, path, " LIMIT 0");
+			    pgduckdb::AppendJobResultColumns(column_definitions, *res);
+		    },
+		    release_result);
+	}
+
+	StringInfo create_table = makeStringInfo();
+	appendStringInfo(create_table, "CREATE TABLE %s AS SELECT * FROM duckdb.fetch(" INT64_FORMAT ") AS t(%s)",
+	                 quote_qualified_identifier(relation->schemaname, relation->relname), job_id,
+	                 column_definitions->data);
+
+	SPI_connect();
+	if (SPI_execute(create_table->data, false, 0) < 0) {
+		elog(ERROR, "could not create table \"%s\" from DuckDB job " INT64_FORMAT, relation->relname, job_id);
+	}
+	uint64 row_count = SPI_processed;
+	SPI_finish();
+
+	PG_RETURN_INT64(row_count);
+}
+
+} // extern "C"
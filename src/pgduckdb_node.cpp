@@ -4,34 +4,84 @@
 extern "C" {
 #include "postgres.h"
 #include "miscadmin.h"
+#include "commands/explain.h"
+#include "executor/tuptable.h"
+#include "storage/latch.h"
+#include "utils/builtins.h"
+#include "utils/wait_event.h"
 }
 
 #include "pgduckdb/pgduckdb_node.hpp"
+#include "pgduckdb/pgduckdb_result_cache.hpp"
+#include "pgduckdb/pgduckdb_service.hpp"
+#include "pgduckdb/pgduckdb_stats.hpp"
 #include "pgduckdb/pgduckdb_types.hpp"
 
+#include <sys/resource.h>
+
 /* global variables */
 CustomScanMethods duckdb_scan_scan_methods;
 
 /* static variables */
 static CustomExecMethods duckdb_scan_exec_methods;
 
+/*
+ * DuckDB objects of a scan. They are allocated outside of the scan state, which lives in the memory of the executor:
+ * when a query fails, that memory is freed with its portal without Duckdb_EndCustomScan being called.
+ */
+struct DuckdbScanQuery {
+	duckdb::unique_ptr<duckdb::Connection> duckdb_connection;
+	duckdb::unique_ptr<duckdb::PreparedStatement> prepared_statement;
+	duckdb::unique_ptr<duckdb::QueryResult> query_results;
+	duckdb::unique_ptr<duckdb::DataChunk> current_data_chunk;
+	/* Result cache candidate collecting the rows of the query, see duckdb.result_cache */
+	duckdb::unique_ptr<pgduckdb::ResultCacheEntry> result_cache_entry;
+	/* Set instead of the connection and prepared statement if the result is served from the result cache */
+	duckdb::unique_ptr<pgduckdb::ResultCacheReader> cached_result;
+	/* Set instead of the connection and prepared statement if the shared service executes the query */
+	duckdb::unique_ptr<pgduckdb::SharedServiceQuery> service_query;
+	duckdb::unique_ptr<pgduckdb::SharedServiceRequest> service_request;
+};
+
 typedef struct DuckdbScanState {
 	CustomScanState css; /* must be first field */
-	duckdb::Connection *duckdb_connection;
-	duckdb::PreparedStatement *prepared_statement;
+	DuckdbScanQuery *query;
+	/* Releases the query when the memory of the executor is freed, e.g. because the query failed */
+	MemoryContextCallback query_release_callback;
 	bool is_executed;
 	bool fetch_next;
-	duckdb::unique_ptr<duckdb::QueryResult> query_results;
 	duckdb::idx_t column_count;
-	duckdb::unique_ptr<duckdb::DataChunk> current_data_chunk;
 	duckdb::idx_t current_row;
+	/* CPU usage of the whole process (backend and DuckDB threads) when execution started */
+	struct rusage execution_start_rusage;
 } DuckdbScanState;
 
+static double
+RusageCpuTimeMs(const struct rusage &usage) {
+	return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 +
+	       (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+}
+
+/*
+ * CPU time used since execution of the query started. DuckDB runs the query on its own threads, whose CPU time
+ * doesn't show up anywhere in Postgres, so it is measured for the whole process.
+ */
+static double
+ExecutionCpuTimeMs(DuckdbScanState *state) {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return RusageCpuTimeMs(usage) - RusageCpuTimeMs(state->execution_start_rusage);
+}
+
 static void
 CleanupDuckdbScanState(DuckdbScanState *state) {
-	state->query_results.reset();
-	delete state->prepared_statement;
-	delete state->duckdb_connection;
+	delete state->query;
+	state->query = nullptr;
+}
+
+static void
+ReleaseDuckdbScanQuery(void *arg) {
+	CleanupDuckdbScanState((DuckdbScanState *)arg);
 }
 
 /* static callbacks */
@@ -46,8 +96,17 @@ static Node *
 Duckdb_CreateCustomScanState(CustomScan *cscan) {
 	DuckdbScanState *duckdb_scan_state = (DuckdbScanState *)newNode(sizeof(DuckdbScanState), T_CustomScanState);
 	CustomScanState *custom_scan_state = &duckdb_scan_state->css;
-	duckdb_scan_state->duckdb_connection = (duckdb::Connection *)linitial(cscan->custom_private);
-	duckdb_scan_state->prepared_statement = (duckdb::PreparedStatement *)lsecond(cscan->custom_private);
+	auto query = new DuckdbScanQuery();
+	query->duckdb_connection.reset((duckdb::Connection *)linitial(cscan->custom_private));
+	query->prepared_statement.reset((duckdb::PreparedStatement *)lsecond(cscan->custom_private));
+	query->result_cache_entry.reset((pgduckdb::ResultCacheEntry *)lthird(cscan->custom_private));
+	query->cached_result.reset((pgduckdb::ResultCacheReader *)lfourth(cscan->custom_private));
+	query->service_query.reset((pgduckdb::SharedServiceQuery *)list_nth(cscan->custom_private, 4));
+	duckdb_scan_state->query = query;
+	/* The scan state is created in the memory context of the executor's query */
+	duckdb_scan_state->query_release_callback.func = ReleaseDuckdbScanQuery;
+	duckdb_scan_state->query_release_callback.arg = duckdb_scan_state;
+	MemoryContextRegisterResetCallback(CurrentMemoryContext, &duckdb_scan_state->query_release_callback);
 	duckdb_scan_state->is_executed = false;
 	duckdb_scan_state->fetch_next = true;
 	custom_scan_state->methods = &duckdb_scan_exec_methods;
@@ -61,38 +120,161 @@ Duckdb_BeginCustomScan(CustomScanState *cscanstate, EState *estate, int eflags)
 	HOLD_CANCEL_INTERRUPTS();
 }
 
+/*
+ * Starts the query and waits until DuckDB's scheduler threads executed it. The scheduler has no thread of the backend
+ * (see external_threads in DuckdbOpenDatabase), so the backend does none of the work and sleeps on its latch, which
+ * cancel requests and statement_timeout set. DuckDB has no callback for a finished query, so the latch wait also times
+ * out every millisecond to check for it. The result is materialized: fetching a streaming result would make the
+ * backend execute the remaining tasks.
+ *
+ * Returns the error of DuckDB, or nullptr. It isn't raised here, an ERROR would skip the destructor of the pending
+ * query.
+ */
+static char *
+WaitForQueryResult(DuckdbScanQuery &query, bool &cancelled) {
+	auto &connection = *query.duckdb_connection;
+
+	try {
+		duckdb::vector<duckdb::Value> parameters;
+		auto pending = query.prepared_statement->PendingQuery(parameters, false);
+		if (pending->HasError()) {
+			return pstrdup(pending->GetError().c_str());
+		}
+
+		auto &executor = duckdb::Executor::Get(*connection.context);
+		while (!executor.ExecutionIsFinished()) {
+			if (QueryCancelPending || ProcDiePending) {
+				// Send an interrupt
+				connection.Interrupt();
+				// Wait for all tasks to terminate
+				executor.CancelTasks();
+				cancelled = true;
+				return nullptr;
+			}
+			(void)WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH, 1L, PG_WAIT_EXTENSION);
+			ResetLatch(MyLatch);
+		}
+
+		/* All pipelines completed, this only collects the result */
+		duckdb::PendingExecutionResult execution_result;
+		do {
+			execution_result = pending->ExecuteTask();
+		} while (!duckdb::PendingQueryResult::IsResultReady(execution_result));
+		if (execution_result == duckdb::PendingExecutionResult::EXECUTION_ERROR) {
+			return pstrdup(pending->GetError().c_str());
+		}
+		query.query_results = pending->Execute();
+		if (query.query_results->HasError()) {
+			return pstrdup(query.query_results->GetError().c_str());
+		}
+	} catch (std::exception &ex) {
+		return pstrdup(ex.what());
+	}
+	return nullptr;
+}
+
+/*
+ * Sends the query to the shared DuckDB service and waits for the columns of its result, which must be the ones the
+ * plan was made for: the rows are returned as Postgres tuples of the types of the scan slot.
+ */
+static char *
+SendServiceQuery(DuckdbScanState *state, bool &cancelled) {
+	auto &query = *state->query;
+	query.service_request = duckdb::make_uniq<pgduckdb::SharedServiceRequest>();
+	query.service_request->Send(pgduckdb::SHARED_SERVICE_EXECUTE, *query.service_query,
+	                            state->css.ss.ps.state->es_snapshot);
+
+	duckdb::vector<Oid> types;
+	duckdb::vector<std::string> names;
+	char *error = query.service_request->ReceiveColumns(types, names, cancelled);
+	if (error || cancelled) {
+		return error;
+	}
+
+	TupleDesc tuple_desc = state->css.ss.ss_ScanTupleSlot->tts_tupleDescriptor;
+	if (types.size() != static_cast<size_t>(tuple_desc->natts)) {
+		return psprintf("the query returns %zu columns instead of %d", types.size(), tuple_desc->natts);
+	}
+	for (int col = 0; col < tuple_desc->natts; col++) {
+		if (types[col] != TupleDescAttr(tuple_desc, col)->atttypid) {
+			return psprintf("column %d of the query changed its type", col + 1);
+		}
+	}
+	return nullptr;
+}
+
+[[noreturn]] static void
+RaiseQueryCancelled(DuckdbScanState *state) {
+	// Release the query
+	CleanupDuckdbScanState(state);
+	// Process the interrupt on the Postgres side, which reports statement_timeout and cancel requests
+	RESUME_CANCEL_INTERRUPTS();
+	ProcessInterrupts();
+	elog(ERROR, "Query cancelled");
+}
+
 static void
 ExecuteQuery(DuckdbScanState *state) {
-	auto &prepared = *state->prepared_statement;
-	auto &query_results = state->query_results;
-	auto &connection = state->duckdb_connection;
-
-	auto pending = prepared.PendingQuery();
-	duckdb::PendingExecutionResult execution_result;
-	do {
-		execution_result = pending->ExecuteTask();
-		if (QueryCancelPending) {
-			// Send an interrupt
-			connection->Interrupt();
-			auto &executor = duckdb::Executor::Get(*connection->context);
-			// Wait for all tasks to terminate
-			executor.CancelTasks();
-
-			// Delete the scan state
-			CleanupDuckdbScanState(state);
-			// Process the interrupt on the Postgres side
-			ProcessInterrupts();
-			elog(ERROR, "Query cancelled");
-		}
-	} while (!duckdb::PendingQueryResult::IsResultReady(execution_result));
-	if (execution_result == duckdb::PendingExecutionResult::EXECUTION_ERROR) {
-		elog(ERROR, "Duckdb execute returned an error: %s", pending->GetError().c_str());
+	getrusage(RUSAGE_SELF, &state->execution_start_rusage);
+
+	bool cancelled = false;
+	char *error =
+	    state->query->service_query ? SendServiceQuery(state, cancelled) : WaitForQueryResult(*state->query, cancelled);
+	if (cancelled) {
+		RaiseQueryCancelled(state);
+	}
+	if (error) {
+		elog(ERROR, "Duckdb execute returned an error: %s", error);
+	}
+	if (state->query->query_results) {
+		state->column_count = state->query->query_results->ColumnCount();
 	}
-	query_results = pending->Execute();
-	state->column_count = query_results->ColumnCount();
 	state->is_executed = true;
 }
 
+/* Returns the next row of a query executed by the shared service in slot, an empty slot at the end */
+static TupleTableSlot *
+FetchServiceTuple(DuckdbScanState *state, TupleTableSlot *slot) {
+	bool cancelled = false;
+	char *error = nullptr;
+	MinimalTuple tuple = state->query->service_request->ReceiveTuple(cancelled, error);
+	if (cancelled) {
+		RaiseQueryCancelled(state);
+	}
+	if (error) {
+		elog(ERROR, "Duckdb execute returned an error: %s", error);
+	}
+
+	MemoryContextReset(state->css.ss.ps.ps_ExprContext->ecxt_per_tuple_memory);
+	ExecClearTuple(slot);
+	if (tuple) {
+		ExecForceStoreMinimalTuple(tuple, slot, false);
+	}
+	return slot;
+}
+
+/*
+ * Returns the next chunk of the result. Chunks returned by DuckDB are also collected for the result cache, which
+ * takes the result once it was returned completely.
+ */
+static duckdb::unique_ptr<duckdb::DataChunk>
+FetchNextChunk(DuckdbScanState *state) {
+	auto &query = *state->query;
+	if (query.cached_result) {
+		return query.cached_result->Fetch();
+	}
+
+	auto chunk = query.query_results->Fetch();
+	if (query.result_cache_entry) {
+		if (!chunk || chunk->size() == 0) {
+			pgduckdb::InsertResultCache(std::move(query.result_cache_entry));
+		} else if (!pgduckdb::CollectResultCacheRows(*query.result_cache_entry, *chunk)) {
+			query.result_cache_entry.reset();
+		}
+	}
+	return chunk;
+}
+
 static TupleTableSlot *
 Duckdb_ExecCustomScan(CustomScanState *node) {
 	DuckdbScanState *duckdb_scan_state = (DuckdbScanState *)node;
@@ -100,14 +282,25 @@ Duckdb_ExecCustomScan(CustomScanState *node) {
 	MemoryContext old_context;
 
 	if (!duckdb_scan_state->is_executed) {
-		ExecuteQuery(duckdb_scan_state);
+		if (duckdb_scan_state->query->cached_result) {
+			getrusage(RUSAGE_SELF, &duckdb_scan_state->execution_start_rusage);
+			duckdb_scan_state->column_count = duckdb_scan_state->query->cached_result->GetEntry().m_types.size();
+			duckdb_scan_state->is_executed = true;
+		} else {
+			ExecuteQuery(duckdb_scan_state);
+		}
+	}
+
+	if (duckdb_scan_state->query->service_request) {
+		return FetchServiceTuple(duckdb_scan_state, slot);
 	}
 
+	auto &current_data_chunk = duckdb_scan_state->query->current_data_chunk;
 	if (duckdb_scan_state->fetch_next) {
-		duckdb_scan_state->current_data_chunk = duckdb_scan_state->query_results->Fetch();
+		current_data_chunk = FetchNextChunk(duckdb_scan_state);
 		duckdb_scan_state->current_row = 0;
 		duckdb_scan_state->fetch_next = false;
-		if (!duckdb_scan_state->current_data_chunk || duckdb_scan_state->current_data_chunk->size() == 0) {
+		if (!current_data_chunk || current_data_chunk->size() == 0) {
 			MemoryContextReset(duckdb_scan_state->css.ss.ps.ps_ExprContext->ecxt_per_tuple_memory);
 			ExecClearTuple(slot);
 			return slot;
@@ -122,7 +315,7 @@ Duckdb_ExecCustomScan(CustomScanState *node) {
 
 	for (idx_t col = 0; col < duckdb_scan_state->column_count; col++) {
 		// FIXME: we should not use the Value API here, it's complicating the LIST conversion logic
-		auto value = duckdb_scan_state->current_data_chunk->GetValue(col, duckdb_scan_state->current_row);
+		auto value = current_data_chunk->GetValue(col, duckdb_scan_state->current_row);
 		if (value.IsNull()) {
 			slot->tts_isnull[col] = true;
 		} else {
@@ -134,8 +327,8 @@ Duckdb_ExecCustomScan(CustomScanState *node) {
 	MemoryContextSwitchTo(old_context);
 
 	duckdb_scan_state->current_row++;
-	if (duckdb_scan_state->current_row >= duckdb_scan_state->current_data_chunk->size()) {
-		delete duckdb_scan_state->current_data_chunk.release();
+	if (duckdb_scan_state->current_row >= current_data_chunk->size()) {
+		current_data_chunk.reset();
 		duckdb_scan_state->fetch_next = true;
 	}
 
@@ -146,6 +339,11 @@ Duckdb_ExecCustomScan(CustomScanState *node) {
 void
 Duckdb_EndCustomScan(CustomScanState *node) {
 	DuckdbScanState *duckdb_scan_state = (DuckdbScanState *)node;
+	if (duckdb_scan_state->is_executed) {
+		pgduckdb::ScanStats stats;
+		stats.Count(pgduckdb::SCAN_STAT_CPU_TIME, ExecutionCpuTimeMs(duckdb_scan_state) * 1000);
+		pgduckdb::FlushScanStats(stats);
+	}
 	CleanupDuckdbScanState(duckdb_scan_state);
 	RESUME_CANCEL_INTERRUPTS();
 }
@@ -154,10 +352,53 @@ void
 Duckdb_ReScanCustomScan(CustomScanState *node) {
 }
 
+/* The query is the EXPLAIN statement, the service returns its output like for any other query */
+static void
+ExplainServiceQuery(DuckdbScanState *state, ExplainState *es) {
+	bool cancelled = false;
+	char *error = SendServiceQuery(state, cancelled);
+	MinimalTuple tuple = nullptr;
+	if (!error && !cancelled) {
+		tuple = state->query->service_request->ReceiveTuple(cancelled, error);
+	}
+	if (cancelled) {
+		RaiseQueryCancelled(state);
+	}
+	if (error) {
+		elog(ERROR, "Duckdb execute returned an error: %s", error);
+	}
+	if (!tuple) {
+		return;
+	}
+
+	TupleTableSlot *slot = state->css.ss.ss_ScanTupleSlot;
+	ExecForceStoreMinimalTuple(tuple, slot, false);
+	bool isnull;
+	Datum plan = slot_getattr(slot, 2, &isnull);
+	if (isnull) {
+		return;
+	}
+	std::string explain_output = "\n\n";
+	explain_output += TextDatumGetCString(plan);
+	explain_output += "\n";
+	ExplainPropertyText("DuckDB Execution Plan", explain_output.c_str(), es);
+}
+
 void
 Duckdb_ExplainCustomScan(CustomScanState *node, List *ancestors, ExplainState *es) {
 	DuckdbScanState *duckdb_scan_state = (DuckdbScanState *)node;
-	auto res = duckdb_scan_state->prepared_statement->Execute();
+	if (es->analyze && duckdb_scan_state->is_executed) {
+		ExplainPropertyFloat("DuckDB CPU Time", "ms", ExecutionCpuTimeMs(duckdb_scan_state), 3, es);
+	}
+	if (duckdb_scan_state->query->cached_result) {
+		ExplainPropertyText("DuckDB Execution Plan", "Result Cache Hit", es);
+		return;
+	}
+	if (duckdb_scan_state->query->service_query) {
+		ExplainServiceQuery(duckdb_scan_state, es);
+		return;
+	}
+	auto res = duckdb_scan_state->query->prepared_statement->Execute();
 	std::string explain_output = "\n\n";
 	auto chunk = res->Fetch();
 	if (!chunk || chunk->size() == 0) {
@@ -194,4 +435,5 @@ DuckdbInitNode() {
 	duckdb_scan_exec_methods.ShutdownCustomScan = NULL;
 
 	duckdb_scan_exec_methods.ExplainCustomScan = Duckdb_ExplainCustomScan;
+
 }
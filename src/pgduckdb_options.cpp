@@ -107,8 +107,7 @@ ReadDuckdbExtensions() {
 
 static bool
 DuckdbInstallExtension(Datum name) {
-	auto db = DuckdbOpenDatabase();
-	auto connection = duckdb::make_uniq<duckdb::Connection>(*db);
+	auto connection = duckdb::make_uniq<duckdb::Connection>(DuckdbGetDatabase());
 	auto &context = *connection->context;
 
 	auto extension_name = DatumToString(name);
@@ -2,21 +2,34 @@
 
 extern "C" {
 #include "postgres.h"
+#include "access/sysattr.h"
 #include "catalog/pg_type.h"
 #include "nodes/makefuncs.h"
 #include "optimizer/optimizer.h"
+#include "optimizer/pathnode.h"
+#include "optimizer/planner.h"
+#include "parser/parsetree.h"
+#include "utils/ruleutils.h"
+#include "utils/snapmgr.h"
 #include "utils/syscache.h"
 }
 
 #include "pgduckdb/pgduckdb_duckdb.hpp"
+#include "pgduckdb/pgduckdb_guard.hpp"
 #include "pgduckdb/scan/postgres_scan.hpp"
 #include "pgduckdb/pgduckdb_node.hpp"
 #include "pgduckdb/pgduckdb_planner.hpp"
+#include "pgduckdb/pgduckdb_result_cache.hpp"
+#include "pgduckdb/pgduckdb_service.hpp"
 #include "pgduckdb/pgduckdb_types.hpp"
 #include "pgduckdb/pgduckdb_utils.hpp"
+#include "pgduckdb/pgduckdb_stats.hpp"
+#include "pgduckdb/pgduckdb_timing.hpp"
+#include "pgduckdb/vendor/pg_list.hpp"
 
 static PlannerInfo *
 PlanQuery(Query *parse, ParamListInfo bound_params) {
+	pgduckdb::SetupTimer timer(pgduckdb::SetupPhase::PLAN_QUERY);
 
 	PlannerGlobal *glob = makeNode(PlannerGlobal);
 
@@ -41,34 +54,127 @@ PlanQuery(Query *parse, ParamListInfo bound_params) {
 	return subquery_planner(glob, parse, NULL, false, 0.0);
 }
 
-static Plan *
-CreatePlan(Query *query, const char *query_string, ParamListInfo bound_params) {
+/*
+ * Postgres answers min() / max() aggregates over B-tree indexed columns, optionally filtered by equality quals on the
+ * leading index columns, with a single index probe per aggregate (see planagg.c). DuckDB would read and aggregate the
+ * whole table instead, so such queries are left to Postgres.
+ */
+static bool
+IsIndexMinMaxQuery(PlannerInfo *root) {
+	if (!root->minmax_aggs) {
+		return false;
+	}
 
-	List *rtables = query->rtable;
+	RelOptInfo *grouped_rel = fetch_upper_rel(root, UPPERREL_GROUP_AGG, NULL);
+	return grouped_rel->cheapest_total_path && IsA(grouped_rel->cheapest_total_path, MinMaxAggPath);
+}
 
-	/* Extract required vars for table */
-	int flags = PVC_RECURSE_AGGREGATES | PVC_RECURSE_WINDOWFUNCS | PVC_RECURSE_PLACEHOLDERS;
-	List *vars = list_concat(pull_var_clause((Node *)query->targetList, flags),
-	                         pull_var_clause((Node *)query->jointree->quals, flags));
+/*
+ * Returns true if the query reads a column of a Postgres table whose type DuckDB can't read, e.g. jsonb or tsvector.
+ * DuckDB can't bind expressions on such columns.
+ */
+static bool
+ReferencesUnsupportedType(List *rtables, List *vars) {
+	foreach_node(Var, var, vars) {
+		RangeTblEntry *rte = rt_fetch(var->varno, rtables);
+		if (rte->rtekind == RTE_RELATION && var->varattno > 0 && !pgduckdb::IsSupportedPostgresType(var->vartype)) {
+			return true;
+		}
+	}
+	return false;
+}
 
-	PlannerInfo *query_planner_info = PlanQuery(query, bound_params);
-	auto duckdb_connection = pgduckdb::DuckdbCreateConnection(rtables, query_planner_info, vars, query_string);
-	auto context = duckdb_connection->context;
+/*
+ * Predicates like `doc @> '{...}'` or `tsv @@ query` on jsonb and tsvector columns are evaluated by Postgres: returns
+ * a copy of query without the WHERE conjuncts that reference unsupported columns, appending the range table index of
+ * the table each removed conjunct restricts to postgres_qual_varnos. The bitmap heap scan of that table evaluates them
+ * instead, see GetPostgresQuals. Returns nullptr if a conjunct can't be left to the scan of a single table.
+ */
+static Query *
+RemovePostgresQuals(Query *query, int flags, List **postgres_qual_varnos) {
+	/* The scan of a table is looked up by its OID, so it has to be read once and not by a subquery */
+	if (query->hasSubLinks || query->cteList || query->setOperations) {
+		return nullptr;
+	}
+	foreach_node(RangeTblEntry, rte, query->rtable) {
+		if (rte->rtekind != RTE_RELATION && rte->rtekind != RTE_JOIN) {
+			return nullptr;
+		}
+	}
 
-	auto prepared_query = context->Prepare(query_string);
+	Query *duckdb_query = (Query *)copyObjectImpl(query);
+	List *duckdb_quals = NIL;
+	foreach_ptr(Expr, qual, make_ands_implicit((Expr *)duckdb_query->jointree->quals)) {
+		List *qual_vars = pull_var_clause((Node *)qual, flags);
+		if (!ReferencesUnsupportedType(query->rtable, qual_vars)) {
+			duckdb_quals = lappend(duckdb_quals, qual);
+			continue;
+		}
 
-	if (prepared_query->HasError()) {
-		elog(WARNING, "(DuckDB) %s", prepared_query->GetError().c_str());
-		return nullptr;
+		if (contain_volatile_functions((Node *)qual)) {
+			return nullptr;
+		}
+		int varno = 0;
+		foreach_node(Var, var, qual_vars) {
+			if (varno && var->varno != varno) {
+				return nullptr;
+			}
+			varno = var->varno;
+		}
+		RangeTblEntry *qual_rte = rt_fetch(varno, query->rtable);
+		foreach_node(RangeTblEntry, rte, query->rtable) {
+			if (rte != qual_rte && rte->rtekind == RTE_RELATION && rte->relid == qual_rte->relid) {
+				return nullptr;
+			}
+		}
+		*postgres_qual_varnos = lappend_int(*postgres_qual_varnos, varno);
 	}
 
-	CustomScan *duckdb_node = makeNode(CustomScan);
+	duckdb_query->jointree->quals = duckdb_quals ? (Node *)make_ands_explicit(duckdb_quals) : nullptr;
+	return duckdb_query;
+}
 
-	auto &prepared_result_types = prepared_query->GetTypes();
+/*
+ * Returns true if every table restricted by conjuncts RemovePostgresQuals left to Postgres is read by a bitmap heap
+ * scan, the only scan that evaluates them, and all of those conjuncts ended up as restrictions of its table.
+ */
+static bool
+CanScanPostgresQuals(PlannerInfo *root, List *vars, List *postgres_qual_varnos) {
+	foreach_int(varno, postgres_qual_varnos) {
+		RelOptInfo *rel = varno < root->simple_rel_array_size ? root->simple_rel_array[varno] : nullptr;
+		if (!rel || rel->reloptkind != RELOPT_BASEREL) {
+			return false;
+		}
 
-	for (auto i = 0; i < prepared_result_types.size(); i++) {
-		auto &column = prepared_result_types[i];
-		Oid postgresColumnOid = pgduckdb::GetPostgresDuckDBType(column);
+		Path *path = get_cheapest_fractional_path(rel, 0.0);
+		if (!path || path->pathtype != T_BitmapHeapScan) {
+			return false;
+		}
+
+		int qual_count = 0;
+		foreach_int(other_varno, postgres_qual_varnos) {
+			qual_count += other_varno == varno;
+		}
+		if (list_length(pgduckdb::GetPostgresQuals(rel)) != qual_count) {
+			return false;
+		}
+
+		/* Only the seq scan exposes the ctid */
+		foreach_node(Var, var, vars) {
+			if (var->varno == varno && var->varattno == SelfItemPointerAttributeNumber) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static CustomScan *
+CreateDuckdbScanNode(const duckdb::vector<Oid> &types, const duckdb::vector<std::string> &names) {
+	CustomScan *duckdb_node = makeNode(CustomScan);
+
+	for (auto i = 0; i < types.size(); i++) {
+		Oid postgresColumnOid = types[i];
 
 		HeapTuple tp;
 		Form_pg_type typtup;
@@ -81,15 +187,171 @@ CreatePlan(Query *query, const char *query_string, ParamListInfo bound_params) {
 
 		Var *var = makeVar(INDEX_VAR, i + 1, postgresColumnOid, typtup->typtypmod, typtup->typcollation, 0);
 
-		duckdb_node->custom_scan_tlist =
-		    lappend(duckdb_node->custom_scan_tlist,
-		            makeTargetEntry((Expr *)var, i + 1, (char *)prepared_query->GetNames()[i].c_str(), false));
+		duckdb_node->custom_scan_tlist = lappend(duckdb_node->custom_scan_tlist,
+		                                         makeTargetEntry((Expr *)var, i + 1, pstrdup(names[i].c_str()), false));
 
 		ReleaseSysCache(tp);
 	}
 
-	duckdb_node->custom_private = list_make2(duckdb_connection.release(), prepared_query.release());
 	duckdb_node->methods = &duckdb_scan_scan_methods;
+	return duckdb_node;
+}
+
+static CustomScan *
+CreateDuckdbScanNode(const duckdb::vector<duckdb::LogicalType> &types, const duckdb::vector<std::string> &names) {
+	duckdb::vector<Oid> postgres_types;
+	for (auto &type : types) {
+		postgres_types.push_back(pgduckdb::GetPostgresDuckDBType(type));
+	}
+	return CreateDuckdbScanNode(postgres_types, names);
+}
+
+/*
+ * Plans a query executed by the shared DuckDB service, see duckdb.shared_service. The service prepares the query to
+ * return the columns of its result, the backend doesn't open a DuckDB database.
+ */
+static Plan *
+CreateSharedServicePlan(List *rtables, List *vars, const char *query_string) {
+	auto service_query = duckdb::make_uniq<pgduckdb::SharedServiceQuery>(rtables, vars, query_string);
+	auto request = duckdb::make_uniq<pgduckdb::SharedServiceRequest>();
+	duckdb::vector<Oid> types;
+	duckdb::vector<std::string> names;
+	bool cancelled = false;
+	char *error = nullptr;
+
+	/* An ERROR would skip the destructor of the request, which cancels it */
+	auto release_request = [&] {
+		request.reset();
+		service_query.reset();
+	};
+	pgduckdb::CleanupOnPostgresError(
+	    [&] {
+		    request->Send(pgduckdb::SHARED_SERVICE_DESCRIBE, *service_query, GetActiveSnapshot());
+		    error = request->ReceiveColumns(types, names, cancelled);
+	    },
+	    release_request);
+	request.reset();
+
+	if (cancelled) {
+		service_query.reset();
+		CHECK_FOR_INTERRUPTS();
+		elog(ERROR, "Query cancelled");
+	}
+	if (error) {
+		elog(WARNING, "(DuckDB) %s", error);
+		pgduckdb::CountFallback(pgduckdb::FALLBACK_DUCKDB_ERROR);
+		return nullptr;
+	}
+
+	pgduckdb::CountDuckdbQuery();
+
+	CustomScan *duckdb_node = nullptr;
+	pgduckdb::CleanupOnPostgresError([&] { duckdb_node = CreateDuckdbScanNode(types, names); }, release_request);
+	duckdb_node->custom_private = list_make5(nullptr, nullptr, nullptr, nullptr, service_query.release());
+
+	return (Plan *)duckdb_node;
+}
+
+static Plan *
+CreatePlan(Query *query, const char *query_string, ParamListInfo bound_params) {
+	pgduckdb::SetupTimer total_timer(pgduckdb::SetupPhase::TOTAL);
+
+	/* Results served from the result cache are returned without planning or executing the query */
+	auto result_cache_entry = pgduckdb::CreateResultCacheEntry(query, query_string);
+	if (result_cache_entry) {
+		auto cached_result = pgduckdb::LookupResultCache(*result_cache_entry);
+		if (cached_result) {
+			pgduckdb::CountDuckdbQuery();
+			CustomScan *duckdb_node = CreateDuckdbScanNode(cached_result->m_types, cached_result->m_names);
+			auto reader = new pgduckdb::ResultCacheReader(std::move(cached_result));
+			duckdb_node->custom_private = list_make5(nullptr, nullptr, nullptr, reader, nullptr);
+			return (Plan *)duckdb_node;
+		}
+		if (!result_cache_entry->m_storable) {
+			result_cache_entry.reset();
+		}
+	}
+
+	List *rtables = query->rtable;
+
+	/* Extract required vars for table */
+	int flags = PVC_RECURSE_AGGREGATES | PVC_RECURSE_WINDOWFUNCS | PVC_RECURSE_PLACEHOLDERS;
+	List *vars = list_concat(pull_var_clause((Node *)query->targetList, flags),
+	                         pull_var_clause((Node *)query->jointree->quals, flags));
+
+	/* DuckDB executes the query text, or the deparsed query if conjuncts are left to Postgres */
+	const char *duckdb_query_string = query_string;
+	List *postgres_qual_varnos = NIL;
+	if (ReferencesUnsupportedType(rtables, vars)) {
+		Query *duckdb_query = nullptr;
+		if (!ReferencesUnsupportedType(rtables, pull_var_clause((Node *)query->targetList, flags))) {
+			duckdb_query = RemovePostgresQuals(query, flags, &postgres_qual_varnos);
+		}
+		if (!duckdb_query) {
+			pgduckdb::CountFallback(pgduckdb::FALLBACK_UNSUPPORTED_TYPE);
+			return nullptr;
+		}
+		duckdb_query_string = pg_get_querydef(duckdb_query, false);
+	}
+
+	/* Plan a copy, the planner modifies the query and Postgres has to plan the original one if we fall back */
+	PlannerInfo *query_planner_info = PlanQuery((Query *)copyObjectImpl(query), bound_params);
+	if (IsIndexMinMaxQuery(query_planner_info)) {
+		pgduckdb::CountFallback(pgduckdb::FALLBACK_INDEX_MINMAX);
+		return nullptr;
+	}
+
+	if (!CanScanPostgresQuals(query_planner_info, vars, postgres_qual_varnos)) {
+		pgduckdb::CountFallback(pgduckdb::FALLBACK_UNSUPPORTED_TYPE);
+		return nullptr;
+	}
+
+	/* The shared service scans the relations sequentially, and results it returns aren't cached */
+	if (!result_cache_entry && !postgres_qual_varnos && pgduckdb::UseSharedService(query)) {
+		return CreateSharedServicePlan(rtables, vars, query_string);
+	}
+
+	auto duckdb_connection = pgduckdb::DuckdbCreateConnection(rtables, query_planner_info, vars, query_string);
+	auto context = duckdb_connection->context;
+
+	instr_time prepare_start;
+	INSTR_TIME_SET_CURRENT(prepare_start);
+	auto prepared_query = context->Prepare(duckdb_query_string);
+	pgduckdb::AccumulateSetupTime(pgduckdb::SetupPhase::PREPARE, prepare_start);
+
+	/* The deparsed query may use syntax DuckDB doesn't know, Postgres then executes the whole query */
+	if (prepared_query->HasError() && postgres_qual_varnos) {
+		pgduckdb::CountFallback(pgduckdb::FALLBACK_UNSUPPORTED_TYPE);
+		return nullptr;
+	}
+
+	if (prepared_query->HasError()) {
+		elog(WARNING, "(DuckDB) %s", prepared_query->GetError().c_str());
+		pgduckdb::CountFallback(pgduckdb::FALLBACK_DUCKDB_ERROR);
+		return nullptr;
+	}
+
+	pgduckdb::CountDuckdbQuery();
+
+	if (result_cache_entry) {
+		result_cache_entry->m_names = prepared_query->GetNames();
+		result_cache_entry->m_types = prepared_query->GetTypes();
+		result_cache_entry->m_rows = duckdb::make_uniq<duckdb::ColumnDataCollection>(
+		    duckdb::Allocator::DefaultAllocator(), result_cache_entry->m_types);
+	}
+
+	/* An ERROR, e.g. for a result type Postgres doesn't support, would skip the destructors of the connection */
+	CustomScan *duckdb_node = nullptr;
+	auto release_query = [&] {
+		result_cache_entry.reset();
+		prepared_query.reset();
+		duckdb_connection.reset();
+	};
+	pgduckdb::CleanupOnPostgresError(
+	    [&] { duckdb_node = CreateDuckdbScanNode(prepared_query->GetTypes(), prepared_query->GetNames()); },
+	    release_query);
+	duckdb_node->custom_private = list_make5(duckdb_connection.release(), prepared_query.release(),
+	                                         result_cache_entry.release(), nullptr, nullptr);
 
 	return (Plan *)duckdb_node;
 }
@@ -0,0 +1,507 @@
+#include "duckdb.hpp"
+
+extern "C" {
+#include "postgres.h"
+#include "miscadmin.h"
+#include "access/xact.h"
+#include "catalog/namespace.h"
+#include "catalog/partition.h"
+#include "catalog/pg_class.h"
+#include "catalog/pg_proc.h"
+#include "catalog/pg_type.h"
+#include "common/hashfn.h"
+#include "executor/executor.h"
+#include "nodes/nodeFuncs.h"
+#include "parser/parsetree.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/inval.h"
+#include "utils/lsyscache.h"
+#include "utils/snapmgr.h"
+#include "utils/syscache.h"
+}
+
+#include "pgduckdb/pgduckdb.h"
+#include "pgduckdb/pgduckdb_result_cache.hpp"
+#include "pgduckdb/pgduckdb_stats.hpp"
+#include "pgduckdb/vendor/pg_list.hpp"
+
+#include <algorithm>
+#include <list>
+
+#include <glob.h>
+#include <sys/stat.h>
+
+/*
+ * Result cache, see duckdb.result_cache. Every backend keeps the results of the cacheable DuckDB queries it executed,
+ * most recently used first, up to duckdb.result_cache_size. Results are not shared with other backends, and queries
+ * with parameters aren't cached as their key would have to include the parameter values.
+ *
+ * A cached result stays valid as long as no transaction that wrote to one of the relations it read committed since.
+ * To tell, every relation is mapped to a pair of write counters in shared memory. A transaction that wrote to the
+ * relation increments the started counter before it commits and the finished counter once it committed (or failed
+ * to). Several relations can share a pair of counters, which only causes spurious misses.
+ *
+ * When the result is computed, the finished counters are read before the started ones. If they are equal, every
+ * write transaction counted by them committed before the counters were read. If in addition no transaction
+ * completed since the snapshot of the query was taken, exactly those transactions are visible to the query, and the
+ * counters are stored with the result. A later query may reuse the result if the started counters still have the
+ * same value: its snapshot then sees the same committed writes.
+ *
+ * Writes of the current transaction are not counted yet, so transactions that already wrote something don't use the
+ * cache, nor do transactions whose snapshot may predate cached results. Schema changes drop the cached results of
+ * the affected relations through relcache invalidations. Local files read with read_parquet() and read_csv() are
+ * checked for changes of their modification time and size. Remote files aren't checked at all, not even their ETag,
+ * so results that read them are returned until they expire after duckdb.result_cache_ttl.
+ */
+
+namespace pgduckdb {
+
+/* Number of write counter pairs */
+#define RESULT_CACHE_SLOTS 8192
+
+struct ResultCacheWriteCounters {
+	pg_atomic_uint64 started;
+	pg_atomic_uint64 finished;
+};
+
+static ResultCacheWriteCounters *write_counters = nullptr;
+
+/* Slots written by the current transaction and whether their started counters were incremented */
+static duckdb::vector<uint32> written_slots;
+static bool written_slots_started = false;
+
+typedef std::list<duckdb::shared_ptr<ResultCacheEntry>> CachedResultList;
+
+static CachedResultList cached_results;
+static duckdb::unordered_map<std::string, CachedResultList::iterator> cached_result_index;
+static duckdb::idx_t cached_results_size = 0;
+
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static ExecutorStart_hook_type prev_executor_start_hook = NULL;
+
+static duckdb::idx_t
+ResultCacheSizeLimit() {
+	return (duckdb::idx_t)duckdb_result_cache_size * 1024;
+}
+
+static uint32
+WriteCounterSlot(Oid relid) {
+	return hash_combine(hash_uint32(MyDatabaseId), hash_uint32(relid)) % RESULT_CACHE_SLOTS;
+}
+
+/* Writes to a partition are routed through its ancestors or read through them, so they share the fate of both */
+static void
+AddRelationWithAncestors(Oid relid, duckdb::vector<Oid> &relids) {
+	relids.push_back(relid);
+	if (get_rel_relispartition(relid)) {
+		foreach_oid(ancestor, get_partition_ancestors(relid)) {
+			relids.push_back(ancestor);
+		}
+	}
+}
+
+// Cached results
+
+static duckdb::idx_t
+CachedResultSize(const ResultCacheEntry &entry) {
+	return entry.m_key.size() + entry.m_rows->SizeInBytes();
+}
+
+static void
+RemoveCachedResult(CachedResultList::iterator it) {
+	cached_results_size -= CachedResultSize(**it);
+	cached_result_index.erase((*it)->m_key);
+	cached_results.erase(it);
+}
+
+static void
+RemoveAllCachedResults() {
+	cached_results.clear();
+	cached_result_index.clear();
+	cached_results_size = 0;
+}
+
+static void
+ResultCacheRelcacheCallback(Datum arg, Oid relid) {
+	if (relid == InvalidOid) {
+		RemoveAllCachedResults();
+		return;
+	}
+	for (auto it = cached_results.begin(); it != cached_results.end();) {
+		auto &relids = (*it)->m_relids;
+		auto current = it++;
+		if (std::find(relids.begin(), relids.end(), relid) != relids.end()) {
+			RemoveCachedResult(current);
+		}
+	}
+}
+
+/* Functions may be redefined and new relations may shadow the ones a query read through search_path */
+static void
+ResultCacheSyscacheCallback(Datum arg, int cache_id, uint32 hash_value) {
+	RemoveAllCachedResults();
+}
+
+// Write tracking
+
+static void
+TrackWrite(Oid relid) {
+	if (!write_counters || relid == InvalidOid) {
+		return;
+	}
+	duckdb::vector<Oid> relids;
+	AddRelationWithAncestors(relid, relids);
+	for (auto written_relid : relids) {
+		auto slot = WriteCounterSlot(written_relid);
+		if (std::find(written_slots.begin(), written_slots.end(), slot) == written_slots.end()) {
+			written_slots.push_back(slot);
+		}
+	}
+}
+
+static void
+ResultCacheExecutorStart(QueryDesc *query_desc, int eflags) {
+	if (!(eflags & EXEC_FLAG_EXPLAIN_ONLY)) {
+		auto pstmt = query_desc->plannedstmt;
+		foreach_int(rti, pstmt->resultRelations) {
+			TrackWrite(rt_fetch(rti, pstmt->rtable)->relid);
+		}
+	}
+
+	if (prev_executor_start_hook) {
+		prev_executor_start_hook(query_desc, eflags);
+	} else {
+		standard_ExecutorStart(query_desc, eflags);
+	}
+}
+
+static void
+ResultCacheXactCallback(XactEvent event, void *arg) {
+	switch (event) {
+	case XACT_EVENT_PRE_COMMIT:
+	case XACT_EVENT_PRE_PREPARE:
+		for (auto slot : written_slots) {
+			pg_atomic_fetch_add_u64(&write_counters[slot].started, 1);
+		}
+		written_slots_started = true;
+		/*
+		 * The prepared transaction commits in another backend, which doesn't know the slots it wrote. Their
+		 * finished counters are never incremented, so the relations are not cached anymore.
+		 */
+		if (event == XACT_EVENT_PRE_PREPARE) {
+			written_slots.clear();
+			written_slots_started = false;
+		}
+		break;
+	case XACT_EVENT_COMMIT:
+	case XACT_EVENT_ABORT:
+		if (written_slots_started) {
+			for (auto slot : written_slots) {
+				pg_atomic_fetch_add_u64(&write_counters[slot].finished, 1);
+			}
+		}
+		written_slots.clear();
+		written_slots_started = false;
+		break;
+	default:
+		break;
+	}
+}
+
+// Cacheable queries
+
+static bool
+IsFileReaderFunction(Oid func_id) {
+	auto name = get_func_name(func_id);
+	return name && (strcmp(name, "read_parquet") == 0 || strcmp(name, "read_csv") == 0 ||
+	                strcmp(name, "iceberg_scan") == 0);
+}
+
+static bool
+IsMutableFunction(Oid func_id, void *context) {
+	return func_volatile(func_id) != PROVOLATILE_IMMUTABLE && !IsFileReaderFunction(func_id);
+}
+
+/* Records the files read by a file reader function, returns false if changes to them can't be detected */
+static bool
+AddFileReaderFiles(FuncExpr *func, ResultCacheEntry &entry) {
+	if (list_length(func->args) != 1 || !IsA(linitial(func->args), Const)) {
+		return false;
+	}
+	auto path_arg = (Const *)linitial(func->args);
+	if (path_arg->constisnull) {
+		return false;
+	}
+
+	duckdb::vector<std::string> paths;
+	if (path_arg->consttype == TEXTARRAYOID) {
+		Datum *elements;
+		bool *nulls;
+		int count;
+		deconstruct_array_builtin(DatumGetArrayTypeP(path_arg->constvalue), TEXTOID, &elements, &nulls, &count);
+		for (int i = 0; i < count; i++) {
+			if (nulls[i]) {
+				return false;
+			}
+			paths.push_back(TextDatumGetCString(elements[i]));
+		}
+	} else {
+		paths.push_back(TextDatumGetCString(path_arg->constvalue));
+	}
+
+	/* Iceberg tables are directories of metadata and data files, so they are treated like remote files */
+	bool is_iceberg = strcmp(get_func_name(func->funcid), "iceberg_scan") == 0;
+	for (auto &path : paths) {
+		if (is_iceberg || path.find("://") != std::string::npos) {
+			if (duckdb_result_cache_ttl == 0) {
+				return false;
+			}
+			entry.m_expires_at =
+			    TimestampTzPlusMilliseconds(GetCurrentTimestamp(), (int64)duckdb_result_cache_ttl * 1000);
+			continue;
+		}
+		/* Recursive globs are DuckDB specific, glob() would miss files that are created later */
+		if (path.find("**") != std::string::npos) {
+			return false;
+		}
+
+		glob_t matches;
+		int rc = glob(path.c_str(), 0, NULL, &matches);
+		if (rc == GLOB_NOMATCH) {
+			entry.m_files.push_back({path, 0, -1});
+			continue;
+		} else if (rc != 0) {
+			return false;
+		}
+		for (size_t i = 0; i < matches.gl_pathc; i++) {
+			struct stat st;
+			if (stat(matches.gl_pathv[i], &st) != 0) {
+				globfree(&matches);
+				return false;
+			}
+			entry.m_files.push_back({matches.gl_pathv[i], (int64)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec,
+			                         (int64)st.st_size});
+		}
+		globfree(&matches);
+	}
+	return true;
+}
+
+/* Collects the relations and files read by the query, returns true if its result can't be cached */
+static bool
+ResultCacheWalker(Node *node, ResultCacheEntry *entry) {
+	if (node == NULL) {
+		return false;
+	}
+
+	if (IsA(node, Query)) {
+		return query_tree_walker((Query *)node, ResultCacheWalker, entry, QTW_EXAMINE_RTES_BEFORE);
+	}
+
+	if (IsA(node, RangeTblEntry)) {
+		auto rte = (RangeTblEntry *)node;
+		if (rte->relid != InvalidOid && (rte->rtekind == RTE_RELATION || rte->rtekind == RTE_SUBQUERY)) {
+			if (rte->relkind == RELKIND_FOREIGN_TABLE || rte->tablesample) {
+				return true;
+			}
+			AddRelationWithAncestors(rte->relid, entry->m_relids);
+		} else if (rte->rtekind == RTE_FUNCTION) {
+			foreach_node(RangeTblFunction, rtfunc, rte->functions) {
+				if (IsA(rtfunc->funcexpr, FuncExpr) && IsFileReaderFunction(((FuncExpr *)rtfunc->funcexpr)->funcid) &&
+				    !AddFileReaderFiles((FuncExpr *)rtfunc->funcexpr, *entry)) {
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	/* The result depends on something else than the data it reads */
+	if (IsA(node, Param) || IsA(node, SQLValueFunction) || IsA(node, NextValueExpr) || IsA(node, CurrentOfExpr)) {
+		return true;
+	}
+	if (check_functions_in_node(node, IsMutableFunction, NULL)) {
+		return true;
+	}
+
+	return expression_tree_walker(node, ResultCacheWalker, entry);
+}
+
+duckdb::unique_ptr<ResultCacheEntry>
+CreateResultCacheEntry(Query *query, const char *query_string) {
+	if (!duckdb_result_cache || !write_counters || duckdb_result_cache_size == 0 || !ActiveSnapshotSet()) {
+		return nullptr;
+	}
+	if (GetTopTransactionIdIfAny() != InvalidTransactionId || IsolationUsesXactSnapshot()) {
+		return nullptr;
+	}
+
+	auto entry = duckdb::make_uniq<ResultCacheEntry>();
+	entry->m_expires_at = 0;
+	if (ResultCacheWalker((Node *)query, entry.get())) {
+		return nullptr;
+	}
+	std::sort(entry->m_relids.begin(), entry->m_relids.end());
+	entry->m_relids.erase(std::unique(entry->m_relids.begin(), entry->m_relids.end()), entry->m_relids.end());
+
+	/* The statement location tells apart the statements of a multi-statement query string */
+	entry->m_key = std::to_string(GetUserId()) + '\0' + namespace_search_path + '\0' +
+	               std::to_string(query->stmt_location) + '\0' + std::to_string(query->stmt_len) + '\0' + query_string;
+
+	for (auto relid : entry->m_relids) {
+		auto slot = WriteCounterSlot(relid);
+		entry->m_slots.push_back({slot, 0, pg_atomic_read_u64(&write_counters[slot].finished)});
+	}
+	pg_read_barrier();
+	entry->m_storable = true;
+	for (auto &slot : entry->m_slots) {
+		slot.m_started = pg_atomic_read_u64(&write_counters[slot.m_slot].started);
+		entry->m_storable &= slot.m_started == slot.m_finished;
+	}
+	entry->m_storable &= GetLatestSnapshot()->snapXactCompletionCount == GetActiveSnapshot()->snapXactCompletionCount;
+	return entry;
+}
+
+static bool
+IsCachedResultValid(const ResultCacheEntry &entry, const ResultCacheEntry &candidate) {
+	if (entry.m_expires_at != 0 && GetCurrentTimestamp() >= entry.m_expires_at) {
+		return false;
+	}
+	if (entry.m_relids != candidate.m_relids || entry.m_files != candidate.m_files) {
+		return false;
+	}
+	for (duckdb::idx_t i = 0; i < entry.m_slots.size(); i++) {
+		if (entry.m_slots[i].m_started != candidate.m_slots[i].m_started) {
+			return false;
+		}
+	}
+	return true;
+}
+
+duckdb::shared_ptr<ResultCacheEntry>
+LookupResultCache(const ResultCacheEntry &candidate) {
+	auto it = cached_result_index.find(candidate.m_key);
+	if (it == cached_result_index.end()) {
+		CountResultCacheLookup(false);
+		return nullptr;
+	}
+
+	auto entry = *it->second;
+	if (!IsCachedResultValid(*entry, candidate)) {
+		RemoveCachedResult(it->second);
+		CountResultCacheLookup(false);
+		return nullptr;
+	}
+
+	cached_results.splice(cached_results.begin(), cached_results, it->second);
+	CountResultCacheLookup(true);
+	return entry;
+}
+
+bool
+CollectResultCacheRows(ResultCacheEntry &candidate, duckdb::DataChunk &chunk) {
+	candidate.m_rows->Append(chunk);
+	return candidate.m_rows->SizeInBytes() <= ResultCacheSizeLimit();
+}
+
+void
+InsertResultCache(duckdb::unique_ptr<ResultCacheEntry> candidate) {
+	auto existing = cached_result_index.find(candidate->m_key);
+	if (existing != cached_result_index.end()) {
+		RemoveCachedResult(existing->second);
+	}
+
+	auto size = CachedResultSize(*candidate);
+	if (size > ResultCacheSizeLimit()) {
+		return;
+	}
+	while (cached_results_size + size > ResultCacheSizeLimit()) {
+		RemoveCachedResult(std::prev(cached_results.end()));
+	}
+
+	cached_results.push_front(duckdb::shared_ptr<ResultCacheEntry>(candidate.release()));
+	cached_result_index[cached_results.front()->m_key] = cached_results.begin();
+	cached_results_size += size;
+}
+
+// ResultCacheReader
+
+ResultCacheReader::ResultCacheReader(duckdb::shared_ptr<ResultCacheEntry> entry) : m_entry(std::move(entry)) {
+	m_entry->m_rows->InitializeScan(m_scan_state);
+}
+
+duckdb::unique_ptr<duckdb::DataChunk>
+ResultCacheReader::Fetch() {
+	auto chunk = duckdb::make_uniq<duckdb::DataChunk>();
+	chunk->Initialize(duckdb::Allocator::DefaultAllocator(), m_entry->m_types);
+	m_entry->m_rows->Scan(m_scan_state, *chunk);
+	return chunk;
+}
+
+// Initialization
+
+static Size
+ResultCacheShmemSize() {
+	return mul_size(RESULT_CACHE_SLOTS, sizeof(ResultCacheWriteCounters));
+}
+
+static void
+ResultCacheShmemRequest() {
+	if (prev_shmem_request_hook) {
+		prev_shmem_request_hook();
+	}
+	RequestAddinShmemSpace(ResultCacheShmemSize());
+}
+
+static void
+ResultCacheShmemStartup() {
+	bool found;
+
+	if (prev_shmem_startup_hook) {
+		prev_shmem_startup_hook();
+	}
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+	write_counters =
+	    (ResultCacheWriteCounters *)ShmemInitStruct("pg_duckdb result cache", ResultCacheShmemSize(), &found);
+	if (!found) {
+		for (int i = 0; i < RESULT_CACHE_SLOTS; i++) {
+			pg_atomic_init_u64(&write_counters[i].started, 0);
+			pg_atomic_init_u64(&write_counters[i].finished, 0);
+		}
+	}
+	LWLockRelease(AddinShmemInitLock);
+}
+
+} // namespace pgduckdb
+
+void
+DuckdbResultCacheTrackWrite(Oid relid) {
+	pgduckdb::TrackWrite(relid);
+}
+
+/* The write counters live in shared memory, without them the result cache is disabled */
+void
+DuckdbInitResultCache(void) {
+	if (!process_shared_preload_libraries_in_progress) {
+		return;
+	}
+	pgduckdb::prev_shmem_request_hook = shmem_request_hook;
+	shmem_request_hook = pgduckdb::ResultCacheShmemRequest;
+	pgduckdb::prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = pgduckdb::ResultCacheShmemStartup;
+
+	pgduckdb::prev_executor_start_hook = ExecutorStart_hook;
+	ExecutorStart_hook = pgduckdb::ResultCacheExecutorStart;
+
+	RegisterXactCallback(pgduckdb::ResultCacheXactCallback, NULL);
+	CacheRegisterRelcacheCallback(pgduckdb::ResultCacheRelcacheCallback, (Datum)0);
+	CacheRegisterSyscacheCallback(PROCOID, pgduckdb::ResultCacheSyscacheCallback, (Datum)0);
+	CacheRegisterSyscacheCallback(RELNAMENSP, pgduckdb::ResultCacheSyscacheCallback, (Datum)0);
+}
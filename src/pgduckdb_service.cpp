@@ -0,0 +1,927 @@
+#include "duckdb.hpp"
+
+extern "C" {
+#include "postgres.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "access/tupdesc.h"
+#include "access/xact.h"
+#include "catalog/namespace.h"
+#include "catalog/pg_class.h"
+#include "executor/tuptable.h"
+#include "nodes/nodeFuncs.h"
+#include "port/atomics.h"
+#include "postmaster/bgworker.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/lock.h"
+#include "storage/lwlock.h"
+#include "storage/proc.h"
+#include "storage/shm_toc.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "tcop/tcopprot.h"
+#include "utils/guc.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/snapmgr.h"
+#include "utils/timestamp.h"
+#include "utils/wait_event.h"
+}
+
+#include "pgduckdb/pgduckdb.h"
+#include "pgduckdb/pgduckdb_duckdb.hpp"
+#include "pgduckdb/pgduckdb_service.hpp"
+#include "pgduckdb/pgduckdb_types.hpp"
+
+/*
+ * Shared DuckDB service, see duckdb.shared_service. Each database has at most one service worker, a background
+ * worker with its own DuckDB database that executes the queries of all backends connected to the database, so that
+ * they share its caches and memory limit instead of opening a database each.
+ *
+ * A backend passes a request in a dynamic shared memory segment: the query, the state of the backend it depends on
+ * and a message queue the worker returns the result in. The worker slot in shared memory holds the handles of the
+ * queued requests. The worker executes the queries one after the other and materializes their results, which it then
+ * sends without waiting for the backends to read them: a backend reading the rows of one query while another one of
+ * its queries waits in the queue, e.g. with two open cursors, must not block the worker.
+ */
+
+#define SERVICE_MAGIC             0x50474453
+#define SERVICE_KEY_HEADER        1
+#define SERVICE_KEY_QUERY         2
+#define SERVICE_KEY_SEARCH_PATH   3
+#define SERVICE_KEY_RTABLES       4
+#define SERVICE_KEY_NEEDED        5
+#define SERVICE_KEY_SNAPSHOT      6
+#define SERVICE_KEY_QUEUE         7
+#define SERVICE_KEY_COUNT         7
+#define SERVICE_QUEUE_SIZE        65536
+#define SERVICE_ERROR_SIZE        1024
+/* A worker without requests exits after this long, a running worker keeps its database from being dropped */
+#define SERVICE_IDLE_TIMEOUT_MS   60000
+/* Interval in which a waiting backend checks that the worker is still running */
+#define SERVICE_CHECK_INTERVAL_MS 100
+
+namespace pgduckdb {
+
+/* State of a request shared by the backend and the worker */
+struct SharedServiceRequestHeader {
+	SharedServiceRequestKind kind;
+	Oid user;
+	/* Backend whose snapshot the worker uses, the backend keeps its xmin until the request is done */
+	PGPROC *backend;
+	/* Set by the worker that took the request, a handle of a dropped request may be reused for another one */
+	pg_atomic_uint32 claimed;
+	/* Set by the backend when it no longer waits for the result */
+	pg_atomic_uint32 cancelled;
+	/* Set by the worker before it detaches from the queue, the backend then knows whether the result is complete */
+	bool finished;
+	bool failed;
+	char error[SERVICE_ERROR_SIZE];
+};
+
+/* Message describing a result column, sent after the message with the number of columns */
+struct SharedServiceColumn {
+	Oid type;
+	char name[NAMEDATALEN];
+};
+
+/* Worker of a database, its queued requests are in the slot's part of service_queue */
+struct ServiceWorkerSlot {
+	/* InvalidOid if the slot is free */
+	Oid database;
+	/* Changes whenever the slot is taken, a backend compares it to see if the worker it queued for is still running */
+	uint64 generation;
+	/* Latch of the worker once it started */
+	Latch *latch;
+	int queue_head;
+	int queue_length;
+};
+
+struct ServiceShared {
+	slock_t mutex;
+	uint64 next_generation;
+	ServiceWorkerSlot workers[FLEXIBLE_ARRAY_MEMBER];
+};
+
+/* Passed to a service worker through bgw_extra */
+struct ServiceWorkerArgs {
+	Oid database;
+	uint64 generation;
+};
+
+static ServiceShared *service = nullptr;
+static dsm_handle *service_queue = nullptr;
+
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+/* Every backend may have a request queued for the same worker */
+static int
+ServiceQueueLength() {
+	return MaxBackends;
+}
+
+static Size
+ServiceSlotsSize() {
+	Size size = add_size(offsetof(ServiceShared, workers), mul_size(max_worker_processes, sizeof(ServiceWorkerSlot)));
+	return MAXALIGN(size);
+}
+
+static Size
+ServiceShmemSize() {
+	return add_size(ServiceSlotsSize(),
+	                mul_size(mul_size(max_worker_processes, ServiceQueueLength()), sizeof(dsm_handle)));
+}
+
+static void
+ServiceShmemRequest() {
+	if (prev_shmem_request_hook) {
+		prev_shmem_request_hook();
+	}
+	RequestAddinShmemSpace(ServiceShmemSize());
+}
+
+static void
+ServiceShmemStartup() {
+	bool found;
+
+	if (prev_shmem_startup_hook) {
+		prev_shmem_startup_hook();
+	}
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+	service = (ServiceShared *)ShmemInitStruct("pg_duckdb shared service", ServiceShmemSize(), &found);
+	service_queue = (dsm_handle *)((char *)service + ServiceSlotsSize());
+	if (!found) {
+		SpinLockInit(&service->mutex);
+		service->next_generation = 1;
+		for (int i = 0; i < max_worker_processes; i++) {
+			service->workers[i].database = InvalidOid;
+			service->workers[i].generation = 0;
+			service->workers[i].latch = nullptr;
+			service->workers[i].queue_head = 0;
+			service->workers[i].queue_length = 0;
+		}
+	}
+	LWLockRelease(AddinShmemInitLock);
+}
+
+static void
+LaunchServiceWorker(int slot_index, uint64 generation) {
+	BackgroundWorker worker;
+	BackgroundWorkerHandle *handle;
+	ServiceWorkerArgs args = {MyDatabaseId, generation};
+	pid_t pid;
+
+	memset(&worker, 0, sizeof(worker));
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+	/* The worker only reads, it also serves the backends of a hot standby */
+	worker.bgw_start_time = BgWorkerStart_ConsistentState;
+	worker.bgw_restart_time = BGW_NEVER_RESTART;
+	snprintf(worker.bgw_library_name, BGW_MAXLEN, "pg_duckdb");
+	snprintf(worker.bgw_function_name, BGW_MAXLEN, "DuckdbServiceWorkerMain");
+	snprintf(worker.bgw_name, BGW_MAXLEN, "pg_duckdb shared service for database %u", MyDatabaseId);
+	snprintf(worker.bgw_type, BGW_MAXLEN, "pg_duckdb shared service");
+	worker.bgw_main_arg = Int32GetDatum(slot_index);
+	worker.bgw_notify_pid = MyProcPid;
+	memcpy(worker.bgw_extra, &args, sizeof(args));
+
+	if (RegisterDynamicBackgroundWorker(&worker, &handle) &&
+	    WaitForBackgroundWorkerStartup(handle, &pid) == BGWH_STARTED) {
+		return;
+	}
+
+	/* Requests queued for the worker in the meantime fail when their backends see the slot was released */
+	SpinLockAcquire(&service->mutex);
+	if (service->workers[slot_index].generation == generation) {
+		service->workers[slot_index].database = InvalidOid;
+	}
+	SpinLockRelease(&service->mutex);
+	ereport(ERROR, (errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+	                errmsg("could not start the shared DuckDB service worker"),
+	                errhint("You may need to increase max_worker_processes.")));
+}
+
+/* Queues a request for the worker of the current database, launching the worker if there is none */
+static void
+EnqueueServiceRequest(dsm_handle handle, int &slot_index, uint64 &generation) {
+	int queue_length = ServiceQueueLength();
+	int free_slot = -1;
+	bool launch = false;
+	bool queued = false;
+	Latch *latch = nullptr;
+
+	slot_index = -1;
+	SpinLockAcquire(&service->mutex);
+	for (int i = 0; i < max_worker_processes; i++) {
+		if (service->workers[i].database == MyDatabaseId) {
+			slot_index = i;
+			break;
+		}
+		if (service->workers[i].database == InvalidOid && free_slot < 0) {
+			free_slot = i;
+		}
+	}
+	if (slot_index < 0 && free_slot >= 0) {
+		auto &slot = service->workers[free_slot];
+		slot.database = MyDatabaseId;
+		slot.generation = service->next_generation++;
+		slot.latch = nullptr;
+		slot.queue_head = 0;
+		slot.queue_length = 0;
+		slot_index = free_slot;
+		launch = true;
+	}
+	if (slot_index >= 0) {
+		auto &slot = service->workers[slot_index];
+		if (slot.queue_length < queue_length) {
+			service_queue[slot_index * queue_length + (slot.queue_head + slot.queue_length) % queue_length] = handle;
+			slot.queue_length++;
+			queued = true;
+		}
+		generation = slot.generation;
+		latch = slot.latch;
+	}
+	SpinLockRelease(&service->mutex);
+
+	if (slot_index < 0) {
+		ereport(ERROR, (errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+		                errmsg("too many databases use the shared DuckDB service"),
+		                errhint("You may need to increase max_worker_processes.")));
+	}
+	if (!queued) {
+		ereport(ERROR, (errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+		                errmsg("too many requests are queued for the shared DuckDB service")));
+	}
+	if (launch) {
+		LaunchServiceWorker(slot_index, generation);
+	} else if (latch) {
+		SetLatch(latch);
+	}
+}
+
+/* Returns true if the worker a request was queued for is still running, wake sets its latch */
+static bool
+CheckServiceWorker(int slot_index, uint64 generation, bool wake) {
+	Latch *latch = nullptr;
+	bool running;
+
+	SpinLockAcquire(&service->mutex);
+	running = service->workers[slot_index].generation == generation &&
+	          service->workers[slot_index].database != InvalidOid;
+	if (running && wake) {
+		latch = service->workers[slot_index].latch;
+	}
+	SpinLockRelease(&service->mutex);
+
+	if (latch) {
+		SetLatch(latch);
+	}
+	return running;
+}
+
+static void
+InsertString(shm_toc *toc, uint64 key, const char *value) {
+	Size size = strlen(value) + 1;
+	char *space = (char *)shm_toc_allocate(toc, size);
+	memcpy(space, value, size);
+	shm_toc_insert(toc, key, space);
+}
+
+SharedServiceQuery::SharedServiceQuery(List *rtables, List *needed_columns, const char *query)
+    : m_query(query), m_rtables(nodeToString(rtables)), m_needed_columns(nodeToString(needed_columns)) {
+}
+
+SharedServiceRequest::~SharedServiceRequest() {
+	if (!m_segment) {
+		return;
+	}
+	pg_atomic_write_u32(&m_header->cancelled, 1);
+	if (m_worker_slot >= 0) {
+		CheckServiceWorker(m_worker_slot, m_worker_generation, true);
+	}
+	dsm_detach(m_segment);
+}
+
+void
+SharedServiceRequest::Send(SharedServiceRequestKind kind, const SharedServiceQuery &query, Snapshot snapshot) {
+	shm_toc_estimator estimator;
+	Size snapshot_size = EstimateSnapshotSpace(snapshot);
+
+	shm_toc_initialize_estimator(&estimator);
+	shm_toc_estimate_chunk(&estimator, sizeof(SharedServiceRequestHeader));
+	shm_toc_estimate_chunk(&estimator, query.m_query.size() + 1);
+	shm_toc_estimate_chunk(&estimator, strlen(namespace_search_path) + 1);
+	shm_toc_estimate_chunk(&estimator, query.m_rtables.size() + 1);
+	shm_toc_estimate_chunk(&estimator, query.m_needed_columns.size() + 1);
+	shm_toc_estimate_chunk(&estimator, snapshot_size);
+	shm_toc_estimate_chunk(&estimator, SERVICE_QUEUE_SIZE);
+	shm_toc_estimate_keys(&estimator, SERVICE_KEY_COUNT);
+	Size size = shm_toc_estimate(&estimator);
+
+	/* The request is released by its destructor, not at the end of the transaction */
+	m_segment = dsm_create(size, 0);
+	dsm_pin_mapping(m_segment);
+	shm_toc *toc = shm_toc_create(SERVICE_MAGIC, dsm_segment_address(m_segment), size);
+
+	m_header = (SharedServiceRequestHeader *)shm_toc_allocate(toc, sizeof(SharedServiceRequestHeader));
+	m_header->kind = kind;
+	m_header->user = GetUserId();
+	m_header->backend = MyProc;
+	pg_atomic_init_u32(&m_header->claimed, 0);
+	pg_atomic_init_u32(&m_header->cancelled, 0);
+	m_header->finished = false;
+	m_header->failed = false;
+	m_header->error[0] = '\0';
+	shm_toc_insert(toc, SERVICE_KEY_HEADER, m_header);
+
+	InsertString(toc, SERVICE_KEY_QUERY, query.m_query.c_str());
+	/* The worker resolves the names of the query's relations like the backend */
+	InsertString(toc, SERVICE_KEY_SEARCH_PATH, namespace_search_path);
+	InsertString(toc, SERVICE_KEY_RTABLES, query.m_rtables.c_str());
+	InsertString(toc, SERVICE_KEY_NEEDED, query.m_needed_columns.c_str());
+
+	char *snapshot_space = (char *)shm_toc_allocate(toc, snapshot_size);
+	SerializeSnapshot(snapshot, snapshot_space);
+	shm_toc_insert(toc, SERVICE_KEY_SNAPSHOT, snapshot_space);
+
+	shm_mq *queue = shm_mq_create(shm_toc_allocate(toc, SERVICE_QUEUE_SIZE), SERVICE_QUEUE_SIZE);
+	shm_toc_insert(toc, SERVICE_KEY_QUEUE, queue);
+	shm_mq_set_receiver(queue, MyProc);
+	m_queue = shm_mq_attach(queue, m_segment, NULL);
+
+	EnqueueServiceRequest(dsm_segment_handle(m_segment), m_worker_slot, m_worker_generation);
+}
+
+/*
+ * Waits for the next message of the worker. Returns SHM_MQ_DETACHED once the worker detached from the queue or
+ * exited, or if a cancel request or statement_timeout interrupted the wait, which the caller has to process.
+ */
+shm_mq_result
+SharedServiceRequest::Receive(Size &nbytes, void *&data, bool &cancelled) {
+	for (;;) {
+		shm_mq_result result = shm_mq_receive(m_queue, &nbytes, &data, true);
+		if (result != SHM_MQ_WOULD_BLOCK) {
+			return result;
+		}
+		if (QueryCancelPending || ProcDiePending) {
+			cancelled = true;
+			return SHM_MQ_DETACHED;
+		}
+		if (!CheckServiceWorker(m_worker_slot, m_worker_generation, false)) {
+			/* The worker may have sent the rest of the result before it exited */
+			result = shm_mq_receive(m_queue, &nbytes, &data, true);
+			return result == SHM_MQ_SUCCESS ? result : SHM_MQ_DETACHED;
+		}
+		(void)WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH, SERVICE_CHECK_INTERVAL_MS,
+		                PG_WAIT_EXTENSION);
+		ResetLatch(MyLatch);
+	}
+}
+
+char *
+SharedServiceRequest::WorkerError() {
+	pg_read_barrier();
+	if (m_header->failed) {
+		return pstrdup(m_header->error);
+	}
+	return pstrdup("the shared DuckDB service exited before it returned the result");
+}
+
+char *
+SharedServiceRequest::ReceiveColumns(duckdb::vector<Oid> &types, duckdb::vector<std::string> &names,
+                                     bool &cancelled) {
+	Size nbytes;
+	void *data;
+
+	if (Receive(nbytes, data, cancelled) != SHM_MQ_SUCCESS) {
+		return cancelled ? nullptr : WorkerError();
+	}
+	uint32 column_count = *(uint32 *)data;
+	for (uint32 i = 0; i < column_count; i++) {
+		if (Receive(nbytes, data, cancelled) != SHM_MQ_SUCCESS) {
+			return cancelled ? nullptr : WorkerError();
+		}
+		auto column = (SharedServiceColumn *)data;
+		types.push_back(column->type);
+		names.emplace_back(column->name);
+	}
+	return nullptr;
+}
+
+MinimalTuple
+SharedServiceRequest::ReceiveTuple(bool &cancelled, char *&error) {
+	Size nbytes;
+	void *data;
+
+	if (Receive(nbytes, data, cancelled) == SHM_MQ_SUCCESS) {
+		return (MinimalTuple)data;
+	}
+	if (!cancelled) {
+		pg_read_barrier();
+		if (!m_header->finished) {
+			error = WorkerError();
+		}
+	}
+	return nullptr;
+}
+
+static bool
+ReadsBackendLocalRelation(Node *node, void *context) {
+	if (node == NULL) {
+		return false;
+	}
+
+	if (IsA(node, Query)) {
+		return query_tree_walker((Query *)node, ReadsBackendLocalRelation, context, QTW_EXAMINE_RTES_BEFORE);
+	}
+
+	if (IsA(node, RangeTblEntry)) {
+		auto rte = (RangeTblEntry *)node;
+		if (rte->rtekind == RTE_RELATION) {
+			LOCKTAG tag;
+			SET_LOCKTAG_RELATION(tag, MyDatabaseId, rte->relid);
+			return get_rel_persistence(rte->relid) == RELPERSISTENCE_TEMP || LockHeldByMe(&tag, AccessExclusiveLock);
+		}
+		return false;
+	}
+
+	return expression_tree_walker(node, ReadsBackendLocalRelation, context);
+}
+
+/*
+ * The worker reads the relations with the snapshot of the backend, which works as long as the backend didn't write
+ * anything in its transaction: the worker can't see uncommitted rows. It can't read temporary relations either, and
+ * it would wait forever for a relation the backend locked exclusively. Serializable transactions run their queries
+ * themselves, the worker doesn't take predicate locks for them.
+ */
+bool
+UseSharedService(Query *query) {
+	if (!duckdb_shared_service || !service || !ActiveSnapshotSet()) {
+		return false;
+	}
+	if (GetTopTransactionIdIfAny() != InvalidTransactionId || IsolationIsSerializable()) {
+		return false;
+	}
+	return !ReadsBackendLocalRelation((Node *)query, NULL);
+}
+
+/* A request taken by the worker */
+struct ServiceWorkerRequest {
+	~ServiceWorkerRequest() {
+		shm_mq_detach(m_queue);
+		dsm_detach(m_segment);
+		MemoryContextDelete(m_context);
+	}
+
+	const char *
+	Lookup(uint64 key) {
+		return (const char *)shm_toc_lookup(m_toc, key, false);
+	}
+
+	dsm_segment *m_segment;
+	shm_toc *m_toc;
+	SharedServiceRequestHeader *m_header;
+	shm_mq_handle *m_queue;
+	/* Holds the queue handle and the slot the rows are converted in */
+	MemoryContext m_context;
+	/* Reset for every row */
+	MemoryContext m_row_context;
+
+	duckdb::unique_ptr<duckdb::Connection> m_connection;
+	duckdb::unique_ptr<duckdb::PreparedStatement> m_prepared;
+	duckdb::unique_ptr<duckdb::QueryResult> m_result;
+	duckdb::unique_ptr<duckdb::DataChunk> m_chunk;
+	duckdb::idx_t m_row = 0;
+	duckdb::vector<Oid> m_types;
+	duckdb::vector<std::string> m_names;
+	TupleTableSlot *m_slot = nullptr;
+	/* Messages sent so far: the number of columns, the columns and the rows */
+	duckdb::idx_t m_sent = 0;
+	/* Message the queue had no room for, it has to be sent again as it is */
+	std::string m_message;
+};
+
+/* Worker slot of this service worker */
+static int my_slot_index = -1;
+static uint64 my_generation = 0;
+
+/* Context of the DuckDB query the worker executes, see ServiceWorkerSigterm */
+static duckdb::ClientContext *volatile service_query_context = nullptr;
+
+/* Publishes the context of a request's query to the SIGTERM handler while it exists */
+struct ServiceQueryInterruptGuard {
+	explicit ServiceQueryInterruptGuard(duckdb::ClientContext &context) {
+		service_query_context = &context;
+	}
+	~ServiceQueryInterruptGuard() {
+		service_query_context = nullptr;
+	}
+};
+
+/* DuckDB doesn't check for Postgres interrupts, SIGTERM interrupts the running query in addition to die() */
+static void
+ServiceWorkerSigterm(SIGNAL_ARGS) {
+	duckdb::ClientContext *context = service_query_context;
+	if (context) {
+		context->Interrupt();
+	}
+	die(postgres_signal_arg);
+}
+
+/* Frees the slot of the worker when it exits, backends waiting for its requests then report an error */
+static void
+ReleaseServiceSlot(int code, Datum arg) {
+	SpinLockAcquire(&service->mutex);
+	if (service->workers[my_slot_index].generation == my_generation) {
+		service->workers[my_slot_index].database = InvalidOid;
+		service->workers[my_slot_index].latch = nullptr;
+	}
+	SpinLockRelease(&service->mutex);
+}
+
+/* Takes the next queued request, or frees the slot if there is none and the worker is idle. */
+static bool
+DequeueServiceRequest(dsm_handle &handle, bool idle, bool &released) {
+	int queue_length = ServiceQueueLength();
+	bool found = false;
+
+	released = false;
+	SpinLockAcquire(&service->mutex);
+	auto &slot = service->workers[my_slot_index];
+	if (slot.queue_length > 0) {
+		handle = service_queue[my_slot_index * queue_length + slot.queue_head];
+		slot.queue_head = (slot.queue_head + 1) % queue_length;
+		slot.queue_length--;
+		found = true;
+	} else if (idle) {
+		slot.database = InvalidOid;
+		slot.latch = nullptr;
+		released = true;
+	}
+	SpinLockRelease(&service->mutex);
+	return found;
+}
+
+/* Attaches to a request, returns nullptr if its backend gave up on it or another worker took it */
+static duckdb::unique_ptr<ServiceWorkerRequest>
+AttachServiceRequest(dsm_handle handle) {
+	dsm_segment *segment = dsm_attach(handle);
+	if (!segment) {
+		return nullptr;
+	}
+	dsm_pin_mapping(segment);
+
+	shm_toc *toc = shm_toc_attach(SERVICE_MAGIC, dsm_segment_address(segment));
+	auto header = toc ? (SharedServiceRequestHeader *)shm_toc_lookup(toc, SERVICE_KEY_HEADER, true) : nullptr;
+	if (!header || pg_atomic_exchange_u32(&header->claimed, 1) != 0) {
+		dsm_detach(segment);
+		return nullptr;
+	}
+
+	auto request = duckdb::make_uniq<ServiceWorkerRequest>();
+	request->m_segment = segment;
+	request->m_toc = toc;
+	request->m_header = header;
+	request->m_context = AllocSetContextCreate(TopMemoryContext, "pg_duckdb service request", ALLOCSET_DEFAULT_SIZES);
+	request->m_row_context = AllocSetContextCreate(request->m_context, "pg_duckdb service row", ALLOCSET_DEFAULT_SIZES);
+
+	MemoryContext old_context = MemoryContextSwitchTo(request->m_context);
+	shm_mq *queue = (shm_mq *)shm_toc_lookup(toc, SERVICE_KEY_QUEUE, false);
+	shm_mq_set_sender(queue, MyProc);
+	request->m_queue = shm_mq_attach(queue, segment, NULL);
+	MemoryContextSwitchTo(old_context);
+	return request;
+}
+
+/* Reports the failure of a request to its backend */
+static void
+FailServiceRequest(ServiceWorkerRequest &request, const char *error) {
+	strlcpy(request.m_header->error, error ? error : "unknown error", SERVICE_ERROR_SIZE);
+	pg_write_barrier();
+	request.m_header->failed = true;
+}
+
+static bool
+ServiceRequestCancelled(ServiceWorkerRequest &request) {
+	return pg_atomic_read_u32(&request.m_header->cancelled) != 0;
+}
+
+/*
+ * Prepares the query of a request with DuckDB, and executes it if it is to be executed. The result is materialized,
+ * see the top of the file. Errors of DuckDB are returned instead of raised, like in RunJobQuery.
+ */
+static char *
+RunServiceQuery(ServiceWorkerRequest &request, List *rtables, List *needed_columns, const char *query) {
+	try {
+		request.m_connection = DuckdbCreateConnection(rtables, nullptr, needed_columns, query);
+		auto &context = *request.m_connection->context;
+		request.m_prepared = context.Prepare(query);
+		if (request.m_prepared->HasError()) {
+			return pstrdup(request.m_prepared->GetError().c_str());
+		}
+		request.m_names = request.m_prepared->GetNames();
+		if (request.m_header->kind == SHARED_SERVICE_DESCRIBE) {
+			return nullptr;
+		}
+
+		duckdb::vector<duckdb::Value> parameters;
+		ServiceQueryInterruptGuard interrupt_guard(context);
+		auto pending = request.m_prepared->PendingQuery(parameters, false);
+		if (pending->HasError()) {
+			return pstrdup(pending->GetError().c_str());
+		}
+		auto &executor = duckdb::Executor::Get(context);
+		while (!executor.ExecutionIsFinished()) {
+			if (ServiceRequestCancelled(request) || ProcDiePending) {
+				context.Interrupt();
+				executor.CancelTasks();
+				return pstrdup("the query was cancelled");
+			}
+			(void)WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH, 1L, PG_WAIT_EXTENSION);
+			ResetLatch(MyLatch);
+		}
+		/* The latch may have been set for a new request while the query ran */
+		SetLatch(MyLatch);
+
+		duckdb::PendingExecutionResult execution_result;
+		do {
+			execution_result = pending->ExecuteTask();
+		} while (!duckdb::PendingQueryResult::IsResultReady(execution_result));
+		if (execution_result == duckdb::PendingExecutionResult::EXECUTION_ERROR) {
+			return pstrdup(pending->GetError().c_str());
+		}
+		request.m_result = pending->Execute();
+		if (request.m_result->HasError()) {
+			return pstrdup(request.m_result->GetError().c_str());
+		}
+	} catch (std::exception &ex) {
+		return pstrdup(ex.what());
+	}
+	return nullptr;
+}
+
+/*
+ * Runs the query of a request in a transaction with the snapshot of its backend, as the backend's user and with its
+ * search_path. A failed request is reported to the backend right away.
+ */
+static void
+StartServiceRequest(ServiceWorkerRequest &request) {
+	const char *query = request.Lookup(SERVICE_KEY_QUERY);
+
+	pgstat_report_activity(STATE_RUNNING, query);
+	PG_TRY();
+	{
+		StartTransactionCommand();
+		Snapshot snapshot = RestoreSnapshot((char *)request.Lookup(SERVICE_KEY_SNAPSHOT));
+		RestoreTransactionSnapshot(snapshot, request.m_header->backend);
+		PushActiveSnapshot(snapshot);
+		(void)set_config_option("search_path", request.Lookup(SERVICE_KEY_SEARCH_PATH), PGC_USERSET, PGC_S_SESSION,
+		                        GUC_ACTION_LOCAL, true, 0, false);
+
+		Oid saved_user;
+		int saved_sec_context;
+		GetUserIdAndSecContext(&saved_user, &saved_sec_context);
+		SetUserIdAndSecContext(request.m_header->user, saved_sec_context | SECURITY_RESTRICTED_OPERATION);
+
+		List *rtables = (List *)stringToNode(request.Lookup(SERVICE_KEY_RTABLES));
+		List *needed_columns = (List *)stringToNode(request.Lookup(SERVICE_KEY_NEEDED));
+		char *error = RunServiceQuery(request, rtables, needed_columns, query);
+		if (error) {
+			FailServiceRequest(request, error);
+		} else {
+			for (auto &type : request.m_prepared->GetTypes()) {
+				request.m_types.push_back(GetPostgresDuckDBType(type));
+			}
+		}
+
+		SetUserIdAndSecContext(saved_user, saved_sec_context);
+		PopActiveSnapshot();
+		CommitTransactionCommand();
+	}
+	PG_CATCH();
+	{
+		MemoryContextSwitchTo(TopMemoryContext);
+		ErrorData *edata = CopyErrorData();
+		FlushErrorState();
+		AbortCurrentTransaction();
+		FailServiceRequest(request, edata->message);
+		FreeErrorData(edata);
+	}
+	PG_END_TRY();
+	pgstat_report_activity(STATE_IDLE, NULL);
+}
+
+/* Converts the next row of the result into the message to send, returns false at the end of the result */
+static bool
+NextServiceRow(ServiceWorkerRequest &request) {
+	if (!request.m_chunk || request.m_row >= request.m_chunk->size()) {
+		request.m_chunk = request.m_result->Fetch();
+		request.m_row = 0;
+		if (!request.m_chunk || request.m_chunk->size() == 0) {
+			return false;
+		}
+	}
+
+	if (!request.m_slot) {
+		MemoryContext old_context = MemoryContextSwitchTo(request.m_context);
+		TupleDesc tuple_desc = CreateTemplateTupleDesc(request.m_types.size());
+		for (duckdb::idx_t col = 0; col < request.m_types.size(); col++) {
+			TupleDescInitEntry(tuple_desc, col + 1, request.m_names[col].c_str(), request.m_types[col], -1, 0);
+		}
+		request.m_slot = MakeSingleTupleTableSlot(tuple_desc, &TTSOpsVirtual);
+		MemoryContextSwitchTo(old_context);
+	}
+
+	TupleTableSlot *slot = request.m_slot;
+	MemoryContextReset(request.m_row_context);
+	MemoryContext old_context = MemoryContextSwitchTo(request.m_row_context);
+	ExecClearTuple(slot);
+	for (duckdb::idx_t col = 0; col < request.m_chunk->ColumnCount(); col++) {
+		auto value = request.m_chunk->GetValue(col, request.m_row);
+		if (value.IsNull()) {
+			slot->tts_isnull[col] = true;
+		} else {
+			slot->tts_isnull[col] = false;
+			ConvertDuckToPostgresValue(slot, value, col);
+		}
+	}
+	ExecStoreVirtualTuple(slot);
+	bool should_free;
+	MinimalTuple tuple = ExecFetchSlotMinimalTuple(slot, &should_free);
+	request.m_message.assign((char *)tuple, tuple->t_len);
+	MemoryContextSwitchTo(old_context);
+
+	request.m_row++;
+	return true;
+}
+
+/* Sets the next message of the result to send, returns false once all of them were sent */
+static bool
+NextServiceMessage(ServiceWorkerRequest &request) {
+	duckdb::idx_t column_count = request.m_types.size();
+	if (request.m_sent == 0) {
+		uint32 count = column_count;
+		request.m_message.assign((char *)&count, sizeof(count));
+	} else if (request.m_sent <= column_count) {
+		SharedServiceColumn column;
+		memset(&column, 0, sizeof(column));
+		column.type = request.m_types[request.m_sent - 1];
+		strlcpy(column.name, request.m_names[request.m_sent - 1].c_str(), NAMEDATALEN);
+		request.m_message.assign((char *)&column, sizeof(column));
+	} else if (!request.m_result || !NextServiceRow(request)) {
+		return false;
+	}
+	request.m_sent++;
+	return true;
+}
+
+/*
+ * Sends the result of a request until the queue to its backend is full. Returns true once the request is done: its
+ * result was sent, it failed, or its backend cancelled it.
+ */
+static bool
+SendServiceResult(ServiceWorkerRequest &request) {
+	bool done = false;
+
+	/* Without any message sent, the backend learns about the failure when the worker detaches */
+	if (request.m_header->failed) {
+		return true;
+	}
+
+	PG_TRY();
+	{
+		StartTransactionCommand();
+		char *error = nullptr;
+		try {
+			while (!done) {
+				if (ServiceRequestCancelled(request)) {
+					done = true;
+				} else if (request.m_message.empty() && !NextServiceMessage(request)) {
+					request.m_header->finished = true;
+					pg_write_barrier();
+					done = true;
+				} else {
+					shm_mq_result result =
+					    shm_mq_send(request.m_queue, request.m_message.size(), request.m_message.data(), true, true);
+					if (result == SHM_MQ_WOULD_BLOCK) {
+						break;
+					}
+					done = result == SHM_MQ_DETACHED;
+					request.m_message.clear();
+				}
+			}
+		} catch (std::exception &ex) {
+			error = pstrdup(ex.what());
+		}
+		if (error) {
+			FailServiceRequest(request, error);
+			done = true;
+		}
+		CommitTransactionCommand();
+	}
+	PG_CATCH();
+	{
+		MemoryContextSwitchTo(TopMemoryContext);
+		ErrorData *edata = CopyErrorData();
+		FlushErrorState();
+		AbortCurrentTransaction();
+		FailServiceRequest(request, edata->message);
+		FreeErrorData(edata);
+		done = true;
+	}
+	PG_END_TRY();
+	return done;
+}
+
+/* Serves the requests of the worker's database until it was idle for SERVICE_IDLE_TIMEOUT_MS */
+static void
+ServeRequests() {
+	duckdb::vector<duckdb::unique_ptr<ServiceWorkerRequest>> requests;
+	TimestampTz last_request = GetCurrentTimestamp();
+
+	for (;;) {
+		bool idle = requests.empty() &&
+		            TimestampDifferenceExceeds(last_request, GetCurrentTimestamp(), SERVICE_IDLE_TIMEOUT_MS);
+		bool released;
+		dsm_handle handle;
+		while (DequeueServiceRequest(handle, idle, released)) {
+			last_request = GetCurrentTimestamp();
+			idle = false;
+			auto request = AttachServiceRequest(handle);
+			if (request) {
+				StartServiceRequest(*request);
+				requests.push_back(std::move(request));
+			}
+		}
+		if (released) {
+			return;
+		}
+
+		for (auto request = requests.begin(); request != requests.end();) {
+			if (SendServiceResult(**request)) {
+				request = requests.erase(request);
+			} else {
+				request++;
+			}
+		}
+		if (!requests.empty()) {
+			last_request = GetCurrentTimestamp();
+		}
+
+		(void)WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH, SERVICE_IDLE_TIMEOUT_MS,
+		                PG_WAIT_EXTENSION);
+		ResetLatch(MyLatch);
+		CHECK_FOR_INTERRUPTS();
+	}
+}
+
+} // namespace pgduckdb
+
+/* The worker slots live in shared memory, without them the shared service is disabled */
+void
+DuckdbInitService(void) {
+	if (!process_shared_preload_libraries_in_progress) {
+		return;
+	}
+	pgduckdb::prev_shmem_request_hook = shmem_request_hook;
+	shmem_request_hook = pgduckdb::ServiceShmemRequest;
+	pgduckdb::prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = pgduckdb::ServiceShmemStartup;
+}
+
+extern "C" {
+
+PGDLLEXPORT void DuckdbServiceWorkerMain(Datum main_arg);
+
+/*
+ * Background worker of the shared DuckDB service for one database. It connects to the database as superuser and runs
+ * every query as the user of the backend that sent it.
+ */
+void
+DuckdbServiceWorkerMain(Datum main_arg) {
+	pgduckdb::ServiceWorkerArgs args;
+
+	memcpy(&args, MyBgworkerEntry->bgw_extra, sizeof(args));
+	pgduckdb::my_slot_index = DatumGetInt32(main_arg);
+	pgduckdb::my_generation = args.generation;
+	before_shmem_exit(pgduckdb::ReleaseServiceSlot, (Datum)0);
+
+	pqsignal(SIGTERM, pgduckdb::ServiceWorkerSigterm);
+	BackgroundWorkerUnblockSignals();
+	BackgroundWorkerInitializeConnectionByOid(args.database, InvalidOid, 0);
+	/* The worker takes the snapshots of the backends, which only works as is in READ COMMITTED */
+	SetConfigOption("default_transaction_isolation", "read committed", PGC_SUSET, PGC_S_OVERRIDE);
+
+	SpinLockAcquire(&pgduckdb::service->mutex);
+	if (pgduckdb::service->workers[pgduckdb::my_slot_index].generation == args.generation) {
+		pgduckdb::service->workers[pgduckdb::my_slot_index].latch = MyLatch;
+	}
+	SpinLockRelease(&pgduckdb::service->mutex);
+
+	pgduckdb::ServeRequests();
+	proc_exit(0);
+}
+
+} // extern "C"
@@ -0,0 +1,317 @@
+extern "C" {
+#include "postgres.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "port/atomics.h"
+#include "storage/backendid.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/builtins.h"
+#include "utils/tuplestore.h"
+}
+
+#include "pgduckdb/pgduckdb_stats.hpp"
+
+/*
+ * Cumulative scan statistics. Every backend owns a slot in shared memory that it attaches to the first time it
+ * plans a query with DuckDB. Scan threads accumulate their counters locally and add them to the slot of their
+ * backend when they are done. When a backend exits its counters are folded into the cluster wide totals, so that
+ * the totals cover backends that are gone as well.
+ */
+
+namespace pgduckdb {
+
+static const char *fallback_reason_names[] = {"catalog_table", "unsupported_statement", "duckdb_error",
+                                              "index_minmax", "unsupported_type"};
+
+static_assert(sizeof(fallback_reason_names) / sizeof(fallback_reason_names[0]) == FALLBACK_REASON_COUNT,
+              "every fallback reason needs a name");
+
+struct BackendScanStats {
+	int pid;
+	pg_atomic_uint64 counters[SCAN_STAT_COUNT];
+	pg_atomic_uint64 fallbacks[FALLBACK_REASON_COUNT];
+};
+
+struct DuckdbStatsShared {
+	BackendScanStats cluster;
+	BackendScanStats backends[FLEXIBLE_ARRAY_MEMBER];
+};
+
+static DuckdbStatsShared *duckdb_stats = nullptr;
+static BackendScanStats *my_stats = nullptr;
+
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+static Size
+DuckdbStatsShmemSize() {
+	return add_size(offsetof(DuckdbStatsShared, backends), mul_size(MaxBackends, sizeof(BackendScanStats)));
+}
+
+static void
+ResetBackendScanStats(BackendScanStats *stats) {
+	for (int i = 0; i < SCAN_STAT_COUNT; i++) {
+		pg_atomic_write_u64(&stats->counters[i], 0);
+	}
+	for (int i = 0; i < FALLBACK_REASON_COUNT; i++) {
+		pg_atomic_write_u64(&stats->fallbacks[i], 0);
+	}
+}
+
+static void
+InitBackendScanStats(BackendScanStats *stats) {
+	stats->pid = 0;
+	for (int i = 0; i < SCAN_STAT_COUNT; i++) {
+		pg_atomic_init_u64(&stats->counters[i], 0);
+	}
+	for (int i = 0; i < FALLBACK_REASON_COUNT; i++) {
+		pg_atomic_init_u64(&stats->fallbacks[i], 0);
+	}
+}
+
+static void
+DuckdbStatsShmemRequest() {
+	if (prev_shmem_request_hook) {
+		prev_shmem_request_hook();
+	}
+	RequestAddinShmemSpace(DuckdbStatsShmemSize());
+}
+
+static void
+DuckdbStatsShmemStartup() {
+	bool found;
+
+	if (prev_shmem_startup_hook) {
+		prev_shmem_startup_hook();
+	}
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+	duckdb_stats = (DuckdbStatsShared *)ShmemInitStruct("pg_duckdb scan stats", DuckdbStatsShmemSize(), &found);
+	if (!found) {
+		InitBackendScanStats(&duckdb_stats->cluster);
+		for (int i = 0; i < MaxBackends; i++) {
+			InitBackendScanStats(&duckdb_stats->backends[i]);
+		}
+	}
+	LWLockRelease(AddinShmemInitLock);
+}
+
+static void
+DetachScanStats(int code, Datum arg) {
+	auto stats = my_stats;
+	my_stats = nullptr;
+	for (int i = 0; i < SCAN_STAT_COUNT; i++) {
+		pg_atomic_fetch_add_u64(&duckdb_stats->cluster.counters[i], pg_atomic_exchange_u64(&stats->counters[i], 0));
+	}
+	for (int i = 0; i < FALLBACK_REASON_COUNT; i++) {
+		pg_atomic_fetch_add_u64(&duckdb_stats->cluster.fallbacks[i], pg_atomic_exchange_u64(&stats->fallbacks[i], 0));
+	}
+	stats->pid = 0;
+}
+
+/*
+ * Attaches this backend to its shared memory slot. Has to be called from the backend itself (not from a DuckDB
+ * thread) before any scan runs.
+ */
+void
+AttachScanStats() {
+	if (my_stats || !duckdb_stats || MyBackendId == InvalidBackendId) {
+		return;
+	}
+	my_stats = &duckdb_stats->backends[MyBackendId - 1];
+	ResetBackendScanStats(my_stats);
+	my_stats->pid = MyProcPid;
+	before_shmem_exit(DetachScanStats, (Datum)0);
+}
+
+void
+FlushScanStats(ScanStats &stats) {
+	if (my_stats) {
+		for (int i = 0; i < SCAN_STAT_COUNT; i++) {
+			if (stats.m_counters[i]) {
+				pg_atomic_fetch_add_u64(&my_stats->counters[i], stats.m_counters[i]);
+			}
+		}
+	}
+	memset(stats.m_counters, 0, sizeof(stats.m_counters));
+}
+
+void
+CountDuckdbQuery() {
+	if (my_stats) {
+		pg_atomic_fetch_add_u64(&my_stats->counters[SCAN_STAT_DUCKDB_QUERIES], 1);
+	}
+}
+
+void
+CountFallback(FallbackReason reason) {
+	if (my_stats) {
+		pg_atomic_fetch_add_u64(&my_stats->counters[SCAN_STAT_FALLBACKS], 1);
+		pg_atomic_fetch_add_u64(&my_stats->fallbacks[reason], 1);
+	}
+}
+
+void
+CountResultCacheLookup(bool hit) {
+	if (my_stats) {
+		auto counter = hit ? SCAN_STAT_RESULT_CACHE_HITS : SCAN_STAT_RESULT_CACHE_MISSES;
+		pg_atomic_fetch_add_u64(&my_stats->counters[counter], 1);
+	}
+}
+
+void
+DuckdbInitStats() {
+	if (!process_shared_preload_libraries_in_progress) {
+		return;
+	}
+	prev_shmem_request_hook = shmem_request_hook;
+	shmem_request_hook = DuckdbStatsShmemRequest;
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = DuckdbStatsShmemStartup;
+}
+
+static void
+CheckStatsAvailable() {
+	if (!duckdb_stats) {
+		ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+		                errmsg("pg_duckdb statistics are only collected when pg_duckdb is loaded via "
+		                       "shared_preload_libraries")));
+	}
+}
+
+/* Adds the counters of the cluster wide totals and every attached backend */
+static void
+SumScanStats(uint64 *counters, uint64 *fallbacks) {
+	for (int i = 0; i < SCAN_STAT_COUNT; i++) {
+		counters[i] = pg_atomic_read_u64(&duckdb_stats->cluster.counters[i]);
+	}
+	for (int i = 0; i < FALLBACK_REASON_COUNT; i++) {
+		fallbacks[i] = pg_atomic_read_u64(&duckdb_stats->cluster.fallbacks[i]);
+	}
+	for (int backend = 0; backend < MaxBackends; backend++) {
+		auto stats = &duckdb_stats->backends[backend];
+		if (stats->pid == 0) {
+			continue;
+		}
+		for (int i = 0; i < SCAN_STAT_COUNT; i++) {
+			counters[i] += pg_atomic_read_u64(&stats->counters[i]);
+		}
+		for (int i = 0; i < FALLBACK_REASON_COUNT; i++) {
+			fallbacks[i] += pg_atomic_read_u64(&stats->fallbacks[i]);
+		}
+	}
+}
+
+static bool
+IsTimeCounter(int counter) {
+	return counter >= SCAN_STAT_VISIBILITY_TIME;
+}
+
+static void
+PutScanStatsRow(ReturnSetInfo *rsinfo, int pid, const uint64 *counters) {
+	Datum values[SCAN_STAT_COUNT + 1];
+	bool nulls[SCAN_STAT_COUNT + 1] = {};
+
+	/* The cluster wide row has no pid */
+	nulls[0] = pid == 0;
+	values[0] = Int32GetDatum(pid);
+	for (int i = 0; i < SCAN_STAT_COUNT; i++) {
+		/* Times are reported in milliseconds, like pg_stat_statements and pg_stat_io do */
+		values[i + 1] = IsTimeCounter(i) ? Float8GetDatum(counters[i] / 1000.0) : Int64GetDatum(counters[i]);
+	}
+	tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc, values, nulls);
+}
+
+static void
+PutFallbackRows(ReturnSetInfo *rsinfo, int pid, const uint64 *fallbacks) {
+	for (int i = 0; i < FALLBACK_REASON_COUNT; i++) {
+		Datum values[3];
+		bool nulls[3] = {pid == 0, false, false};
+		values[0] = Int32GetDatum(pid);
+		values[1] = CStringGetTextDatum(fallback_reason_names[i]);
+		values[2] = Int64GetDatum(fallbacks[i]);
+		tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc, values, nulls);
+	}
+}
+
+/* Reads the counters of a backend slot, returns false if the slot is not in use */
+static bool
+ReadBackendScanStats(BackendScanStats *stats, int *pid, uint64 *counters, uint64 *fallbacks) {
+	*pid = stats->pid;
+	if (*pid == 0) {
+		return false;
+	}
+	for (int i = 0; i < SCAN_STAT_COUNT; i++) {
+		counters[i] = pg_atomic_read_u64(&stats->counters[i]);
+	}
+	for (int i = 0; i < FALLBACK_REASON_COUNT; i++) {
+		fallbacks[i] = pg_atomic_read_u64(&stats->fallbacks[i]);
+	}
+	return true;
+}
+
+} // namespace pgduckdb
+
+extern "C" {
+
+PG_FUNCTION_INFO_V1(duckdb_stat_scans);
+Datum
+duckdb_stat_scans(PG_FUNCTION_ARGS) {
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *)fcinfo->resultinfo;
+	uint64 counters[pgduckdb::SCAN_STAT_COUNT];
+	uint64 fallbacks[pgduckdb::FALLBACK_REASON_COUNT];
+	int pid;
+
+	pgduckdb::CheckStatsAvailable();
+	InitMaterializedSRF(fcinfo, 0);
+
+	pgduckdb::SumScanStats(counters, fallbacks);
+	pgduckdb::PutScanStatsRow(rsinfo, 0, counters);
+
+	for (int backend = 0; backend < MaxBackends; backend++) {
+		if (pgduckdb::ReadBackendScanStats(&pgduckdb::duckdb_stats->backends[backend], &pid, counters, fallbacks)) {
+			pgduckdb::PutScanStatsRow(rsinfo, pid, counters);
+		}
+	}
+
+	return (Datum)0;
+}
+
+PG_FUNCTION_INFO_V1(duckdb_stat_fallbacks);
+Datum
+duckdb_stat_fallbacks(PG_FUNCTION_ARGS) {
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *)fcinfo->resultinfo;
+	uint64 counters[pgduckdb::SCAN_STAT_COUNT];
+	uint64 fallbacks[pgduckdb::FALLBACK_REASON_COUNT];
+	int pid;
+
+	pgduckdb::CheckStatsAvailable();
+	InitMaterializedSRF(fcinfo, 0);
+
+	pgduckdb::SumScanStats(counters, fallbacks);
+	pgduckdb::PutFallbackRows(rsinfo, 0, fallbacks);
+
+	for (int backend = 0; backend < MaxBackends; backend++) {
+		if (pgduckdb::ReadBackendScanStats(&pgduckdb::duckdb_stats->backends[backend], &pid, counters, fallbacks)) {
+			pgduckdb::PutFallbackRows(rsinfo, pid, fallbacks);
+		}
+	}
+
+	return (Datum)0;
+}
+
+PG_FUNCTION_INFO_V1(duckdb_stat_scans_reset);
+Datum
+duckdb_stat_scans_reset(PG_FUNCTION_ARGS) {
+	pgduckdb::CheckStatsAvailable();
+	pgduckdb::ResetBackendScanStats(&pgduckdb::duckdb_stats->cluster);
+	for (int backend = 0; backend < MaxBackends; backend++) {
+		pgduckdb::ResetBackendScanStats(&pgduckdb::duckdb_stats->backends[backend]);
+	}
+	PG_RETURN_VOID();
+}
+
+} // extern "C"
@@ -0,0 +1,70 @@
+extern "C" {
+#include "postgres.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "utils/builtins.h"
+#include "utils/tuplestore.h"
+}
+
+#include "pgduckdb/pgduckdb_timing.hpp"
+
+namespace pgduckdb {
+
+static const char *setup_phase_names[] = {"plan_query",      "open_database",   "create_connection", "register_catalog",
+                                          "load_secrets",    "load_extensions", "prepare",           "total"};
+
+static_assert(sizeof(setup_phase_names) / sizeof(setup_phase_names[0]) == (size_t)SetupPhase::PHASE_COUNT,
+              "every setup phase needs a name");
+
+struct SetupPhaseTiming {
+	int64 calls;
+	instr_time total;
+};
+
+static SetupPhaseTiming setup_timings[(size_t)SetupPhase::PHASE_COUNT];
+
+void
+AccumulateSetupTime(SetupPhase phase, const instr_time &start) {
+	instr_time duration;
+	INSTR_TIME_SET_CURRENT(duration);
+	INSTR_TIME_SUBTRACT(duration, start);
+
+	auto &timing = setup_timings[(size_t)phase];
+	timing.calls++;
+	INSTR_TIME_ADD(timing.total, duration);
+}
+
+} // namespace pgduckdb
+
+extern "C" {
+
+PG_FUNCTION_INFO_V1(query_setup_timing);
+Datum
+query_setup_timing(PG_FUNCTION_ARGS) {
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *)fcinfo->resultinfo;
+	InitMaterializedSRF(fcinfo, 0);
+
+	for (size_t phase = 0; phase < (size_t)pgduckdb::SetupPhase::PHASE_COUNT; phase++) {
+		auto &timing = pgduckdb::setup_timings[phase];
+		double total_ms = INSTR_TIME_GET_MILLISEC(timing.total);
+		Datum values[4];
+		bool nulls[4] = {false, false, false, false};
+
+		values[0] = CStringGetTextDatum(pgduckdb::setup_phase_names[phase]);
+		values[1] = Int64GetDatum(timing.calls);
+		values[2] = Float8GetDatum(total_ms);
+		values[3] = Float8GetDatum(timing.calls ? total_ms / timing.calls : 0.0);
+		tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc, values, nulls);
+	}
+
+	return (Datum)0;
+}
+
+PG_FUNCTION_INFO_V1(reset_query_setup_timing);
+Datum
+reset_query_setup_timing(PG_FUNCTION_ARGS) {
+	memset(pgduckdb::setup_timings, 0, sizeof(pgduckdb::setup_timings));
+	PG_RETURN_VOID();
+}
+
+} // extern "C"
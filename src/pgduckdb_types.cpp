@@ -22,6 +22,8 @@ extern "C" {
 #include "pgduckdb/types/decimal.hpp"
 #include "pgduckdb/pgduckdb_filter.hpp"
 #include "pgduckdb/pgduckdb_detoast.hpp"
+#include "pgduckdb/pgduckdb_guard.hpp"
+#include "pgduckdb/pgduckdb_process_lock.hpp"
 #include "pgduckdb/pgduckdb_types.hpp"
 
 namespace pgduckdb {
@@ -552,6 +554,15 @@ ConvertPostgresToDuckColumnType(Form_pg_attribute &attribute) {
 	}
 }
 
+bool
+IsSupportedPostgresType(Oid type) {
+	FormData_pg_attribute attribute = {};
+	attribute.atttypid = type;
+	attribute.atttypmod = -1;
+	Form_pg_attribute attr = &attribute;
+	return ConvertPostgresToDuckColumnType(attr).id() != duckdb::LogicalTypeId::USER;
+}
+
 Oid
 GetPostgresDuckDBType(duckdb::LogicalType type) {
 	auto id = type.id();
@@ -804,23 +815,30 @@ ConvertPostgresToDuckValue(Datum value, duckdb::Vector &result, idx_t offset) {
 		break;
 	}
 	case duckdb::LogicalTypeId::LIST: {
-		// Convert Datum to ArrayType
-		auto array = DatumGetArrayTypeP(value);
+		ArrayType *array = nullptr;
+		int nelems = 0;
+		Datum *elems = nullptr;
+		bool *nulls = nullptr;
+		{
+			/* Detoasting and deconstructing the array allocate memory and may look up the element type */
+			std::lock_guard<std::mutex> lock(DuckdbProcessLock::GetLock());
+			PostgresFunctionGuard([&] {
+				// Convert Datum to ArrayType
+				array = DatumGetArrayTypeP(value);
+
+				int16 typlen;
+				bool typbyval;
+				char typalign;
+				get_typlenbyvalalign(ARR_ELEMTYPE(array), &typlen, &typbyval, &typalign);
+
+				// Deconstruct the array into Datum elements
+				deconstruct_array(array, ARR_ELEMTYPE(array), typlen, typbyval, typalign, &elems, &nulls, &nelems);
+			});
+		}
 
 		auto ndims = ARR_NDIM(array);
 		int *dims = ARR_DIMS(array);
 
-		int16 typlen;
-		bool typbyval;
-		char typalign;
-		get_typlenbyvalalign(ARR_ELEMTYPE(array), &typlen, &typbyval, &typalign);
-
-		int nelems;
-		Datum *elems;
-		bool *nulls;
-		// Deconstruct the array into Datum elements
-		deconstruct_array(array, ARR_ELEMTYPE(array), typlen, typbyval, typalign, &elems, &nulls, &nelems);
-
 		if (ndims == -1) {
 			throw duckdb::InternalException("Array type has an ndims of -1, so it's actually not an array??");
 		}
@@ -882,150 +900,214 @@ ConvertPostgresToDuckValue(Datum value, duckdb::Vector &result, idx_t offset) {
 	}
 }
 
-typedef struct HeapTupleReadState {
-	bool m_slow = 0;
-	int m_last_tuple_att = 0;
-	uint32 m_page_tuple_offset = 0;
-} HeapTupleReadState;
-
-static Datum
-HeapTupleFetchNextColumnDatum(TupleDesc tupleDesc, HeapTuple tuple, HeapTupleReadState &heap_tuple_read_state,
-                              int att_num, bool *is_null) {
-	HeapTupleHeader tup = tuple->t_data;
-	bool hasnulls = HeapTupleHasNulls(tuple);
-	int attnum;
-	char *tp;
-	uint32 off;
-	bits8 *bp = tup->t_bits;
-	bool slow = false;
-	Datum value = (Datum)0;
-
-	attnum = heap_tuple_read_state.m_last_tuple_att;
-
-	if (attnum == 0) {
-		/* Start from the first attribute */
-		off = 0;
-		heap_tuple_read_state.m_slow = false;
-	} else {
-		/* Restore state from previous execution */
-		off = heap_tuple_read_state.m_page_tuple_offset;
-		slow = heap_tuple_read_state.m_slow;
+/*
+ * Returns a converter for values of the given type. Types whose conversion needs no extra type information get a
+ * specialized converter; everything else goes through the generic ConvertPostgresToDuckValue.
+ */
+PostgresToDuckConverter
+GetPostgresToDuckConverter(const duckdb::LogicalType &type) {
+	if (type.GetAuxInfoShrPtr()) {
+		return ConvertPostgresToDuckValue;
 	}
+	switch (type.id()) {
+	case duckdb::LogicalTypeId::BOOLEAN:
+		return [](Datum value, duckdb::Vector &result, idx_t offset) {
+			Append<bool>(result, DatumGetBool(value), offset);
+		};
+	case duckdb::LogicalTypeId::SMALLINT:
+		return [](Datum value, duckdb::Vector &result, idx_t offset) {
+			Append<int16_t>(result, DatumGetInt16(value), offset);
+		};
+	case duckdb::LogicalTypeId::INTEGER:
+		return [](Datum value, duckdb::Vector &result, idx_t offset) {
+			Append<int32_t>(result, DatumGetInt32(value), offset);
+		};
+	case duckdb::LogicalTypeId::BIGINT:
+		return [](Datum value, duckdb::Vector &result, idx_t offset) {
+			Append<int64_t>(result, DatumGetInt64(value), offset);
+		};
+	case duckdb::LogicalTypeId::FLOAT:
+		return [](Datum value, duckdb::Vector &result, idx_t offset) {
+			Append<float>(result, DatumGetFloat4(value), offset);
+		};
+	case duckdb::LogicalTypeId::DOUBLE:
+		return [](Datum value, duckdb::Vector &result, idx_t offset) {
+			Append<double>(result, DatumGetFloat8(value), offset);
+		};
+	case duckdb::LogicalTypeId::DATE:
+		return [](Datum value, duckdb::Vector &result, idx_t offset) {
+			Append<duckdb::date_t>(result, duckdb::date_t(static_cast<int32_t>(value + PGDUCKDB_DUCK_DATE_OFFSET)),
+			                       offset);
+		};
+	case duckdb::LogicalTypeId::TIMESTAMP:
+		return [](Datum value, duckdb::Vector &result, idx_t offset) {
+			Append<duckdb::timestamp_t>(
+			    result, duckdb::timestamp_t(static_cast<int64_t>(value + PGDUCKDB_DUCK_TIMESTAMP_OFFSET)), offset);
+		};
+	case duckdb::LogicalTypeId::VARCHAR:
+		return AppendString;
+	default:
+		return ConvertPostgresToDuckValue;
+	}
+}
 
-	tp = (char *)tup + tup->t_hoff;
-
-	for (; attnum < att_num; attnum++) {
-		Form_pg_attribute thisatt = TupleDescAttr(tupleDesc, attnum);
+/* Applies the TableFilters DuckDB pushed into the scan to a deformed tuple */
+static bool
+ApplyFilterSteps(const TupleDeformProgram &program, const Datum *values, const bool *nulls, ScanStats &stats) {
+	if (program.m_filter_steps.empty()) {
+		return true;
+	}
 
-		if (hasnulls && att_isnull(attnum, bp)) {
-			value = (Datum)0;
-			*is_null = true;
-			slow = true; /* can't use attcacheoff anymore */
-			continue;
+	instr_time start;
+	bool valid_tuple = true;
+	stats.StartTimer(start);
+	for (auto &filter_step : program.m_filter_steps) {
+		if (!ApplyValueFilter(*filter_step.filter, values[filter_step.value_idx], nulls[filter_step.value_idx],
+		                      filter_step.type_oid)) {
+			valid_tuple = false;
+			break;
 		}
+	}
+	stats.StopTimer(SCAN_STAT_FILTER_TIME, start);
+	return valid_tuple;
+}
 
-		*is_null = false;
-
-		if (!slow && thisatt->attcacheoff >= 0) {
-			off = thisatt->attcacheoff;
-		} else if (thisatt->attlen == -1) {
-			if (!slow && off == att_align_nominal(off, thisatt->attalign)) {
-				thisatt->attcacheoff = off;
-			} else {
-				off = att_align_pointer(off, thisatt->attalign, -1, tp + off);
-				slow = true;
+/* Detoasts and converts the values of a deformed tuple into row of the vectors of chunk, one per step */
+static void
+ConvertTupleValues(const duckdb::vector<TupleDeformProgram::OutputStep> &steps, const Datum *values,
+                   const bool *nulls, duckdb::DataChunk &chunk, idx_t row, ScanStats &stats) {
+	instr_time start;
+	for (idx_t idx = 0; idx < steps.size(); idx++) {
+		auto &output_step = steps[idx];
+		auto &result = chunk.data[idx];
+		if (nulls[output_step.value_idx]) {
+			auto &array_mask = duckdb::FlatVector::Validity(result);
+			array_mask.SetInvalid(row);
+		} else if (output_step.is_varlena) {
+			bool should_free = false;
+			stats.StartTimer(start);
+			Datum value =
+			    DetoastPostgresDatum(reinterpret_cast<varlena *>(values[output_step.value_idx]), &should_free);
+			stats.StopTimer(SCAN_STAT_DETOAST_TIME, start);
+			output_step.convert(value, result, row);
+			if (should_free) {
+				duckdb_free(reinterpret_cast<void *>(value));
 			}
 		} else {
-			off = att_align_nominal(off, thisatt->attalign);
-			if (!slow) {
-				thisatt->attcacheoff = off;
-			}
-		}
-
-		value = fetchatt(thisatt, tp + off);
-
-		off = att_addlength_pointer(off, thisatt->attlen, tp + off);
-
-		if (thisatt->attlen <= 0) {
-			slow = true;
+			output_step.convert(values[output_step.value_idx], result, row);
 		}
 	}
-
-	heap_tuple_read_state.m_last_tuple_att = att_num;
-	heap_tuple_read_state.m_page_tuple_offset = off;
-
-	if (slow) {
-		heap_tuple_read_state.m_slow = true;
-	} else {
-		heap_tuple_read_state.m_slow = false;
-	}
-
-	return value;
 }
 
 void
 InsertTupleIntoChunk(duckdb::DataChunk &output, duckdb::shared_ptr<PostgresScanGlobalState> scan_global_state,
                      duckdb::shared_ptr<PostgresScanLocalState> scan_local_state, HeapTupleData *tuple) {
-	HeapTupleReadState heap_tuple_read_state = {};
-
 	if (scan_global_state->m_count_tuples_only) {
 		scan_local_state->m_output_vector_size++;
 		return;
 	}
 
+	auto &program = *scan_global_state->m_deform_program;
+	auto &stats = scan_local_state->m_stats;
+	instr_time start;
+
 	/* FIXME: all calls to duckdb_malloc/duckdb_free should be changed in future */
-	Datum *values = (Datum *)duckdb_malloc(sizeof(Datum) * scan_global_state->m_columns.size());
-	bool *nulls = (bool *)duckdb_malloc(sizeof(bool) * scan_global_state->m_columns.size());
+	Datum *values = (Datum *)duckdb_malloc(sizeof(Datum) * program.m_value_count);
+	bool *nulls = (bool *)duckdb_malloc(sizeof(bool) * program.m_value_count);
 
-	bool valid_tuple = true;
+	stats.StartTimer(start);
+	program.Deform(tuple, values, nulls);
+	stats.StopTimer(SCAN_STAT_DEFORM_TIME, start);
 
-	for (auto const &[columnIdx, valueIdx] : scan_global_state->m_columns) {
-		values[valueIdx] = HeapTupleFetchNextColumnDatum(scan_global_state->m_tuple_desc, tuple, heap_tuple_read_state,
-		                                                 columnIdx + 1, &nulls[valueIdx]);
-		if (scan_global_state->m_filters &&
-		    (scan_global_state->m_filters->filters.find(valueIdx) != scan_global_state->m_filters->filters.end())) {
-			auto &filter = scan_global_state->m_filters->filters[valueIdx];
-			valid_tuple = ApplyValueFilter(*filter, values[valueIdx], nulls[valueIdx],
-			                               scan_global_state->m_tuple_desc->attrs[columnIdx].atttypid);
-		}
+	if (ApplyFilterSteps(program, values, nulls, stats)) {
+		ConvertTupleValues(program.m_output_steps, values, nulls, output, scan_local_state->m_output_vector_size,
+		                   stats);
+		scan_local_state->m_output_vector_size++;
+	} else {
+		stats.Count(SCAN_STAT_TUPLES_FILTERED);
+	}
 
-		if (!valid_tuple) {
-			break;
+	output.SetCardinality(scan_local_state->m_output_vector_size);
+	output.Verify();
+
+	scan_global_state->m_total_row_count++;
+
+	duckdb_free(values);
+	duckdb_free(nulls);
+}
+
+/*
+ * Evaluates the complex filter of the scan on a batch of visible tuples whose buffers are still pinned. Only the filter
+ * columns are converted for every tuple, the other output columns are detoasted and converted for the tuples that
+ * pass the filter.
+ */
+void
+InsertFilteredTuplesIntoChunk(duckdb::DataChunk &output, duckdb::shared_ptr<PostgresScanGlobalState> scan_global_state,
+                              duckdb::shared_ptr<PostgresScanLocalState> scan_local_state, HeapTupleData *tuples,
+                              idx_t count) {
+	auto &program = *scan_global_state->m_deform_program;
+	auto &filter = *scan_local_state->m_complex_filter;
+	auto &stats = scan_local_state->m_stats;
+	auto value_count = program.m_value_count;
+	instr_time start;
+
+	Datum *values = (Datum *)duckdb_malloc(sizeof(Datum) * value_count * count);
+	bool *nulls = (bool *)duckdb_malloc(sizeof(bool) * value_count * count);
+
+	filter.m_chunk.Reset();
+	idx_t filter_count = 0;
+	for (idx_t idx = 0; idx < count; idx++) {
+		stats.StartTimer(start);
+		program.Deform(&tuples[idx], values + idx * value_count, nulls + idx * value_count);
+		stats.StopTimer(SCAN_STAT_DEFORM_TIME, start);
+
+		if (ApplyFilterSteps(program, values + idx * value_count, nulls + idx * value_count, stats)) {
+			ConvertTupleValues(program.m_complex_filter_steps, values + idx * value_count, nulls + idx * value_count,
+			                   filter.m_chunk, filter_count, stats);
+			filter.m_rows[filter_count++] = idx;
 		}
 	}
+	filter.m_chunk.SetCardinality(filter_count);
 
-	for (idx_t idx = 0; valid_tuple && idx < scan_global_state->m_projections.size(); idx++) {
-		auto &result = output.data[idx];
-		if (nulls[idx]) {
-			auto &array_mask = duckdb::FlatVector::Validity(result);
-			array_mask.SetInvalid(scan_local_state->m_output_vector_size);
-		} else {
-			idx_t projectionColumnIdx = scan_global_state->m_columns[scan_global_state->m_projections[idx]];
-			if (scan_global_state->m_tuple_desc->attrs[scan_global_state->m_projections[idx]].attlen == -1) {
-				bool should_free = false;
-				values[projectionColumnIdx] =
-				    DetoastPostgresDatum(reinterpret_cast<varlena *>(values[projectionColumnIdx]), &should_free);
-				ConvertPostgresToDuckValue(values[projectionColumnIdx], result, scan_local_state->m_output_vector_size);
-				if (should_free) {
-					duckdb_free(reinterpret_cast<void *>(values[projectionColumnIdx]));
-				}
-			} else {
-				ConvertPostgresToDuckValue(values[projectionColumnIdx], result, scan_local_state->m_output_vector_size);
-			}
-		}
+	idx_t selected = 0;
+	if (filter_count) {
+		stats.StartTimer(start);
+		selected = filter.m_executor.SelectExpression(filter.m_chunk, filter.m_sel);
+		stats.StopTimer(SCAN_STAT_FILTER_TIME, start);
 	}
 
-	if (valid_tuple) {
+	for (idx_t idx = 0; idx < selected; idx++) {
+		idx_t tuple_idx = filter.m_rows[filter.m_sel.get_index(idx)];
+		ConvertTupleValues(program.m_output_steps, values + tuple_idx * value_count, nulls + tuple_idx * value_count,
+		                   output, scan_local_state->m_output_vector_size, stats);
 		scan_local_state->m_output_vector_size++;
 	}
+	stats.Count(SCAN_STAT_TUPLES_FILTERED, count - selected);
 
 	output.SetCardinality(scan_local_state->m_output_vector_size);
-	output.Verify();
-
-	scan_global_state->m_total_row_count++;
+	scan_global_state->m_total_row_count += count;
 
 	duckdb_free(values);
 	duckdb_free(nulls);
 }
 
+/* Tuples have to be visible and pass TupleDeformProgram::CanGatherTuple() */
+void
+InsertFixedWidthTuplesIntoChunk(duckdb::DataChunk &output,
+                                duckdb::shared_ptr<PostgresScanGlobalState> scan_global_state,
+                                duckdb::shared_ptr<PostgresScanLocalState> scan_local_state,
+                                const HeapTupleHeader *tuples, idx_t count) {
+	auto &stats = scan_local_state->m_stats;
+	instr_time start;
+
+	stats.StartTimer(start);
+	scan_global_state->m_deform_program->GatherFixedWidth(tuples, count, output,
+	                                                      scan_local_state->m_output_vector_size);
+	stats.StopTimer(SCAN_STAT_DEFORM_TIME, start);
+
+	scan_local_state->m_output_vector_size += count;
+	output.SetCardinality(scan_local_state->m_output_vector_size);
+	scan_global_state->m_total_row_count += count;
+}
+
 } // namespace pgduckdb
@@ -3,33 +3,246 @@
 extern "C" {
 #include "postgres.h"
 #include "pgstat.h"
+#include "portability/instr_time.h"
 #include "access/heapam.h"
+#include "access/visibilitymap.h"
+#include "access/xlog.h"
+#include "common/relpath.h"
 #include "storage/bufmgr.h"
 #include "storage/bufpage.h"
+#include "storage/fd.h"
 #include "utils/rel.h"
+#include "utils/snapmgr.h"
 }
 
+#include <unistd.h>
+
+#include "pgduckdb/pgduckdb.h"
+#include "pgduckdb/pgduckdb_guard.hpp"
 #include "pgduckdb/pgduckdb_process_lock.hpp"
 #include "pgduckdb/scan/heap_reader.hpp"
 #include "pgduckdb/pgduckdb_types.hpp"
+#include "pgduckdb/pgduckdb_stats.hpp"
 
 namespace pgduckdb {
 
+//
+// HeapReaderSharedState
+//
+
+/* Largest temporary relation whose pages are copied for the scan threads, larger ones are read page by page */
+#define HEAP_READER_MAX_LOCAL_PAGES ((BlockNumber)(1024L * 1024L * 1024L / BLCKSZ))
+
+/* Most pages whose tuple visibility is kept at once for the other scans of a relation, 1GB of pages with 8kB blocks */
+#define HEAP_READER_MAX_SHARED_VISIBILITY_PAGES 131072
+
+HeapReaderSharedState::HeapReaderSharedState(Snapshot snapshot, duckdb::idx_t scan_count)
+    : m_snapshot(snapshot), m_scan_count(scan_count), m_registered_scans(0), m_xid_status_cache(snapshot),
+      m_local_pages_copied(false) {
+}
+
+duckdb::idx_t
+HeapReaderSharedState::RegisterScan() {
+	std::lock_guard<std::mutex> guard(m_page_visibility_lock);
+	return m_registered_scans++;
+}
+
+/*
+ * A scan that is stopped early never reads the pages whose visibility other scans kept for it, so it is dropped from
+ * them to free the ones no other scan still has to read.
+ */
+void
+HeapReaderSharedState::FinishScan(duckdb::idx_t scan) {
+	if (scan >= m_scan_count) {
+		return;
+	}
+	std::lock_guard<std::mutex> guard(m_page_visibility_lock);
+	for (auto entry = m_page_visibility.begin(); entry != m_page_visibility.end();) {
+		auto &page_visibility = entry->second;
+		if (page_visibility.pending_scans[scan]) {
+			page_visibility.pending_scans[scan] = false;
+			page_visibility.remaining_scans--;
+		}
+		if (page_visibility.remaining_scans == 0) {
+			entry = m_page_visibility.erase(entry);
+		} else {
+			entry++;
+		}
+	}
+}
+
+/*
+ * Temporary relations live in backend local buffers, so every page read of the scan threads would have to be
+ * serialized with DuckdbProcessLock. Instead their pages are copied once while initializing the scan, together with
+ * the visibility of their tuples, and the threads only decode the copies.
+ */
+BlockNumber
+HeapReaderSharedState::CopyLocalPages(Relation relation, BlockNumber nblocks) {
+	std::lock_guard<std::mutex> lock(DuckdbProcessLock::GetLock());
+	if (m_local_pages_copied || nblocks == 0 || nblocks > HEAP_READER_MAX_LOCAL_PAGES) {
+		return HasLocalPages() ? m_local_pages.size() / BLCKSZ : nblocks;
+	}
+	m_local_pages_copied = true;
+
+	m_local_pages.resize((size_t)nblocks * BLCKSZ);
+	m_local_visibility.resize((size_t)nblocks * MaxHeapTuplesPerPage);
+
+	HeapTupleData tuple;
+	tuple.t_tableOid = RelationGetRelid(relation);
+	PostgresFunctionGuard([&] {
+		for (BlockNumber block = 0; block < nblocks; block++) {
+			Buffer buffer = ReadBuffer(relation, block);
+			LockBuffer(buffer, BUFFER_LOCK_SHARE);
+			Page page = BufferGetPage(buffer);
+			bool all_visible = PageIsAllVisible(page) && !m_snapshot->takenDuringRecovery;
+			char *visible = &m_local_visibility[(size_t)block * MaxHeapTuplesPerPage];
+			OffsetNumber max_offset = PageGetMaxOffsetNumber(page);
+			for (OffsetNumber offset = FirstOffsetNumber; offset <= max_offset; offset++) {
+				ItemId lpp = PageGetItemId(page, offset);
+				if (!ItemIdIsNormal(lpp)) {
+					continue;
+				}
+				if (all_visible) {
+					visible[offset - FirstOffsetNumber] = true;
+					continue;
+				}
+				tuple.t_data = (HeapTupleHeader)PageGetItem(page, lpp);
+				tuple.t_len = ItemIdGetLength(lpp);
+				ItemPointerSet(&tuple.t_self, block, offset);
+				visible[offset - FirstOffsetNumber] = HeapTupleSatisfiesVisibility(&tuple, m_snapshot, buffer);
+			}
+			/* Copied after the visibility checks, so the hint bits they set are part of the copy */
+			memcpy(&m_local_pages[(size_t)block * BLCKSZ], page, BLCKSZ);
+			UnlockReleaseBuffer(buffer);
+		}
+	});
+	return nblocks;
+}
+
+/* Returns the copy of a page of a temporary relation and sets the visibility of its tuples */
+Page
+HeapReaderSharedState::GetLocalPage(BlockNumber block, bool *visible) {
+	Page page = &m_local_pages[(size_t)block * BLCKSZ];
+	const char *local_visible = &m_local_visibility[(size_t)block * MaxHeapTuplesPerPage];
+	OffsetNumber max_offset = PageGetMaxOffsetNumber(page);
+	for (OffsetNumber offset = FirstOffsetNumber; offset <= max_offset; offset++) {
+		visible[offset - FirstOffsetNumber] = local_visible[offset - FirstOffsetNumber];
+	}
+	return page;
+}
+
+/*
+ * The visibility of a tuple to an MVCC snapshot doesn't change, and the line pointers of the tuples the snapshot can
+ * see are not reused while it is registered. Tuples added to the page after another scan resolved its visibility are
+ * not visible to the snapshot either, so that result can be reused as is.
+ */
+void
+HeapReaderSharedState::PageTuplesVisibility(duckdb::idx_t scan, Relation relation, BlockNumber block, Buffer buffer,
+                                            Page page, bool *visible, ScanStats &stats) {
+	/* Scans beyond the expected ones, e.g. of a plan that is executed again, don't take part */
+	if (m_scan_count < 2 || scan >= m_scan_count) {
+		m_xid_status_cache.PageTuplesVisibility(relation, block, buffer, page, visible, stats);
+		return;
+	}
+
+	OffsetNumber max_offset = PageGetMaxOffsetNumber(page);
+	{
+		std::lock_guard<std::mutex> guard(m_page_visibility_lock);
+		auto entry = m_page_visibility.find(block);
+		if (entry != m_page_visibility.end()) {
+			auto &known_visible = entry->second.visible;
+			for (OffsetNumber offset = FirstOffsetNumber; offset <= max_offset; offset++) {
+				duckdb::idx_t idx = offset - FirstOffsetNumber;
+				visible[idx] = idx < known_visible.size() && known_visible[idx];
+			}
+			if (entry->second.pending_scans[scan]) {
+				entry->second.pending_scans[scan] = false;
+				entry->second.remaining_scans--;
+			}
+			if (entry->second.remaining_scans == 0) {
+				m_page_visibility.erase(entry);
+			}
+			return;
+		}
+	}
+
+	m_xid_status_cache.PageTuplesVisibility(relation, block, buffer, page, visible, stats);
+
+	std::lock_guard<std::mutex> guard(m_page_visibility_lock);
+	if (m_page_visibility.size() >= HEAP_READER_MAX_SHARED_VISIBILITY_PAGES) {
+		return;
+	}
+	PageVisibility page_visibility;
+	page_visibility.visible.resize(max_offset);
+	for (OffsetNumber offset = FirstOffsetNumber; offset <= max_offset; offset++) {
+		page_visibility.visible[offset - FirstOffsetNumber] =
+		    ItemIdIsNormal(PageGetItemId(page, offset)) && visible[offset - FirstOffsetNumber];
+	}
+	page_visibility.pending_scans.resize(m_scan_count, true);
+	page_visibility.pending_scans[scan] = false;
+	page_visibility.remaining_scans = m_scan_count - 1;
+	m_page_visibility.emplace(block, std::move(page_visibility));
+}
+
 //
 // HeapReaderGlobalState
 //
 
+HeapReaderGlobalState::HeapReaderGlobalState(Relation relation, Snapshot snapshot,
+                                             duckdb::shared_ptr<HeapReaderSharedState> shared_state)
+    : m_nblocks(0), m_last_assigned_block_number(InvalidBlockNumber),
+      m_shared_state(shared_state ? shared_state : duckdb::make_shared_ptr<HeapReaderSharedState>(snapshot, 1)),
+      m_scan_index(m_shared_state->RegisterScan()), m_direct_reads(false) {
+	{
+		std::lock_guard<std::mutex> lock(DuckdbProcessLock::GetLock());
+		PostgresFunctionGuard([&] { m_nblocks = RelationGetNumberOfBlocks(relation); });
+	}
+	if (RelationUsesLocalBuffers(relation)) {
+		/* Pages added after another scan copied the relation hold no tuples visible to the snapshot */
+		m_nblocks = m_shared_state->CopyLocalPages(relation, m_nblocks);
+		return;
+	}
+
+	/* Pages that were being written while they were read directly are detected by their checksum */
+	if (duckdb_direct_heap_reads && DataChecksumsEnabled() && !ignore_checksum_failure &&
+	    !snapshot->takenDuringRecovery) {
+		std::lock_guard<std::mutex> lock(DuckdbProcessLock::GetLock());
+		char *path = nullptr;
+		PostgresFunctionGuard([&] { path = relpathperm(relation->rd_locator, MAIN_FORKNUM); });
+		m_relation_path = path;
+		pfree(path);
+		m_direct_reads = true;
+	}
+}
+
+/*
+ * Assigns the next range of contiguous blocks to a reader and returns its first block, or InvalidBlockNumber once the
+ * relation has been handed out. Contiguous ranges let the kernel merge the reads of a thread.
+ */
 BlockNumber
-HeapReaderGlobalState::AssignNextBlockNumber(std::mutex &lock) {
-	lock.lock();
-	BlockNumber block_number = InvalidBlockNumber;
-	if (m_nblocks > 0 && m_last_assigned_block_number == InvalidBlockNumber) {
-		block_number = m_last_assigned_block_number = 0;
-	} else if (m_nblocks > 0 && m_last_assigned_block_number < m_nblocks - 1) {
-		block_number = ++m_last_assigned_block_number;
+HeapReaderGlobalState::AssignNextBlockRange(std::mutex &lock, BlockNumber &range_end) {
+	std::lock_guard<std::mutex> guard(lock);
+	BlockNumber start = m_last_assigned_block_number == InvalidBlockNumber ? 0 : m_last_assigned_block_number + 1;
+	if (start >= m_nblocks) {
+		return InvalidBlockNumber;
+	}
+	BlockNumber remaining = m_nblocks - start;
+	BlockNumber range = remaining / (duckdb_max_threads_per_query * 4);
+	range = Max(Min(range, (BlockNumber)HEAP_READER_MAX_BLOCK_RANGE), (BlockNumber)1);
+	range_end = start + range;
+	m_last_assigned_block_number = range_end - 1;
+	return start;
+}
+
+HeapReaderGlobalState::~HeapReaderGlobalState() {
+	m_shared_state->FinishScan(m_scan_index);
+	/* Blocks that were never handed out to a reader, because the scan was stopped early */
+	BlockNumber assigned = m_last_assigned_block_number == InvalidBlockNumber ? 0 : m_last_assigned_block_number + 1;
+	if (assigned < m_nblocks) {
+		ScanStats stats;
+		stats.Count(SCAN_STAT_BLOCKS_SKIPPED, m_nblocks - assigned);
+		FlushScanStats(stats);
 	}
-	lock.unlock();
-	return block_number;
 }
 
 //
@@ -41,20 +254,234 @@ HeapReader::HeapReader(Relation relation, duckdb::shared_ptr<HeapReaderGlobalSta
                        duckdb::shared_ptr<PostgresScanLocalState> local_state)
     : m_global_state(global_state), m_heap_reader_global_state(heap_reader_global_state), m_local_state(local_state),
       m_relation(relation), m_inited(false), m_read_next_page(true), m_block_number(InvalidBlockNumber),
-      m_buffer(InvalidBuffer), m_current_tuple_index(InvalidOffsetNumber), m_page_tuples_left(0) {
+      m_range_start(InvalidBlockNumber), m_range_end(InvalidBlockNumber), m_prefetch_range(false),
+      m_strategy(nullptr), m_buffer(InvalidBuffer), m_page(nullptr), m_page_all_visible_in_vm(false),
+      m_direct_page_valid(),
+      m_segment_number(InvalidBlockNumber), m_segment_fd(-1), m_vm_buffer(InvalidBuffer),
+      m_current_tuple_index(InvalidOffsetNumber), m_page_tuples_left(0), m_tuples_returned(0), m_tuple_batch_size(0) {
+	auto &program = m_global_state->m_deform_program;
+	m_gather_fixed_width = program && program->CanGatherFixedWidth();
+	if (m_gather_fixed_width) {
+		m_tuple_batch.resize(STANDARD_VECTOR_SIZE);
+	}
+	m_complex_filter = program && !program->m_complex_filter_steps.empty();
+	if (m_complex_filter) {
+		m_filter_batch.resize(STANDARD_VECTOR_SIZE);
+	}
+	if (m_heap_reader_global_state->m_direct_reads) {
+		m_direct_pages.resize(HEAP_READER_MAX_BLOCK_RANGE * BLCKSZ);
+	}
 	m_tuple.t_data = NULL;
 	m_tuple.t_tableOid = RelationGetRelid(m_relation);
 	ItemPointerSetInvalid(&m_tuple.t_self);
 }
 
 HeapReader::~HeapReader() {
+	/* Blocks of the assigned range that weren't read, because the scan was stopped early */
+	if (m_block_number != InvalidBlockNumber && m_block_number + 1 < m_range_end) {
+		m_local_state->m_stats.Count(SCAN_STAT_BLOCKS_SKIPPED, m_range_end - m_block_number - 1);
+	}
+	if (m_tuples_returned || m_strategy || BufferIsValid(m_vm_buffer) || m_segment_fd >= 0) {
+		auto lock = LockProcessLock(m_local_state->m_stats);
+		ReportTuplesReturned();
+		PostgresCleanupGuard([&] {
+			if (m_segment_fd >= 0) {
+				CloseTransientFile(m_segment_fd);
+			}
+			if (m_strategy) {
+				FreeAccessStrategy(m_strategy);
+			}
+			if (BufferIsValid(m_vm_buffer)) {
+				ReleaseBuffer(m_vm_buffer);
+			}
+		});
+	}
+}
+
+BlockNumber
+HeapReader::NextBlockNumber() {
+	/* Handle cancel request */
+	if (QueryCancelPending) {
+		return InvalidBlockNumber;
+	}
+	if (m_block_number != InvalidBlockNumber && m_block_number + 1 < m_range_end) {
+		return m_block_number + 1;
+	}
+	m_prefetch_range = true;
+	return m_heap_reader_global_state->AssignNextBlockRange(m_global_state->m_lock, m_range_end);
+}
+
+/*
+ * Prefetches the blocks of a new range, so their reads are not issued one by one. With direct reads, the blocks that
+ * are all-visible according to the visibility map and not in shared buffers are then read from the segment files.
+ *
+ * A page that is all-visible and not in shared buffers after the snapshot was taken holds every change visible to
+ * the snapshot. If the page is loaded and modified after this check, the copy is either older, which the snapshot
+ * can't tell apart, or no longer all-visible, or torn and fails its checksum. Only the first kind is used.
+ */
+void
+HeapReader::StartBlockRange() {
+	bool direct_reads = false;
+	m_range_start = m_block_number;
+	{
+		auto lock = LockProcessLock(m_local_state->m_stats);
+		PostgresFunctionGuard([&] {
+			for (BlockNumber block = m_range_start; block < m_range_end; block++) {
+				PrefetchBufferResult result = PrefetchBuffer(m_relation, MAIN_FORKNUM, block);
+				bool &direct_read = m_direct_page_valid[block - m_range_start];
+				direct_read = m_heap_reader_global_state->m_direct_reads && !BufferIsValid(result.recent_buffer) &&
+				              VM_ALL_VISIBLE(m_relation, block, &m_vm_buffer);
+				direct_reads = direct_reads || direct_read;
+			}
+		});
+	}
+	m_prefetch_range = false;
+
+	if (direct_reads) {
+		ReadDirectPages();
+	}
+}
+
+/* Reads the blocks of the range marked in m_direct_page_valid with one pread per run of blocks of a segment */
+void
+HeapReader::ReadDirectPages() {
+	BlockNumber block = m_range_start;
+	while (block < m_range_end) {
+		if (!m_direct_page_valid[block - m_range_start]) {
+			block++;
+			continue;
+		}
+
+		BlockNumber segment_number = block / RELSEG_SIZE;
+		BlockNumber end = block + 1;
+		while (end < m_range_end && m_direct_page_valid[end - m_range_start] && end / RELSEG_SIZE == segment_number) {
+			end++;
+		}
+
+		if (m_segment_number != segment_number) {
+			std::string path = m_heap_reader_global_state->m_relation_path;
+			if (segment_number > 0) {
+				path += "." + std::to_string(segment_number);
+			}
+			/* Transient files are closed when the transaction aborts, so an ERROR of the query doesn't leak them */
+			auto lock = LockProcessLock(m_local_state->m_stats);
+			PostgresFunctionGuard([&] {
+				if (m_segment_fd >= 0) {
+					CloseTransientFile(m_segment_fd);
+					m_segment_fd = -1;
+				}
+				m_segment_fd = OpenTransientFile(path.c_str(), O_RDONLY | PG_BINARY);
+			});
+			m_segment_number = segment_number;
+		}
+
+		BlockNumber run_start = block;
+		ssize_t bytes_read = -1;
+		if (m_segment_fd >= 0) {
+			bytes_read = pread(m_segment_fd, m_direct_pages.data() + (run_start - m_range_start) * BLCKSZ,
+			                   (end - run_start) * BLCKSZ, (off_t)(run_start % RELSEG_SIZE) * BLCKSZ);
+		}
+
+		/* Blocks that were not read completely or fail verification are read through shared buffers */
+		for (; block < end; block++) {
+			Page page = m_direct_pages.data() + (block - m_range_start) * BLCKSZ;
+			m_direct_page_valid[block - m_range_start] =
+			    bytes_read >= (ssize_t)((block - run_start + 1) * BLCKSZ) && PageIsVerifiedExtended(page, block, 0) &&
+			    !PageIsNew(page) && PageIsAllVisible(page);
+		}
+	}
+}
+
+/*
+ * pgstat_count_heap_getnext() modifies backend local state, so instead of calling it for every tuple from the scan
+ * threads, the count is kept per reader and reported while holding DuckdbProcessLock.
+ */
+void
+HeapReader::ReportTuplesReturned() {
+	if (pgstat_should_count_relation(m_relation)) {
+		m_relation->pgstat_info->counts.tuples_returned += m_tuples_returned;
+	}
+	m_tuples_returned = 0;
+}
+
+/*
+ * Gathers or filters the batched tuples into the output chunk. Must be called before the buffer holding them is
+ * released.
+ */
+void
+HeapReader::FlushTupleBatch(duckdb::DataChunk &output) {
+	if (!m_tuple_batch_size) {
+		return;
+	}
+	if (m_complex_filter) {
+		InsertFilteredTuplesIntoChunk(output, m_global_state, m_local_state, m_filter_batch.data(), m_tuple_batch_size);
+	} else {
+		InsertFixedWidthTuplesIntoChunk(output, m_global_state, m_local_state, m_tuple_batch.data(),
+		                                m_tuple_batch_size);
+	}
+	m_tuple_batch_size = 0;
+}
+
+Page
+HeapReader::GetDirectPage(BlockNumber block) {
+	if (m_direct_pages.empty() || !m_direct_page_valid[block - m_range_start]) {
+		return nullptr;
+	}
+	m_buffer = InvalidBuffer;
+	m_local_state->m_stats.Count(SCAN_STAT_DIRECT_BLKS_READ);
+	return m_direct_pages.data() + (block - m_range_start) * BLCKSZ;
 }
 
 Page
-HeapReader::PreparePageRead() {
-	Page page = BufferGetPage(m_buffer);
-	TestForOldSnapshot(m_global_state->m_snapshot, m_relation, page);
-	m_page_tuples_all_visible = PageIsAllVisible(page) && !m_global_state->m_snapshot->takenDuringRecovery;
+HeapReader::ReadBufferedPage(BlockNumber block) {
+	auto lock = LockProcessLock(m_local_state->m_stats);
+	BufferUsage buffer_usage_start = pgBufferUsage;
+	PostgresFunctionGuard([&] {
+		if (!m_strategy) {
+			m_strategy = GetAccessStrategy(BAS_BULKREAD);
+		}
+		m_buffer = ReadBufferExtended(m_relation, MAIN_FORKNUM, block, RBM_NORMAL, m_strategy);
+		LockBuffer(m_buffer, BUFFER_LOCK_SHARE);
+		/*
+		 * The page level all-visible flag may reach a standby without being WAL-logged, e.g. through a full page
+		 * image, so Postgres doesn't trust it during recovery. The visibility map bit is only set by replaying a
+		 * record whose conflict horizon cancels the standby queries that could still see the page differently, which
+		 * is what index-only scans rely on. Replay of a record that modifies the heap page clears the bit before it
+		 * changes the page, which needs the exclusive lock of the page. A bit that is still set while holding the
+		 * share lock therefore means the page hasn't been modified since it was set.
+		 */
+		if (m_global_state->m_snapshot->takenDuringRecovery) {
+			m_page_all_visible_in_vm = VM_ALL_VISIBLE(m_relation, block, &m_vm_buffer);
+		}
+	});
+	CountBufferUsage(m_local_state->m_stats, buffer_usage_start);
+	return BufferGetPage(m_buffer);
+}
+
+Page
+HeapReader::PreparePageRead(Page page) {
+	/* Raises "snapshot too old", which is only possible with old_snapshot_threshold */
+	if (old_snapshot_threshold >= 0) {
+		auto lock = LockProcessLock(m_local_state->m_stats);
+		PostgresFunctionGuard([&] { TestForOldSnapshot(m_global_state->m_snapshot, m_relation, page); });
+	}
+	/* On a standby only the visibility map is trusted, see ReadBufferedPage */
+	if (m_global_state->m_snapshot->takenDuringRecovery) {
+		m_page_tuples_all_visible = m_page_all_visible_in_vm;
+	} else {
+		m_page_tuples_all_visible = PageIsAllVisible(page);
+	}
+	/* The visibility of the tuples of copied local pages was set by GetLocalPage */
+	if (m_heap_reader_global_state->m_shared_state->HasLocalPages()) {
+		m_page_tuples_all_visible = false;
+	} else if (!m_page_tuples_all_visible) {
+		instr_time start;
+		m_local_state->m_stats.StartTimer(start);
+		m_heap_reader_global_state->m_shared_state->PageTuplesVisibility(
+		    m_heap_reader_global_state->m_scan_index, m_relation, m_block_number, m_buffer, page,
+		    m_page_tuples_visible, m_local_state->m_stats);
+		m_local_state->m_stats.StopTimer(SCAN_STAT_VISIBILITY_TIME, start);
+	}
 	m_page_tuples_left = PageGetMaxOffsetNumber(page) - FirstOffsetNumber + 1;
 	m_current_tuple_index = FirstOffsetNumber;
 	return page;
@@ -66,7 +493,7 @@ HeapReader::ReadPageTuples(duckdb::DataChunk &output) {
 	Page page = nullptr;
 
 	if (!m_inited) {
-		block = m_block_number = m_heap_reader_global_state->AssignNextBlockNumber(m_global_state->m_lock);
+		block = m_block_number = NextBlockNumber();
 		if (m_block_number == InvalidBlockNumber) {
 			return false;
 		}
@@ -74,26 +501,32 @@ HeapReader::ReadPageTuples(duckdb::DataChunk &output) {
 		m_read_next_page = true;
 	} else {
 		block = m_block_number;
-		if (block != InvalidBlockNumber) {
-			page = BufferGetPage(m_buffer);
-		}
+		page = m_page;
 	}
 
 	while (block != InvalidBlockNumber) {
 		if (m_read_next_page) {
-			CHECK_FOR_INTERRUPTS();
-			DuckdbProcessLock::GetLock().lock();
 			block = m_block_number;
-			m_buffer = ReadBufferExtended(m_relation, MAIN_FORKNUM, block, RBM_NORMAL, GetAccessStrategy(BAS_BULKREAD));
-			LockBuffer(m_buffer, BUFFER_LOCK_SHARE);
-			DuckdbProcessLock::GetLock().unlock();
-			page = PreparePageRead();
+			if (m_heap_reader_global_state->m_shared_state->HasLocalPages()) {
+				m_buffer = InvalidBuffer;
+				page = m_heap_reader_global_state->m_shared_state->GetLocalPage(block, m_page_tuples_visible);
+			} else {
+				if (m_prefetch_range) {
+					StartBlockRange();
+				}
+				page = GetDirectPage(block);
+				if (!page) {
+					page = ReadBufferedPage(block);
+				}
+			}
+			m_page = page = PreparePageRead(page);
 			m_read_next_page = false;
+			m_local_state->m_stats.Count(SCAN_STAT_BLOCKS_SCANNED);
 		}
 
-		for (; m_page_tuples_left > 0 && m_local_state->m_output_vector_size < STANDARD_VECTOR_SIZE;
+		for (; m_page_tuples_left > 0 &&
+		       m_local_state->m_output_vector_size + m_tuple_batch_size < STANDARD_VECTOR_SIZE;
 		     m_page_tuples_left--, m_current_tuple_index++) {
-			bool visible = true;
 			ItemId lpp = PageGetItemId(page, m_current_tuple_index);
 
 			if (!ItemIdIsNormal(lpp))
@@ -103,29 +536,43 @@ HeapReader::ReadPageTuples(duckdb::DataChunk &output) {
 			m_tuple.t_len = ItemIdGetLength(lpp);
 			ItemPointerSet(&(m_tuple.t_self), block, m_current_tuple_index);
 
-			if (!m_page_tuples_all_visible) {
-				visible = HeapTupleSatisfiesVisibility(&m_tuple, m_global_state->m_snapshot, m_buffer);
-				/* skip tuples not visible to this snapshot */
-				if (!visible)
-					continue;
+			/* skip tuples not visible to this snapshot */
+			if (!m_page_tuples_all_visible && !m_page_tuples_visible[m_current_tuple_index - FirstOffsetNumber]) {
+				m_local_state->m_stats.Count(SCAN_STAT_TUPLES_INVISIBLE);
+				continue;
 			}
 
-			pgstat_count_heap_getnext(m_relation);
+			m_tuples_returned++;
+			m_local_state->m_stats.Count(SCAN_STAT_TUPLES_VISIBLE);
+
+			if (m_complex_filter) {
+				m_filter_batch[m_tuple_batch_size++] = m_tuple;
+				continue;
+			}
+
+			if (m_gather_fixed_width && m_global_state->m_deform_program->CanGatherTuple(m_tuple.t_data)) {
+				m_tuple_batch[m_tuple_batch_size++] = m_tuple.t_data;
+				continue;
+			}
+
+			FlushTupleBatch(output);
 			InsertTupleIntoChunk(output, m_global_state, m_local_state, &m_tuple);
 		}
 
+		FlushTupleBatch(output);
+
 		/* No more items on current page */
 		if (!m_page_tuples_left) {
-			DuckdbProcessLock::GetLock().lock();
-			UnlockReleaseBuffer(m_buffer);
-			DuckdbProcessLock::GetLock().unlock();
+			auto lock = LockProcessLock(m_local_state->m_stats);
+			PostgresFunctionGuard([&] {
+				if (BufferIsValid(m_buffer)) {
+					UnlockReleaseBuffer(m_buffer);
+				}
+			});
+			ReportTuplesReturned();
+			lock.unlock();
 			m_read_next_page = true;
-			/* Handle cancel request */
-			if (QueryCancelPending) {
-				block = m_block_number = InvalidBlockNumber;
-			} else {
-				block = m_block_number = m_heap_reader_global_state->AssignNextBlockNumber(m_global_state->m_lock);
-			}
+			block = m_block_number = NextBlockNumber();
 		}
 
 		/* We have collected STANDARD_VECTOR_SIZE */
@@ -143,6 +590,7 @@ HeapReader::ReadPageTuples(duckdb::DataChunk &output) {
 	}
 
 	m_buffer = InvalidBuffer;
+	m_page = nullptr;
 	m_block_number = InvalidBlockNumber;
 	m_tuple.t_data = NULL;
 	m_read_next_page = false;
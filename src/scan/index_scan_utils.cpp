@@ -1,4 +1,5 @@
 #include "pgduckdb/scan/index_scan_utils.hpp"
+#include "pgduckdb/vendor/pg_list.hpp"
 
 namespace pgduckdb {
 
@@ -76,12 +77,12 @@ FixIndexQualOperand(Node *node, IndexOptInfo *index, int indexcol) {
 Node *
 FixIndexQualClause(PlannerInfo *root, IndexOptInfo *index, int indexcol, Node *clause, List *indexcolnos) {
 	/*
-	 * Replace any outer-relation variables with nestloop params.
-	 *
-	 * This also makes a copy of the clause, so it's safe to modify it
-	 * in-place below.
+	 * Postgres replaces outer-relation variables with nestloop params here,
+	 * which also makes a copy of the clause. Index scans run by DuckDB are
+	 * never parameterized, but the clause still belongs to the planner and
+	 * must not be modified in-place below.
 	 */
-	// clause = replace_nestloop_params(root, clause);
+	clause = (Node *)copyObjectImpl(clause);
 
 	if (IsA(clause, OpExpr)) {
 		OpExpr *op = (OpExpr *)clause;
@@ -110,4 +111,21 @@ FixIndexQualClause(PlannerInfo *root, IndexOptInfo *index, int indexcol, Node *c
 	return clause;
 }
 
+/*
+ * Returns the index quals of index_path with their indexkeys replaced by index Vars, as expected by
+ * ExecIndexBuildScanKeys.
+ */
+List *
+FixIndexQualClauses(PlannerInfo *root, IndexPath *index_path) {
+	List *clauses = NIL;
+	foreach_node(IndexClause, iclause, index_path->indexclauses) {
+		foreach_node(RestrictInfo, rinfo, iclause->indexquals) {
+			Node *clause = FixIndexQualClause(root, index_path->indexinfo, iclause->indexcol, (Node *)rinfo->clause,
+			                                  iclause->indexcols);
+			clauses = lappend(clauses, clause);
+		}
+	}
+	return clauses;
+}
+
 } // namespace pgduckdb
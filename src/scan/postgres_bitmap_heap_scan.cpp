@@ -0,0 +1,367 @@
+#include "duckdb.hpp"
+
+extern "C" {
+#include "postgres.h"
+#include "miscadmin.h"
+#include "access/genam.h"
+#include "access/htup_details.h"
+#include "access/tableam.h"
+#include "executor/executor.h"
+#include "executor/nodeIndexscan.h"
+#include "executor/tuptable.h"
+#include "nodes/pathnodes.h"
+#include "nodes/tidbitmap.h"
+#include "parser/parsetree.h"
+#include "utils/rel.h"
+}
+
+#include "pgduckdb/pgduckdb_guard.hpp"
+#include "pgduckdb/pgduckdb_process_lock.hpp"
+#include "pgduckdb/scan/index_scan_utils.hpp"
+#include "pgduckdb/scan/postgres_bitmap_heap_scan.hpp"
+#include "pgduckdb/pgduckdb_types.hpp"
+#include "pgduckdb/vendor/pg_list.hpp"
+
+namespace pgduckdb {
+
+//
+// PostgresBitmapHeapScanGlobalState
+//
+
+PostgresBitmapHeapScanGlobalState::PostgresBitmapHeapScanGlobalState(Relation relation, EState *estate,
+                                                                     TIDBitmap *tbm, ExprState *postgres_quals,
+                                                                     duckdb::TableFunctionInitInput &input)
+    : m_global_state(duckdb::make_shared_ptr<PostgresScanGlobalState>()), m_relation(relation), m_estate(estate),
+      m_tbm(tbm), m_iterator(nullptr), m_postgres_quals(postgres_quals), m_econtext(nullptr) {
+	/* Called while holding DuckdbProcessLock, see PostgresBitmapHeapScanInitGlobal */
+	PostgresFunctionGuard([&] {
+		m_iterator = tbm_begin_iterate(tbm);
+		if (m_postgres_quals) {
+			m_econtext = CreateExprContext(estate);
+		}
+	});
+	m_global_state->m_tuple_desc = RelationGetDescr(m_relation);
+	m_global_state->InitGlobalState(input);
+}
+
+PostgresBitmapHeapScanGlobalState::~PostgresBitmapHeapScanGlobalState() {
+	std::lock_guard<std::mutex> lock(DuckdbProcessLock::GetLock());
+	PostgresCleanupGuard([&] {
+		if (m_iterator) {
+			tbm_end_iterate(m_iterator);
+		}
+		tbm_free(m_tbm);
+		RelationClose(m_relation);
+		FreeExecutorState(m_estate);
+	});
+}
+
+//
+// PostgresBitmapHeapScanLocalState
+//
+
+PostgresBitmapHeapScanLocalState::PostgresBitmapHeapScanLocalState(Relation relation, Snapshot snapshot)
+    : m_local_state(duckdb::make_shared_ptr<PostgresScanLocalState>()), m_scan(nullptr), m_slot(nullptr),
+      m_tbmres(nullptr), m_page_ready(false) {
+	/* Called while holding DuckdbProcessLock, see PostgresBitmapHeapScanInitLocal */
+	PostgresFunctionGuard([&] {
+		m_scan = table_beginscan_bm(relation, snapshot, 0, NULL);
+		m_slot = table_slot_create(relation, NULL);
+		m_tbmres = (TBMIterateResult *)palloc(offsetof(TBMIterateResult, offsets) +
+		                                      MaxHeapTuplesPerPage * sizeof(OffsetNumber));
+	});
+}
+
+PostgresBitmapHeapScanLocalState::~PostgresBitmapHeapScanLocalState() {
+	std::lock_guard<std::mutex> lock(DuckdbProcessLock::GetLock());
+	PostgresCleanupGuard([&] {
+		if (m_slot) {
+			ExecDropSingleTupleTableSlot(m_slot);
+		}
+		if (m_scan) {
+			table_endscan(m_scan);
+		}
+		if (m_tbmres) {
+			pfree(m_tbmres);
+		}
+	});
+}
+
+//
+// PostgresBitmapHeapScanFunctionData
+//
+
+PostgresBitmapHeapScanFunctionData::PostgresBitmapHeapScanFunctionData(uint64_t cardinality, Path *path,
+                                                                       PlannerInfo *planner_info, Oid relation_oid,
+                                                                       Snapshot snapshot)
+    : m_cardinality(cardinality), m_path(path), m_planner_info(planner_info), m_snapshot(snapshot),
+      m_relation_oid(relation_oid) {
+}
+
+PostgresBitmapHeapScanFunctionData::~PostgresBitmapHeapScanFunctionData() {
+}
+
+//
+// PostgresBitmapHeapScanFunction
+//
+
+PostgresBitmapHeapScanFunction::PostgresBitmapHeapScanFunction()
+    : TableFunction("postgres_bitmap_heap_scan", {}, PostgresBitmapHeapScanFunc, PostgresBitmapHeapScanBind,
+                    PostgresBitmapHeapScanInitGlobal, PostgresBitmapHeapScanInitLocal) {
+	named_parameters["cardinality"] = duckdb::LogicalType::UBIGINT;
+	named_parameters["path"] = duckdb::LogicalType::POINTER;
+	named_parameters["planner_info"] = duckdb::LogicalType::POINTER;
+	named_parameters["snapshot"] = duckdb::LogicalType::POINTER;
+	projection_pushdown = true;
+	filter_pushdown = true;
+	filter_prune = true;
+	cardinality = PostgresBitmapHeapScanCardinality;
+}
+
+duckdb::unique_ptr<duckdb::FunctionData>
+PostgresBitmapHeapScanFunction::PostgresBitmapHeapScanBind(duckdb::ClientContext &context,
+                                                           duckdb::TableFunctionBindInput &input,
+                                                           duckdb::vector<duckdb::LogicalType> &return_types,
+                                                           duckdb::vector<duckdb::string> &names) {
+	auto cardinality = input.named_parameters["cardinality"].GetValue<uint64_t>();
+	auto path = (reinterpret_cast<Path *>(input.named_parameters["path"].GetPointer()));
+	auto planner_info = (reinterpret_cast<PlannerInfo *>(input.named_parameters["planner_info"].GetPointer()));
+	auto snapshot = (reinterpret_cast<Snapshot>(input.named_parameters["snapshot"].GetPointer()));
+
+	RangeTblEntry *rte = planner_rt_fetch(path->parent->relid, planner_info);
+
+	auto rel = RelationIdGetRelation(rte->relid);
+	auto relation_descr = RelationGetDescr(rel);
+
+	if (!relation_descr) {
+		elog(ERROR, "Failed to get tuple descriptor for relation with OID %u", rel->rd_id);
+		return nullptr;
+	}
+
+	for (int i = 0; i < relation_descr->natts; i++) {
+		Form_pg_attribute attr = &relation_descr->attrs[i];
+		return_types.push_back(ConvertPostgresToDuckColumnType(attr));
+		names.push_back(duckdb::string(NameStr(attr->attname)));
+	}
+
+	RelationClose(rel);
+
+	return duckdb::make_uniq<PostgresBitmapHeapScanFunctionData>(cardinality, path, planner_info, rte->relid,
+	                                                              snapshot);
+}
+
+/*
+ * Adds the TIDs of the index entries matching the index quals of index_path to tbm, like a BitmapIndexScan node.
+ */
+static void
+ExecBitmapIndexPath(PlannerInfo *root, EState *estate, Snapshot snapshot, IndexPath *index_path, TIDBitmap *tbm) {
+	/* Runtime keys are evaluated in the expression context of a dummy index scan state */
+	IndexScanState *index_state = makeNode(IndexScanState);
+	index_state->ss.ps.state = estate;
+	ExecAssignExprContext(estate, &index_state->ss.ps);
+
+	Relation index = index_open(index_path->indexinfo->indexoid, AccessShareLock);
+
+	ScanKey scan_keys;
+	int num_scan_keys;
+	IndexRuntimeKeyInfo *runtime_keys;
+	int num_runtime_keys;
+	IndexArrayKeyInfo *array_keys;
+	int num_array_keys;
+	ExecIndexBuildScanKeys((PlanState *)index_state, index, FixIndexQualClauses(root, index_path), false, &scan_keys,
+	                       &num_scan_keys, &runtime_keys, &num_runtime_keys, &array_keys, &num_array_keys);
+
+	ExprContext *econtext = index_state->ss.ps.ps_ExprContext;
+	if (num_runtime_keys) {
+		ExecIndexEvalRuntimeKeys(econtext, runtime_keys, num_runtime_keys);
+	}
+
+	/* A NULL or empty array key can't match any entry */
+	if (!num_array_keys || ExecIndexEvalArrayKeys(econtext, array_keys, num_array_keys)) {
+		IndexScanDesc scan = index_beginscan_bitmap(index, snapshot, num_scan_keys);
+		do {
+			index_rescan(scan, scan_keys, num_scan_keys, NULL, 0);
+			index_getbitmap(scan, tbm);
+		} while (num_array_keys && ExecIndexAdvanceArrayKeys(array_keys, num_array_keys));
+		index_endscan(scan);
+	}
+
+	index_close(index, NoLock);
+}
+
+/*
+ * Returns the TIDs matching a bitmap qual tree of BitmapAndPath, BitmapOrPath and IndexPath nodes.
+ */
+static TIDBitmap *
+ExecBitmapQual(PlannerInfo *root, EState *estate, Snapshot snapshot, Path *bitmapqual) {
+	if (IsA(bitmapqual, BitmapAndPath)) {
+		TIDBitmap *result = nullptr;
+		foreach_ptr(Path, subpath, ((BitmapAndPath *)bitmapqual)->bitmapquals) {
+			TIDBitmap *subresult = ExecBitmapQual(root, estate, snapshot, subpath);
+			if (!result) {
+				result = subresult;
+			} else {
+				tbm_intersect(result, subresult);
+				tbm_free(subresult);
+			}
+			/* No need to evaluate the remaining quals */
+			if (tbm_is_empty(result)) {
+				break;
+			}
+		}
+		return result;
+	}
+
+	if (IsA(bitmapqual, BitmapOrPath)) {
+		TIDBitmap *result = tbm_create(work_mem * 1024L, NULL);
+		foreach_ptr(Path, subpath, ((BitmapOrPath *)bitmapqual)->bitmapquals) {
+			if (IsA(subpath, IndexPath)) {
+				ExecBitmapIndexPath(root, estate, snapshot, (IndexPath *)subpath, result);
+			} else {
+				TIDBitmap *subresult = ExecBitmapQual(root, estate, snapshot, subpath);
+				tbm_union(result, subresult);
+				tbm_free(subresult);
+			}
+		}
+		return result;
+	}
+
+	if (IsA(bitmapqual, IndexPath)) {
+		TIDBitmap *result = tbm_create(work_mem * 1024L, NULL);
+		ExecBitmapIndexPath(root, estate, snapshot, (IndexPath *)bitmapqual, result);
+		return result;
+	}
+
+	elog(ERROR, "unrecognized bitmap qual node type: %d", (int)nodeTag(bitmapqual));
+	return nullptr;
+}
+
+duckdb::unique_ptr<duckdb::GlobalTableFunctionState>
+PostgresBitmapHeapScanFunction::PostgresBitmapHeapScanInitGlobal(duckdb::ClientContext &context,
+                                                                 duckdb::TableFunctionInitInput &input) {
+	auto &bind_data = input.bind_data->CastNoConst<PostgresBitmapHeapScanFunctionData>();
+
+	/* The bitmap is built by the index AMs, which read buffers and call arbitrary functions */
+	std::lock_guard<std::mutex> lock(DuckdbProcessLock::GetLock());
+
+	EState *estate = nullptr;
+	TIDBitmap *tbm = nullptr;
+	ExprState *postgres_quals = nullptr;
+	Relation relation = nullptr;
+	PostgresFunctionGuard([&] {
+		estate = CreateExecutorState();
+		estate->es_snapshot = bind_data.m_snapshot;
+		estate->es_param_list_info = bind_data.m_planner_info->glob->boundParams;
+
+		auto bitmap_path = (BitmapHeapPath *)bind_data.m_path;
+		tbm = ExecBitmapQual(bind_data.m_planner_info, estate, bind_data.m_snapshot, bitmap_path->bitmapqual);
+		List *quals = GetPostgresQuals(bitmap_path->path.parent);
+		if (quals) {
+			postgres_quals = ExecPrepareQual(quals, estate);
+		}
+		relation = RelationIdGetRelation(bind_data.m_relation_oid);
+	});
+
+	return duckdb::make_uniq<PostgresBitmapHeapScanGlobalState>(relation, estate, tbm, postgres_quals, input);
+}
+
+duckdb::unique_ptr<duckdb::LocalTableFunctionState>
+PostgresBitmapHeapScanFunction::PostgresBitmapHeapScanInitLocal(duckdb::ExecutionContext &context,
+                                                                duckdb::TableFunctionInitInput &input,
+                                                                duckdb::GlobalTableFunctionState *gstate) {
+	auto &bind_data = input.bind_data->CastNoConst<PostgresBitmapHeapScanFunctionData>();
+	auto global_state = reinterpret_cast<PostgresBitmapHeapScanGlobalState *>(gstate);
+	std::lock_guard<std::mutex> lock(DuckdbProcessLock::GetLock());
+	return duckdb::make_uniq<PostgresBitmapHeapScanLocalState>(global_state->m_relation, bind_data.m_snapshot);
+}
+
+/*
+ * Returns true if the tuple in slot passes the quals DuckDB left to Postgres, must be called with the process lock
+ * held.
+ */
+static bool
+PassesPostgresQuals(PostgresBitmapHeapScanGlobalState &global_state, TupleTableSlot *slot) {
+	if (!global_state.m_postgres_quals) {
+		return true;
+	}
+	ResetExprContext(global_state.m_econtext);
+	global_state.m_econtext->ecxt_scantuple = slot;
+	return ExecQual(global_state.m_postgres_quals, global_state.m_econtext);
+}
+
+/*
+ * Returns the next visible tuple of the current bitmap page that passes the Postgres quals in the slot, moving on to
+ * the next page of the shared iterator when the current one is done. Must be called with the process lock held.
+ */
+static bool
+NextBitmapHeapTuple(PostgresBitmapHeapScanGlobalState &global_state, PostgresBitmapHeapScanLocalState &local_state) {
+	while (true) {
+		if (local_state.m_page_ready &&
+		    table_scan_bitmap_next_tuple(local_state.m_scan, local_state.m_tbmres, local_state.m_slot)) {
+			if (PassesPostgresQuals(global_state, local_state.m_slot)) {
+				return true;
+			}
+			continue;
+		}
+
+		TBMIterateResult *tbmres = tbm_iterate(global_state.m_iterator);
+		if (!tbmres) {
+			return false;
+		}
+		memcpy(local_state.m_tbmres, tbmres,
+		       offsetof(TBMIterateResult, offsets) + Max(tbmres->ntuples, 0) * sizeof(OffsetNumber));
+		local_state.m_local_state->m_stats.Count(SCAN_STAT_BLOCKS_SCANNED);
+		/*
+		 * Pages of lossy bitmaps and index AMs that need a recheck (GIN) may contain non-matching rows, DuckDB filters
+		 * them out with the WHERE clause of the query and PassesPostgresQuals with the quals DuckDB can't evaluate.
+		 */
+		local_state.m_page_ready = table_scan_bitmap_next_block(local_state.m_scan, local_state.m_tbmres);
+	}
+}
+
+void
+PostgresBitmapHeapScanFunction::PostgresBitmapHeapScanFunc(duckdb::ClientContext &context,
+                                                           duckdb::TableFunctionInput &data,
+                                                           duckdb::DataChunk &output) {
+	auto &local_state = data.local_state->Cast<PostgresBitmapHeapScanLocalState>();
+	auto &global_state = data.global_state->Cast<PostgresBitmapHeapScanGlobalState>();
+	auto &stats = local_state.m_local_state->m_stats;
+
+	local_state.m_local_state->m_output_vector_size = 0;
+
+	if (local_state.m_local_state->m_exhausted_scan) {
+		output.SetCardinality(0);
+		return;
+	}
+
+	while (local_state.m_local_state->m_output_vector_size < STANDARD_VECTOR_SIZE) {
+		/* Iterating the bitmap and reading heap pages is not thread safe */
+		auto lock = LockProcessLock(stats);
+		BufferUsage buffer_usage_start = pgBufferUsage;
+		bool next_tuple = false;
+		PostgresFunctionGuard([&] { next_tuple = NextBitmapHeapTuple(global_state, local_state); });
+		CountBufferUsage(stats, buffer_usage_start);
+		lock.unlock();
+
+		if (!next_tuple) {
+			local_state.m_local_state->m_exhausted_scan = true;
+			break;
+		}
+
+		bool should_free;
+		auto tuple = ExecFetchSlotHeapTuple(local_state.m_slot, false, &should_free);
+		stats.Count(SCAN_STAT_TUPLES_VISIBLE);
+		InsertTupleIntoChunk(output, global_state.m_global_state, local_state.m_local_state, tuple);
+	}
+
+	output.SetCardinality(local_state.m_local_state->m_output_vector_size);
+}
+
+duckdb::unique_ptr<duckdb::NodeStatistics>
+PostgresBitmapHeapScanFunction::PostgresBitmapHeapScanCardinality(duckdb::ClientContext &context,
+                                                                  const duckdb::FunctionData *data) {
+	auto &bind_data = data->Cast<PostgresBitmapHeapScanFunctionData>();
+	return duckdb::make_uniq<duckdb::NodeStatistics>(bind_data.m_cardinality, bind_data.m_cardinality);
+}
+
+} // namespace pgduckdb
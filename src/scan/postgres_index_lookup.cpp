@@ -0,0 +1,456 @@
+#include "duckdb.hpp"
+#include "duckdb/optimizer/optimizer.hpp"
+#include "duckdb/planner/binder.hpp"
+#include "duckdb/planner/expression/bound_columnref_expression.hpp"
+#include "duckdb/planner/operator/logical_comparison_join.hpp"
+#include "duckdb/planner/operator/logical_get.hpp"
+#include "duckdb/planner/operator/logical_projection.hpp"
+
+extern "C" {
+#include "postgres.h"
+#include "access/htup_details.h"
+#include "access/skey.h"
+#include "access/stratnum.h"
+#include "catalog/pg_am.h"
+#include "catalog/pg_index.h"
+#include "catalog/pg_type.h"
+#include "utils/array.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/relcache.h"
+}
+
+#include "pgduckdb/pgduckdb_guard.hpp"
+#include "pgduckdb/pgduckdb_process_lock.hpp"
+#include "pgduckdb/scan/postgres_index_lookup.hpp"
+#include "pgduckdb/scan/postgres_seq_scan.hpp"
+#include "pgduckdb/pgduckdb_types.hpp"
+#include "pgduckdb/vendor/pg_list.hpp"
+
+#include <algorithm>
+
+namespace pgduckdb {
+
+static bool
+IsLookupKeyType(Oid type_oid) {
+	return type_oid == INT2OID || type_oid == INT4OID || type_oid == INT8OID;
+}
+
+static Datum
+LookupKeyGetDatum(int64_t key, Oid type_oid) {
+	switch (type_oid) {
+	case INT2OID:
+		return Int16GetDatum(static_cast<int16>(key));
+	case INT4OID:
+		return Int32GetDatum(static_cast<int32>(key));
+	default:
+		return Int64GetDatum(key);
+	}
+}
+
+static int64_t
+DatumGetLookupKey(Datum value, Oid type_oid) {
+	switch (type_oid) {
+	case INT2OID:
+		return DatumGetInt16(value);
+	case INT4OID:
+		return DatumGetInt32(value);
+	default:
+		return DatumGetInt64(value);
+	}
+}
+
+//
+// PostgresIndexLookupGlobalState
+//
+
+PostgresIndexLookupGlobalState::PostgresIndexLookupGlobalState(Relation relation, Relation index,
+                                                               duckdb::TableFunctionInitInput &input)
+    : m_global_state(duckdb::make_shared_ptr<PostgresScanGlobalState>()), m_relation(relation), m_index(index) {
+	auto &bind_data = input.bind_data->Cast<PostgresIndexLookupFunctionData>();
+	m_global_state->m_snapshot = bind_data.m_snapshot;
+	m_global_state->m_tuple_desc = RelationGetDescr(m_relation);
+	m_global_state->InitInOutGlobalState(input, bind_data.m_table_column_count);
+
+	/* Called while holding DuckdbProcessLock, see PostgresIndexLookupInitGlobal */
+	PostgresFunctionGuard([&] {
+		Oid opfamily = m_index->rd_opfamily[0];
+		Oid eq_operator =
+		    get_opfamily_member(opfamily, bind_data.m_key_type, bind_data.m_key_type, BTEqualStrategyNumber);
+		if (!OidIsValid(eq_operator)) {
+			elog(ERROR, "missing equality operator for type %u in opfamily %u", bind_data.m_key_type, opfamily);
+		}
+		m_eq_proc = get_opcode(eq_operator);
+	});
+}
+
+PostgresIndexLookupGlobalState::~PostgresIndexLookupGlobalState() {
+	std::lock_guard<std::mutex> lock(DuckdbProcessLock::GetLock());
+	PostgresCleanupGuard([&] {
+		index_close(m_index, NoLock);
+		RelationClose(m_relation);
+	});
+}
+
+//
+// PostgresIndexLookupLocalState
+//
+
+PostgresIndexLookupLocalState::PostgresIndexLookupLocalState(Relation relation, Relation index, Snapshot snapshot)
+    : m_local_state(duckdb::make_shared_ptr<PostgresScanLocalState>()), m_index_scan_desc(nullptr), m_slot(nullptr),
+      m_probing(false), m_pending_rows(nullptr), m_pending_idx(0) {
+	/* Called while holding DuckdbProcessLock, see PostgresIndexLookupInitLocal */
+	PostgresFunctionGuard([&] {
+		m_index_scan_desc = index_beginscan(relation, index, snapshot, 1, 0);
+		m_slot = MakeTupleTableSlot(CreateTupleDescCopy(RelationGetDescr(relation)), &TTSOpsBufferHeapTuple);
+	});
+}
+
+PostgresIndexLookupLocalState::~PostgresIndexLookupLocalState() {
+	/* The slot may still pin the buffer of the last tuple returned by the index scan */
+	std::lock_guard<std::mutex> lock(DuckdbProcessLock::GetLock());
+	PostgresCleanupGuard([&] {
+		if (m_slot) {
+			ExecDropSingleTupleTableSlot(m_slot);
+		}
+		if (m_index_scan_desc) {
+			index_endscan(m_index_scan_desc);
+		}
+	});
+}
+
+//
+// PostgresIndexLookupFunctionData
+//
+
+PostgresIndexLookupFunctionData::PostgresIndexLookupFunctionData(Oid relid, Oid index_oid, Snapshot snapshot,
+                                                                 AttrNumber key_attnum, Oid key_type,
+                                                                 duckdb::idx_t key_input_idx,
+                                                                 duckdb::idx_t table_column_count)
+    : m_relid(relid), m_index_oid(index_oid), m_snapshot(snapshot), m_key_attnum(key_attnum), m_key_type(key_type),
+      m_key_input_idx(key_input_idx), m_table_column_count(table_column_count) {
+}
+
+PostgresIndexLookupFunctionData::~PostgresIndexLookupFunctionData() {
+}
+
+//
+// PostgresIndexLookupFunction
+//
+
+PostgresIndexLookupFunction::PostgresIndexLookupFunction()
+    : TableFunction("postgres_index_lookup", {}, nullptr, nullptr, PostgresIndexLookupInitGlobal,
+                    PostgresIndexLookupInitLocal) {
+	in_out_function = PostgresIndexLookupFunc;
+}
+
+duckdb::unique_ptr<duckdb::GlobalTableFunctionState>
+PostgresIndexLookupFunction::PostgresIndexLookupInitGlobal(duckdb::ClientContext &context,
+                                                           duckdb::TableFunctionInitInput &input) {
+	auto &bind_data = input.bind_data->CastNoConst<PostgresIndexLookupFunctionData>();
+	std::lock_guard<std::mutex> lock(DuckdbProcessLock::GetLock());
+	Relation relation = nullptr;
+	Relation index = nullptr;
+	PostgresFunctionGuard([&] {
+		relation = RelationIdGetRelation(bind_data.m_relid);
+		index = index_open(bind_data.m_index_oid, AccessShareLock);
+	});
+	return duckdb::make_uniq<PostgresIndexLookupGlobalState>(relation, index, input);
+}
+
+duckdb::unique_ptr<duckdb::LocalTableFunctionState>
+PostgresIndexLookupFunction::PostgresIndexLookupInitLocal(duckdb::ExecutionContext &context,
+                                                          duckdb::TableFunctionInitInput &input,
+                                                          duckdb::GlobalTableFunctionState *gstate) {
+	auto &bind_data = input.bind_data->CastNoConst<PostgresIndexLookupFunctionData>();
+	auto global_state = reinterpret_cast<PostgresIndexLookupGlobalState *>(gstate);
+	std::lock_guard<std::mutex> lock(DuckdbProcessLock::GetLock());
+	return duckdb::make_uniq<PostgresIndexLookupLocalState>(global_state->m_relation, global_state->m_index,
+	                                                        bind_data.m_snapshot);
+}
+
+/*
+ * Groups the rows of the input chunk by join key and restarts the index scan with the sorted distinct keys as
+ * array key. Returns false if there is no key to look up.
+ */
+static bool
+StartProbe(const PostgresIndexLookupFunctionData &bind_data, PostgresIndexLookupGlobalState &global_state,
+           PostgresIndexLookupLocalState &local_state, duckdb::DataChunk &input) {
+	auto &keys = input.data[bind_data.m_key_input_idx];
+
+	local_state.m_key_rows.clear();
+	for (duckdb::idx_t row = 0; row < input.size(); row++) {
+		auto value = keys.GetValue(row);
+		/* NULL never satisfies the join condition */
+		if (value.IsNull()) {
+			continue;
+		}
+		local_state.m_key_rows[value.GetValue<int64_t>()].push_back(row);
+	}
+
+	if (local_state.m_key_rows.empty()) {
+		return false;
+	}
+
+	duckdb::vector<int64_t> sorted_keys;
+	sorted_keys.reserve(local_state.m_key_rows.size());
+	for (auto &key_rows : local_state.m_key_rows) {
+		sorted_keys.push_back(key_rows.first);
+	}
+	std::sort(sorted_keys.begin(), sorted_keys.end());
+
+	{
+		auto lock = LockProcessLock(local_state.m_local_state->m_stats);
+		PostgresFunctionGuard([&] {
+			Datum *key_datums = (Datum *)palloc(sizeof(Datum) * sorted_keys.size());
+			for (duckdb::idx_t i = 0; i < sorted_keys.size(); i++) {
+				key_datums[i] = LookupKeyGetDatum(sorted_keys[i], bind_data.m_key_type);
+			}
+			ArrayType *key_array = construct_array_builtin(key_datums, sorted_keys.size(), bind_data.m_key_type);
+
+			ScanKeyData scan_key;
+			ScanKeyEntryInitialize(&scan_key, SK_SEARCHARRAY, 1, BTEqualStrategyNumber, bind_data.m_key_type,
+			                       InvalidOid, global_state.m_eq_proc, PointerGetDatum(key_array));
+			/* The array keys are copied into the scan state by the rescan */
+			index_rescan(local_state.m_index_scan_desc, &scan_key, 1, NULL, 0);
+			pfree(key_array);
+			pfree(key_datums);
+		});
+	}
+
+	local_state.m_probing = true;
+	local_state.m_pending_rows = nullptr;
+	local_state.m_pending_idx = 0;
+	return true;
+}
+
+duckdb::OperatorResultType
+PostgresIndexLookupFunction::PostgresIndexLookupFunc(duckdb::ExecutionContext &context,
+                                                     duckdb::TableFunctionInput &data, duckdb::DataChunk &input,
+                                                     duckdb::DataChunk &output) {
+	auto &bind_data = data.bind_data->Cast<PostgresIndexLookupFunctionData>();
+	auto &global_state = data.global_state->Cast<PostgresIndexLookupGlobalState>();
+	auto &local_state = data.local_state->Cast<PostgresIndexLookupLocalState>();
+	auto &scan_local_state = local_state.m_local_state;
+	auto &stats = scan_local_state->m_stats;
+
+	if (!local_state.m_probing && !StartProbe(bind_data, global_state, local_state, input)) {
+		output.SetCardinality(0);
+		return duckdb::OperatorResultType::NEED_MORE_INPUT;
+	}
+
+	scan_local_state->m_output_vector_size = 0;
+	while (scan_local_state->m_output_vector_size < STANDARD_VECTOR_SIZE) {
+		if (local_state.m_pending_rows && local_state.m_pending_idx < local_state.m_pending_rows->size()) {
+			auto input_row = (*local_state.m_pending_rows)[local_state.m_pending_idx++];
+			auto output_row = scan_local_state->m_output_vector_size;
+			for (auto &[output_idx, input_idx] : global_state.m_global_state->m_input_columns) {
+				output.data[output_idx].SetValue(output_row, input.data[input_idx].GetValue(input_row));
+			}
+			bool should_free;
+			auto tuple = ExecFetchSlotHeapTuple(local_state.m_slot, false, &should_free);
+			InsertTupleIntoChunk(output, global_state.m_global_state, scan_local_state, tuple);
+			continue;
+		}
+
+		/* The index scan reads and pins buffers, which is not thread safe */
+		auto lock = LockProcessLock(stats);
+		BufferUsage buffer_usage_start = pgBufferUsage;
+		bool found = false;
+		bool key_is_null = true;
+		Datum key = (Datum)0;
+		PostgresFunctionGuard([&] {
+			found = index_getnext_slot(local_state.m_index_scan_desc, ForwardScanDirection, local_state.m_slot);
+			if (found) {
+				key = slot_getattr(local_state.m_slot, bind_data.m_key_attnum, &key_is_null);
+			}
+		});
+		CountBufferUsage(stats, buffer_usage_start);
+		lock.unlock();
+
+		if (!found) {
+			local_state.m_probing = false;
+			local_state.m_pending_rows = nullptr;
+			break;
+		}
+
+		stats.Count(SCAN_STAT_TUPLES_VISIBLE);
+		auto key_rows = key_is_null ? local_state.m_key_rows.end()
+		                            : local_state.m_key_rows.find(DatumGetLookupKey(key, bind_data.m_key_type));
+		local_state.m_pending_rows = key_rows == local_state.m_key_rows.end() ? nullptr : &key_rows->second;
+		local_state.m_pending_idx = 0;
+	}
+
+	output.SetCardinality(scan_local_state->m_output_vector_size);
+	return local_state.m_probing ? duckdb::OperatorResultType::HAVE_MORE_OUTPUT
+	                             : duckdb::OperatorResultType::NEED_MORE_INPUT;
+}
+
+//
+// Optimizer
+//
+
+/* Returns a valid, non-partial B-tree index whose first key column is attnum, InvalidOid if there is none */
+static Oid
+FindLookupIndex(Oid relid, AttrNumber attnum) {
+	Oid found_index = InvalidOid;
+	Relation relation = RelationIdGetRelation(relid);
+
+	foreach_oid(index_oid, RelationGetIndexList(relation)) {
+		Relation index = index_open(index_oid, AccessShareLock);
+		bool usable = index->rd_rel->relam == BTREE_AM_OID && index->rd_index->indisvalid &&
+		              index->rd_index->indkey.values[0] == attnum &&
+		              heap_attisnull(index->rd_indextuple, Anum_pg_index_indpred, NULL);
+		index_close(index, NoLock);
+		if (usable) {
+			found_index = index_oid;
+			break;
+		}
+	}
+
+	RelationClose(relation);
+	return found_index;
+}
+
+static duckdb::optional_idx
+FindBinding(const duckdb::vector<duckdb::ColumnBinding> &bindings, const duckdb::ColumnBinding &binding) {
+	for (duckdb::idx_t i = 0; i < bindings.size(); i++) {
+		if (bindings[i] == binding) {
+			return i;
+		}
+	}
+	return duckdb::optional_idx();
+}
+
+/*
+ * Builds a postgres_index_lookup of the join's table side that consumes the probe side, below a projection that
+ * returns the columns of the join in the same order. Returns nullptr if the join isn't a small inner equi-join with
+ * a Postgres table that has a B-tree index on its join column.
+ */
+static duckdb::unique_ptr<duckdb::LogicalOperator>
+TryIndexLookupJoin(duckdb::OptimizerExtensionInput &input, duckdb::LogicalComparisonJoin &join,
+                   duckdb::vector<duckdb::ReplacementBinding> &replacements) {
+	if (join.join_type != duckdb::JoinType::INNER || join.conditions.size() != 1 ||
+	    join.conditions[0].comparison != duckdb::ExpressionType::COMPARE_EQUAL ||
+	    join.conditions[0].left->type != duckdb::ExpressionType::BOUND_COLUMN_REF ||
+	    join.conditions[0].right->type != duckdb::ExpressionType::BOUND_COLUMN_REF) {
+		return nullptr;
+	}
+
+	join.ResolveOperatorTypes();
+	auto join_bindings = join.GetColumnBindings();
+	auto join_types = join.types;
+	auto join_cardinality = join.EstimateCardinality(input.context);
+
+	for (duckdb::idx_t table_side = 0; table_side < 2; table_side++) {
+		auto &table_child = join.children[table_side];
+		auto &probe_child = join.children[1 - table_side];
+		auto &table_column = (table_side == 0 ? join.conditions[0].left : join.conditions[0].right)
+		                         ->Cast<duckdb::BoundColumnRefExpression>();
+		auto &probe_column = (table_side == 0 ? join.conditions[0].right : join.conditions[0].left)
+		                         ->Cast<duckdb::BoundColumnRefExpression>();
+
+		if (table_child->type != duckdb::LogicalOperatorType::LOGICAL_GET) {
+			continue;
+		}
+		auto &get = table_child->Cast<duckdb::LogicalGet>();
+		if (get.function.name != "postgres_seq_scan" || !get.table_filters.filters.empty() ||
+		    !get.projection_ids.empty() || !get.children.empty() ||
+		    table_column.binding.table_index != get.table_index) {
+			continue;
+		}
+		if (std::any_of(get.column_ids.begin(), get.column_ids.end(),
+		                [](duckdb::column_t column_id) { return duckdb::IsRowIdColumnId(column_id); })) {
+			continue;
+		}
+
+		auto probe_cardinality = probe_child->EstimateCardinality(input.context);
+		if (probe_cardinality > (duckdb::idx_t)duckdb_index_lookup_max_keys ||
+		    probe_cardinality >= get.EstimateCardinality(input.context)) {
+			continue;
+		}
+
+		auto &seq_scan_data = get.bind_data->Cast<PostgresSeqScanFunctionData>();
+		AttrNumber key_attnum = get.column_ids[table_column.binding.column_index] + 1;
+		Oid key_type = get_atttype(seq_scan_data.m_relid, key_attnum);
+		if (!IsLookupKeyType(key_type)) {
+			continue;
+		}
+
+		probe_child->ResolveOperatorTypes();
+		auto probe_bindings = probe_child->GetColumnBindings();
+		auto key_input_idx = FindBinding(probe_bindings, probe_column.binding);
+		if (!key_input_idx.IsValid()) {
+			continue;
+		}
+
+		Oid index_oid = FindLookupIndex(seq_scan_data.m_relid, key_attnum);
+		if (!OidIsValid(index_oid)) {
+			continue;
+		}
+
+		/* Table columns keep their bindings, probe columns are appended after them */
+		auto table_column_count = get.returned_types.size();
+		auto returned_types = get.returned_types;
+		auto names = get.names;
+		auto column_ids = get.column_ids;
+		duckdb::vector<duckdb::ColumnBinding> probe_lookup_bindings;
+		for (duckdb::idx_t i = 0; i < probe_bindings.size(); i++) {
+			returned_types.push_back(probe_child->types[i]);
+			names.push_back("probe_" + std::to_string(i));
+			probe_lookup_bindings.emplace_back(get.table_index, column_ids.size());
+			column_ids.push_back(table_column_count + i);
+		}
+
+		auto bind_data = duckdb::make_uniq<PostgresIndexLookupFunctionData>(
+		    seq_scan_data.m_relid, index_oid, seq_scan_data.m_snapshot, key_attnum, key_type, key_input_idx.GetIndex(),
+		    table_column_count);
+		auto lookup = duckdb::make_uniq<duckdb::LogicalGet>(get.table_index, PostgresIndexLookupFunction(),
+		                                                    std::move(bind_data), std::move(returned_types),
+		                                                    std::move(names));
+		lookup->column_ids = std::move(column_ids);
+		lookup->children.push_back(std::move(probe_child));
+		lookup->SetEstimatedCardinality(join_cardinality);
+
+		/* Parents may refer to the join's columns by position, so keep them in the same order */
+		auto projection_index = input.optimizer.binder.GenerateTableIndex();
+		duckdb::vector<duckdb::unique_ptr<duckdb::Expression>> expressions;
+		for (duckdb::idx_t i = 0; i < join_bindings.size(); i++) {
+			auto binding = join_bindings[i];
+			auto probe_idx = FindBinding(probe_bindings, binding);
+			if (probe_idx.IsValid()) {
+				binding = probe_lookup_bindings[probe_idx.GetIndex()];
+			}
+			expressions.push_back(duckdb::make_uniq<duckdb::BoundColumnRefExpression>(join_types[i], binding));
+			replacements.emplace_back(join_bindings[i], duckdb::ColumnBinding(projection_index, i));
+		}
+
+		auto projection = duckdb::make_uniq<duckdb::LogicalProjection>(projection_index, std::move(expressions));
+		projection->children.push_back(std::move(lookup));
+		projection->SetEstimatedCardinality(join_cardinality);
+		projection->ResolveOperatorTypes();
+		return std::move(projection);
+	}
+
+	return nullptr;
+}
+
+static void
+PostgresIndexLookupOptimize(duckdb::OptimizerExtensionInput &input, duckdb::unique_ptr<duckdb::LogicalOperator> &plan) {
+	if (duckdb_index_lookup_max_keys <= 0) {
+		return;
+	}
+	RewriteOperators(plan, plan, duckdb::LogicalOperatorType::LOGICAL_COMPARISON_JOIN,
+	                 [&](duckdb::LogicalOperator &op, duckdb::vector<duckdb::ReplacementBinding> &replacements) {
+		                 return TryIndexLookupJoin(input, op.Cast<duckdb::LogicalComparisonJoin>(), replacements);
+	                 });
+}
+
+duckdb::OptimizerExtension
+PostgresIndexLookupOptimizerExtension() {
+	duckdb::OptimizerExtension extension;
+	extension.optimize_function = PostgresIndexLookupOptimize;
+	return extension;
+}
+
+} // namespace pgduckdb
@@ -2,6 +2,7 @@
 
 extern "C" {
 #include "postgres.h"
+#include "executor/executor.h"
 #include "executor/nodeIndexscan.h"
 #include "nodes/pathnodes.h"
 #include "nodes/execnodes.h"
@@ -13,6 +14,7 @@ extern "C" {
 
 #include "pgduckdb/scan/index_scan_utils.hpp"
 #include "pgduckdb/scan/postgres_index_scan.hpp"
+#include "pgduckdb/pgduckdb_guard.hpp"
 #include "pgduckdb/pgduckdb_types.hpp"
 #include "pgduckdb/vendor/pg_list.hpp"
 
@@ -23,30 +25,77 @@ namespace pgduckdb {
 //
 
 PostgresIndexScanGlobalState::PostgresIndexScanGlobalState(IndexScanState *indexScanState, Relation relation,
-                                                           duckdb::TableFunctionInitInput &input)
+                                                           List *index_quals, duckdb::TableFunctionInitInput &input)
     : m_global_state(duckdb::make_shared_ptr<PostgresScanGlobalState>()), m_index_scan(indexScanState),
-      m_relation(relation) {
-	m_global_state->InitGlobalState(input);
+      m_relation(relation), m_index_quals(index_quals) {
 	m_global_state->m_tuple_desc = RelationGetDescr(m_relation);
+	m_global_state->InitGlobalState(input);
 }
 
 PostgresIndexScanGlobalState::~PostgresIndexScanGlobalState() {
-	index_close(m_index_scan->iss_RelationDesc, NoLock);
-	RelationClose(m_relation);
+	std::lock_guard<std::mutex> lock(DuckdbProcessLock::GetLock());
+	PostgresCleanupGuard([&] {
+		index_close(m_index_scan->iss_RelationDesc, NoLock);
+		RelationClose(m_relation);
+		FreeExecutorState(m_index_scan->ss.ps.state);
+	});
 }
 
 //
 // PostgresIndexScanLocalState
 //
 
-PostgresIndexScanLocalState::PostgresIndexScanLocalState(IndexScanDesc index_scan_desc, Relation relation)
-    : m_local_state(duckdb::make_shared_ptr<PostgresScanLocalState>()), m_index_scan_desc(index_scan_desc),
-      m_relation(relation) {
-	m_slot = MakeTupleTableSlot(CreateTupleDescCopy(RelationGetDescr(m_relation)), &TTSOpsBufferHeapTuple);
+PostgresIndexScanLocalState::PostgresIndexScanLocalState(Relation relation, ScanDirection direction)
+    : m_local_state(duckdb::make_shared_ptr<PostgresScanLocalState>()), m_index_scan_desc(nullptr),
+      m_relation(relation), m_slot(nullptr), m_direction(direction), m_scan_keys(nullptr), m_num_scan_keys(0),
+      m_array_keys(nullptr), m_num_array_keys(0), m_array_keys_empty(false), m_rows_returned(0) {
 }
 
 PostgresIndexScanLocalState::~PostgresIndexScanLocalState() {
-	index_endscan(m_index_scan_desc);
+	/* The slot may still pin the buffer of the last tuple returned by the index scan */
+	std::lock_guard<std::mutex> lock(DuckdbProcessLock::GetLock());
+	PostgresCleanupGuard([&] {
+		if (m_slot) {
+			ExecDropSingleTupleTableSlot(m_slot);
+		}
+		if (m_index_scan_desc) {
+			index_endscan(m_index_scan_desc);
+		}
+	});
+}
+
+/*
+ * Builds the scan keys of this scan from the index quals and starts the index scan with them. Array keys the index AM
+ * can't handle natively are advanced by every scan, so each one has its own keys. Must be called while holding
+ * DuckdbProcessLock.
+ */
+void
+PostgresIndexScanLocalState::BeginScan(PostgresIndexScanGlobalState &global_state, Snapshot snapshot) {
+	auto index_scan = global_state.m_index_scan;
+	PostgresFunctionGuard([&] {
+		m_slot = MakeTupleTableSlot(CreateTupleDescCopy(RelationGetDescr(m_relation)), &TTSOpsBufferHeapTuple);
+
+		IndexRuntimeKeyInfo *runtime_keys = NULL;
+		int num_runtime_keys = 0;
+		ExecIndexBuildScanKeys((PlanState *)index_scan, index_scan->iss_RelationDesc, global_state.m_index_quals,
+		                       false, &m_scan_keys, &m_num_scan_keys, &runtime_keys, &num_runtime_keys,
+		                       &m_array_keys, &m_num_array_keys);
+
+		/*
+		 * Scan keys that aren't constants (stable functions, parameters, arrays that aren't constants) are computed
+		 * once, in an expression context of this scan, the scan is never rescanned with different values.
+		 */
+		ExprContext *econtext = CreateExprContext(index_scan->ss.ps.state);
+		if (num_runtime_keys) {
+			ExecIndexEvalRuntimeKeys(econtext, runtime_keys, num_runtime_keys);
+		}
+		if (m_num_array_keys) {
+			m_array_keys_empty = !ExecIndexEvalArrayKeys(econtext, m_array_keys, m_num_array_keys);
+		}
+
+		m_index_scan_desc = index_beginscan(m_relation, index_scan->iss_RelationDesc, snapshot, m_num_scan_keys, 0);
+		index_rescan(m_index_scan_desc, m_scan_keys, m_num_scan_keys, NULL, 0);
+	});
 }
 
 //
@@ -55,9 +104,9 @@ PostgresIndexScanLocalState::~PostgresIndexScanLocalState() {
 
 PostgresIndexScanFunctionData::PostgresIndexScanFunctionData(uint64_t cardinality, Path *path,
                                                              PlannerInfo *planner_info, Oid relation_oid,
-                                                             Snapshot snapshot)
+                                                             Snapshot snapshot, uint64_t limit)
     : m_cardinality(cardinality), m_path(path), m_planner_info(planner_info), m_snapshot(snapshot),
-      m_relation_oid(relation_oid) {
+      m_relation_oid(relation_oid), m_limit(limit) {
 }
 
 PostgresIndexScanFunctionData::~PostgresIndexScanFunctionData() {
@@ -74,6 +123,7 @@ PostgresIndexScanFunction::PostgresIndexScanFunction()
 	named_parameters["path"] = duckdb::LogicalType::POINTER;
 	named_parameters["planner_info"] = duckdb::LogicalType::POINTER;
 	named_parameters["snapshot"] = duckdb::LogicalType::POINTER;
+	named_parameters["limit"] = duckdb::LogicalType::UBIGINT;
 	projection_pushdown = true;
 	filter_pushdown = true;
 	filter_prune = true;
@@ -88,6 +138,7 @@ PostgresIndexScanFunction::PostgresIndexScanBind(duckdb::ClientContext &context,
 	auto path = (reinterpret_cast<Path *>(input.named_parameters["path"].GetPointer()));
 	auto planner_info = (reinterpret_cast<PlannerInfo *>(input.named_parameters["planner_info"].GetPointer()));
 	auto snapshot = (reinterpret_cast<Snapshot>(input.named_parameters["snapshot"].GetPointer()));
+	auto limit = input.named_parameters["limit"].GetValue<uint64_t>();
 
 	RangeTblEntry *rte = planner_rt_fetch(path->parent->relid, planner_info);
 
@@ -112,7 +163,8 @@ PostgresIndexScanFunction::PostgresIndexScanBind(duckdb::ClientContext &context,
 
 	RelationClose(rel);
 
-	return duckdb::make_uniq<PostgresIndexScanFunctionData>(cardinality, path, planner_info, rte->relid, snapshot);
+	return duckdb::make_uniq<PostgresIndexScanFunctionData>(cardinality, path, planner_info, rte->relid, snapshot,
+	                                                         limit);
 }
 
 duckdb::unique_ptr<duckdb::GlobalTableFunctionState>
@@ -120,33 +172,30 @@ PostgresIndexScanFunction::PostgresIndexScanInitGlobal(duckdb::ClientContext &co
                                                        duckdb::TableFunctionInitInput &input) {
 	auto &bind_data = input.bind_data->CastNoConst<PostgresIndexScanFunctionData>();
 
-	IndexScanState *index_state = makeNode(IndexScanState);
-	IndexPath *index_path = (IndexPath *)bind_data.m_path;
-
-	index_state->iss_RelationDesc = index_open(index_path->indexinfo->indexoid, AccessShareLock);
-	index_state->iss_RuntimeKeysReady = false;
-	index_state->iss_RuntimeKeys = NULL;
-	index_state->iss_NumRuntimeKeys = 0;
-
-	List *stripped_clause_list = NIL;
-	IndexOptInfo *index = index_path->indexinfo;
-
-	foreach_node(IndexClause, iclause, index_path->indexclauses) {
-		int indexcol = iclause->indexcol;
-		foreach_node(RestrictInfo, rinfo, iclause->indexquals) {
-			Node *clause = (Node *)rinfo->clause;
-			clause = FixIndexQualClause(bind_data.m_planner_info, index, indexcol, clause, iclause->indexcols);
-			stripped_clause_list = lappend(stripped_clause_list, clause);
-		}
-	}
-
-	ExecIndexBuildScanKeys((PlanState *)index_state, index_state->iss_RelationDesc, stripped_clause_list, false,
-	                       &index_state->iss_ScanKeys, &index_state->iss_NumScanKeys, &index_state->iss_RuntimeKeys,
-	                       &index_state->iss_NumRuntimeKeys, NULL, /* no ArrayKeys */
-	                       NULL);
-
-	return duckdb::make_uniq<PostgresIndexScanGlobalState>(index_state, RelationIdGetRelation(bind_data.m_relation_oid),
-	                                                       input);
+	std::lock_guard<std::mutex> lock(DuckdbProcessLock::GetLock());
+
+	IndexScanState *index_state = nullptr;
+	Relation relation = nullptr;
+	List *index_quals = NIL;
+	PostgresFunctionGuard([&] {
+		index_state = makeNode(IndexScanState);
+		IndexPath *index_path = (IndexPath *)bind_data.m_path;
+
+		/*
+		 * Runtime and array keys are evaluated in this executor state, with the parameters the query was planned
+		 * with.
+		 */
+		EState *estate = CreateExecutorState();
+		estate->es_snapshot = bind_data.m_snapshot;
+		estate->es_param_list_info = bind_data.m_planner_info->glob->boundParams;
+		index_state->ss.ps.state = estate;
+
+		index_state->iss_RelationDesc = index_open(index_path->indexinfo->indexoid, AccessShareLock);
+		index_quals = FixIndexQualClauses(bind_data.m_planner_info, index_path);
+		relation = RelationIdGetRelation(bind_data.m_relation_oid);
+	});
+
+	return duckdb::make_uniq<PostgresIndexScanGlobalState>(index_state, relation, index_quals, input);
 }
 
 duckdb::unique_ptr<duckdb::LocalTableFunctionState>
@@ -156,15 +205,14 @@ PostgresIndexScanFunction::PostgresIndexScanInitLocal(duckdb::ExecutionContext &
 	auto &bind_data = input.bind_data->CastNoConst<PostgresIndexScanFunctionData>();
 	auto global_state = reinterpret_cast<PostgresIndexScanGlobalState *>(gstate);
 
-	IndexScanDesc scandesc =
-	    index_beginscan(global_state->m_relation, global_state->m_index_scan->iss_RelationDesc, bind_data.m_snapshot,
-	                    global_state->m_index_scan->iss_NumScanKeys, global_state->m_index_scan->iss_NumOrderByKeys);
-
-	if (global_state->m_index_scan->iss_NumRuntimeKeys == 0 || global_state->m_index_scan->iss_RuntimeKeysReady)
-		index_rescan(scandesc, global_state->m_index_scan->iss_ScanKeys, global_state->m_index_scan->iss_NumScanKeys,
-		             global_state->m_index_scan->iss_OrderByKeys, global_state->m_index_scan->iss_NumOrderByKeys);
+	/* Backward for ORDER BY ... DESC on an ascending index and vice versa */
+	auto direction = reinterpret_cast<IndexPath *>(bind_data.m_path)->indexscandir;
+	auto local_state = duckdb::make_uniq<PostgresIndexScanLocalState>(global_state->m_relation, direction);
 
-	return duckdb::make_uniq<PostgresIndexScanLocalState>(scandesc, global_state->m_relation);
+	/* Runtime keys call arbitrary functions */
+	std::lock_guard<std::mutex> lock(DuckdbProcessLock::GetLock());
+	local_state->BeginScan(*global_state, bind_data.m_snapshot);
+	return std::move(local_state);
 }
 
 void
@@ -172,25 +220,57 @@ PostgresIndexScanFunction::PostgresIndexScanFunc(duckdb::ClientContext &context,
                                                  duckdb::DataChunk &output) {
 	auto &local_state = data.local_state->Cast<PostgresIndexScanLocalState>();
 	auto &global_state = data.global_state->Cast<PostgresIndexScanGlobalState>();
+	auto &bind_data = data.bind_data->Cast<PostgresIndexScanFunctionData>();
 	bool next_index_tuple = false;
 
 	local_state.m_local_state->m_output_vector_size = 0;
 
-	if (local_state.m_local_state->m_exhausted_scan) {
+	if (local_state.m_local_state->m_exhausted_scan || local_state.m_array_keys_empty) {
 		output.SetCardinality(0);
 		return;
 	}
 
-	while (local_state.m_local_state->m_output_vector_size < STANDARD_VECTOR_SIZE &&
-	       (next_index_tuple =
-	            index_getnext_slot(local_state.m_index_scan_desc, ForwardScanDirection, local_state.m_slot))) {
+	auto &stats = local_state.m_local_state->m_stats;
+	uint64_t max_rows = STANDARD_VECTOR_SIZE;
+	if (bind_data.m_limit) {
+		max_rows = duckdb::MinValue<uint64_t>(max_rows, bind_data.m_limit - local_state.m_rows_returned);
+	}
+
+	while ((uint64_t)local_state.m_local_state->m_output_vector_size < max_rows) {
+		/* The index scan reads and pins buffers, which is not thread safe */
+		auto lock = LockProcessLock(stats);
+		BufferUsage buffer_usage_start = pgBufferUsage;
+		PostgresFunctionGuard([&] {
+			next_index_tuple =
+			    index_getnext_slot(local_state.m_index_scan_desc, local_state.m_direction, local_state.m_slot);
+			/* Continue with the next combination of array key elements */
+			while (!next_index_tuple && local_state.m_num_array_keys &&
+			       ExecIndexAdvanceArrayKeys(local_state.m_array_keys, local_state.m_num_array_keys)) {
+				index_rescan(local_state.m_index_scan_desc, local_state.m_scan_keys, local_state.m_num_scan_keys,
+				             NULL, 0);
+				next_index_tuple =
+				    index_getnext_slot(local_state.m_index_scan_desc, local_state.m_direction, local_state.m_slot);
+			}
+		});
+		CountBufferUsage(stats, buffer_usage_start);
+		lock.unlock();
+
+		if (!next_index_tuple) {
+			break;
+		}
+
 		bool should_free;
 		auto tuple = ExecFetchSlotHeapTuple(local_state.m_slot, false, &should_free);
+		stats.Count(SCAN_STAT_TUPLES_VISIBLE);
 		InsertTupleIntoChunk(output, global_state.m_global_state, local_state.m_local_state, tuple);
-		ExecClearTuple(local_state.m_slot);
+
+		lock = LockProcessLock(stats);
+		PostgresFunctionGuard([&] { ExecClearTuple(local_state.m_slot); });
+		lock.unlock();
 	}
 
-	if (!next_index_tuple) {
+	local_state.m_rows_returned += local_state.m_local_state->m_output_vector_size;
+	if (!next_index_tuple || (bind_data.m_limit && local_state.m_rows_returned >= bind_data.m_limit)) {
 		local_state.m_local_state->m_exhausted_scan = true;
 	}
 
@@ -0,0 +1,250 @@
+#include "duckdb.hpp"
+
+extern "C" {
+#include "postgres.h"
+#include "access/skey.h"
+#include "access/stratnum.h"
+#include "utils/datum.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+}
+
+#include "pgduckdb/pgduckdb_guard.hpp"
+#include "pgduckdb/pgduckdb_process_lock.hpp"
+#include "pgduckdb/scan/postgres_index_skip_scan.hpp"
+#include "pgduckdb/pgduckdb_types.hpp"
+
+namespace pgduckdb {
+
+//
+// PostgresIndexSkipScanGlobalState
+//
+
+PostgresIndexSkipScanGlobalState::PostgresIndexSkipScanGlobalState(Relation relation, Relation index,
+                                                                   Snapshot snapshot,
+                                                                   duckdb::TableFunctionInitInput &input)
+    : m_global_state(duckdb::make_shared_ptr<PostgresScanGlobalState>()), m_relation(relation), m_index(index),
+      m_key_attnum(index->rd_index->indkey.values[0]) {
+	m_global_state->m_snapshot = snapshot;
+	m_global_state->m_tuple_desc = RelationGetDescr(m_relation);
+	m_global_state->InitGlobalState(input);
+
+	/* Called while holding DuckdbProcessLock, see PostgresIndexSkipScanInitGlobal */
+	PostgresFunctionGuard([&] {
+		Oid opfamily = m_index->rd_opfamily[0];
+		Oid opcintype = m_index->rd_opcintype[0];
+		Oid greater_operator = get_opfamily_member(opfamily, opcintype, opcintype, BTGreaterStrategyNumber);
+		if (!OidIsValid(greater_operator)) {
+			elog(ERROR, "missing greater than operator for type %u in opfamily %u", opcintype, opfamily);
+		}
+		m_greater_proc = get_opcode(greater_operator);
+	});
+}
+
+PostgresIndexSkipScanGlobalState::~PostgresIndexSkipScanGlobalState() {
+	std::lock_guard<std::mutex> lock(DuckdbProcessLock::GetLock());
+	PostgresCleanupGuard([&] {
+		index_close(m_index, NoLock);
+		RelationClose(m_relation);
+	});
+}
+
+//
+// PostgresIndexSkipScanLocalState
+//
+
+PostgresIndexSkipScanLocalState::PostgresIndexSkipScanLocalState(Relation relation, Relation index,
+                                                                 Snapshot snapshot)
+    : m_local_state(duckdb::make_shared_ptr<PostgresScanLocalState>()), m_index_scan_desc(nullptr), m_slot(nullptr),
+      m_phase(SkipScanPhase::FIRST_KEY), m_last_key((Datum)0) {
+	/* Called while holding DuckdbProcessLock, see PostgresIndexSkipScanInitLocal */
+	PostgresFunctionGuard([&] {
+		m_index_scan_desc = index_beginscan(relation, index, snapshot, 1, 0);
+		m_slot = MakeTupleTableSlot(CreateTupleDescCopy(RelationGetDescr(relation)), &TTSOpsBufferHeapTuple);
+	});
+}
+
+PostgresIndexSkipScanLocalState::~PostgresIndexSkipScanLocalState() {
+	/* The slot may still pin the buffer of the last tuple returned by the index scan */
+	std::lock_guard<std::mutex> lock(DuckdbProcessLock::GetLock());
+	PostgresCleanupGuard([&] {
+		if (m_slot) {
+			ExecDropSingleTupleTableSlot(m_slot);
+		}
+		if (m_index_scan_desc) {
+			index_endscan(m_index_scan_desc);
+		}
+	});
+}
+
+//
+// PostgresIndexSkipScanFunctionData
+//
+
+PostgresIndexSkipScanFunctionData::PostgresIndexSkipScanFunctionData(uint64_t cardinality, Oid relid, Oid index_oid,
+                                                                     Snapshot snapshot)
+    : m_cardinality(cardinality), m_relid(relid), m_index_oid(index_oid), m_snapshot(snapshot) {
+}
+
+PostgresIndexSkipScanFunctionData::~PostgresIndexSkipScanFunctionData() {
+}
+
+//
+// PostgresIndexSkipScanFunction
+//
+
+PostgresIndexSkipScanFunction::PostgresIndexSkipScanFunction()
+    : TableFunction("postgres_index_skip_scan", {}, PostgresIndexSkipScanFunc, PostgresIndexSkipScanBind,
+                    PostgresIndexSkipScanInitGlobal, PostgresIndexSkipScanInitLocal) {
+	named_parameters["cardinality"] = duckdb::LogicalType::UBIGINT;
+	named_parameters["relid"] = duckdb::LogicalType::UINTEGER;
+	named_parameters["index"] = duckdb::LogicalType::UINTEGER;
+	named_parameters["snapshot"] = duckdb::LogicalType::POINTER;
+	projection_pushdown = true;
+	cardinality = PostgresIndexSkipScanCardinality;
+}
+
+duckdb::unique_ptr<duckdb::FunctionData>
+PostgresIndexSkipScanFunction::PostgresIndexSkipScanBind(duckdb::ClientContext &context,
+                                                         duckdb::TableFunctionBindInput &input,
+                                                         duckdb::vector<duckdb::LogicalType> &return_types,
+                                                         duckdb::vector<duckdb::string> &names) {
+	auto cardinality = input.named_parameters["cardinality"].GetValue<uint64_t>();
+	auto relid = input.named_parameters["relid"].GetValue<uint32_t>();
+	auto index_oid = input.named_parameters["index"].GetValue<uint32_t>();
+	auto snapshot = (reinterpret_cast<Snapshot>(input.named_parameters["snapshot"].GetPointer()));
+
+	auto rel = RelationIdGetRelation(relid);
+	auto relation_descr = RelationGetDescr(rel);
+
+	if (!relation_descr) {
+		elog(ERROR, "Failed to get tuple descriptor for relation with OID %u", relid);
+		RelationClose(rel);
+		return nullptr;
+	}
+
+	for (int i = 0; i < relation_descr->natts; i++) {
+		Form_pg_attribute attr = &relation_descr->attrs[i];
+		return_types.push_back(ConvertPostgresToDuckColumnType(attr));
+		names.push_back(duckdb::string(NameStr(attr->attname)));
+	}
+
+	RelationClose(rel);
+	return duckdb::make_uniq<PostgresIndexSkipScanFunctionData>(cardinality, relid, index_oid, snapshot);
+}
+
+duckdb::unique_ptr<duckdb::GlobalTableFunctionState>
+PostgresIndexSkipScanFunction::PostgresIndexSkipScanInitGlobal(duckdb::ClientContext &context,
+                                                               duckdb::TableFunctionInitInput &input) {
+	auto &bind_data = input.bind_data->CastNoConst<PostgresIndexSkipScanFunctionData>();
+	std::lock_guard<std::mutex> lock(DuckdbProcessLock::GetLock());
+	Relation relation = nullptr;
+	Relation index = nullptr;
+	PostgresFunctionGuard([&] {
+		relation = RelationIdGetRelation(bind_data.m_relid);
+		index = index_open(bind_data.m_index_oid, AccessShareLock);
+	});
+	return duckdb::make_uniq<PostgresIndexSkipScanGlobalState>(relation, index, bind_data.m_snapshot, input);
+}
+
+duckdb::unique_ptr<duckdb::LocalTableFunctionState>
+PostgresIndexSkipScanFunction::PostgresIndexSkipScanInitLocal(duckdb::ExecutionContext &context,
+                                                              duckdb::TableFunctionInitInput &input,
+                                                              duckdb::GlobalTableFunctionState *gstate) {
+	auto &bind_data = input.bind_data->CastNoConst<PostgresIndexSkipScanFunctionData>();
+	auto global_state = reinterpret_cast<PostgresIndexSkipScanGlobalState *>(gstate);
+	std::lock_guard<std::mutex> lock(DuckdbProcessLock::GetLock());
+	return duckdb::make_uniq<PostgresIndexSkipScanLocalState>(global_state->m_relation, global_state->m_index,
+	                                                          bind_data.m_snapshot);
+}
+
+/*
+ * Restarts the index scan at the first entry of the next key: the first non-NULL key, the first key greater than the
+ * last returned one, or NULL once all non-NULL keys have been returned.
+ */
+static void
+StartNextKeyProbe(PostgresIndexSkipScanGlobalState &global_state, PostgresIndexSkipScanLocalState &local_state) {
+	ScanKeyData scan_key;
+
+	switch (local_state.m_phase) {
+	case SkipScanPhase::FIRST_KEY:
+		ScanKeyEntryInitialize(&scan_key, SK_ISNULL | SK_SEARCHNOTNULL, 1, InvalidStrategy, InvalidOid, InvalidOid,
+		                       InvalidOid, (Datum)0);
+		break;
+	case SkipScanPhase::NEXT_KEY:
+		ScanKeyEntryInitialize(&scan_key, 0, 1, BTGreaterStrategyNumber, global_state.m_index->rd_opcintype[0],
+		                       global_state.m_index->rd_indcollation[0], global_state.m_greater_proc,
+		                       local_state.m_last_key);
+		break;
+	default:
+		ScanKeyEntryInitialize(&scan_key, SK_ISNULL | SK_SEARCHNULL, 1, InvalidStrategy, InvalidOid, InvalidOid,
+		                       InvalidOid, (Datum)0);
+		break;
+	}
+
+	index_rescan(local_state.m_index_scan_desc, &scan_key, 1, NULL, 0);
+}
+
+void
+PostgresIndexSkipScanFunction::PostgresIndexSkipScanFunc(duckdb::ClientContext &context,
+                                                         duckdb::TableFunctionInput &data, duckdb::DataChunk &output) {
+	auto &local_state = data.local_state->Cast<PostgresIndexSkipScanLocalState>();
+	auto &global_state = data.global_state->Cast<PostgresIndexSkipScanGlobalState>();
+	auto &stats = local_state.m_local_state->m_stats;
+	Form_pg_attribute key_attr =
+	    TupleDescAttr(RelationGetDescr(global_state.m_relation), global_state.m_key_attnum - 1);
+
+	local_state.m_local_state->m_output_vector_size = 0;
+
+	while (local_state.m_phase != SkipScanPhase::DONE &&
+	       local_state.m_local_state->m_output_vector_size < STANDARD_VECTOR_SIZE) {
+		/* The index scan reads and pins buffers, which is not thread safe */
+		auto lock = LockProcessLock(stats);
+		BufferUsage buffer_usage_start = pgBufferUsage;
+		bool found = false;
+		PostgresFunctionGuard([&] {
+			StartNextKeyProbe(global_state, local_state);
+			found = index_getnext_slot(local_state.m_index_scan_desc, ForwardScanDirection, local_state.m_slot);
+			if (found && local_state.m_phase != SkipScanPhase::NULL_KEY) {
+				bool is_null;
+				Datum key = slot_getattr(local_state.m_slot, global_state.m_key_attnum, &is_null);
+				if (local_state.m_phase == SkipScanPhase::NEXT_KEY && !key_attr->attbyval) {
+					pfree(DatumGetPointer(local_state.m_last_key));
+				}
+				local_state.m_last_key = datumCopy(key, key_attr->attbyval, key_attr->attlen);
+			}
+		});
+		CountBufferUsage(stats, buffer_usage_start);
+		lock.unlock();
+
+		if (!found) {
+			local_state.m_phase =
+			    local_state.m_phase == SkipScanPhase::NULL_KEY ? SkipScanPhase::DONE : SkipScanPhase::NULL_KEY;
+			continue;
+		}
+
+		bool should_free;
+		auto tuple = ExecFetchSlotHeapTuple(local_state.m_slot, false, &should_free);
+		stats.Count(SCAN_STAT_TUPLES_VISIBLE);
+		InsertTupleIntoChunk(output, global_state.m_global_state, local_state.m_local_state, tuple);
+
+		lock = LockProcessLock(stats);
+		PostgresFunctionGuard([&] { ExecClearTuple(local_state.m_slot); });
+		lock.unlock();
+
+		/* All NULL keys are equal for DISTINCT and GROUP BY */
+		local_state.m_phase =
+		    local_state.m_phase == SkipScanPhase::NULL_KEY ? SkipScanPhase::DONE : SkipScanPhase::NEXT_KEY;
+	}
+
+	output.SetCardinality(local_state.m_local_state->m_output_vector_size);
+}
+
+duckdb::unique_ptr<duckdb::NodeStatistics>
+PostgresIndexSkipScanFunction::PostgresIndexSkipScanCardinality(duckdb::ClientContext &context,
+                                                                const duckdb::FunctionData *data) {
+	auto &bind_data = data->Cast<PostgresIndexSkipScanFunctionData>();
+	return duckdb::make_uniq<duckdb::NodeStatistics>(bind_data.m_cardinality, bind_data.m_cardinality);
+}
+
+} // namespace pgduckdb
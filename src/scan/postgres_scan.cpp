@@ -14,34 +14,57 @@
 
 extern "C" {
 #include "postgres.h"
+#include "access/sysattr.h"
 #include "catalog/namespace.h"
+#include "catalog/pg_am.h"
 #include "catalog/pg_class.h"
+#include "optimizer/cost.h"
+#include "optimizer/optimizer.h"
+#include "optimizer/paths.h"
 #include "optimizer/planmain.h"
 #include "optimizer/planner.h"
+#include "optimizer/tlist.h"
+#include "parser/parsetree.h"
 #include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
 #include "utils/regproc.h"
+#include "utils/selfuncs.h"
 #include "utils/snapmgr.h"
 #include "utils/syscache.h"
 }
 
 #include "pgduckdb/scan/postgres_scan.hpp"
 #include "pgduckdb/pgduckdb_types.hpp"
+#include "pgduckdb/vendor/pg_list.hpp"
 
 namespace pgduckdb {
 
 void
 PostgresScanGlobalState::InitGlobalState(duckdb::TableFunctionInitInput &input) {
 	/* SELECT COUNT(*) FROM */
-	if (input.column_ids.size() == 1 && input.column_ids[0] == UINT64_MAX) {
+	if (input.column_ids.size() == 1 && input.column_ids[0] == UINT64_MAX && !m_complex_filter) {
 		m_count_tuples_only = true;
 		return;
 	}
 
 	/* We need ordered columns ids for tuple fetch */
 	for (duckdb::idx_t i = 0; i < input.column_ids.size(); i++) {
+		/* The row id DuckDB asks for when counting rows that pass the complex filter */
+		if (input.column_ids[i] == UINT64_MAX) {
+			continue;
+		}
 		m_columns[input.column_ids[i]] = i;
 	}
 
+	/* Columns only the complex filter needs are deformed after the scan columns */
+	duckdb::idx_t value_idx = input.column_ids.size();
+	for (auto column_id : m_complex_filter_columns) {
+		if (m_columns.find(column_id) == m_columns.end()) {
+			m_columns[column_id] = value_idx++;
+		}
+	}
+
 	if (input.CanRemoveFilterColumns()) {
 		for (duckdb::idx_t i = 0; i < input.projection_ids.size(); i++) {
 			m_projections[i] = input.column_ids[input.projection_ids[i]];
@@ -51,8 +74,42 @@ PostgresScanGlobalState::InitGlobalState(duckdb::TableFunctionInitInput &input)
 			m_projections[i] = input.column_ids[i];
 		}
 	}
+	if (m_projections.size() == 1 && m_projections.begin()->second == UINT64_MAX) {
+		m_projections.clear();
+	}
 
 	m_filters = input.filters.get();
+	m_deform_program = duckdb::make_uniq<TupleDeformProgram>(m_tuple_desc, m_columns, m_projections, m_filters,
+	                                                         m_complex_filter_columns);
+}
+
+/*
+ * Initializes the state of an in-out function, e.g. postgres_tid_fetch, that reads the columns with ids below
+ * table_column_count from heap tuples of the relation and passes the others through from its input chunk.
+ */
+void
+PostgresScanGlobalState::InitInOutGlobalState(duckdb::TableFunctionInitInput &input,
+                                              duckdb::idx_t table_column_count) {
+	/* Only the table columns are read from the heap tuples, the others are copied from the input */
+	duckdb::vector<duckdb::column_t> table_column_ids;
+	duckdb::vector<duckdb::idx_t> table_projection_ids;
+	for (duckdb::idx_t i = 0; i < input.column_ids.size(); i++) {
+		if (input.column_ids[i] < table_column_count) {
+			table_projection_ids.push_back(table_column_ids.size());
+			table_column_ids.push_back(input.column_ids[i]);
+		} else {
+			m_input_columns.emplace_back(i, input.column_ids[i] - table_column_count);
+		}
+	}
+
+	duckdb::TableFunctionInitInput table_input(input.bind_data, table_column_ids, table_projection_ids, nullptr);
+	InitGlobalState(table_input);
+}
+
+ComplexFilterState::ComplexFilterState(duckdb::ClientContext &context, const duckdb::Expression &filter,
+                                       const duckdb::vector<duckdb::LogicalType> &types)
+    : m_executor(context, filter), m_sel(STANDARD_VECTOR_SIZE), m_rows(STANDARD_VECTOR_SIZE) {
+	m_chunk.Initialize(duckdb::Allocator::DefaultAllocator(), types);
 }
 
 static Oid
@@ -85,7 +142,7 @@ CreateFunctionSeqScanArguments(uint64 cardinality, Oid relid, Snapshot snapshot)
 }
 
 static duckdb::vector<duckdb::unique_ptr<duckdb::ParsedExpression>>
-CreateFunctionIndexScanArguments(uint64_t cardinality, Path *path, PlannerInfo *plannerInfo, Snapshot snapshot) {
+CreateFunctionPathScanArguments(uint64_t cardinality, Path *path, PlannerInfo *plannerInfo, Snapshot snapshot) {
 	duckdb::vector<duckdb::unique_ptr<duckdb::ParsedExpression>> children;
 
 	children.push_back(duckdb::make_uniq<duckdb::ComparisonExpression>(
@@ -108,6 +165,29 @@ CreateFunctionIndexScanArguments(uint64_t cardinality, Path *path, PlannerInfo *
 	return children;
 }
 
+static duckdb::vector<duckdb::unique_ptr<duckdb::ParsedExpression>>
+CreateFunctionIndexScanArguments(uint64_t cardinality, Path *path, PlannerInfo *plannerInfo, Snapshot snapshot,
+                                 uint64_t limit) {
+	auto children = CreateFunctionPathScanArguments(cardinality, path, plannerInfo, snapshot);
+
+	children.push_back(duckdb::make_uniq<duckdb::ComparisonExpression>(
+	    duckdb::ExpressionType::COMPARE_EQUAL, duckdb::make_uniq<duckdb::ColumnRefExpression>("limit"),
+	    duckdb::make_uniq<duckdb::ConstantExpression>(duckdb::Value::UBIGINT(limit))));
+
+	return children;
+}
+
+static duckdb::vector<duckdb::unique_ptr<duckdb::ParsedExpression>>
+CreateFunctionIndexSkipScanArguments(uint64_t cardinality, Oid relid, Oid index_oid, Snapshot snapshot) {
+	auto children = CreateFunctionSeqScanArguments(cardinality, relid, snapshot);
+
+	children.push_back(duckdb::make_uniq<duckdb::ComparisonExpression>(
+	    duckdb::ExpressionType::COMPARE_EQUAL, duckdb::make_uniq<duckdb::ColumnRefExpression>("index"),
+	    duckdb::make_uniq<duckdb::ConstantExpression>(duckdb::Value::UINTEGER(index_oid))));
+
+	return children;
+}
+
 duckdb::unique_ptr<duckdb::TableRef>
 ReplaceView(Oid view) {
 	auto oid = ObjectIdGetDatum(view);
@@ -153,12 +233,279 @@ FindMatchingRelEntry(Oid relid, PlannerInfo *planner_info) {
 	return nullptr;
 }
 
+/* Returns true if rel is the only relation the query of root reads */
+static bool
+IsOnlyRelationOfQuery(PlannerInfo *root, RelOptInfo *rel) {
+	return rel->relid < (Index)root->simple_rel_array_size && root->simple_rel_array[rel->relid] == rel &&
+	       bms_membership(root->all_baserels) == BMS_SINGLETON;
+}
+
+/*
+ * Returns LIMIT + OFFSET of a query that only sorts and limits the rows of rel, 0 if the number of rows it needs from
+ * rel isn't bounded.
+ */
+static uint64_t
+GetRelationRowLimit(PlannerInfo *root, RelOptInfo *rel) {
+	Query *parse = root->parse;
+
+	if (!IsOnlyRelationOfQuery(root, rel)) {
+		return 0;
+	}
+
+	if (parse->groupClause || parse->groupingSets || parse->hasAggs || parse->hasWindowFuncs ||
+	    parse->distinctClause || parse->hasTargetSRFs || parse->setOperations || parse->havingQual ||
+	    parse->limitOption != LIMIT_OPTION_COUNT) {
+		return 0;
+	}
+
+	if (!parse->limitCount || !IsA(parse->limitCount, Const) || castNode(Const, parse->limitCount)->constisnull) {
+		return 0;
+	}
+
+	int64 limit = DatumGetInt64(castNode(Const, parse->limitCount)->constvalue);
+	if (parse->limitOffset) {
+		if (!IsA(parse->limitOffset, Const)) {
+			return 0;
+		}
+		auto offset = castNode(Const, parse->limitOffset);
+		if (!offset->constisnull && DatumGetInt64(offset->constvalue) > 0) {
+			limit += DatumGetInt64(offset->constvalue);
+		}
+	}
+
+	return limit > 0 ? limit : 0;
+}
+
+/*
+ * DuckDB still sorts the rows returned by the index scan, so the scan may only stop after the first rows if those are
+ * the rows DuckDB would keep. That's the case if the index quals are the only filters and DuckDB orders the rows like
+ * the index does: no collations, and NULLs can only come first (Postgres' default for DESC) if the column is NOT NULL,
+ * because DuckDB sorts NULLs last.
+ */
+static bool
+IndexPathCanStopAtLimit(PlannerInfo *root, RelOptInfo *rel, Oid relid, IndexPath *index_path) {
+	if (!pathkeys_contained_in(root->query_pathkeys, index_path->path.pathkeys)) {
+		return false;
+	}
+
+	foreach_node(RestrictInfo, rinfo, rel->baserestrictinfo) {
+		bool is_index_qual = false;
+		foreach_node(IndexClause, iclause, index_path->indexclauses) {
+			if (iclause->rinfo == rinfo && !iclause->lossy) {
+				is_index_qual = true;
+				break;
+			}
+		}
+		if (!is_index_qual) {
+			return false;
+		}
+	}
+
+	Relation relation = RelationIdGetRelation(relid);
+	bool ordered_like_duckdb = true;
+	foreach_node(PathKey, pathkey, root->query_pathkeys) {
+		EquivalenceClass *eclass = pathkey->pk_eclass;
+		if (OidIsValid(eclass->ec_collation)) {
+			ordered_like_duckdb = false;
+			break;
+		}
+		if (!pathkey->pk_nulls_first) {
+			continue;
+		}
+		bool not_null = false;
+		foreach_node(EquivalenceMember, member, eclass->ec_members) {
+			Var *var = (Var *)member->em_expr;
+			if (IsA(var, Var) && var->varno == (int)rel->relid && var->varattno > 0 &&
+			    TupleDescAttr(RelationGetDescr(relation), var->varattno - 1)->attnotnull) {
+				not_null = true;
+				break;
+			}
+		}
+		if (!not_null) {
+			ordered_like_duckdb = false;
+			break;
+		}
+	}
+	RelationClose(relation);
+
+	return ordered_like_duckdb;
+}
+
+/*
+ * For ORDER BY ... LIMIT queries, returns an index path that produces rows in the requested order (forward or
+ * backward) and that is cheaper than reading the whole relation, setting limit to the number of rows the scan has to
+ * return. Returns nullptr otherwise.
+ */
+static Path *
+FindLimitedIndexPath(PlannerInfo *root, RelOptInfo *rel, Oid relid, uint64_t &limit) {
+	limit = 0;
+	uint64_t row_limit = GetRelationRowLimit(root, rel);
+	if (!row_limit || !root->query_pathkeys) {
+		return nullptr;
+	}
+
+	double fraction = rel->rows > row_limit ? row_limit / rel->rows : 1.0;
+	Path *path = get_cheapest_fractional_path_for_pathkeys(rel->pathlist, root->query_pathkeys, NULL, fraction);
+	if (!path || (path->pathtype != T_IndexScan && path->pathtype != T_IndexOnlyScan)) {
+		return nullptr;
+	}
+
+	Cost fractional_cost = path->startup_cost + fraction * (path->total_cost - path->startup_cost);
+	if (rel->cheapest_total_path && fractional_cost >= rel->cheapest_total_path->total_cost) {
+		return nullptr;
+	}
+
+	if (!IndexPathCanStopAtLimit(root, rel, relid, (IndexPath *)path)) {
+		return nullptr;
+	}
+
+	limit = row_limit;
+	return path;
+}
+
+/*
+ * For SELECT DISTINCT / GROUP BY queries without filters that group by a single column of rel and whose targets only
+ * reference that column, returns a B-tree index with that column as leading column if probing the index once per
+ * distinct value is cheaper than reading the whole relation. Sets ndistinct to the estimated number of distinct values.
+ * Returns nullptr otherwise.
+ */
+static IndexOptInfo *
+FindSkipScanIndex(PlannerInfo *root, RelOptInfo *rel, double &ndistinct) {
+	Query *parse = root->parse;
+
+	if (!IsOnlyRelationOfQuery(root, rel) || rel->baserestrictinfo) {
+		return nullptr;
+	}
+
+	if ((!parse->groupClause && !parse->distinctClause) || parse->groupingSets || parse->hasAggs ||
+	    parse->hasWindowFuncs || parse->hasTargetSRFs || parse->setOperations || parse->havingQual) {
+		return nullptr;
+	}
+
+	/* The skip scan returns a single row per key, while volatile targets, e.g. random(), differ between its rows */
+	if (contain_volatile_functions((Node *)parse->targetList)) {
+		return nullptr;
+	}
+
+	Var *key_var = nullptr;
+	List *vars = pull_var_clause((Node *)parse->targetList, PVC_RECURSE_PLACEHOLDERS);
+	foreach_node(Var, var, vars) {
+		if (var->varno != (int)rel->relid || var->varattno <= 0 ||
+		    (key_var && var->varattno != key_var->varattno)) {
+			return nullptr;
+		}
+		key_var = var;
+	}
+	if (!key_var) {
+		return nullptr;
+	}
+
+	/* Every DISTINCT and GROUP BY expression has to be the key column itself */
+	List *group_clauses = list_concat_copy(parse->distinctClause, parse->groupClause);
+	foreach_node(SortGroupClause, group_clause, group_clauses) {
+		Node *expr = get_sortgroupclause_expr(group_clause, parse->targetList);
+		if (!IsA(expr, Var) || ((Var *)expr)->varattno != key_var->varattno) {
+			return nullptr;
+		}
+	}
+
+	foreach_node(IndexOptInfo, index, rel->indexlist) {
+		if (index->relam != BTREE_AM_OID || !index->amhasgettuple || index->indpred || index->hypothetical ||
+		    index->indexkeys[0] != key_var->varattno) {
+			continue;
+		}
+		/* The index has to consider the same keys equal as the DISTINCT or GROUP BY */
+		bool same_equality = true;
+		foreach_node(SortGroupClause, group_clause, group_clauses) {
+			same_equality = same_equality && op_in_opfamily(group_clause->eqop, index->opfamily[0]);
+		}
+		if (!same_equality) {
+			continue;
+		}
+
+		ndistinct = estimate_num_groups(root, list_make1(key_var), rel->tuples, NULL, NULL);
+		/* Every probe descends from the root to a leaf page and fetches one heap page */
+		double pages_per_probe = (index->tree_height > 0 ? index->tree_height + 1 : 2) + 1;
+		Cost skip_scan_cost = ndistinct * pages_per_probe * random_page_cost;
+		if (rel->cheapest_total_path && skip_scan_cost < rel->cheapest_total_path->total_cost) {
+			return index;
+		}
+		return nullptr;
+	}
+
+	return nullptr;
+}
+
+/*
+ * Replaces the operators of the given type in the subtree op of plan, bottom up, by the operator try_rewrite returns
+ * for them, unless it returns nullptr. The column bindings try_rewrite adds to its replacements are then replaced in
+ * the rest of plan, so that the parents of the new operator refer to its columns.
+ */
+void
+RewriteOperators(duckdb::unique_ptr<duckdb::LogicalOperator> &op, duckdb::unique_ptr<duckdb::LogicalOperator> &plan,
+                 duckdb::LogicalOperatorType type, const TryRewriteOperator &try_rewrite) {
+	for (auto &child : op->children) {
+		RewriteOperators(child, plan, type, try_rewrite);
+	}
+
+	if (op->type != type) {
+		return;
+	}
+
+	duckdb::vector<duckdb::ReplacementBinding> replacements;
+	auto rewritten = try_rewrite(*op, replacements);
+	if (!rewritten) {
+		return;
+	}
+
+	op = std::move(rewritten);
+	duckdb::ColumnBindingReplacer replacer;
+	replacer.replacement_bindings = std::move(replacements);
+	replacer.stop_operator = op.get();
+	replacer.VisitOperator(*plan);
+}
+
+/*
+ * Returns the restriction clauses of rel that reference a column DuckDB can't read, e.g. `doc @> '{...}'` on a jsonb
+ * column. The planner leaves them out of the query DuckDB executes, the bitmap heap scan of rel evaluates them in
+ * Postgres instead.
+ */
+List *
+GetPostgresQuals(RelOptInfo *rel) {
+	List *quals = NIL;
+	foreach_node(RestrictInfo, rinfo, rel->baserestrictinfo) {
+		foreach_node(Var, var, pull_var_clause((Node *)rinfo->clause, PVC_RECURSE_PLACEHOLDERS)) {
+			if (var->varattno > 0 && !IsSupportedPostgresType(var->vartype)) {
+				quals = lappend(quals, rinfo->clause);
+				break;
+			}
+		}
+	}
+	return quals;
+}
+
+/* Returns true if the query reads the ctid of relid */
+static bool
+QueryReferencesCtid(const PostgresReplacementScanData &scan_data, Oid relid) {
+	foreach_node(Var, var, scan_data.m_needed_columns) {
+		if (var->varattno == SelfItemPointerAttributeNumber && var->varlevelsup == 0 &&
+		    rt_fetch(var->varno, scan_data.m_rtables)->relid == relid) {
+			return true;
+		}
+	}
+	return false;
+}
+
 duckdb::unique_ptr<duckdb::TableRef>
 PostgresReplacementScan(duckdb::ClientContext &context, duckdb::ReplacementScanInput &input,
                         duckdb::optional_ptr<duckdb::ReplacementScanData> data) {
 
 	auto table_name = duckdb::ReplacementScan::GetFullPath(input);
-	auto &scan_data = reinterpret_cast<PostgresReplacementScanData &>(*data);
+	auto registered_state = context.registered_state.find(PostgresReplacementScanData::STATE_KEY);
+	if (registered_state == context.registered_state.end()) {
+		return nullptr;
+	}
+	auto &scan_data = static_cast<PostgresReplacementScanData &>(*registered_state->second);
 
 	/* Check name against query table list and verify that it is heap table */
 	auto relid = FindMatchingRelation(table_name);
@@ -184,27 +531,69 @@ PostgresReplacementScan(duckdb::ClientContext &context, duckdb::ReplacementScanI
 
 	RelOptInfo *node = nullptr;
 	Path *node_path = nullptr;
+	uint64_t limit = 0;
+
+	/* Only the seq scan exposes the ctid, the cheapest path is then only used for the cardinality estimate */
+	bool references_ctid = QueryReferencesCtid(scan_data, relid);
+	/* Only the bitmap heap scan evaluates Postgres quals, the planner made sure it's the cheapest path */
+	bool has_postgres_quals = false;
 
 	if (scan_data.m_query_planner_info) {
 		node = FindMatchingRelEntry(relid, scan_data.m_query_planner_info);
+		has_postgres_quals = node && GetPostgresQuals(node) != NIL;
+		double ndistinct = 0;
+		IndexOptInfo *skip_scan_index = node && !references_ctid && !has_postgres_quals
+		                                    ? FindSkipScanIndex(scan_data.m_query_planner_info, node, ndistinct)
+		                                    : nullptr;
+		if (skip_scan_index) {
+			auto children =
+			    CreateFunctionIndexSkipScanArguments(ndistinct, relid, skip_scan_index->indexoid, GetActiveSnapshot());
+			auto table_function = duckdb::make_uniq<duckdb::TableFunctionRef>();
+			table_function->function =
+			    duckdb::make_uniq<duckdb::FunctionExpression>("postgres_index_skip_scan", std::move(children));
+			table_function->alias = table_name;
+			return std::move(table_function);
+		}
 		if (node) {
-			node_path = get_cheapest_fractional_path(node, 0.0);
+			if (!references_ctid && !has_postgres_quals) {
+				node_path = FindLimitedIndexPath(scan_data.m_query_planner_info, node, relid, limit);
+			}
+			if (!node_path) {
+				node_path = get_cheapest_fractional_path(node, 0.0);
+			}
 		}
 	}
 
 	/* SELECT query will have nodePath so we can return cardinality estimate of scan */
 	Cardinality nodeCardinality = node_path ? node_path->rows : 1;
+	if (limit && limit < nodeCardinality) {
+		nodeCardinality = limit;
+	}
 
-	if ((node_path != nullptr && (node_path->pathtype == T_IndexScan || node_path->pathtype == T_IndexOnlyScan))) {
+	if (!references_ctid && node_path != nullptr &&
+	    (node_path->pathtype == T_IndexScan || node_path->pathtype == T_IndexOnlyScan)) {
 		auto children = CreateFunctionIndexScanArguments(nodeCardinality, node_path, scan_data.m_query_planner_info,
-		                                                 GetActiveSnapshot());
+		                                                 GetActiveSnapshot(), limit);
 		auto table_function = duckdb::make_uniq<duckdb::TableFunctionRef>();
 		table_function->function =
 		    duckdb::make_uniq<duckdb::FunctionExpression>("postgres_index_scan", std::move(children));
 		table_function->alias = table_name;
 		return std::move(table_function);
+	} else if (!references_ctid && node_path != nullptr && node_path->pathtype == T_BitmapHeapScan) {
+		auto children = CreateFunctionPathScanArguments(nodeCardinality, node_path, scan_data.m_query_planner_info,
+		                                                GetActiveSnapshot());
+		auto table_function = duckdb::make_uniq<duckdb::TableFunctionRef>();
+		table_function->function =
+		    duckdb::make_uniq<duckdb::FunctionExpression>("postgres_bitmap_heap_scan", std::move(children));
+		table_function->alias = table_name;
+		return std::move(table_function);
 	} else {
 		auto children = CreateFunctionSeqScanArguments(nodeCardinality, relid, GetActiveSnapshot());
+		if (references_ctid) {
+			children.push_back(duckdb::make_uniq<duckdb::ComparisonExpression>(
+			    duckdb::ExpressionType::COMPARE_EQUAL, duckdb::make_uniq<duckdb::ColumnRefExpression>("ctid"),
+			    duckdb::make_uniq<duckdb::ConstantExpression>(duckdb::Value::BOOLEAN(true))));
+		}
 		auto table_function = duckdb::make_uniq<duckdb::TableFunctionRef>();
 		table_function->function =
 		    duckdb::make_uniq<duckdb::FunctionExpression>("postgres_seq_scan", std::move(children));
@@ -1,6 +1,14 @@
 #include "duckdb.hpp"
+#include "duckdb/planner/expression_iterator.hpp"
+#include "duckdb/planner/expression/bound_between_expression.hpp"
+#include "duckdb/planner/expression/bound_columnref_expression.hpp"
+#include "duckdb/planner/expression/bound_comparison_expression.hpp"
+#include "duckdb/planner/expression/bound_conjunction_expression.hpp"
+#include "duckdb/planner/expression/bound_operator_expression.hpp"
+#include "duckdb/planner/expression/bound_reference_expression.hpp"
 
 #include "pgduckdb/scan/postgres_seq_scan.hpp"
+#include "pgduckdb/pgduckdb_guard.hpp"
 #include "pgduckdb/pgduckdb_types.hpp"
 
 namespace pgduckdb {
@@ -10,16 +18,21 @@ namespace pgduckdb {
 //
 
 PostgresSeqScanGlobalState::PostgresSeqScanGlobalState(Relation relation, duckdb::TableFunctionInitInput &input)
-    : m_global_state(duckdb::make_shared_ptr<PostgresScanGlobalState>()),
-      m_heap_reader_global_state(duckdb::make_shared_ptr<HeapReaderGlobalState>(relation)), m_relation(relation) {
-	m_global_state->InitGlobalState(input);
+    : m_global_state(duckdb::make_shared_ptr<PostgresScanGlobalState>()), m_relation(relation) {
+	auto &bind_data = input.bind_data->Cast<PostgresSeqScanFunctionData>();
+	m_heap_reader_global_state =
+	    duckdb::make_shared_ptr<HeapReaderGlobalState>(relation, bind_data.m_snapshot, bind_data.m_shared_state);
 	m_global_state->m_tuple_desc = RelationGetDescr(m_relation);
+	m_global_state->m_complex_filter = bind_data.m_complex_filter.get();
+	m_global_state->m_complex_filter_columns = bind_data.m_complex_filter_columns;
+	m_global_state->InitGlobalState(input);
 	elog(DEBUG3, "-- (DuckDB/PostgresReplacementScanGlobalState) Running %lu threads -- ", MaxThreads());
 }
 
 PostgresSeqScanGlobalState::~PostgresSeqScanGlobalState() {
 	if (m_relation) {
-		RelationClose(m_relation);
+		std::lock_guard<std::mutex> lock(DuckdbProcessLock::GetLock());
+		PostgresCleanupGuard([&] { RelationClose(m_relation); });
 	}
 }
 
@@ -58,9 +71,11 @@ PostgresSeqScanFunction::PostgresSeqScanFunction()
 	named_parameters["cardinality"] = duckdb::LogicalType::UBIGINT;
 	named_parameters["relid"] = duckdb::LogicalType::UINTEGER;
 	named_parameters["snapshot"] = duckdb::LogicalType::POINTER;
+	named_parameters["ctid"] = duckdb::LogicalType::BOOLEAN;
 	projection_pushdown = true;
 	filter_pushdown = true;
 	filter_prune = true;
+	pushdown_complex_filter = PostgresSeqScanPushdownComplexFilter;
 	cardinality = PostgresSeqScanCardinality;
 }
 
@@ -92,15 +107,116 @@ PostgresSeqScanFunction::PostgresSeqScanBind(duckdb::ClientContext &context, duc
 		     duck_type.ToString().c_str());
 	}
 
+	/* The ctid is only exposed to queries that reference it, so that it doesn't show up in SELECT * */
+	auto ctid = input.named_parameters.find("ctid");
+	if (ctid != input.named_parameters.end() && ctid->second.GetValue<bool>()) {
+		return_types.push_back(TupleDeformProgram::CtidType());
+		names.push_back("ctid");
+	}
+
 	RelationClose(rel);
 	return duckdb::make_uniq<PostgresSeqScanFunctionData>(cardinality, relid, snapshot);
 }
 
+/* Filters on a single column and constants, which DuckDB turns into TableFilters */
+static bool
+IsTableFilter(const duckdb::Expression &expr) {
+	switch (expr.GetExpressionClass()) {
+	case duckdb::ExpressionClass::BOUND_COMPARISON: {
+		auto &comparison = expr.Cast<duckdb::BoundComparisonExpression>();
+		return (comparison.left->type == duckdb::ExpressionType::BOUND_COLUMN_REF && comparison.right->IsFoldable()) ||
+		       (comparison.right->type == duckdb::ExpressionType::BOUND_COLUMN_REF && comparison.left->IsFoldable());
+	}
+	case duckdb::ExpressionClass::BOUND_BETWEEN: {
+		auto &between = expr.Cast<duckdb::BoundBetweenExpression>();
+		return between.input->type == duckdb::ExpressionType::BOUND_COLUMN_REF && between.lower->IsFoldable() &&
+		       between.upper->IsFoldable();
+	}
+	case duckdb::ExpressionClass::BOUND_OPERATOR:
+		return (expr.type == duckdb::ExpressionType::OPERATOR_IS_NULL ||
+		        expr.type == duckdb::ExpressionType::OPERATOR_IS_NOT_NULL) &&
+		       expr.Cast<duckdb::BoundOperatorExpression>().children[0]->type ==
+		           duckdb::ExpressionType::BOUND_COLUMN_REF;
+	default:
+		return false;
+	}
+}
+
+static bool
+ReferencesOnlyScanColumns(const duckdb::Expression &expr, const duckdb::LogicalGet &get) {
+	if (expr.type == duckdb::ExpressionType::BOUND_COLUMN_REF) {
+		auto &colref = expr.Cast<duckdb::BoundColumnRefExpression>();
+		return colref.depth == 0 && colref.binding.table_index == get.table_index &&
+		       get.column_ids[colref.binding.column_index] != duckdb::COLUMN_IDENTIFIER_ROW_ID;
+	}
+	bool result = true;
+	duckdb::ExpressionIterator::EnumerateChildren(
+	    expr, [&](const duckdb::Expression &child) { result = result && ReferencesOnlyScanColumns(child, get); });
+	return result;
+}
+
+/*
+ * Replaces the column references of a pushed down filter by references to the filter columns of the scan, which are
+ * relation column ids. DuckDB may still remove the columns the filter reads from the columns of the scan.
+ */
+static void
+BindComplexFilterColumns(duckdb::unique_ptr<duckdb::Expression> &expr, const duckdb::LogicalGet &get,
+                         duckdb::vector<duckdb::idx_t> &columns) {
+	if (expr->type == duckdb::ExpressionType::BOUND_COLUMN_REF) {
+		auto &colref = expr->Cast<duckdb::BoundColumnRefExpression>();
+		auto column_id = get.column_ids[colref.binding.column_index];
+		auto column = std::find(columns.begin(), columns.end(), column_id);
+		if (column == columns.end()) {
+			column = columns.insert(columns.end(), column_id);
+		}
+		expr = duckdb::make_uniq<duckdb::BoundReferenceExpression>(colref.return_type, column - columns.begin());
+		return;
+	}
+	duckdb::ExpressionIterator::EnumerateChildren(*expr, [&](duckdb::unique_ptr<duckdb::Expression> &child) {
+		BindComplexFilterColumns(child, get, columns);
+	});
+}
+
+/*
+ * Takes the filters on expressions of the relation's columns, e.g. lower(name) LIKE 'abc%' or a + b > 10, so that they
+ * are evaluated on batches of tuples before the other columns are detoasted and converted. Filters that become
+ * TableFilters are left to DuckDB.
+ */
+void
+PostgresSeqScanFunction::PostgresSeqScanPushdownComplexFilter(
+    duckdb::ClientContext &context, duckdb::LogicalGet &get, duckdb::FunctionData *bind_data_p,
+    duckdb::vector<duckdb::unique_ptr<duckdb::Expression>> &filters) {
+	auto &bind_data = bind_data_p->Cast<PostgresSeqScanFunctionData>();
+
+	for (auto filter = filters.begin(); filter != filters.end();) {
+		auto &expr = **filter;
+		if (expr.IsFoldable() || expr.IsVolatile() || expr.HasParameter() || expr.HasSubquery() ||
+		    IsTableFilter(expr) || !ReferencesOnlyScanColumns(expr, get)) {
+			filter++;
+			continue;
+		}
+
+		BindComplexFilterColumns(*filter, get, bind_data.m_complex_filter_columns);
+		if (bind_data.m_complex_filter) {
+			bind_data.m_complex_filter = duckdb::make_uniq<duckdb::BoundConjunctionExpression>(
+			    duckdb::ExpressionType::CONJUNCTION_AND, std::move(bind_data.m_complex_filter), std::move(*filter));
+		} else {
+			bind_data.m_complex_filter = std::move(*filter);
+		}
+		filter = filters.erase(filter);
+	}
+}
+
 duckdb::unique_ptr<duckdb::GlobalTableFunctionState>
 PostgresSeqScanFunction::PostgresSeqScanInitGlobal(duckdb::ClientContext &context,
                                                    duckdb::TableFunctionInitInput &input) {
 	auto &bind_data = input.bind_data->CastNoConst<PostgresSeqScanFunctionData>();
-	auto global_state = duckdb::make_uniq<PostgresSeqScanGlobalState>(RelationIdGetRelation(bind_data.m_relid), input);
+	Relation relation = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(DuckdbProcessLock::GetLock());
+		PostgresFunctionGuard([&] { relation = RelationIdGetRelation(bind_data.m_relid); });
+	}
+	auto global_state = duckdb::make_uniq<PostgresSeqScanGlobalState>(relation, input);
 	global_state->m_global_state->m_snapshot = bind_data.m_snapshot;
 	global_state->m_relid = bind_data.m_relid;
 	return std::move(global_state);
@@ -111,8 +227,15 @@ PostgresSeqScanFunction::PostgresSeqScanInitLocal(duckdb::ExecutionContext &cont
                                                   duckdb::TableFunctionInitInput &input,
                                                   duckdb::GlobalTableFunctionState *gstate) {
 	auto global_state = reinterpret_cast<PostgresSeqScanGlobalState *>(gstate);
-	return duckdb::make_uniq<PostgresSeqScanLocalState>(
+	auto local_state = duckdb::make_uniq<PostgresSeqScanLocalState>(
 	    global_state->m_relation, global_state->m_heap_reader_global_state, global_state->m_global_state);
+	auto &scan_global_state = *global_state->m_global_state;
+	if (scan_global_state.m_complex_filter) {
+		local_state->m_local_state->m_complex_filter = duckdb::make_uniq<ComplexFilterState>(
+		    context.client, *scan_global_state.m_complex_filter,
+		    scan_global_state.m_deform_program->m_complex_filter_types);
+	}
+	return std::move(local_state);
 }
 
 void
@@ -141,4 +264,57 @@ PostgresSeqScanFunction::PostgresSeqScanCardinality(duckdb::ClientContext &conte
 	return duckdb::make_uniq<duckdb::NodeStatistics>(bind_data.m_cardinality, bind_data.m_cardinality);
 }
 
+//
+// Optimizer
+//
+
+static void
+CollectSeqScans(duckdb::LogicalOperator &op, duckdb::vector<duckdb::LogicalGet *> &scans) {
+	for (auto &child : op.children) {
+		CollectSeqScans(*child, scans);
+	}
+	if (op.type == duckdb::LogicalOperatorType::LOGICAL_GET) {
+		auto &get = op.Cast<duckdb::LogicalGet>();
+		if (get.function.name == "postgres_seq_scan") {
+			scans.push_back(&get);
+		}
+	}
+}
+
+/*
+ * Shares the visibility work of the scans of a self-join or of a CTE that is referenced twice, see
+ * HeapReaderSharedState. The scans don't share a pass over the heap: DuckDB runs them one after the other, e.g. the
+ * build side of a hash join before its probe side, so the later scan would have to be fed from a buffer of the whole
+ * relation. Each scan reads, decodes and filters the pages itself.
+ */
+static void
+PostgresSharedVisibilityOptimize(duckdb::OptimizerExtensionInput &input,
+                                 duckdb::unique_ptr<duckdb::LogicalOperator> &plan) {
+	duckdb::vector<duckdb::LogicalGet *> scans;
+	CollectSeqScans(*plan, scans);
+
+	duckdb::map<std::pair<Oid, Snapshot>, duckdb::vector<PostgresSeqScanFunctionData *>> relation_scans;
+	for (auto scan : scans) {
+		auto &bind_data = scan->bind_data->Cast<PostgresSeqScanFunctionData>();
+		relation_scans[{bind_data.m_relid, bind_data.m_snapshot}].push_back(&bind_data);
+	}
+
+	for (auto &[relation, bind_datas] : relation_scans) {
+		if (bind_datas.size() < 2) {
+			continue;
+		}
+		auto shared_state = duckdb::make_shared_ptr<HeapReaderSharedState>(relation.second, bind_datas.size());
+		for (auto bind_data : bind_datas) {
+			bind_data->m_shared_state = shared_state;
+		}
+	}
+}
+
+duckdb::OptimizerExtension
+PostgresSharedVisibilityOptimizerExtension() {
+	duckdb::OptimizerExtension extension;
+	extension.optimize_function = PostgresSharedVisibilityOptimize;
+	return extension;
+}
+
 } // namespace pgduckdb
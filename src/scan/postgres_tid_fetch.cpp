@@ -0,0 +1,374 @@
+#include "duckdb.hpp"
+#include "duckdb/optimizer/optimizer.hpp"
+#include "duckdb/planner/binder.hpp"
+#include "duckdb/planner/expression_iterator.hpp"
+#include "duckdb/planner/expression/bound_columnref_expression.hpp"
+#include "duckdb/planner/operator/logical_get.hpp"
+#include "duckdb/planner/operator/logical_projection.hpp"
+#include "duckdb/planner/operator/logical_top_n.hpp"
+
+extern "C" {
+#include "postgres.h"
+#include "access/heapam.h"
+#include "storage/bufmgr.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/relcache.h"
+}
+
+#include "pgduckdb/pgduckdb_guard.hpp"
+#include "pgduckdb/pgduckdb_process_lock.hpp"
+#include "pgduckdb/scan/postgres_tid_fetch.hpp"
+#include "pgduckdb/scan/postgres_seq_scan.hpp"
+#include "pgduckdb/pgduckdb_types.hpp"
+
+#include <algorithm>
+
+namespace pgduckdb {
+
+//
+// PostgresTidFetchGlobalState
+//
+
+PostgresTidFetchGlobalState::PostgresTidFetchGlobalState(Relation relation, duckdb::TableFunctionInitInput &input)
+    : m_global_state(duckdb::make_shared_ptr<PostgresScanGlobalState>()), m_relation(relation) {
+	auto &bind_data = input.bind_data->Cast<PostgresTidFetchFunctionData>();
+	m_global_state->m_snapshot = bind_data.m_snapshot;
+	m_global_state->m_tuple_desc = RelationGetDescr(m_relation);
+	m_global_state->InitInOutGlobalState(input, bind_data.m_table_column_count);
+}
+
+PostgresTidFetchGlobalState::~PostgresTidFetchGlobalState() {
+	std::lock_guard<std::mutex> lock(DuckdbProcessLock::GetLock());
+	PostgresCleanupGuard([&] { RelationClose(m_relation); });
+}
+
+//
+// PostgresTidFetchLocalState
+//
+
+PostgresTidFetchLocalState::PostgresTidFetchLocalState()
+    : m_local_state(duckdb::make_shared_ptr<PostgresScanLocalState>()) {
+	m_tids.reserve(STANDARD_VECTOR_SIZE);
+	m_tuples.resize(STANDARD_VECTOR_SIZE);
+	m_buffers.reserve(STANDARD_VECTOR_SIZE);
+}
+
+PostgresTidFetchLocalState::~PostgresTidFetchLocalState() {
+}
+
+//
+// PostgresTidFetchFunctionData
+//
+
+PostgresTidFetchFunctionData::PostgresTidFetchFunctionData(Oid relid, Snapshot snapshot, duckdb::idx_t ctid_input_idx,
+                                                           duckdb::idx_t table_column_count)
+    : m_relid(relid), m_snapshot(snapshot), m_ctid_input_idx(ctid_input_idx),
+      m_table_column_count(table_column_count) {
+}
+
+PostgresTidFetchFunctionData::~PostgresTidFetchFunctionData() {
+}
+
+//
+// PostgresTidFetchFunction
+//
+
+PostgresTidFetchFunction::PostgresTidFetchFunction()
+    : TableFunction("postgres_tid_fetch", {}, nullptr, nullptr, PostgresTidFetchInitGlobal, PostgresTidFetchInitLocal) {
+	in_out_function = PostgresTidFetchFunc;
+}
+
+duckdb::unique_ptr<duckdb::GlobalTableFunctionState>
+PostgresTidFetchFunction::PostgresTidFetchInitGlobal(duckdb::ClientContext &context,
+                                                     duckdb::TableFunctionInitInput &input) {
+	auto &bind_data = input.bind_data->CastNoConst<PostgresTidFetchFunctionData>();
+	std::lock_guard<std::mutex> lock(DuckdbProcessLock::GetLock());
+	Relation relation = nullptr;
+	PostgresFunctionGuard([&] { relation = RelationIdGetRelation(bind_data.m_relid); });
+	return duckdb::make_uniq<PostgresTidFetchGlobalState>(relation, input);
+}
+
+duckdb::unique_ptr<duckdb::LocalTableFunctionState>
+PostgresTidFetchFunction::PostgresTidFetchInitLocal(duckdb::ExecutionContext &context,
+                                                    duckdb::TableFunctionInitInput &input,
+                                                    duckdb::GlobalTableFunctionState *gstate) {
+	return duckdb::make_uniq<PostgresTidFetchLocalState>();
+}
+
+/*
+ * Fetches the tuples of an input chunk in ctid order, so that tuples on the same page are read together, and writes
+ * them into the output rows of their input rows, which keeps the order of the input.
+ */
+duckdb::OperatorResultType
+PostgresTidFetchFunction::PostgresTidFetchFunc(duckdb::ExecutionContext &context, duckdb::TableFunctionInput &data,
+                                               duckdb::DataChunk &input, duckdb::DataChunk &output) {
+	auto &bind_data = data.bind_data->Cast<PostgresTidFetchFunctionData>();
+	auto &global_state = data.global_state->Cast<PostgresTidFetchGlobalState>();
+	auto &local_state = data.local_state->Cast<PostgresTidFetchLocalState>();
+	auto &scan_local_state = local_state.m_local_state;
+	auto &stats = scan_local_state->m_stats;
+	auto count = input.size();
+
+	duckdb::UnifiedVectorFormat ctids;
+	input.data[bind_data.m_ctid_input_idx].ToUnifiedFormat(count, ctids);
+	auto ctid_data = duckdb::UnifiedVectorFormat::GetData<int64_t>(ctids);
+	local_state.m_tids.clear();
+	for (duckdb::idx_t row = 0; row < count; row++) {
+		local_state.m_tids.emplace_back(ctid_data[ctids.sel->get_index(row)], row);
+	}
+	std::sort(local_state.m_tids.begin(), local_state.m_tids.end());
+
+	/* The tuples stay valid while their buffers are pinned, so they are converted without holding the lock */
+	bool fetched_all = true;
+	auto lock = LockProcessLock(stats);
+	BufferUsage buffer_usage_start = pgBufferUsage;
+	local_state.m_buffers.clear();
+	PostgresFunctionGuard([&] {
+		for (auto &[ctid, row] : local_state.m_tids) {
+			auto &tuple = local_state.m_tuples[row];
+			Buffer buffer;
+			DecodeCtid(ctid, &tuple.t_self);
+			if (!heap_fetch(global_state.m_relation, bind_data.m_snapshot, &tuple, &buffer, false)) {
+				fetched_all = false;
+				break;
+			}
+			local_state.m_buffers.push_back(buffer);
+		}
+	});
+	CountBufferUsage(stats, buffer_usage_start);
+	lock.unlock();
+
+	if (fetched_all) {
+		for (duckdb::idx_t row = 0; row < count; row++) {
+			stats.Count(SCAN_STAT_TUPLES_VISIBLE);
+			scan_local_state->m_output_vector_size = row;
+			InsertTupleIntoChunk(output, global_state.m_global_state, scan_local_state, &local_state.m_tuples[row]);
+		}
+	}
+
+	lock = LockProcessLock(stats);
+	PostgresFunctionGuard([&] {
+		for (auto buffer : local_state.m_buffers) {
+			ReleaseBuffer(buffer);
+		}
+	});
+	lock.unlock();
+
+	/* The scan that returned the ctids used the same snapshot, so every tuple has to be visible */
+	if (!fetched_all) {
+		throw duckdb::InternalException("Could not fetch tuple of relation %u by ctid", bind_data.m_relid);
+	}
+
+	for (auto &[output_idx, input_idx] : global_state.m_global_state->m_input_columns) {
+		output.data[output_idx].Reference(input.data[input_idx]);
+	}
+	output.SetCardinality(count);
+	return duckdb::OperatorResultType::NEED_MORE_INPUT;
+}
+
+//
+// Optimizer
+//
+
+/*
+ * Builds a postgres_tid_fetch above a TopN that only sorts the ctid and the columns it orders by, below a projection
+ * that returns the columns of the TopN in the same order. Returns nullptr if the TopN doesn't sort the rows of a
+ * postgres_seq_scan, possibly through a projection of its columns, or if it keeps most of them or if none of the
+ * columns it doesn't order by has variable width.
+ */
+static duckdb::unique_ptr<duckdb::LogicalOperator>
+TryLateMaterialization(duckdb::OptimizerExtensionInput &input, duckdb::LogicalTopN &top_n,
+                       duckdb::vector<duckdb::ReplacementBinding> &replacements) {
+	duckdb::LogicalProjection *projection = nullptr;
+	auto *child = top_n.children[0].get();
+	if (child->type == duckdb::LogicalOperatorType::LOGICAL_PROJECTION) {
+		projection = &child->Cast<duckdb::LogicalProjection>();
+		for (auto &expr : projection->expressions) {
+			if (expr->type != duckdb::ExpressionType::BOUND_COLUMN_REF) {
+				return nullptr;
+			}
+		}
+		child = projection->children[0].get();
+	}
+
+	if (child->type != duckdb::LogicalOperatorType::LOGICAL_GET) {
+		return nullptr;
+	}
+	auto &get = child->Cast<duckdb::LogicalGet>();
+	if (get.function.name != "postgres_seq_scan" || !get.projection_ids.empty() || !get.children.empty()) {
+		return nullptr;
+	}
+
+	/* Fetching a tuple by ctid costs more than reading it in the scan, so most rows have to be thrown away */
+	auto top_n_cardinality = top_n.EstimateCardinality(input.context);
+	if ((top_n.limit + top_n.offset) * 2 > get.EstimateCardinality(input.context)) {
+		return nullptr;
+	}
+
+	auto &seq_scan_data = get.bind_data->Cast<PostgresSeqScanFunctionData>();
+	duckdb::idx_t natts = get_relnatts(seq_scan_data.m_relid);
+	if (std::any_of(get.column_ids.begin(), get.column_ids.end(),
+	                [&](duckdb::column_t column_id) { return column_id >= natts; })) {
+		return nullptr;
+	}
+
+	/* Resolves a column of the TopN's input to the index of the scan column it reads */
+	auto scan_column = [&](duckdb::ColumnBinding binding) -> duckdb::optional_idx {
+		if (projection) {
+			if (binding.table_index != projection->table_index) {
+				return duckdb::optional_idx();
+			}
+			binding = projection->expressions[binding.column_index]->Cast<duckdb::BoundColumnRefExpression>().binding;
+		}
+		if (binding.table_index != get.table_index) {
+			return duckdb::optional_idx();
+		}
+		return binding.column_index;
+	};
+
+	/* The columns the TopN orders by and the ones filtered on stay in the scan */
+	duckdb::vector<bool> sorted_column(get.column_ids.size(), false);
+	for (auto &filter : get.table_filters.filters) {
+		sorted_column[filter.first] = true;
+	}
+	bool resolved = true;
+	for (auto &order : top_n.orders) {
+		duckdb::ExpressionIterator::EnumerateExpression(order.expression, [&](duckdb::Expression &expr) {
+			if (expr.type != duckdb::ExpressionType::BOUND_COLUMN_REF) {
+				return;
+			}
+			auto &colref = expr.Cast<duckdb::BoundColumnRefExpression>();
+			auto column = scan_column(colref.binding);
+			if (colref.depth != 0 || !column.IsValid()) {
+				resolved = false;
+				return;
+			}
+			sorted_column[column.GetIndex()] = true;
+		});
+	}
+	if (!resolved) {
+		return nullptr;
+	}
+
+	top_n.ResolveOperatorTypes();
+	auto top_n_bindings = top_n.GetColumnBindings();
+	auto top_n_types = top_n.types;
+	duckdb::vector<duckdb::idx_t> output_columns;
+	bool fetches_variable_width = false;
+	for (auto &binding : top_n_bindings) {
+		auto column = scan_column(binding);
+		if (!column.IsValid()) {
+			return nullptr;
+		}
+		output_columns.push_back(column.GetIndex());
+		auto &type = get.returned_types[get.column_ids[column.GetIndex()]];
+		if (!sorted_column[column.GetIndex()] && !duckdb::TypeIsConstantSize(type.InternalType())) {
+			fetches_variable_width = true;
+		}
+	}
+	if (!fetches_variable_width) {
+		return nullptr;
+	}
+
+	/* The scan only returns the sorted columns and the ctid */
+	auto column_ids = std::move(get.column_ids);
+	duckdb::vector<duckdb::idx_t> scan_positions(column_ids.size(), duckdb::DConstants::INVALID_INDEX);
+	for (duckdb::idx_t i = 0; i < column_ids.size(); i++) {
+		if (sorted_column[i]) {
+			scan_positions[i] = get.column_ids.size();
+			get.column_ids.push_back(column_ids[i]);
+		}
+	}
+	auto ctid_input_idx = get.column_ids.size();
+	get.column_ids.push_back(natts);
+	if (get.returned_types.size() == natts) {
+		get.returned_types.push_back(TupleDeformProgram::CtidType());
+		get.names.push_back("ctid");
+	}
+
+	duckdb::TableFilterSet table_filters;
+	for (auto &filter : get.table_filters.filters) {
+		table_filters.filters[scan_positions[filter.first]] = std::move(filter.second);
+	}
+	get.table_filters.filters = std::move(table_filters.filters);
+
+	for (auto &order : top_n.orders) {
+		duckdb::ExpressionIterator::EnumerateExpression(order.expression, [&](duckdb::Expression &expr) {
+			if (expr.type == duckdb::ExpressionType::BOUND_COLUMN_REF) {
+				auto &colref = expr.Cast<duckdb::BoundColumnRefExpression>();
+				colref.binding = duckdb::ColumnBinding(get.table_index,
+				                                       scan_positions[scan_column(colref.binding).GetIndex()]);
+			}
+		});
+	}
+
+	auto scan = projection ? std::move(projection->children[0]) : std::move(top_n.children[0]);
+	auto narrow_top_n = duckdb::make_uniq<duckdb::LogicalTopN>(std::move(top_n.orders), top_n.limit, top_n.offset);
+	narrow_top_n->children.push_back(std::move(scan));
+	narrow_top_n->SetEstimatedCardinality(top_n_cardinality);
+
+	/* Relation columns are fetched, the sorted columns are appended after them and passed through */
+	auto fetch_index = input.optimizer.binder.GenerateTableIndex();
+	duckdb::vector<duckdb::LogicalType> returned_types(get.returned_types.begin(), get.returned_types.begin() + natts);
+	duckdb::vector<duckdb::string> names(get.names.begin(), get.names.begin() + natts);
+	for (duckdb::idx_t i = 0; i < get.column_ids.size(); i++) {
+		returned_types.push_back(get.returned_types[get.column_ids[i]]);
+		names.push_back("input_" + std::to_string(i));
+	}
+
+	duckdb::vector<duckdb::column_t> fetch_column_ids;
+	duckdb::vector<duckdb::idx_t> fetch_positions(column_ids.size());
+	for (duckdb::idx_t i = 0; i < column_ids.size(); i++) {
+		if (!sorted_column[i]) {
+			fetch_positions[i] = fetch_column_ids.size();
+			fetch_column_ids.push_back(column_ids[i]);
+		}
+	}
+	for (duckdb::idx_t i = 0; i < column_ids.size(); i++) {
+		if (sorted_column[i]) {
+			fetch_positions[i] = fetch_column_ids.size();
+			fetch_column_ids.push_back(natts + scan_positions[i]);
+		}
+	}
+
+	auto bind_data = duckdb::make_uniq<PostgresTidFetchFunctionData>(seq_scan_data.m_relid, seq_scan_data.m_snapshot,
+	                                                                 ctid_input_idx, natts);
+	auto fetch = duckdb::make_uniq<duckdb::LogicalGet>(fetch_index, PostgresTidFetchFunction(), std::move(bind_data),
+	                                                   std::move(returned_types), std::move(names));
+	fetch->column_ids = std::move(fetch_column_ids);
+	fetch->children.push_back(std::move(narrow_top_n));
+	fetch->SetEstimatedCardinality(top_n_cardinality);
+
+	/* Parents may refer to the TopN's columns by position, so keep them in the same order */
+	auto projection_index = input.optimizer.binder.GenerateTableIndex();
+	duckdb::vector<duckdb::unique_ptr<duckdb::Expression>> expressions;
+	for (duckdb::idx_t i = 0; i < top_n_bindings.size(); i++) {
+		expressions.push_back(duckdb::make_uniq<duckdb::BoundColumnRefExpression>(
+		    top_n_types[i], duckdb::ColumnBinding(fetch_index, fetch_positions[output_columns[i]])));
+		replacements.emplace_back(top_n_bindings[i], duckdb::ColumnBinding(projection_index, i));
+	}
+
+	auto result = duckdb::make_uniq<duckdb::LogicalProjection>(projection_index, std::move(expressions));
+	result->children.push_back(std::move(fetch));
+	result->SetEstimatedCardinality(top_n_cardinality);
+	result->ResolveOperatorTypes();
+	return std::move(result);
+}
+
+static void
+PostgresTidFetchOptimize(duckdb::OptimizerExtensionInput &input, duckdb::unique_ptr<duckdb::LogicalOperator> &plan) {
+	RewriteOperators(plan, plan, duckdb::LogicalOperatorType::LOGICAL_TOP_N,
+	                 [&](duckdb::LogicalOperator &op, duckdb::vector<duckdb::ReplacementBinding> &replacements) {
+		                 return TryLateMaterialization(input, op.Cast<duckdb::LogicalTopN>(), replacements);
+	                 });
+}
+
+duckdb::OptimizerExtension
+PostgresTidFetchOptimizerExtension() {
+	duckdb::OptimizerExtension extension;
+	extension.optimize_function = PostgresTidFetchOptimize;
+	return extension;
+}
+
+} // namespace pgduckdb
@@ -0,0 +1,248 @@
+#include "duckdb.hpp"
+
+extern "C" {
+#include "postgres.h"
+#include "access/htup_details.h"
+#include "access/tupmacs.h"
+#include "catalog/pg_type.h"
+}
+
+#include "pgduckdb/scan/tuple_deform.hpp"
+#include "pgduckdb/pgduckdb_types.hpp"
+
+namespace pgduckdb {
+
+//
+// Fixed-width gatherers
+//
+
+template <class T>
+struct FixedWidthCopy {
+	static inline T
+	Convert(T value) {
+		return value;
+	}
+};
+
+struct FixedWidthDate {
+	static inline duckdb::date_t
+	Convert(int32_t value) {
+		return duckdb::date_t(value + PGDUCKDB_DUCK_DATE_OFFSET);
+	}
+};
+
+struct FixedWidthTimestamp {
+	static inline duckdb::timestamp_t
+	Convert(int64_t value) {
+		return duckdb::timestamp_t(value + PGDUCKDB_DUCK_TIMESTAMP_OFFSET);
+	}
+};
+
+template <class SOURCE, class TARGET, class OP>
+static void
+GatherFixedWidthColumn(const HeapTupleHeader *tuples, duckdb::idx_t count, uint32 attr_offset, duckdb::Vector &result,
+                       duckdb::idx_t result_offset) {
+	auto target = duckdb::FlatVector::GetData<TARGET>(result) + result_offset;
+	for (duckdb::idx_t i = 0; i < count; i++) {
+		SOURCE value;
+		memcpy(&value, reinterpret_cast<const char *>(tuples[i]) + tuples[i]->t_hoff + attr_offset, sizeof(SOURCE));
+		target[i] = OP::Convert(value);
+	}
+}
+
+static FixedWidthGatherer
+GetFixedWidthGatherer(Oid type_oid) {
+	switch (type_oid) {
+	case BOOLOID:
+		return GatherFixedWidthColumn<bool, bool, FixedWidthCopy<bool>>;
+	case INT2OID:
+		return GatherFixedWidthColumn<int16_t, int16_t, FixedWidthCopy<int16_t>>;
+	case INT4OID:
+		return GatherFixedWidthColumn<int32_t, int32_t, FixedWidthCopy<int32_t>>;
+	case INT8OID:
+		return GatherFixedWidthColumn<int64_t, int64_t, FixedWidthCopy<int64_t>>;
+	case FLOAT4OID:
+		return GatherFixedWidthColumn<float, float, FixedWidthCopy<float>>;
+	case FLOAT8OID:
+		return GatherFixedWidthColumn<double, double, FixedWidthCopy<double>>;
+	case DATEOID:
+		return GatherFixedWidthColumn<int32_t, duckdb::date_t, FixedWidthDate>;
+	case TIMESTAMPOID:
+		return GatherFixedWidthColumn<int64_t, duckdb::timestamp_t, FixedWidthTimestamp>;
+	default:
+		return nullptr;
+	}
+}
+
+//
+// TupleDeformProgram
+//
+
+TupleDeformProgram::TupleDeformProgram(TupleDesc tuple_desc, const duckdb::map<duckdb::idx_t, duckdb::idx_t> &columns,
+                                       const duckdb::map<duckdb::idx_t, duckdb::idx_t> &projections,
+                                       duckdb::TableFilterSet *filters,
+                                       const duckdb::vector<duckdb::idx_t> &complex_filter_columns)
+    : m_value_count(0), m_tuple_desc(tuple_desc), m_fixed_width(true), m_ctid_value_idx(-1) {
+	/* Columns are ordered, so the last one before the ctid is the last attribute that has to be deformed */
+	int natts = 0;
+	for (auto &[column_idx, value_idx] : columns) {
+		m_value_count = duckdb::MaxValue(m_value_count, value_idx + 1);
+		if (IsCtidColumn(column_idx)) {
+			m_ctid_value_idx = value_idx;
+		} else {
+			natts = column_idx + 1;
+		}
+	}
+
+	uint32 off = 0;
+	bool fixed = true;
+
+	for (int attnum = 0; attnum < natts; attnum++) {
+		Form_pg_attribute attr = TupleDescAttr(tuple_desc, attnum);
+		DeformStep step;
+		step.attlen = attr->attlen;
+		step.attbyval = attr->attbyval;
+		step.attalign = attr->attalign;
+		step.fixed_offset = -1;
+		auto column = columns.find(attnum);
+		step.value_idx = column == columns.end() ? -1 : column->second;
+
+		/* Same rules as used by Postgres for attcacheoff */
+		if (fixed) {
+			if (attr->attlen == -1) {
+				if (off == att_align_nominal(off, attr->attalign)) {
+					step.fixed_offset = off;
+				}
+			} else {
+				off = att_align_nominal(off, attr->attalign);
+				step.fixed_offset = off;
+			}
+			if (attr->attlen > 0 && step.fixed_offset >= 0) {
+				off += attr->attlen;
+			} else {
+				fixed = false;
+			}
+		}
+		m_deform_steps.push_back(step);
+
+		/* A NULL or dropped attribute shifts the ones after it, so the whole prefix has to be fixed-width NOT NULL */
+		if (step.fixed_offset < 0 || attr->attlen <= 0 || !attr->attnotnull || attr->attisdropped) {
+			m_fixed_width = false;
+		}
+	}
+
+	if (filters) {
+		for (auto &[value_idx, filter] : filters->filters) {
+			for (auto &[column_idx, column_value_idx] : columns) {
+				if (column_value_idx == value_idx) {
+					Oid type_oid =
+					    IsCtidColumn(column_idx) ? INT8OID : TupleDescAttr(tuple_desc, column_idx)->atttypid;
+					m_filter_steps.push_back({value_idx, filter.get(), type_oid});
+					break;
+				}
+			}
+		}
+	}
+
+	for (auto &[output_idx, column_idx] : projections) {
+		if (IsCtidColumn(column_idx)) {
+			m_output_steps.push_back({columns.at(column_idx), false, GetPostgresToDuckConverter(CtidType())});
+			m_fixed_width = false;
+			continue;
+		}
+		Form_pg_attribute attr = TupleDescAttr(tuple_desc, column_idx);
+		m_output_steps.push_back({columns.at(column_idx), attr->attlen == -1,
+		                          GetPostgresToDuckConverter(ConvertPostgresToDuckColumnType(attr))});
+
+		auto gather = GetFixedWidthGatherer(attr->atttypid);
+		if (!gather) {
+			m_fixed_width = false;
+		} else if (m_fixed_width) {
+			m_gather_steps.push_back({static_cast<uint32>(m_deform_steps[column_idx].fixed_offset), gather});
+		}
+	}
+
+	for (auto column_idx : complex_filter_columns) {
+		if (IsCtidColumn(column_idx)) {
+			m_complex_filter_steps.push_back({columns.at(column_idx), false, GetPostgresToDuckConverter(CtidType())});
+			m_complex_filter_types.push_back(CtidType());
+			continue;
+		}
+		Form_pg_attribute attr = TupleDescAttr(tuple_desc, column_idx);
+		auto type = ConvertPostgresToDuckColumnType(attr);
+		m_complex_filter_steps.push_back(
+		    {columns.at(column_idx), attr->attlen == -1, GetPostgresToDuckConverter(type)});
+		m_complex_filter_types.push_back(type);
+	}
+
+	if (!m_filter_steps.empty() || !m_complex_filter_steps.empty() || m_output_steps.empty()) {
+		m_fixed_width = false;
+	}
+}
+
+void
+TupleDeformProgram::GatherFixedWidth(const HeapTupleHeader *tuples, duckdb::idx_t count, duckdb::DataChunk &output,
+                                     duckdb::idx_t offset) const {
+	D_ASSERT(m_fixed_width);
+	for (duckdb::idx_t idx = 0; idx < m_gather_steps.size(); idx++) {
+		m_gather_steps[idx].gather(tuples, count, m_gather_steps[idx].attr_offset, output.data[idx], offset);
+	}
+}
+
+void
+TupleDeformProgram::Deform(HeapTuple tuple, Datum *values, bool *nulls) const {
+	HeapTupleHeader tup = tuple->t_data;
+	bool hasnulls = HeapTupleHasNulls(tuple);
+	bits8 *bp = tup->t_bits;
+	char *tp = (char *)tup + tup->t_hoff;
+	int natts = Min((int)HeapTupleHeaderGetNatts(tup), (int)m_deform_steps.size());
+	uint32 off = 0;
+	bool slow = false;
+	int attnum = 0;
+
+	for (; attnum < natts; attnum++) {
+		const auto &step = m_deform_steps[attnum];
+
+		if (hasnulls && att_isnull(attnum, bp)) {
+			if (step.value_idx >= 0) {
+				values[step.value_idx] = (Datum)0;
+				nulls[step.value_idx] = true;
+			}
+			slow = true;
+			continue;
+		}
+
+		if (!slow && step.fixed_offset >= 0) {
+			off = step.fixed_offset;
+		} else if (step.attlen == -1) {
+			off = att_align_pointer(off, step.attalign, -1, tp + off);
+		} else {
+			off = att_align_nominal(off, step.attalign);
+		}
+
+		if (step.value_idx >= 0) {
+			values[step.value_idx] = fetch_att(tp + off, step.attbyval, step.attlen);
+			nulls[step.value_idx] = false;
+		}
+
+		off = att_addlength_pointer(off, step.attlen, tp + off);
+		if (step.attlen <= 0) {
+			slow = true;
+		}
+	}
+
+	/* Attributes that were added after the tuple was written */
+	for (; attnum < (int)m_deform_steps.size(); attnum++) {
+		const auto &step = m_deform_steps[attnum];
+		if (step.value_idx >= 0) {
+			values[step.value_idx] = getmissingattr(m_tuple_desc, attnum + 1, &nulls[step.value_idx]);
+		}
+	}
+
+	if (m_ctid_value_idx >= 0) {
+		values[m_ctid_value_idx] = Int64GetDatum(EncodeCtid(&tuple->t_self));
+		nulls[m_ctid_value_idx] = false;
+	}
+}
+
+} // namespace pgduckdb
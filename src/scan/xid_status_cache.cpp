@@ -0,0 +1,155 @@
+#include "duckdb.hpp"
+
+extern "C" {
+#include "postgres.h"
+#include "access/heapam.h"
+#include "access/transam.h"
+#include "access/xact.h"
+#include "utils/snapmgr.h"
+}
+
+#include "pgduckdb/pgduckdb_guard.hpp"
+#include "pgduckdb/scan/xid_status_cache.hpp"
+
+namespace pgduckdb {
+
+XidStatusCache::XidStatusCache(Snapshot snapshot)
+    : m_snapshot(snapshot), m_snapshot_usable(snapshot->snapshot_type == SNAPSHOT_MVCC && !snapshot->suboverflowed) {
+}
+
+/*
+ * Same rules as HeapTupleSatisfiesMVCC, except that the clog is read through m_committed and that hint bits are not
+ * set. Must be called while holding m_lock.
+ */
+XidStatusCache::TupleVisibility
+XidStatusCache::ResolveVisibility(HeapTupleHeader tuple, TransactionId &unknown_xid) const {
+	if (!m_snapshot_usable) {
+		return TUPLE_NEEDS_POSTGRES;
+	}
+
+	if (HeapTupleHeaderXminInvalid(tuple)) {
+		return TUPLE_INVISIBLE;
+	}
+
+	if (!HeapTupleHeaderXminCommitted(tuple)) {
+		TransactionId xmin = HeapTupleHeaderGetRawXmin(tuple);
+		if ((tuple->t_infomask & HEAP_MOVED) || TransactionIdIsCurrentTransactionId(xmin)) {
+			return TUPLE_NEEDS_POSTGRES;
+		}
+		if (XidInMVCCSnapshot(xmin, m_snapshot)) {
+			return TUPLE_INVISIBLE;
+		}
+		auto status = m_committed.find(xmin);
+		if (status == m_committed.end()) {
+			unknown_xid = xmin;
+			return TUPLE_NEEDS_XID_STATUS;
+		}
+		if (!status->second) {
+			return TUPLE_INVISIBLE;
+		}
+	} else if (!HeapTupleHeaderXminFrozen(tuple) && XidInMVCCSnapshot(HeapTupleHeaderGetRawXmin(tuple), m_snapshot)) {
+		return TUPLE_INVISIBLE;
+	}
+
+	if ((tuple->t_infomask & HEAP_XMAX_INVALID) || HEAP_XMAX_IS_LOCKED_ONLY(tuple->t_infomask)) {
+		return TUPLE_VISIBLE;
+	}
+	if (tuple->t_infomask & HEAP_XMAX_IS_MULTI) {
+		return TUPLE_NEEDS_POSTGRES;
+	}
+
+	TransactionId xmax = HeapTupleHeaderGetRawXmax(tuple);
+	if (!(tuple->t_infomask & HEAP_XMAX_COMMITTED)) {
+		if (TransactionIdIsCurrentTransactionId(xmax)) {
+			return TUPLE_NEEDS_POSTGRES;
+		}
+		if (XidInMVCCSnapshot(xmax, m_snapshot)) {
+			return TUPLE_VISIBLE;
+		}
+		auto status = m_committed.find(xmax);
+		if (status == m_committed.end()) {
+			unknown_xid = xmax;
+			return TUPLE_NEEDS_XID_STATUS;
+		}
+		return status->second ? TUPLE_INVISIBLE : TUPLE_VISIBLE;
+	}
+
+	return XidInMVCCSnapshot(xmax, m_snapshot) ? TUPLE_VISIBLE : TUPLE_INVISIBLE;
+}
+
+void
+XidStatusCache::PageTuplesVisibility(Relation relation, BlockNumber block, Buffer buffer, Page page, bool *visible,
+                                     ScanStats &stats) {
+	OffsetNumber max_offset = PageGetMaxOffsetNumber(page);
+	duckdb::vector<OffsetNumber> pending;
+	for (OffsetNumber offset = FirstOffsetNumber; offset <= max_offset; offset++) {
+		if (ItemIdIsNormal(PageGetItemId(page, offset))) {
+			pending.push_back(offset);
+		}
+	}
+
+	/* A tuple may need the status of its xmin and then of its xmax, so this takes at most two rounds */
+	while (!pending.empty()) {
+		duckdb::vector<TransactionId> unknown_xids;
+		duckdb::vector<OffsetNumber> needs_xid_status;
+		duckdb::vector<OffsetNumber> needs_postgres;
+
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			for (auto offset : pending) {
+				auto tuple = (HeapTupleHeader)PageGetItem(page, PageGetItemId(page, offset));
+				TransactionId unknown_xid = InvalidTransactionId;
+				switch (ResolveVisibility(tuple, unknown_xid)) {
+				case TUPLE_VISIBLE:
+					visible[offset - FirstOffsetNumber] = true;
+					break;
+				case TUPLE_INVISIBLE:
+					visible[offset - FirstOffsetNumber] = false;
+					break;
+				case TUPLE_NEEDS_XID_STATUS:
+					if (std::find(unknown_xids.begin(), unknown_xids.end(), unknown_xid) == unknown_xids.end()) {
+						unknown_xids.push_back(unknown_xid);
+					}
+					needs_xid_status.push_back(offset);
+					break;
+				case TUPLE_NEEDS_POSTGRES:
+					needs_postgres.push_back(offset);
+					break;
+				}
+			}
+		}
+
+		if (unknown_xids.empty() && needs_postgres.empty()) {
+			break;
+		}
+
+		duckdb::vector<bool> committed(unknown_xids.size());
+		{
+			auto lock = LockProcessLock(stats);
+			PostgresFunctionGuard([&] {
+				for (duckdb::idx_t i = 0; i < unknown_xids.size(); i++) {
+					committed[i] = TransactionIdDidCommit(unknown_xids[i]);
+				}
+				for (auto offset : needs_postgres) {
+					ItemId lpp = PageGetItemId(page, offset);
+					HeapTupleData tuple;
+					tuple.t_data = (HeapTupleHeader)PageGetItem(page, lpp);
+					tuple.t_len = ItemIdGetLength(lpp);
+					tuple.t_tableOid = RelationGetRelid(relation);
+					ItemPointerSet(&tuple.t_self, block, offset);
+					visible[offset - FirstOffsetNumber] = HeapTupleSatisfiesVisibility(&tuple, m_snapshot, buffer);
+				}
+			});
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			for (duckdb::idx_t i = 0; i < unknown_xids.size(); i++) {
+				m_committed.emplace(unknown_xids[i], committed[i]);
+			}
+		}
+		pending = std::move(needs_xid_status);
+	}
+}
+
+} // namespace pgduckdb
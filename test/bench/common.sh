@@ -0,0 +1,79 @@
+#!/usr/bin/env bash
+#
+# Helpers shared by the benchmark scripts. Every script emits its results as
+# JSON lines (one object per measurement) so that runs can be diffed or loaded
+# into DuckDB with read_json_auto().
+
+PSQL=${PSQL:-psql}
+BENCH_RESULTS_DIR=${BENCH_RESULTS_DIR:-$(pwd)/results}
+BENCH_ROOT_DIR=$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)
+
+bench_psql() {
+	"$PSQL" -X -q -v ON_ERROR_STOP=1 "$@"
+}
+
+# Print the result of a single query executed by Postgres.
+bench_scalar() {
+	bench_psql -A -t -c "SET duckdb.execution TO false" -c "$1"
+}
+
+# bench_time_query REPEAT QUERY [SETUP_STATEMENT...]
+#
+# Runs the setup statements and one warm-up execution of QUERY, then prints the
+# client side latency in milliseconds of REPEAT further executions, one per line.
+bench_time_query() {
+	local repeat=$1
+	local query=$2
+	shift 2
+
+	local args=()
+	local stmt
+	for stmt in "$@"; do
+		args+=(-c "$stmt")
+	done
+	args+=(-c "$query" -c '\timing on')
+	local i
+	for ((i = 0; i < repeat; i++)); do
+		args+=(-c "$query")
+	done
+
+	bench_psql -o /dev/null "${args[@]}" | sed -n 's/^Time: \([0-9.]*\) ms.*$/\1/p'
+}
+
+# Read numbers from stdin and print their median.
+bench_median() {
+	sort -n | awk '{ v[NR] = $1 } END {
+		if (NR == 0) exit 1;
+		if (NR % 2) print v[(NR + 1) / 2]; else printf "%.3f\n", (v[NR / 2] + v[NR / 2 + 1]) / 2
+	}'
+}
+
+# Read numbers from stdin and print the given percentile (0-100).
+bench_percentile() {
+	sort -n | awk -v p="$1" '{ v[NR] = $1 } END {
+		if (NR == 0) exit 1;
+		idx = int((p / 100.0) * NR + 0.999999); if (idx < 1) idx = 1; if (idx > NR) idx = NR;
+		print v[idx]
+	}'
+}
+
+# bench_rate AMOUNT MILLISECONDS
+bench_rate() {
+	awk -v amount="$1" -v ms="$2" 'BEGIN { if (ms <= 0) print 0; else printf "%.1f\n", amount / (ms / 1000.0) }'
+}
+
+# Print the metadata record that starts every result file.
+bench_meta() {
+	local suite=$1
+	local git_commit duckdb_commit server_version
+	git_commit=$(git -C "$BENCH_ROOT_DIR" rev-parse HEAD 2>/dev/null || echo unknown)
+	duckdb_commit=$(git -C "$BENCH_ROOT_DIR" rev-parse HEAD:third_party/duckdb 2>/dev/null || echo unknown)
+	server_version=$(bench_scalar "SHOW server_version")
+	printf '{"record":"meta","suite":"%s","git_commit":"%s","duckdb_commit":"%s","server_version":"%s","timestamp":"%s"}\n' \
+		"$suite" "$git_commit" "$duckdb_commit" "$server_version" "$(date -u +%Y-%m-%dT%H:%M:%SZ)"
+}
+
+bench_result_file() {
+	mkdir -p "$BENCH_RESULTS_DIR"
+	echo "$BENCH_RESULTS_DIR/$1-$(date -u +%Y%m%dT%H%M%SZ).jsonl"
+}
@@ -0,0 +1,127 @@
+#!/usr/bin/env bash
+#
+# Latency benchmark for short queries. For queries that touch only a handful of
+# rows the cost of running them through DuckDB is dominated by the per-query
+# setup: planning the query in Postgres, opening a DuckDB database, registering
+# the Postgres scan functions, loading secrets and extensions and preparing the
+# query in DuckDB.
+#
+# For every query this runs pgbench with and without duckdb.execution and
+# reports throughput and the p50/p99 latency computed from the per-transaction
+# log. Afterwards the query is run BENCH_BREAKDOWN_RUNS times in a single session
+# and the mean time per setup phase is taken from duckdb.query_setup_timing().
+#
+# Environment:
+#   PGBENCH               pgbench binary (default pgbench next to $PSQL)
+#   BENCH_DURATION        seconds per pgbench run (default 10)
+#   BENCH_CLIENTS         concurrent pgbench clients (default 1)
+#   BENCH_BREAKDOWN_RUNS  executions used for the setup breakdown (default 200)
+#   BENCH_FILTER          only run queries whose name matches this regex
+#
+# Results are written as JSON lines to $BENCH_RESULTS_DIR/latency-<timestamp>.jsonl
+# and echoed to stdout.
+
+set -euo pipefail
+
+SCRIPT_DIR=$(cd "$(dirname "$0")" && pwd)
+. "$SCRIPT_DIR/common.sh"
+
+PGBENCH=${PGBENCH:-$(dirname "$(command -v "$PSQL")")/pgbench}
+BENCH_DURATION=${BENCH_DURATION:-10}
+BENCH_CLIENTS=${BENCH_CLIENTS:-1}
+BENCH_BREAKDOWN_RUNS=${BENCH_BREAKDOWN_RUNS:-200}
+BENCH_FILTER=${BENCH_FILTER:-.}
+
+bench_psql <<'SQL'
+SET duckdb.execution TO false;
+DROP SCHEMA IF EXISTS bench_latency CASCADE;
+CREATE SCHEMA bench_latency;
+CREATE TABLE bench_latency.small (id int PRIMARY KEY, val text NOT NULL);
+INSERT INTO bench_latency.small SELECT g, md5(g::text) FROM generate_series(1, 1000) g;
+CREATE TABLE bench_latency.empty (id int, val text);
+VACUUM (FREEZE, ANALYZE) bench_latency.small, bench_latency.empty;
+SQL
+
+RESULT_FILE=$(bench_result_file latency)
+bench_meta latency | tee "$RESULT_FILE"
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+# run_pgbench NAME MODE SCRIPT
+run_pgbench() {
+	local name=$1
+	local mode=$2
+	local script=$3
+	local execution=false
+	if [ "$mode" = duckdb ]; then
+		execution=true
+	fi
+
+	local log_dir="$WORK_DIR/$name-$mode"
+	mkdir -p "$log_dir"
+
+	local output tps
+	output=$(PGOPTIONS="-c duckdb.execution=$execution" "$PGBENCH" -n -f "$script" \
+		-T "$BENCH_DURATION" -c "$BENCH_CLIENTS" -j "$BENCH_CLIENTS" \
+		--log --log-prefix="$log_dir/log" 2>&1)
+	tps=$(echo "$output" | sed -n 's/^tps = \([0-9.]*\).*$/\1/p' | head -n 1)
+
+	# The third field of every log line is the transaction latency in microseconds
+	local latencies="$log_dir/latencies"
+	cat "$log_dir"/log.* | awk '{ printf "%.3f\n", $3 / 1000.0 }' >"$latencies"
+
+	printf '{"record":"result","suite":"latency","query":"%s","mode":"%s","clients":%d,"duration_s":%d,"transactions":%d,"tps":%s,"p50_ms":%s,"p99_ms":%s}\n' \
+		"$name" "$mode" "$BENCH_CLIENTS" "$BENCH_DURATION" "$(wc -l <"$latencies")" "${tps:-0}" \
+		"$(bench_percentile 50 <"$latencies")" "$(bench_percentile 99 <"$latencies")" | tee -a "$RESULT_FILE"
+}
+
+# run_breakdown NAME QUERY
+run_breakdown() {
+	local name=$1
+	local query=$2
+
+	# Query output is discarded, only the final breakdown is printed
+	local args=(-c '\o /dev/null' -c "SET duckdb.execution TO false" -c "SELECT duckdb.reset_query_setup_timing()"
+		-c "SET duckdb.execution TO true")
+	local i
+	for ((i = 0; i < BENCH_BREAKDOWN_RUNS; i++)); do
+		args+=(-c "$query")
+	done
+	args+=(-c "SET duckdb.execution TO false" -c '\o'
+		-c "SELECT phase, calls, round(mean_time::numeric, 3) FROM duckdb.query_setup_timing()")
+
+	local phase calls mean_ms
+	bench_psql -A -t -F ' ' "${args[@]}" | while read -r phase calls mean_ms; do
+		printf '{"record":"setup_phase","suite":"latency","query":"%s","phase":"%s","calls":%d,"mean_ms":%s}\n' \
+			"$name" "$phase" "$calls" "$mean_ms" | tee -a "$RESULT_FILE"
+	done
+}
+
+# run_query NAME SCRIPT_BODY [PLAIN_QUERY]
+run_query() {
+	local name=$1
+	local body=$2
+	local query=${3:-$2}
+
+	if ! [[ $name =~ $BENCH_FILTER ]]; then
+		return
+	fi
+
+	local script="$WORK_DIR/$name.sql"
+	printf '%s\n' "$body" >"$script"
+
+	run_pgbench "$name" postgres "$script"
+	run_pgbench "$name" duckdb "$script"
+	run_breakdown "$name" "$query"
+}
+
+run_query empty_table "SELECT count(*) FROM bench_latency.empty;"
+run_query point_lookup \
+	"\\set id random(1, 1000)
+SELECT val FROM bench_latency.small WHERE id = :id;" \
+	"SELECT val FROM bench_latency.small WHERE id = 42"
+run_query small_aggregate "SELECT count(*), max(val) FROM bench_latency.small;"
+run_query small_scan "SELECT * FROM bench_latency.small;"
+
+echo "Results written to $RESULT_FILE" >&2
@@ -0,0 +1,114 @@
+#!/usr/bin/env bash
+#
+# Microbenchmarks for the scan and conversion hot paths.
+#
+# Each benchmark is a query shaped so that its cost is dominated by one code
+# path of the Postgres scan:
+#
+#   heap_reader        SELECT count(*): HeapReader page/visibility loop only, no
+#                      tuple deforming (count-tuples-only path)
+#   insert_tuple       count() of every column: InsertTupleIntoChunk deforming
+#                      and Postgres -> DuckDB value conversion
+#   apply_value_filter selective pushed down filter: ApplyValueFilter
+#   detoast            length() of toasted values: DetoastPostgresDatum
+#   result_conversion  SELECT * returned to the client: DuckDB -> Postgres
+#                      conversion in Duckdb_ExecCustomScan (includes transfer
+#                      to psql, which discards the rows)
+#
+# Environment:
+#   BENCH_ROWS        rows in the regular tables (default 1000000)
+#   BENCH_TOAST_ROWS  rows in the toasted tables (default BENCH_ROWS / 50)
+#   BENCH_THREADS     duckdb.max_threads_per_query values (default "1 2 4 8")
+#   BENCH_REPEAT      timed executions per measurement (default 5)
+#   BENCH_SKIP_SETUP  reuse the tables of a previous run when set to 1
+#   BENCH_FILTER      only run benchmarks whose name matches this regex
+#
+# Results are written as JSON lines to $BENCH_RESULTS_DIR/micro-<timestamp>.jsonl
+# and echoed to stdout. Rates are computed from the median execution time.
+
+set -euo pipefail
+
+SCRIPT_DIR=$(cd "$(dirname "$0")" && pwd)
+. "$SCRIPT_DIR/common.sh"
+
+BENCH_ROWS=${BENCH_ROWS:-1000000}
+BENCH_TOAST_ROWS=${BENCH_TOAST_ROWS:-$((BENCH_ROWS / 50))}
+BENCH_THREADS=${BENCH_THREADS:-"1 2 4 8"}
+BENCH_REPEAT=${BENCH_REPEAT:-5}
+BENCH_SKIP_SETUP=${BENCH_SKIP_SETUP:-0}
+BENCH_FILTER=${BENCH_FILTER:-.}
+
+REGULAR_TABLES="narrow wide numeric_heavy text_heavy nulls_10 nulls_50 nulls_90"
+TOAST_TABLES="toast_external toast_compressed"
+
+if [ "$BENCH_SKIP_SETUP" != 1 ]; then
+	echo "Creating benchmark tables with $BENCH_ROWS rows ($BENCH_TOAST_ROWS toasted rows)" >&2
+	bench_psql -v rows="$BENCH_ROWS" -v toast_rows="$BENCH_TOAST_ROWS" -f "$SCRIPT_DIR/microbench_setup.sql"
+fi
+
+RESULT_FILE=$(bench_result_file micro)
+bench_meta micro | tee "$RESULT_FILE"
+
+table_rows() {
+	case " $TOAST_TABLES " in
+	*" $1 "*) echo "$BENCH_TOAST_ROWS" ;;
+	*) echo "$BENCH_ROWS" ;;
+	esac
+}
+
+# Comma separated count(<column>) for every column of the table
+count_all_columns() {
+	bench_scalar "SELECT string_agg(format('count(%I)', attname), ', ' ORDER BY attnum)
+	              FROM pg_attribute WHERE attrelid = 'bench.$1'::regclass AND attnum > 0 AND NOT attisdropped"
+}
+
+# run_benchmark NAME TABLE QUERY
+run_benchmark() {
+	local name=$1
+	local table=$2
+	local query=$3
+
+	if ! [[ $name =~ $BENCH_FILTER ]]; then
+		return
+	fi
+
+	local rows bytes
+	rows=$(table_rows "$table")
+	bytes=$(bench_scalar "SELECT pg_table_size('bench.$table')")
+
+	local threads median_ms
+	for threads in $BENCH_THREADS; do
+		median_ms=$(bench_time_query "$BENCH_REPEAT" "$query" \
+			"SET duckdb.execution TO true" \
+			"SET duckdb.max_threads_per_query TO $threads" | bench_median)
+		printf '{"record":"result","suite":"micro","benchmark":"%s","table":"%s","threads":%d,"rows":%d,"bytes":%d,"runs":%d,"median_ms":%s,"rows_per_sec":%s,"bytes_per_sec":%s}\n' \
+			"$name" "$table" "$threads" "$rows" "$bytes" "$BENCH_REPEAT" "$median_ms" \
+			"$(bench_rate "$rows" "$median_ms")" "$(bench_rate "$bytes" "$median_ms")" | tee -a "$RESULT_FILE"
+	done
+}
+
+for table in $REGULAR_TABLES $TOAST_TABLES; do
+	run_benchmark heap_reader "$table" "SELECT count(*) FROM bench.$table"
+done
+
+for table in $REGULAR_TABLES; do
+	run_benchmark insert_tuple "$table" "SELECT $(count_all_columns "$table") FROM bench.$table"
+done
+
+# Every table has an integer column with values 0..999 as its first column; the
+# filter keeps 1% of the rows.
+for table in narrow wide numeric_heavy text_heavy nulls_10 nulls_50 nulls_90; do
+	first_column=$(bench_scalar "SELECT attname FROM pg_attribute WHERE attrelid = 'bench.$table'::regclass AND attnum = 1")
+	run_benchmark apply_value_filter "$table" \
+		"SELECT count(*) FROM bench.$table WHERE $first_column >= 10 AND $first_column < 20"
+done
+
+for table in $TOAST_TABLES; do
+	run_benchmark detoast "$table" "SELECT sum(length(payload)) FROM bench.$table"
+done
+
+for table in narrow wide text_heavy nulls_50; do
+	run_benchmark result_conversion "$table" "SELECT * FROM bench.$table"
+done
+
+echo "Results written to $RESULT_FILE" >&2
@@ -0,0 +1,82 @@
+-- Synthetic tables for the scan and conversion microbenchmarks.
+--
+-- Expects the psql variables :rows (row count of the regular tables) and
+-- :toast_rows (row count of the tables with toasted values).
+
+SET duckdb.execution TO false;
+
+DROP SCHEMA IF EXISTS bench CASCADE;
+CREATE SCHEMA bench;
+
+-- Two fixed width columns
+CREATE TABLE bench.narrow(a INT NOT NULL, b BIGINT NOT NULL);
+INSERT INTO bench.narrow SELECT g % 1000, g FROM generate_series(1, :rows) g;
+
+-- 32 fixed width NOT NULL columns
+CREATE TABLE bench.wide(
+    c1 INT NOT NULL, c2 INT NOT NULL, c3 INT NOT NULL, c4 INT NOT NULL,
+    c5 INT NOT NULL, c6 INT NOT NULL, c7 INT NOT NULL, c8 INT NOT NULL,
+    c9 BIGINT NOT NULL, c10 BIGINT NOT NULL, c11 BIGINT NOT NULL, c12 BIGINT NOT NULL,
+    c13 BIGINT NOT NULL, c14 BIGINT NOT NULL, c15 BIGINT NOT NULL, c16 BIGINT NOT NULL,
+    c17 FLOAT8 NOT NULL, c18 FLOAT8 NOT NULL, c19 FLOAT8 NOT NULL, c20 FLOAT8 NOT NULL,
+    c21 FLOAT8 NOT NULL, c22 FLOAT8 NOT NULL, c23 FLOAT8 NOT NULL, c24 FLOAT8 NOT NULL,
+    c25 DATE NOT NULL, c26 DATE NOT NULL, c27 DATE NOT NULL, c28 DATE NOT NULL,
+    c29 TIMESTAMP NOT NULL, c30 TIMESTAMP NOT NULL, c31 TIMESTAMP NOT NULL, c32 TIMESTAMP NOT NULL
+);
+INSERT INTO bench.wide
+SELECT g % 1000, g % 7, g % 13, g % 101, g, -g, g * 2, g * 3,
+       g, g * 10, g * 100, g % 1000, g % 7, g % 13, g % 101, -g,
+       g * 0.5, g * 0.25, g / 3.0, g / 7.0, g % 1000 * 1.5, g % 7 * 1.5, g % 13 * 1.5, g % 101 * 1.5,
+       DATE '2000-01-01' + g % 10000, DATE '2010-01-01' + g % 1000, DATE '2020-01-01' + g % 100, DATE '2024-01-01',
+       TIMESTAMP '2000-01-01' + g * INTERVAL '1 second', TIMESTAMP '2010-01-01' + g * INTERVAL '1 minute',
+       TIMESTAMP '2020-01-01' + g % 1000 * INTERVAL '1 hour', TIMESTAMP '2024-01-01'
+FROM generate_series(1, :rows) g;
+
+-- Numeric heavy
+CREATE TABLE bench.numeric_heavy(a INT NOT NULL, n1 NUMERIC(18, 4), n2 NUMERIC(18, 4), n3 NUMERIC(38, 10),
+                                 n4 NUMERIC(12, 2));
+INSERT INTO bench.numeric_heavy
+SELECT g % 1000, g / 7.0, g * 1.0001, g / 3.0, g % 100000 / 100.0 FROM generate_series(1, :rows) g;
+
+-- Short, untoasted text
+CREATE TABLE bench.text_heavy(a INT NOT NULL, t1 TEXT, t2 TEXT, t3 TEXT, t4 TEXT);
+INSERT INTO bench.text_heavy
+SELECT g % 1000, md5(g::TEXT), md5((g + 1)::TEXT), 'value_' || g, repeat('x', g % 64)
+FROM generate_series(1, :rows) g;
+
+-- Out of line, uncompressed toast values
+CREATE TABLE bench.toast_external(a INT NOT NULL, payload TEXT);
+ALTER TABLE bench.toast_external ALTER COLUMN payload SET STORAGE EXTERNAL;
+INSERT INTO bench.toast_external
+SELECT g % 1000, (SELECT string_agg(md5((g * 100 + i)::TEXT), '') FROM generate_series(1, 128) i)
+FROM generate_series(1, :toast_rows) g;
+
+-- Inline compressed values
+CREATE TABLE bench.toast_compressed(a INT NOT NULL, payload TEXT);
+INSERT INTO bench.toast_compressed SELECT g % 1000, repeat(md5(g::TEXT), 64) FROM generate_series(1, :toast_rows) g;
+
+-- Various null densities
+CREATE TABLE bench.nulls_10(a INT, b TEXT, c FLOAT8);
+INSERT INTO bench.nulls_10
+SELECT CASE WHEN g % 10 = 0 THEN NULL ELSE g % 1000 END,
+       CASE WHEN g % 10 = 1 THEN NULL ELSE md5(g::TEXT) END,
+       CASE WHEN g % 10 = 2 THEN NULL ELSE g * 0.5 END
+FROM generate_series(1, :rows) g;
+
+CREATE TABLE bench.nulls_50(a INT, b TEXT, c FLOAT8);
+INSERT INTO bench.nulls_50
+SELECT CASE WHEN g % 2 = 0 THEN NULL ELSE g % 1000 END,
+       CASE WHEN g % 2 = 1 THEN NULL ELSE md5(g::TEXT) END,
+       CASE WHEN g % 4 < 2 THEN NULL ELSE g * 0.5 END
+FROM generate_series(1, :rows) g;
+
+CREATE TABLE bench.nulls_90(a INT, b TEXT, c FLOAT8);
+INSERT INTO bench.nulls_90
+SELECT CASE WHEN g % 10 <> 0 THEN NULL ELSE g % 1000 END,
+       CASE WHEN g % 10 <> 1 THEN NULL ELSE md5(g::TEXT) END,
+       CASE WHEN g % 10 <> 2 THEN NULL ELSE g * 0.5 END
+FROM generate_series(1, :rows) g;
+
+-- Set hint bits and the visibility map so the all-visible fast path is measured
+VACUUM (FREEZE, ANALYZE) bench.narrow, bench.wide, bench.numeric_heavy, bench.text_heavy, bench.toast_external,
+    bench.toast_compressed, bench.nulls_10, bench.nulls_50, bench.nulls_90;
@@ -0,0 +1,105 @@
+#!/usr/bin/env bash
+#
+# Compares the scan throughput of a hot standby with the one of its primary.
+# During recovery the all-visible flag of heap pages is not trusted and scans
+# check the visibility map instead, so on a vacuumed table both servers should
+# skip the per-tuple visibility checks and scan at about the same rate.
+#
+# Benchmarks:
+#   all_visible  SELECT count(*) / sum() of a frozen table
+#   modified     the same table after updating 10% of its rows, so most pages
+#                need per-tuple visibility checks on both servers
+#
+# The primary is reached through the usual libpq environment variables. Both
+# servers must have pg_duckdb installed and preloaded.
+#
+# Environment:
+#   BENCH_STANDBY_HOST  host of the standby (default $PGHOST)
+#   BENCH_STANDBY_PORT  port of the standby (required)
+#   BENCH_ROWS          rows in the benchmark table (default 10000000)
+#   BENCH_THREADS       duckdb.max_threads_per_query values (default "1 4")
+#   BENCH_REPEAT        timed executions per measurement (default 5)
+#
+# Results are written as JSON lines to $BENCH_RESULTS_DIR/replica-<timestamp>.jsonl
+# and echoed to stdout. Rates are computed from the median execution time.
+
+set -euo pipefail
+
+SCRIPT_DIR=$(cd "$(dirname "$0")" && pwd)
+. "$SCRIPT_DIR/common.sh"
+
+BENCH_STANDBY_HOST=${BENCH_STANDBY_HOST:-${PGHOST:-}}
+BENCH_STANDBY_PORT=${BENCH_STANDBY_PORT:?BENCH_STANDBY_PORT must be set to the port of the standby}
+BENCH_ROWS=${BENCH_ROWS:-10000000}
+BENCH_THREADS=${BENCH_THREADS:-"1 4"}
+BENCH_REPEAT=${BENCH_REPEAT:-5}
+
+on_standby() {
+	PGHOST=$BENCH_STANDBY_HOST PGPORT=$BENCH_STANDBY_PORT "$@"
+}
+
+# Wait until the standby has replayed everything written on the primary so far
+wait_for_replay() {
+	local lsn
+	lsn=$(bench_scalar "SELECT pg_current_wal_lsn()")
+	until [ "$(on_standby bench_scalar "SELECT pg_last_wal_replay_lsn() >= '$lsn'")" = t ]; do
+		sleep 1
+	done
+}
+
+if [ "$(on_standby bench_scalar "SELECT pg_is_in_recovery()")" != t ]; then
+	echo "The server at $BENCH_STANDBY_HOST:$BENCH_STANDBY_PORT is not a standby" >&2
+	exit 1
+fi
+
+RESULT_FILE=$(bench_result_file replica)
+bench_meta replica | tee "$RESULT_FILE"
+
+# run_benchmark NAME QUERY
+run_benchmark() {
+	local name=$1
+	local query=$2
+
+	local bytes
+	bytes=$(bench_scalar "SELECT pg_table_size('bench_replica.facts')")
+
+	local role threads median_ms
+	for role in primary standby; do
+		for threads in $BENCH_THREADS; do
+			if [ "$role" = primary ]; then
+				median_ms=$(bench_time_query "$BENCH_REPEAT" "$query" \
+					"SET duckdb.execution TO true" \
+					"SET duckdb.max_threads_per_query TO $threads" | bench_median)
+			else
+				median_ms=$(on_standby bench_time_query "$BENCH_REPEAT" "$query" \
+					"SET duckdb.execution TO true" \
+					"SET duckdb.max_threads_per_query TO $threads" | bench_median)
+			fi
+			printf '{"record":"result","suite":"replica","benchmark":"%s","role":"%s","threads":%d,"rows":%d,"bytes":%d,"runs":%d,"median_ms":%s,"rows_per_sec":%s,"bytes_per_sec":%s}\n' \
+				"$name" "$role" "$threads" "$BENCH_ROWS" "$bytes" "$BENCH_REPEAT" "$median_ms" \
+				"$(bench_rate "$BENCH_ROWS" "$median_ms")" "$(bench_rate "$bytes" "$median_ms")" | tee -a "$RESULT_FILE"
+		done
+	done
+}
+
+echo "Creating benchmark table with $BENCH_ROWS rows" >&2
+bench_psql -v rows="$BENCH_ROWS" <<'SQL'
+SET duckdb.execution TO false;
+DROP SCHEMA IF EXISTS bench_replica CASCADE;
+CREATE SCHEMA bench_replica;
+CREATE TABLE bench_replica.facts (id bigint, customer int, amount numeric(12, 2), created timestamp);
+INSERT INTO bench_replica.facts
+SELECT g, g % 10000, (g % 100000) / 100.0, '2024-01-01'::timestamp + g * interval '1 second'
+FROM generate_series(1, :rows) g;
+VACUUM (FREEZE, ANALYZE) bench_replica.facts;
+SQL
+wait_for_replay
+
+run_benchmark all_visible "SELECT count(*), sum(customer) FROM bench_replica.facts"
+
+bench_psql -c "UPDATE bench_replica.facts SET customer = customer + 1 WHERE id % 10 = 0"
+wait_for_replay
+
+run_benchmark modified "SELECT count(*), sum(customer) FROM bench_replica.facts"
+
+echo "Results written to $RESULT_FILE" >&2
@@ -0,0 +1,175 @@
+#!/usr/bin/env bash
+#
+# TPC-H / TPC-DS end-to-end benchmark comparing DuckDB execution against plain
+# Postgres on Postgres heap tables.
+#
+# Usage: tpc.sh tpch|tpcds
+#
+# Data and queries are generated with the tpch/tpcds extensions of the DuckDB
+# CLI, exported as CSV and loaded into Postgres heap tables in a schema named
+# after the benchmark. Every query is then run with duckdb.execution off and
+# with duckdb.execution on for each value of BENCH_THREADS.
+#
+# Environment:
+#   BENCH_SF        scale factor (default 1)
+#   BENCH_THREADS   duckdb.max_threads_per_query values (default "1 4 8")
+#   BENCH_REPEAT    timed executions per measurement (default 3)
+#   BENCH_TIMEOUT   statement_timeout for a single execution (default 10min)
+#   BENCH_QUERIES   space separated query numbers to run (default all)
+#   BENCH_DATA_DIR  where generated data is cached (default ./data)
+#   BENCH_RELOAD    reload the tables even if they exist when set to 1
+#   DUCKDB_CLI      DuckDB command line binary (default duckdb)
+#
+# Results are written as JSON lines to $BENCH_RESULTS_DIR/<suite>-<timestamp>.jsonl.
+# A DuckDB result with "fallback":true means the query was executed by Postgres
+# because DuckDB could not plan it.
+
+set -euo pipefail
+
+SCRIPT_DIR=$(cd "$(dirname "$0")" && pwd)
+. "$SCRIPT_DIR/common.sh"
+
+SUITE=${1:-}
+case "$SUITE" in
+tpch)
+	GENERATOR=dbgen
+	QUERY_FUNCTION=tpch_queries
+	;;
+tpcds)
+	GENERATOR=dsdgen
+	QUERY_FUNCTION=tpcds_queries
+	;;
+*)
+	echo "usage: $0 tpch|tpcds" >&2
+	exit 1
+	;;
+esac
+
+BENCH_SF=${BENCH_SF:-1}
+BENCH_THREADS=${BENCH_THREADS:-"1 4 8"}
+BENCH_REPEAT=${BENCH_REPEAT:-3}
+BENCH_TIMEOUT=${BENCH_TIMEOUT:-10min}
+BENCH_QUERIES=${BENCH_QUERIES:-}
+BENCH_DATA_DIR=${BENCH_DATA_DIR:-$SCRIPT_DIR/data}
+BENCH_RELOAD=${BENCH_RELOAD:-0}
+DUCKDB_CLI=${DUCKDB_CLI:-duckdb}
+
+DATA_DIR="$BENCH_DATA_DIR/$SUITE-sf$BENCH_SF"
+
+if ! command -v "$DUCKDB_CLI" >/dev/null; then
+	echo "DuckDB CLI '$DUCKDB_CLI' not found, set DUCKDB_CLI" >&2
+	exit 1
+fi
+
+duckdb_cli() {
+	"$DUCKDB_CLI" -batch -noheader -list -c "INSTALL $SUITE; LOAD $SUITE; $1"
+}
+
+generate_data() {
+	if [ -f "$DATA_DIR/schema.sql" ]; then
+		return
+	fi
+	echo "Generating $SUITE data with scale factor $BENCH_SF in $DATA_DIR" >&2
+	mkdir -p "$DATA_DIR/queries"
+	duckdb_cli "CALL $GENERATOR(sf = $BENCH_SF);
+	            EXPORT DATABASE '$DATA_DIR' (FORMAT CSV, DELIMITER '|', HEADER false);" >/dev/null
+	local query_nr
+	for query_nr in $(duckdb_cli "SELECT query_nr FROM $QUERY_FUNCTION() ORDER BY query_nr"); do
+		duckdb_cli "SELECT query FROM $QUERY_FUNCTION() WHERE query_nr = $query_nr" >"$DATA_DIR/queries/$query_nr.sql"
+	done
+}
+
+load_data() {
+	local loaded_sf
+	loaded_sf=$(bench_scalar "SELECT sf FROM $SUITE.bench_info" 2>/dev/null || true)
+	if [ "$BENCH_RELOAD" != 1 ] && [ "$loaded_sf" = "$BENCH_SF" ]; then
+		return
+	fi
+
+	echo "Loading $SUITE data into schema $SUITE" >&2
+	bench_psql -c "DROP SCHEMA IF EXISTS $SUITE CASCADE" -c "CREATE SCHEMA $SUITE"
+	PGOPTIONS="-c search_path=$SUITE" bench_psql -f "$DATA_DIR/schema.sql"
+
+	local csv table
+	local tables=()
+	for csv in "$DATA_DIR"/*.csv; do
+		table=$(basename "$csv" .csv)
+		tables+=("$SUITE.$table")
+		PGOPTIONS="-c search_path=$SUITE" bench_psql -c "\\copy $table FROM '$csv' WITH (FORMAT csv, DELIMITER '|')"
+	done
+
+	local table_list
+	table_list=$(IFS=,; echo "${tables[*]}")
+	bench_psql -c "VACUUM (FREEZE, ANALYZE) $table_list" \
+		-c "CREATE TABLE $SUITE.bench_info AS SELECT '$BENCH_SF'::TEXT AS sf"
+}
+
+# time_query QUERY_FILE SETUP_STATEMENT... -- prints the median or nothing on error
+time_query() {
+	local query
+	query=$(cat "$1")
+	shift
+	local timings
+	if ! timings=$(PGOPTIONS="-c search_path=$SUITE -c statement_timeout=$BENCH_TIMEOUT" \
+		bench_time_query "$BENCH_REPEAT" "$query" "$@" 2>/dev/null); then
+		return 0
+	fi
+	echo "$timings" | bench_median
+}
+
+is_fallback() {
+	local plan
+	plan=$(PGOPTIONS="-c search_path=$SUITE" bench_psql -A -t -c "SET duckdb.execution TO true" \
+		-c "EXPLAIN $(cat "$1")" 2>/dev/null || true)
+	if [[ $plan == *DuckDBScan* ]]; then
+		echo false
+	else
+		echo true
+	fi
+}
+
+emit() {
+	tee -a "$RESULT_FILE"
+}
+
+generate_data
+load_data
+
+RESULT_FILE=$(bench_result_file "$SUITE")
+bench_meta "$SUITE" | emit
+
+if [ -z "$BENCH_QUERIES" ]; then
+	BENCH_QUERIES=$(ls "$DATA_DIR/queries" | sed 's/\.sql$//' | sort -n)
+fi
+
+for query_nr in $BENCH_QUERIES; do
+	query_file="$DATA_DIR/queries/$query_nr.sql"
+
+	postgres_ms=$(time_query "$query_file" "SET duckdb.execution TO false")
+	if [ -n "$postgres_ms" ]; then
+		printf '{"record":"result","suite":"%s","sf":"%s","query":%d,"engine":"postgres","status":"ok","median_ms":%s}\n' \
+			"$SUITE" "$BENCH_SF" "$query_nr" "$postgres_ms" | emit
+	else
+		printf '{"record":"result","suite":"%s","sf":"%s","query":%d,"engine":"postgres","status":"error"}\n' \
+			"$SUITE" "$BENCH_SF" "$query_nr" | emit
+	fi
+
+	fallback=$(is_fallback "$query_file")
+	for threads in $BENCH_THREADS; do
+		duckdb_ms=$(time_query "$query_file" "SET duckdb.execution TO true" \
+			"SET duckdb.max_threads_per_query TO $threads")
+		if [ -z "$duckdb_ms" ]; then
+			printf '{"record":"result","suite":"%s","sf":"%s","query":%d,"engine":"duckdb","threads":%d,"status":"error","fallback":%s}\n' \
+				"$SUITE" "$BENCH_SF" "$query_nr" "$threads" "$fallback" | emit
+			continue
+		fi
+		speedup=null
+		if [ -n "$postgres_ms" ]; then
+			speedup=$(awk -v pg="$postgres_ms" -v duck="$duckdb_ms" 'BEGIN { printf "%.3f\n", pg / duck }')
+		fi
+		printf '{"record":"result","suite":"%s","sf":"%s","query":%d,"engine":"duckdb","threads":%d,"status":"ok","median_ms":%s,"speedup":%s,"fallback":%s}\n' \
+			"$SUITE" "$BENCH_SF" "$query_nr" "$threads" "$duckdb_ms" "$speedup" "$fallback" | emit
+	done
+done
+
+echo "Results written to $RESULT_FILE" >&2
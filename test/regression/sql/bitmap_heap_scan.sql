@@ -0,0 +1,37 @@
+CREATE TABLE orders(id INT, customer INT, product INT, amount INT);
+INSERT INTO orders SELECT i, i % 1000, i % 997, i % 100 FROM generate_series(1, 100000) i;
+CREATE INDEX orders_customer_idx ON orders(customer);
+CREATE INDEX orders_product_idx ON orders(product);
+ANALYZE orders;
+
+-- Only the heap pages of rows matching either index are read
+SELECT count(*) AS cnt, sum(amount) AS total FROM orders WHERE customer = 7 OR product = 11;
+
+-- Filters that aren't bitmap quals are applied by DuckDB
+SELECT count(*) AS cnt, sum(amount) AS total FROM orders WHERE (customer = 7 OR product = 11) AND id % 2 = 0;
+
+-- Index entries of deleted rows are skipped
+DELETE FROM orders WHERE id <= 50000;
+SELECT count(*) AS cnt, sum(amount) AS total FROM orders WHERE customer = 7 OR product = 11;
+
+DROP TABLE orders;
+
+-- DuckDB can't read jsonb and tsvector, Postgres evaluates @> and @@ with their GIN indexes while DuckDB executes the
+-- rest of the query
+SELECT duckdb.stat_scans_reset();
+CREATE TABLE docs(id INT, doc JSONB, body TSVECTOR);
+INSERT INTO docs SELECT i, jsonb_build_object('type', CASE WHEN i % 100 = 0 THEN 'click' ELSE 'view' END),
+    to_tsvector('simple', 'word' || i % 100) FROM generate_series(1, 10000) i;
+CREATE INDEX docs_doc_idx ON docs USING gin(doc);
+CREATE INDEX docs_body_idx ON docs USING gin(body);
+ANALYZE docs;
+SELECT count(*) AS cnt, sum(id) AS total FROM docs WHERE doc @> '{"type": "click"}';
+SELECT count(*) AS cnt, sum(id) AS total FROM docs WHERE body @@ to_tsquery('simple', 'word7');
+SELECT count(*) AS cnt, sum(id) AS total FROM docs WHERE doc @> '{"type": "click"}' AND id % 200 = 0;
+SELECT reason, fallbacks FROM duckdb.stat_fallbacks WHERE pid = pg_backend_pid() AND reason = 'unsupported_type';
+
+-- Queries returning such columns are still executed by Postgres
+SELECT id, doc FROM docs WHERE doc @> '{"type": "click"}' AND id <= 300 ORDER BY id;
+SELECT reason, fallbacks FROM duckdb.stat_fallbacks WHERE pid = pg_backend_pid() AND reason = 'unsupported_type';
+
+DROP TABLE docs;
@@ -0,0 +1,18 @@
+SELECT duckdb.stat_scans_reset();
+
+CREATE TABLE items(id INT, name TEXT, a INT, b INT, created DATE);
+INSERT INTO items SELECT i, 'Item' || i, i % 10, i % 7, '2024-01-01'::DATE + (i % 30) FROM generate_series(1, 1000) i;
+INSERT INTO items VALUES (1001, NULL, NULL, NULL, NULL);
+
+-- Filters on expressions of columns are evaluated by the scan
+SELECT count(*) AS cnt FROM items WHERE lower(name) LIKE 'item1%';
+SELECT count(*) AS cnt, sum(id) AS total FROM items WHERE a + b > 14;
+
+-- Combined with a filter that is pushed down as a table filter
+SELECT created, count(*) AS cnt FROM items WHERE date_trunc('week', created) = '2024-01-08' AND id > 900
+GROUP BY created ORDER BY created;
+
+-- Tuples removed by the filters are counted before they are returned to DuckDB
+SELECT tuples_filtered FROM duckdb.stat_scans WHERE pid = pg_backend_pid();
+
+DROP TABLE items;
@@ -0,0 +1,18 @@
+CREATE TABLE ctid_test(id INT, payload TEXT);
+INSERT INTO ctid_test SELECT g, 'payload ' || g FROM generate_series(1, 1000) g;
+ANALYZE ctid_test;
+
+-- The ctid is returned as (block number << 16) | offset number
+SELECT ctid, id FROM ctid_test ORDER BY id LIMIT 3;
+SELECT count(DISTINCT ctid) AS tids FROM ctid_test;
+
+-- Only the ids are sorted, the payloads of the remaining rows are fetched by ctid
+SELECT id, payload FROM ctid_test ORDER BY id DESC LIMIT 3;
+SELECT payload FROM ctid_test WHERE id % 7 = 0 ORDER BY id LIMIT 2;
+
+-- The old version of an updated row is not visible, its fetched payload is the new one
+UPDATE ctid_test SET payload = 'updated' WHERE id = 1;
+SELECT ctid FROM ctid_test ORDER BY ctid LIMIT 2;
+SELECT id, payload FROM ctid_test ORDER BY id LIMIT 2;
+
+DROP TABLE ctid_test;
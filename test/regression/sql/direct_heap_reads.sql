@@ -0,0 +1,24 @@
+-- The table is larger than the buffer ring of CREATE TABLE AS, and VACUUM reads the evicted pages through its own
+-- small ring, so most pages are all-visible and not in shared buffers afterwards
+CREATE TABLE direct_reads_table AS SELECT g AS a, 'row ' || g AS b FROM generate_series(1, 1000000) g;
+VACUUM direct_reads_table;
+
+SET duckdb.direct_heap_reads = true;
+
+SELECT duckdb.stat_scans_reset();
+SELECT count(*) AS cnt, sum(a) AS total, max(b) AS max_b FROM direct_reads_table;
+-- Direct reads require data checksums
+SELECT (direct_blks_read > 0) = current_setting('data_checksums')::BOOL AS direct_reads_used,
+       shared_blks_hit + shared_blks_read + direct_blks_read = blocks_scanned AS blocks_counted
+FROM duckdb.stat_scans WHERE pid = pg_backend_pid();
+
+-- Pages that can't be read directly are read through shared buffers
+DELETE FROM direct_reads_table WHERE a % 100 = 0;
+SELECT duckdb.stat_scans_reset();
+SELECT count(*) AS cnt, sum(a) AS total, max(b) AS max_b FROM direct_reads_table;
+SELECT direct_blks_read FROM duckdb.stat_scans WHERE pid = pg_backend_pid();
+
+RESET duckdb.direct_heap_reads;
+SELECT count(*) AS cnt, sum(a) AS total, max(b) AS max_b FROM direct_reads_table;
+
+DROP TABLE direct_reads_table;
@@ -0,0 +1,17 @@
+CREATE TABLE lookup_big(id INT NOT NULL, k INT, payload TEXT);
+INSERT INTO lookup_big SELECT i, i % 5000, 'row ' || i FROM generate_series(1, 10000) i;
+INSERT INTO lookup_big VALUES (10001, NULL, 'null key');
+CREATE INDEX lookup_big_k_idx ON lookup_big(k);
+CREATE TABLE lookup_small(k INT, tag TEXT);
+INSERT INTO lookup_small VALUES (1, 'one'), (42, 'forty-two'), (42, 'again'), (NULL, 'null'), (99999, 'missing');
+ANALYZE lookup_big, lookup_small;
+
+-- The few keys of lookup_small are looked up in the index of lookup_big
+SELECT s.tag, b.id, b.payload FROM lookup_small s JOIN lookup_big b ON b.k = s.k ORDER BY s.tag, b.id;
+
+-- Same result with a hash join over the whole table
+SET duckdb.index_lookup_max_keys = 0;
+SELECT s.tag, b.id, b.payload FROM lookup_small s JOIN lookup_big b ON b.k = s.k ORDER BY s.tag, b.id;
+RESET duckdb.index_lookup_max_keys;
+
+DROP TABLE lookup_big, lookup_small;
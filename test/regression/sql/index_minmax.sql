@@ -0,0 +1,18 @@
+CREATE TABLE events(id INT, ts TIMESTAMP, kind INT);
+INSERT INTO events SELECT i, '2024-01-01'::TIMESTAMP + i * INTERVAL '1 minute', i % 4
+    FROM generate_series(1, 10000) i;
+CREATE INDEX events_ts_idx ON events(ts);
+CREATE INDEX events_kind_ts_idx ON events(kind, ts);
+ANALYZE events;
+
+-- Answered by Postgres with index endpoint probes
+SELECT max(ts) FROM events;
+SELECT min(ts), max(ts) FROM events;
+SELECT max(ts) FROM events WHERE kind = 2;
+
+-- No index on id, DuckDB aggregates the table
+SELECT max(id) FROM events;
+
+SELECT reason, fallbacks FROM duckdb.stat_fallbacks WHERE pid = pg_backend_pid() AND reason = 'index_minmax';
+
+DROP TABLE events;
@@ -0,0 +1,24 @@
+CREATE TABLE events(id INT NOT NULL, ts TIMESTAMP NOT NULL, note INT);
+INSERT INTO events SELECT i, '2024-01-01'::TIMESTAMP + i * INTERVAL '1 minute', NULLIF(i, i / 1000 * 1000)
+    FROM generate_series(1, 10000) i;
+CREATE INDEX events_ts_idx ON events(ts);
+CREATE INDEX events_note_idx ON events(note);
+ANALYZE events;
+
+-- Backward index scan that stops after the limit
+SELECT id, ts FROM events ORDER BY ts DESC LIMIT 3;
+SELECT id FROM events WHERE ts >= '2024-01-02' ORDER BY ts LIMIT 3 OFFSET 2;
+
+-- Filters that aren't index quals need all rows
+SELECT id FROM events WHERE id % 2 = 0 ORDER BY ts DESC LIMIT 3;
+
+-- DuckDB sorts NULLs last, the index returns them first for DESC
+SELECT id, note FROM events ORDER BY note DESC LIMIT 3;
+
+-- Array keys and keys computed when the scan starts
+CREATE INDEX events_id_idx ON events(id);
+SELECT id, note FROM events WHERE id IN (3, 1000, 7) ORDER BY id;
+SELECT count(*) AS cnt FROM events WHERE ts > '2024-01-07 22:30:00'::TIMESTAMP + (now() - now());
+SELECT count(*) AS cnt FROM events WHERE ts < '2024-01-01 00:05:00'::TIMESTAMP + (now() - now());
+
+DROP TABLE events;
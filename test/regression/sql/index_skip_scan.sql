@@ -0,0 +1,27 @@
+CREATE TABLE readings(sensor INT, value INT);
+INSERT INTO readings SELECT NULLIF(i % 5, 4), i FROM generate_series(1, 100000) i;
+CREATE INDEX readings_sensor_idx ON readings(sensor);
+ANALYZE readings;
+
+-- One index probe per distinct value, NULLs are returned once
+SELECT duckdb.stat_scans_reset();
+SELECT DISTINCT sensor FROM readings ORDER BY sensor;
+-- Only one row per key was read
+SELECT tuples_visible FROM duckdb.stat_scans WHERE pid = pg_backend_pid();
+SELECT sensor FROM readings GROUP BY sensor ORDER BY sensor;
+SELECT DISTINCT sensor * 10 AS tens FROM readings ORDER BY tens;
+
+-- Probes skip the index entries of deleted rows
+DELETE FROM readings WHERE sensor = 2;
+SELECT DISTINCT sensor FROM readings ORDER BY sensor;
+
+-- Filters and other columns need all rows
+SELECT DISTINCT sensor FROM readings WHERE value > 99990 ORDER BY sensor;
+SELECT DISTINCT sensor, value % 2 AS odd FROM readings ORDER BY sensor, odd;
+
+-- Volatile targets differ between the rows of a key
+SELECT duckdb.stat_scans_reset();
+SELECT DISTINCT sensor, random() >= 0 AS positive FROM readings ORDER BY sensor;
+SELECT tuples_visible FROM duckdb.stat_scans WHERE pid = pg_backend_pid();
+
+DROP TABLE readings;
@@ -0,0 +1,63 @@
+CREATE TABLE report_source(a INT, b TEXT);
+INSERT INTO report_source SELECT g, 'value ' || g FROM generate_series(1, 1000) g;
+
+CREATE FUNCTION wait_for_job(job_id BIGINT) RETURNS TEXT AS $$
+DECLARE
+    job_status TEXT;
+BEGIN
+    FOR i IN 1..600 LOOP
+        SELECT status INTO job_status FROM duckdb.status(job_id);
+        EXIT WHEN job_status IN ('done', 'failed');
+        PERFORM pg_sleep(0.1);
+    END LOOP;
+    RETURN job_status;
+END;
+$$ LANGUAGE plpgsql;
+
+SELECT duckdb.submit('SELECT a % 3 AS bucket, count(*) AS cnt, max(b) AS max_b FROM report_source
+                      GROUP BY bucket ORDER BY bucket;') AS job \gset
+SELECT wait_for_job(:job);
+SELECT status, error, row_count, finished_at >= started_at AS finished_after_start FROM duckdb.status(:job);
+SELECT * FROM duckdb.fetch(:job) AS t(bucket INT, cnt BIGINT, max_b TEXT);
+-- Columns can only be fetched as types their values convert to
+SELECT * FROM duckdb.fetch(:job) AS t(bucket INT, cnt BIGINT, max_b INT);
+SELECT * FROM duckdb.fetch(:job) AS t(bucket INT, cnt SMALLINT, max_b VARCHAR);
+SELECT duckdb.result_to_table(:job, 'report_copy');
+SELECT * FROM report_copy ORDER BY bucket;
+
+-- Errors of the query are reported through the job
+SELECT duckdb.submit('SELECT * FROM missing_table') AS failed_job \gset
+SELECT wait_for_job(:failed_job);
+SELECT status, error, row_count FROM duckdb.status(:failed_job);
+SELECT * FROM duckdb.fetch(:failed_job) AS t(a INT);
+
+-- Only single SELECT queries can be submitted
+SELECT duckdb.submit('DELETE FROM report_source');
+SELECT duckdb.submit('SELECT 1; SELECT 2');
+
+-- A job submitted by a transaction that rolls back is not executed
+BEGIN;
+SELECT duckdb.submit('SELECT count(*) FROM report_source') IS NOT NULL AS submitted;
+ROLLBACK;
+SELECT count(*) AS jobs FROM duckdb.jobs;
+
+-- Removing a job keeps its result until the transaction commits
+BEGIN;
+SELECT duckdb.job_remove(:job);
+ROLLBACK;
+SELECT count(*) FROM duckdb.fetch(:job) AS t(bucket INT, cnt BIGINT, max_b TEXT);
+SELECT duckdb.job_remove(:job);
+SELECT duckdb.job_remove(:failed_job);
+
+-- A queued job can be removed, its worker then doesn't execute it
+BEGIN;
+SELECT duckdb.submit('SELECT count(*) FROM report_source') AS queued_job \gset
+SELECT status FROM duckdb.status(:queued_job);
+SELECT duckdb.job_remove(:queued_job);
+COMMIT;
+SELECT count(*) AS jobs FROM duckdb.jobs;
+SELECT * FROM duckdb.status(:job);
+
+DROP TABLE report_copy;
+DROP FUNCTION wait_for_job;
+DROP TABLE report_source;
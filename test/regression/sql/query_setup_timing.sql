@@ -0,0 +1,18 @@
+CREATE TABLE setup_timing_table(a INT);
+INSERT INTO setup_timing_table VALUES (1), (2), (3);
+
+SELECT duckdb.reset_query_setup_timing();
+
+SELECT count(*) AS cnt FROM setup_timing_table;
+SELECT sum(a) AS total FROM setup_timing_table;
+
+-- Read the counters through Postgres so that reading them doesn't add to them
+SET duckdb.execution TO false;
+SELECT phase, calls, total_time >= 0 AS total_time_ok, mean_time >= 0 AS mean_time_ok
+FROM duckdb.query_setup_timing();
+
+SELECT duckdb.reset_query_setup_timing();
+SELECT phase, calls, total_time FROM duckdb.query_setup_timing();
+SET duckdb.execution TO true;
+
+DROP TABLE setup_timing_table;
@@ -0,0 +1,33 @@
+CREATE TABLE result_cache_table(a INT, b TEXT);
+INSERT INTO result_cache_table SELECT g, 'row ' || g FROM generate_series(1, 100) g;
+
+SET duckdb.result_cache TO true;
+SELECT duckdb.stat_scans_reset();
+
+-- The first execution is cached, the second one is served from the cache
+SELECT count(*) AS cnt, sum(a) AS total FROM result_cache_table;
+SELECT count(*) AS cnt, sum(a) AS total FROM result_cache_table;
+
+-- Committed writes invalidate the cached result
+INSERT INTO result_cache_table VALUES (101, 'row 101');
+SELECT count(*) AS cnt, sum(a) AS total FROM result_cache_table;
+SELECT count(*) AS cnt, sum(a) AS total FROM result_cache_table;
+
+-- Transactions that wrote something bypass the cache, rolled back writes don't invalidate it
+BEGIN;
+DELETE FROM result_cache_table WHERE a > 100;
+SELECT count(*) AS cnt, sum(a) AS total FROM result_cache_table;
+ROLLBACK;
+SELECT count(*) AS cnt, sum(a) AS total FROM result_cache_table;
+
+-- Queries calling volatile functions are not cached
+SELECT count(*) AS cnt FROM result_cache_table WHERE a > 200 + random();
+
+-- Schema changes invalidate the cached result
+ALTER TABLE result_cache_table ADD COLUMN c INT DEFAULT 1;
+SELECT count(*) AS cnt, sum(a) AS total FROM result_cache_table;
+
+SELECT duckdb_queries, result_cache_hits, result_cache_misses FROM duckdb.stat_scans WHERE pid = pg_backend_pid();
+
+RESET duckdb.result_cache;
+DROP TABLE result_cache_table;
@@ -0,0 +1,28 @@
+CREATE TABLE shared_service_table(a INT, b TEXT);
+INSERT INTO shared_service_table SELECT g, 'row ' || g FROM generate_series(1, 100) g;
+
+SET duckdb.shared_service TO true;
+
+-- Executed by the service worker of the database
+SELECT count(*) AS cnt, sum(a) AS total FROM shared_service_table;
+SELECT a, b FROM shared_service_table WHERE a > 97 ORDER BY a;
+SELECT count(*) AS workers FROM pg_stat_activity WHERE backend_type = 'pg_duckdb shared service';
+
+-- Transactions that wrote something execute their queries themselves and see their writes
+BEGIN;
+INSERT INTO shared_service_table VALUES (101, 'row 101');
+SELECT count(*) AS cnt, sum(a) AS total FROM shared_service_table;
+ROLLBACK;
+SELECT count(*) AS cnt, sum(a) AS total FROM shared_service_table;
+
+-- Temporary tables are read by the backend
+CREATE TEMP TABLE shared_service_temp(a INT);
+INSERT INTO shared_service_temp VALUES (1), (2);
+SELECT count(*) AS cnt, sum(a) AS total FROM shared_service_temp;
+
+SELECT count(pg_terminate_backend(pid)) AS terminated FROM pg_stat_activity
+WHERE backend_type = 'pg_duckdb shared service';
+
+RESET duckdb.shared_service;
+DROP TABLE shared_service_temp;
+DROP TABLE shared_service_table;
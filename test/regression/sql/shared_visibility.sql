@@ -0,0 +1,27 @@
+CREATE TABLE shared_visibility(id INT, parent INT, name TEXT);
+INSERT INTO shared_visibility SELECT g, g / 10, 'node ' || g FROM generate_series(1, 1000) g;
+
+-- Rows of an aborted transaction and updated rows, so that the visibility of the tuples is resolved
+BEGIN;
+INSERT INTO shared_visibility SELECT g, 0, 'aborted' FROM generate_series(1001, 1100) g;
+ROLLBACK;
+UPDATE shared_visibility SET name = 'updated ' || id WHERE id % 100 = 0;
+
+-- Both sides of the self-join share the visibility of the pages, each of them reads the pages itself
+SELECT count(*) AS children, count(DISTINCT p.id) AS parents FROM shared_visibility c JOIN shared_visibility p ON c.parent = p.id;
+SELECT p.name, count(*) AS children FROM shared_visibility c JOIN shared_visibility p ON c.parent = p.id
+WHERE p.id % 50 = 0 GROUP BY p.name ORDER BY p.name;
+
+WITH t AS (SELECT * FROM shared_visibility)
+SELECT (SELECT count(*) FROM t) AS total, (SELECT count(*) FROM t WHERE name LIKE 'updated%') AS updated;
+
+-- One side stops early, the visibility kept for it is dropped when it ends
+SELECT count(*) AS cnt FROM (SELECT id FROM shared_visibility LIMIT 10) a JOIN shared_visibility b ON a.id = b.id;
+
+-- The pages of a temporary table are copied once for both scans
+CREATE TEMP TABLE shared_visibility_temp AS SELECT * FROM shared_visibility;
+DELETE FROM shared_visibility_temp WHERE id % 2 = 0;
+SELECT count(*) AS pairs FROM shared_visibility_temp a JOIN shared_visibility_temp b ON a.id = b.id + 2;
+
+DROP TABLE shared_visibility_temp;
+DROP TABLE shared_visibility;
@@ -0,0 +1,31 @@
+SELECT duckdb.stat_scans_reset();
+
+CREATE TABLE stat_scans_table(a INT, b TEXT);
+INSERT INTO stat_scans_table SELECT g, 'row ' || g FROM generate_series(1, 1000) g;
+
+-- 1000 visible tuples of which 900 are removed by the pushed down filter
+SELECT count(*) AS cnt FROM stat_scans_table WHERE a > 900;
+
+-- Catalog queries are executed by Postgres
+SELECT count(*) AS cnt FROM pg_class WHERE relname = 'stat_scans_table';
+
+-- Reading the statistics views counts as a catalog fallback as well
+SELECT duckdb_queries, fallbacks, blocks_scanned > 0 AS blocks_scanned, blocks_skipped,
+       tuples_visible, tuples_invisible, tuples_filtered
+FROM duckdb.stat_scans WHERE pid = pg_backend_pid();
+
+-- Every scanned block is read through shared buffers
+SELECT shared_blks_hit + shared_blks_read = blocks_scanned AS buffers_counted, cpu_time >= 0 AS cpu_time_counted
+FROM duckdb.stat_scans WHERE pid = pg_backend_pid();
+
+SELECT reason, fallbacks FROM duckdb.stat_fallbacks WHERE pid = pg_backend_pid() ORDER BY reason;
+
+-- The cluster wide row includes this backend
+SELECT c.tuples_visible >= b.tuples_visible AS includes_backend
+FROM duckdb.stat_scans c, duckdb.stat_scans b
+WHERE c.pid IS NULL AND b.pid = pg_backend_pid();
+
+SELECT duckdb.stat_scans_reset();
+SELECT duckdb_queries, tuples_visible FROM duckdb.stat_scans WHERE pid = pg_backend_pid();
+
+DROP TABLE stat_scans_table;
@@ -0,0 +1,15 @@
+CREATE TEMP TABLE staging(id INT, category TEXT, amount INT);
+INSERT INTO staging SELECT g, 'category ' || (g % 5), g % 100 FROM generate_series(1, 10000) g;
+
+SELECT category, count(*) AS cnt, sum(amount) AS total FROM staging GROUP BY category ORDER BY category;
+
+-- Changes of the current transaction are visible to the scan
+BEGIN;
+DELETE FROM staging WHERE id > 5000;
+UPDATE staging SET amount = amount + 1 WHERE category = 'category 0';
+SELECT count(*) AS cnt, sum(amount) AS total FROM staging;
+ROLLBACK;
+
+SELECT count(*) AS cnt, sum(amount) AS total FROM staging;
+
+DROP TABLE staging;
@@ -0,0 +1,27 @@
+CREATE TABLE deform_table(a INT, b TEXT, c BIGINT, d FLOAT8);
+INSERT INTO deform_table VALUES (1, 'one', 10, 1.5), (2, NULL, 20, 2.5), (NULL, 'three', NULL, 3.5);
+
+-- Tuples written before these columns were added don't contain them
+ALTER TABLE deform_table ADD COLUMN e INT DEFAULT 42;
+ALTER TABLE deform_table ADD COLUMN f TEXT;
+INSERT INTO deform_table VALUES (4, 'four', 40, 4.5, 7, 'new');
+
+SELECT * FROM deform_table ORDER BY a;
+SELECT d, e FROM deform_table WHERE c > 15 ORDER BY d;
+SELECT b, f FROM deform_table WHERE e = 42 ORDER BY b;
+
+DROP TABLE deform_table;
+
+-- Fixed-width NOT NULL columns are gathered directly from the page
+CREATE TABLE fixed_table(a INT NOT NULL, b BIGINT NOT NULL, c FLOAT8 NOT NULL, d DATE NOT NULL,
+                         e TIMESTAMP NOT NULL, f BOOL NOT NULL, g SMALLINT NOT NULL, h TEXT);
+INSERT INTO fixed_table SELECT i, i::BIGINT * 1000000000, i / 4.0, '2024-01-01'::DATE + i,
+    '2024-01-01 10:00:00'::TIMESTAMP + i * INTERVAL '1 hour', i % 2 = 0, i, NULL FROM generate_series(1, 3) i;
+ALTER TABLE fixed_table ADD COLUMN z INT NOT NULL DEFAULT 7;
+INSERT INTO fixed_table VALUES (4, 4000000000, 1.0, '2024-01-05', '2024-01-01 14:00:00', true, 4, 'four', 8);
+
+SELECT a, b, c, d, e, f, g FROM fixed_table ORDER BY a;
+SELECT g, a, z FROM fixed_table ORDER BY a;
+SELECT count(*) AS cnt, max(e) AS max_e FROM fixed_table;
+
+DROP TABLE fixed_table;
@@ -0,0 +1,22 @@
+CREATE TABLE visibility_table(a INT);
+INSERT INTO visibility_table SELECT g FROM generate_series(1, 1000) g;
+
+-- Rows deleted by an aborted transaction stay visible
+BEGIN;
+DELETE FROM visibility_table WHERE a <= 100;
+ROLLBACK;
+SELECT count(*) AS cnt, sum(a) AS total FROM visibility_table;
+
+-- Old versions of updated rows are not visible
+UPDATE visibility_table SET a = a + 1000 WHERE a > 900;
+SELECT count(*) AS cnt, sum(a) AS total FROM visibility_table;
+
+-- Changes of the current transaction are visible to it
+BEGIN;
+INSERT INTO visibility_table SELECT g FROM generate_series(2001, 2010) g;
+DELETE FROM visibility_table WHERE a <= 10;
+SELECT count(*) AS cnt, sum(a) AS total FROM visibility_table;
+COMMIT;
+SELECT count(*) AS cnt, sum(a) AS total FROM visibility_table;
+
+DROP TABLE visibility_table;